@@ -0,0 +1,330 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+/*
+  chm2dir: extracts the files in a .chm archive to a directory, decompressing with several threads at once.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#ifdef ENABLE_BUILTIN_CHMLIB
+#include "xchm_chm_lib.h"
+#else
+#include <chm_lib.h>
+#endif
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Files are handed to the workers in runs of about this many (uncompressed) bytes.
+constexpr uint64_t RUN_BYTES {4 * 1024 * 1024};
+
+// Read/write buffer size.
+constexpr size_t COPY_BUF_SIZE {64 * 1024};
+
+// More threads than this are a typo, not a machine.
+constexpr unsigned long MAX_JOBS {1024};
+
+struct Entry {
+    std::string path;
+    uint64_t    start;
+    uint64_t    length;
+    int         space;
+};
+
+struct Options {
+    std::vector<std::string> includes;
+    std::vector<std::string> excludes;
+    unsigned                 jobs {std::max(1U, std::thread::hardware_concurrency())};
+    bool                     quiet {false};
+    std::string              archive;
+    std::string              outDir;
+};
+
+// Shell-style match of '*' and '?'. '*' matches across '/' too.
+bool GlobMatch(const char* pattern, const char* str)
+{
+    const char *star = nullptr, *retry = nullptr;
+
+    while (*str) {
+        if (*pattern == '*') {
+            star  = ++pattern;
+            retry = str;
+        } else if (*pattern == '?' || *pattern == *str) {
+            ++pattern;
+            ++str;
+        } else if (star) {
+            pattern = star;
+            str     = ++retry;
+        } else
+            return false;
+    }
+
+    while (*pattern == '*')
+        ++pattern;
+
+    return !*pattern;
+}
+
+bool Wanted(const Options& options, const std::string& path)
+{
+    auto matches = [&path](const std::string& glob) { return GlobMatch(glob.c_str(), path.c_str()); };
+
+    if (!options.includes.empty() && std::none_of(options.includes.begin(), options.includes.end(), matches))
+        return false;
+
+    return std::none_of(options.excludes.begin(), options.excludes.end(), matches);
+}
+
+// Paths climbing out of the output directory are refused.
+bool SafePath(const std::string& path)
+{
+    size_t start = 0;
+
+    while (start <= path.size()) {
+        auto end = path.find('/', start);
+
+        if (end == std::string::npos)
+            end = path.size();
+
+        if (path.compare(start, end - start, "..") == 0)
+            return false;
+
+        start = end + 1;
+    }
+
+    return !path.empty() && path[0] != '/';
+}
+
+int Collect(chmFile*, chmUnitInfo* ui, void* context)
+{
+    auto entries = static_cast<std::vector<Entry>*>(context);
+    auto len     = std::strlen(ui->path);
+
+    if (len > 1 && ui->path[0] == '/' && ui->path[len - 1] != '/')
+        entries->push_back({ui->path + 1, ui->start, ui->length, ui->space});
+
+    return CHM_ENUMERATOR_CONTINUE;
+}
+
+bool Extract(chmFile* h, const Entry& entry, const std::filesystem::path& outDir, std::vector<unsigned char>& buffer)
+{
+    chmUnitInfo ui {};
+
+    ui.start  = entry.start;
+    ui.length = entry.length;
+    ui.space  = entry.space;
+
+    auto target = outDir / std::filesystem::u8path(entry.path);
+
+    std::error_code ec;
+    std::filesystem::create_directories(target.parent_path(), ec);
+
+    auto out = std::fopen(target.string().c_str(), "wb");
+
+    if (!out)
+        return false;
+
+    auto ok = true;
+
+    for (uint64_t offset = 0; ok && offset < entry.length;) {
+        auto want = static_cast<LONGINT64>(std::min<uint64_t>(buffer.size(), entry.length - offset));
+        auto got  = chm_retrieve_object(h, &ui, buffer.data(), offset, want);
+
+        ok = got > 0 && std::fwrite(buffer.data(), 1, got, out) == static_cast<size_t>(got);
+        offset += got > 0 ? got : 0;
+    }
+
+    return std::fclose(out) == 0 && ok;
+}
+
+// A thread count: digits only, from 1 to MAX_JOBS.
+bool ParseJobs(const std::string& value, unsigned& jobs)
+{
+    // strtoul() would take "-1", or " 4".
+    if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])))
+        return false;
+
+    char* end = nullptr;
+
+    errno  = 0;
+    auto n = std::strtoul(value.c_str(), &end, 10);
+
+    if (*end || errno == ERANGE || n == 0 || n > MAX_JOBS)
+        return false;
+
+    jobs = static_cast<unsigned>(n);
+    return true;
+}
+
+bool ParseArgs(int argc, char** argv, Options& options)
+{
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if ((arg == "-i" || arg == "-x" || arg == "-j") && i + 1 < argc) {
+            std::string value = argv[++i];
+
+            if (arg == "-i")
+                options.includes.push_back(value);
+            else if (arg == "-x")
+                options.excludes.push_back(value);
+            else if (!ParseJobs(value, options.jobs))
+                return false;
+
+        } else if (arg == "-q")
+            options.quiet = true;
+        else if (!arg.empty() && arg[0] == '-')
+            return false;
+        else
+            positional.push_back(arg);
+    }
+
+    if (positional.size() != 2)
+        return false;
+
+    options.archive = positional[0];
+    options.outDir  = positional[1];
+
+    return true;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    if (!ParseArgs(argc, argv, options)) {
+        std::fprintf(stderr,
+                     "Usage: %s [-j jobs] [-i glob]... [-x glob]... [-q] file.chm outdir\n"
+                     "  -j jobs  number of decompressing threads (default: one per CPU)\n"
+                     "  -i glob  only extract the files matching glob (can be repeated)\n"
+                     "  -x glob  skip the files matching glob (can be repeated)\n"
+                     "  -q       don't print the summary\n",
+                     argv[0]);
+        return 2;
+    }
+
+    auto begin   = std::chrono::steady_clock::now();
+    auto archive = chm_open(options.archive.c_str());
+
+    if (!archive) {
+        std::fprintf(stderr, "%s: can't open %s\n", argv[0], options.archive.c_str());
+        return 1;
+    }
+
+    std::vector<Entry> entries;
+    chm_enumerate(archive, CHM_ENUMERATE_NORMAL | CHM_ENUMERATE_FILES, Collect, &entries);
+    chm_close(archive);
+
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [&options](const Entry& e) { return !Wanted(options, e.path); }),
+                  entries.end());
+
+    // In archive order the LZX decoder keeps going forward and never has to restart from the last reset point.
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.space != b.space ? a.space < b.space : a.start < b.start;
+    });
+
+    // Contiguous runs of files, each extracted by one worker in order.
+    std::vector<size_t> runs {0};
+    uint64_t            runBytes = 0, totalBytes = 0;
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (runBytes >= RUN_BYTES) {
+            runs.push_back(i);
+            runBytes = 0;
+        }
+
+        runBytes += entries[i].length;
+        totalBytes += entries[i].length;
+    }
+
+    runs.push_back(entries.size());
+
+    std::atomic<size_t>   nextRun {0};
+    std::atomic<unsigned> failures {0};
+    std::filesystem::path outDir(options.outDir);
+
+    auto worker = [&]() {
+        // A handle of its own, so every thread has its own decoder and cache.
+        auto h = chm_open(options.archive.c_str());
+
+        if (!h) {
+            ++failures;
+            return;
+        }
+
+#ifdef ENABLE_BUILTIN_CHMLIB
+        // The runs are in archive order, and so are their files.
+        chm_set_param(h, CHM_PARAM_ACCESS_PATTERN, CHM_ACCESS_SEQUENTIAL);
+#endif
+
+        std::vector<unsigned char> buffer(COPY_BUF_SIZE);
+
+        for (size_t run; (run = nextRun++) + 1 < runs.size();)
+            for (auto i = runs[run]; i < runs[run + 1]; ++i) {
+                auto& entry = entries[i];
+
+                if (!SafePath(entry.path) || !Extract(h, entry, outDir, buffer)) {
+                    std::fprintf(stderr, "%s: failed to extract /%s\n", argv[0], entry.path.c_str());
+                    ++failures;
+                }
+            }
+
+        chm_close(h);
+    };
+
+    std::vector<std::thread> threads;
+    auto jobs = std::min<size_t>(options.jobs, runs.size() - 1);
+
+    for (size_t i = 1; i < jobs; ++i)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (auto& t : threads)
+        t.join();
+
+    if (!options.quiet) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        auto                          mib     = totalBytes / (1024.0 * 1024.0);
+
+        std::fprintf(stderr, "%zu files, %.1f MiB in %.2f s (%.1f MiB/s, %zu threads)\n", entries.size(), mib,
+                     elapsed.count(), elapsed.count() > 0 ? mib / elapsed.count() : 0.0, std::max<size_t>(jobs, 1));
+    }
+
+    return failures ? 1 : 0;
+}
@@ -29,7 +29,10 @@
  *              a deal, at least until CHM v4 (MS .lit files), which also  *
  *              incorporate encryption, of some description.               *
  *                                                                         *
- * switches:    CHM_MT:        compile library with thread-safety          *
+ * switches:    CHM_MT:        compile library with thread-safety; several *
+ *                             threads may read from the same handle at    *
+ *                             once, each decompressing with its own LZX   *
+ *                             state                                       *
  *                                                                         *
  * switches (Linux only):                                                  *
  *              CHM_USE_PREAD: compile library to use pread instead of     *
@@ -37,6 +40,11 @@
  *              CHM_USE_IO64:  compile library to support full 64-bit I/O  *
  *                             as is needed to properly deal with the      *
  *                             64-bit file offsets.                        *
+ *              CHM_USE_IO_URING: queue the reads of the                   *
+ *                             compressed blocks a decompressor is about   *
+ *                             to go through with io_uring (liburing), so  *
+ *                             they overlap with decompression; plain      *
+ *                             reads are used where io_uring isn't there   *
  ***************************************************************************/
 
 /***************************************************************************
@@ -48,6 +56,11 @@
  *                                                                         *
  ***************************************************************************/
 
+#ifdef CHM_USE_IO_URING
+/* liburing.h wants cpu_set_t, which glibc only declares for _GNU_SOURCE */
+#define _GNU_SOURCE
+#endif
+
 #include "xchm_chm_lib.h"
 
 #ifdef CHM_MT
@@ -56,6 +69,7 @@
 
 #include "lzx.h"
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #ifdef CHM_DEBUG
@@ -78,11 +92,17 @@
 #endif
 #else
 /* basic Linux system includes */
-#define _XOPEN_SOURCE 500
+/* 600 for posix_fadvise() */
+#define _XOPEN_SOURCE 600
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#ifdef CHM_USE_IO_URING
+#include <errno.h>
+#include <liburing.h>
+#include <stdint.h>
+#endif
 /* #include <dmalloc.h> */
 #endif
 
@@ -93,8 +113,14 @@
         EnterCriticalSection(&(a));                     \
     } while(0)
 #define CHM_RELEASE_LOCK(a) do {                        \
-        EnterCriticalSection(&(a));                     \
+        LeaveCriticalSection(&(a));                     \
     } while(0)
+#define CHM_INIT_LOCK(a)    InitializeCriticalSection(&(a))
+#define CHM_DESTROY_LOCK(a) DeleteCriticalSection(&(a))
+#define CHM_INIT_COND(c)    InitializeConditionVariable(&(c))
+#define CHM_DESTROY_COND(c) /* nothing to do */
+#define CHM_WAIT_COND(c, a) SleepConditionVariableCS(&(c), &(a), INFINITE)
+#define CHM_SIGNAL_COND(c)  WakeConditionVariable(&(c))
 
 #else
 #include <pthread.h>
@@ -105,11 +131,19 @@
 #define CHM_RELEASE_LOCK(a) do {                        \
         pthread_mutex_unlock(&(a));                     \
     } while(0)
+#define CHM_INIT_LOCK(a)    pthread_mutex_init(&(a), NULL)
+#define CHM_DESTROY_LOCK(a) pthread_mutex_destroy(&(a))
+#define CHM_INIT_COND(c)    pthread_cond_init(&(c), NULL)
+#define CHM_DESTROY_COND(c) pthread_cond_destroy(&(c))
+#define CHM_WAIT_COND(c, a) pthread_cond_wait(&(c), &(a))
+#define CHM_SIGNAL_COND(c)  pthread_cond_signal(&(c))
 
 #endif
 #else
 #define CHM_ACQUIRE_LOCK(a) /* do nothing */
 #define CHM_RELEASE_LOCK(a) /* do nothing */
+#define CHM_INIT_LOCK(a)    /* do nothing */
+#define CHM_DESTROY_LOCK(a) /* do nothing */
 #endif
 
 #ifdef WIN32
@@ -128,6 +162,59 @@
 #define CHM_MAX_BLOCKS_CACHED 5
 #endif
 
+/* largest directory page we're willing to believe in (they're 4K in practice) */
+#ifndef CHM_MAX_DIR_BLOCK_LEN
+#define CHM_MAX_DIR_BLOCK_LEN 0x100000
+#endif
+
+/* largest span handed out for data in the uncompressed section */
+#ifndef CHM_MAX_UNCOMPRESSED_SPAN
+#define CHM_MAX_UNCOMPRESSED_SPAN 32768
+#endif
+
+/* most compressed blocks a decompressor reads ahead of itself at once */
+#ifndef CHM_MAX_RUN_BLOCKS
+#define CHM_MAX_RUN_BLOCKS 16
+#endif
+
+/* how much compressed data past what's being decompressed the kernel is asked
+ * to read ahead, with CHM_ACCESS_SEQUENTIAL */
+#ifndef CHM_READAHEAD_BYTES
+#define CHM_READAHEAD_BYTES 0x200000
+#endif
+
+/* largest reset table CHM_ACCESS_SEQUENTIAL keeps in memory (an entry per
+ * 32K block: 1M entries is a 32G content section) */
+#ifndef CHM_MAX_CACHED_RESET_TABLE
+#define CHM_MAX_CACHED_RESET_TABLE 0x100000
+#endif
+
+/* how many stripes of performance counters threads spread over */
+#ifdef CHM_MT
+#ifndef CHM_STAT_STRIPES
+#define CHM_STAT_STRIPES 16
+#endif
+#else
+#undef CHM_STAT_STRIPES
+#define CHM_STAT_STRIPES 1
+#endif
+
+/* how many threads may decompress from the same handle at once, and how many
+ * independently locked pieces the block cache is split into */
+#ifdef CHM_MT
+#ifndef CHM_MAX_DECODERS
+#define CHM_MAX_DECODERS 4
+#endif
+#ifndef CHM_CACHE_SHARDS
+#define CHM_CACHE_SHARDS 8
+#endif
+#else
+#undef CHM_MAX_DECODERS
+#define CHM_MAX_DECODERS 1
+#undef CHM_CACHE_SHARDS
+#define CHM_CACHE_SHARDS 1
+#endif
+
 /*
  * architecture specific defines
  *
@@ -261,7 +348,7 @@ static int _unmarshal_int32(unsigned char **pData,
 {
     if (4 > *pLenRemain)
         return 0;
-    *dest = (*pData)[0] | (*pData)[1]<<8 | (*pData)[2]<<16 | (*pData)[3]<<24;
+    *dest = (*pData)[0] | (*pData)[1]<<8 | (*pData)[2]<<16 | (UInt32)(*pData)[3]<<24;
     *pData += 4;
     *pLenRemain -= 4;
     return 1;
@@ -273,17 +360,18 @@ static int _unmarshal_uint32(unsigned char **pData,
 {
     if (4 > *pLenRemain)
         return 0;
-    *dest = (*pData)[0] | (*pData)[1]<<8 | (*pData)[2]<<16 | (*pData)[3]<<24;
+    *dest = (*pData)[0] | (*pData)[1]<<8 | (*pData)[2]<<16 | (UInt32)(*pData)[3]<<24;
     *pData += 4;
     *pLenRemain -= 4;
     return 1;
 }
 
+#if 0
 static int _unmarshal_int64(unsigned char **pData,
                             unsigned int *pLenRemain,
                             Int64 *dest)
 {
-    Int64 temp;
+    UInt64 temp;
     int i;
     if (8 > *pLenRemain)
         return 0;
@@ -293,11 +381,12 @@ static int _unmarshal_int64(unsigned char **pData,
         temp <<= 8;
         temp |= (*pData)[i-1];
     }
-    *dest = temp;
+    *dest = (Int64)temp;
     *pData += 8;
     *pLenRemain -= 8;
     return 1;
 }
+#endif
 
 static int _unmarshal_uint64(unsigned char **pData,
                              unsigned int *pLenRemain,
@@ -631,6 +720,66 @@ static int _unmarshal_lzxc_control_data(unsigned char **pData,
     return 1;
 }
 
+/* the compressed input of a run of consecutive blocks, read ahead of their
+ * decompression.  ready[i] is 1 once block first + i is in the decoder's
+ * cbuffer, -1 while a read of it is queued and 0 if it's still to be read */
+struct chmRun
+{
+    UInt64              first;
+    int                 count;
+    UInt64              bounds[CHM_MAX_RUN_BLOCKS + 1]; /* in the file     */
+    int                 ready[CHM_MAX_RUN_BLOCKS];
+#ifdef CHM_USE_IO_URING
+    struct io_uring     ring;
+    int                 ring_ok;
+    int                 inflight;               /* queued reads            */
+#endif
+};
+
+/* an LZX decompressor, used by one thread at a time */
+struct chmDecoder
+{
+    struct LZXstate    *state;
+    int                 last_block;
+    int                 busy;
+    UChar              *ubuffer;                /* last decompressed block */
+    UChar              *cbuffer;                /* compressed input        */
+    UInt64              cbuffer_len;
+    struct chmRun       run;                    /* what's in cbuffer       */
+};
+
+/* where a caller wants (part of) the content section copied */
+struct chmRegion
+{
+    UChar              *buf;
+    UInt64              start;
+    UInt64              len;
+};
+
+/* a decompressed block.  the cache holds one reference, every span handed
+ * out by chm_retrieve_span() another; guarded by the mutex of its shard */
+struct chmBlock
+{
+    int                 refs;
+    UChar               data[];
+};
+
+/* a piece of the decompressed blocks cache; block b lives in shard
+ * b % CHM_CACHE_SHARDS, in slot (b / CHM_CACHE_SHARDS) % num_blocks */
+struct chmCacheShard
+{
+#ifdef CHM_MT
+#ifdef WIN32
+    CRITICAL_SECTION    mutex;
+#else
+    pthread_mutex_t     mutex;
+#endif
+#endif
+    struct chmBlock   **blocks;
+    UInt64             *indices;
+    Int32               num_blocks;
+};
+
 /* the structure used for chm file handles */
 struct chmFile
 {
@@ -644,11 +793,11 @@ struct chmFile
 #ifdef WIN32
     CRITICAL_SECTION    mutex;
     CRITICAL_SECTION    lzx_mutex;
-    CRITICAL_SECTION    cache_mutex;
+    CONDITION_VARIABLE  lzx_cond;
 #else
     pthread_mutex_t     mutex;
     pthread_mutex_t     lzx_mutex;
-    pthread_mutex_t     cache_mutex;
+    pthread_cond_t      lzx_cond;
 #endif
 #endif
 
@@ -658,6 +807,7 @@ struct chmFile
     Int32               index_root;
     Int32               index_head;
     UInt32              block_len;
+    UInt32              num_blocks;
 
     UInt64              span;
     struct chmUnitInfo  rt_unit;
@@ -670,20 +820,129 @@ struct chmFile
     UInt32              reset_interval;
     UInt32              reset_blkcount;
 
-    /* decompressor state */
-    struct LZXstate    *lzx_state;
-    int                 lzx_last_block;
+    /* decompressor states, guarded by lzx_mutex */
+    struct chmDecoder   decoders[CHM_MAX_DECODERS];
+    int                 num_decoders;
 
     /* cache for decompressed blocks */
-    UChar             **cache_blocks;
-    UInt64             *cache_block_indices;
-    Int32               cache_num_blocks;
+    struct chmCacheShard cache[CHM_CACHE_SHARDS];
+
+    /* CHM_PARAM_ACCESS_PATTERN, the reset table it has us keep (once loaded,
+     * it stays until chm_close()) and how far ahead the kernel's reading for
+     * us; guarded by mutex */
+    int                 access_pattern;
+    UInt64             *rt_entries;
+    UInt64              readahead_end;
 };
 
+/*
+ * performance counters
+ *
+ * cheap enough to always keep: every thread adds to a stripe of its own (each
+ * on its own cache line) with relaxed atomics, and chm_get_stats() sums the
+ * stripes up.  threads only share a stripe past CHM_STAT_STRIPES of them.
+ */
+#if !defined(CHM_MT)
+#define CHM_STAT_ADD_ATOMIC(p, n) (*(p) += (n))
+#define CHM_STAT_LOAD(p)          (*(p))
+#elif defined(_MSC_VER)
+#define CHM_STAT_ADD_ATOMIC(p, n) InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(n))
+#define CHM_STAT_LOAD(p)          ((UInt64)InterlockedCompareExchange64((volatile LONG64 *)(p), 0, 0))
+#define CHM_THREAD_LOCAL          __declspec(thread)
+#else
+#define CHM_STAT_ADD_ATOMIC(p, n) __atomic_fetch_add((p), (UInt64)(n), __ATOMIC_RELAXED)
+#define CHM_STAT_LOAD(p)          __atomic_load_n((p), __ATOMIC_RELAXED)
+#define CHM_THREAD_LOCAL          __thread
+#endif
+
+union chmStatStripe
+{
+    UInt64              counters[CHM_STAT_COUNT];
+    char                line[(CHM_STAT_COUNT * sizeof(UInt64) + 63) / 64 * 64];
+};
+
+static union chmStatStripe _chm_stats[CHM_STAT_STRIPES];
+
+#ifdef CHM_MT
+static CHM_THREAD_LOCAL union chmStatStripe *_chm_stat_stripe = NULL;
+static UInt64 _chm_stat_next_stripe = 0;
+
+/* the calling thread's stripe, handed out round robin */
+static union chmStatStripe *_chm_get_stat_stripe(void)
+{
+    if (_chm_stat_stripe == NULL)
+        _chm_stat_stripe = &_chm_stats[CHM_STAT_ADD_ATOMIC(&_chm_stat_next_stripe, 1) % CHM_STAT_STRIPES];
+    return _chm_stat_stripe;
+}
+#define CHM_STAT_ADD(c, n) CHM_STAT_ADD_ATOMIC(&_chm_get_stat_stripe()->counters[(c)], (n))
+#else
+#define CHM_STAT_ADD(c, n) CHM_STAT_ADD_ATOMIC(&_chm_stats[0].counters[(c)], (n))
+#endif
+
+void chm_get_stats(LONGUINT64 *stats)
+{
+    int c, s;
+
+    for (c=0; c<CHM_STAT_COUNT; c++)
+    {
+        stats[c] = 0;
+        for (s=0; s<CHM_STAT_STRIPES; s++)
+            stats[c] += CHM_STAT_LOAD(&_chm_stats[s].counters[c]);
+    }
+}
+
+/*
+ * tracing
+ */
+static CHM_TRACE_HOOK _chm_trace_hook = NULL;
+
+/* set from one thread while the others may be tracing */
+#if !defined(CHM_MT)
+#define CHM_LOAD_TRACE_HOOK()      (_chm_trace_hook)
+#define CHM_STORE_TRACE_HOOK(hook) (_chm_trace_hook = (hook))
+#elif defined(_MSC_VER)
+#define CHM_LOAD_TRACE_HOOK()      \
+    ((CHM_TRACE_HOOK)InterlockedCompareExchangePointer((PVOID volatile *)&_chm_trace_hook, NULL, NULL))
+#define CHM_STORE_TRACE_HOOK(hook) \
+    InterlockedExchangePointer((PVOID volatile *)&_chm_trace_hook, (PVOID)(hook))
+#else
+#define CHM_LOAD_TRACE_HOOK()      __atomic_load_n(&_chm_trace_hook, __ATOMIC_ACQUIRE)
+#define CHM_STORE_TRACE_HOOK(hook) __atomic_store_n(&_chm_trace_hook, (hook), __ATOMIC_RELEASE)
+#endif
+
+#define CHM_TRACE(name, begin)                              \
+    do {                                                    \
+        CHM_TRACE_HOOK _hook = CHM_LOAD_TRACE_HOOK();       \
+        if (_hook != NULL)                                  \
+            _hook((name), (begin));                         \
+    } while (0)
+
+void chm_set_trace_hook(CHM_TRACE_HOOK hook)
+{
+    CHM_STORE_TRACE_HOOK(hook);
+}
+
 /*
  * utility functions local to this module
  */
 
+/* allocate a block holding one reference */
+static struct chmBlock *_chm_new_block(UInt64 len)
+{
+    struct chmBlock *block = (struct chmBlock *)malloc(offsetof(struct chmBlock, data) + (size_t)len);
+
+    if (block != NULL)
+        block->refs = 1;
+    return block;
+}
+
+/* drop a reference to a block, freeing it if it was the last one */
+static void _chm_unref_block(struct chmBlock *block)
+{
+    if (block != NULL  &&  --block->refs == 0)
+        free(block);
+}
+
 /* utility function to handle differences between {pread,read}(64)? */
 static Int64 _chm_fetch_bytes(struct chmFile *h,
                               UChar *buf,
@@ -694,7 +953,10 @@ static Int64 _chm_fetch_bytes(struct chmFile *h,
     if (h->fd  ==  CHM_NULL_FD)
         return readLen;
 
+    /* pread() doesn't touch the file offset, so readers don't need to take turns */
+#if defined(CHM_USE_WIN32IO) || !defined(CHM_USE_PREAD)
     CHM_ACQUIRE_LOCK(h->mutex);
+#endif
 #ifdef CHM_USE_WIN32IO
     /* NOTE: this might be better done with CreateFileMapping, et cetera... */
     {
@@ -720,14 +982,16 @@ static Int64 _chm_fetch_bytes(struct chmFile *h,
 
         /* restore original position */
         SetFilePointer(h->fd, origOffsetLo, &origOffsetHi, FILE_BEGIN);
+        CHM_STAT_ADD(CHM_STAT_SYSCALLS, 4);
     }
 #else
 #ifdef CHM_USE_PREAD
 #ifdef CHM_USE_IO64
     readLen = pread64(h->fd, buf, (long)len, os);
 #else
-    readLen = pread(h->fd, buf, (long)len, (unsigned int)os);
+    readLen = pread(h->fd, buf, (long)len, (off_t)os);
 #endif
+    CHM_STAT_ADD(CHM_STAT_SYSCALLS, 1);
 #else
 #ifdef CHM_USE_IO64
     oldOs = lseek64(h->fd, 0, SEEK_CUR);
@@ -740,9 +1004,14 @@ static Int64 _chm_fetch_bytes(struct chmFile *h,
     readLen = read(h->fd, buf, len);
     lseek(h->fd, (long)oldOs, SEEK_SET);
 #endif
+    CHM_STAT_ADD(CHM_STAT_SYSCALLS, 4);
 #endif
 #endif
+#if defined(CHM_USE_WIN32IO) || !defined(CHM_USE_PREAD)
     CHM_RELEASE_LOCK(h->mutex);
+#endif
+    if (readLen > 0)
+        CHM_STAT_ADD(CHM_STAT_BYTES_READ, readLen);
     return readLen;
 }
 
@@ -765,16 +1034,23 @@ struct chmFile *chm_open(const char *filename)
 #endif
     struct chmUnitInfo          uiLzxc;
     struct chmLzxcControlData   ctlData;
+    int                         i;
 
     /* allocate handle */
     newHandle = (struct chmFile *)malloc(sizeof(struct chmFile));
     if (newHandle == NULL)
         return NULL;
     newHandle->fd = CHM_NULL_FD;
-    newHandle->lzx_state = NULL;
-    newHandle->cache_blocks = NULL;
-    newHandle->cache_block_indices = NULL;
-    newHandle->cache_num_blocks = 0;
+    newHandle->num_decoders = 0;
+    newHandle->access_pattern = CHM_ACCESS_RANDOM;
+    newHandle->rt_entries = NULL;
+    newHandle->readahead_end = 0;
+    for (i=0; i<CHM_CACHE_SHARDS; i++)
+    {
+        newHandle->cache[i].blocks = NULL;
+        newHandle->cache[i].indices = NULL;
+        newHandle->cache[i].num_blocks = 0;
+    }
 
     /* open file */
 #ifdef WIN32
@@ -813,15 +1089,11 @@ struct chmFile *chm_open(const char *filename)
 
     /* initialize mutexes, if needed */
 #ifdef CHM_MT
-#ifdef WIN32
-    InitializeCriticalSection(&newHandle->mutex);
-    InitializeCriticalSection(&newHandle->lzx_mutex);
-    InitializeCriticalSection(&newHandle->cache_mutex);
-#else
-    pthread_mutex_init(&newHandle->mutex, NULL);
-    pthread_mutex_init(&newHandle->lzx_mutex, NULL);
-    pthread_mutex_init(&newHandle->cache_mutex, NULL);
-#endif
+    CHM_INIT_LOCK(newHandle->mutex);
+    CHM_INIT_LOCK(newHandle->lzx_mutex);
+    CHM_INIT_COND(newHandle->lzx_cond);
+    for (i=0; i<CHM_CACHE_SHARDS; i++)
+        CHM_INIT_LOCK(newHandle->cache[i].mutex);
 #endif
 
     /* read and verify header */
@@ -856,6 +1128,16 @@ struct chmFile *chm_open(const char *filename)
     newHandle->index_root  = itspHeader.index_root;
     newHandle->index_head  = itspHeader.index_head;
     newHandle->block_len   = itspHeader.block_len;
+    newHandle->num_blocks  = itspHeader.num_blocks;
+
+    /* directory pages have to hold at least their header, and shouldn't make
+     * us allocate silly amounts of memory */
+    if (newHandle->block_len < _CHM_PMGL_LEN  ||
+        newHandle->block_len > CHM_MAX_DIR_BLOCK_LEN)
+    {
+        chm_close(newHandle);
+        return NULL;
+    }
 
     /* if the index root is -1, this means we don't have any PMGI blocks.
      * as a result, we must use the sole PMGL block as the index root
@@ -897,15 +1179,15 @@ struct chmFile *chm_open(const char *filename)
     if (CHM_RESOLVE_SUCCESS != chm_resolve_object(newHandle,
                                                   _CHMU_RESET_TABLE,
                                                   &newHandle->rt_unit)    ||
-        newHandle->rt_unit.space == CHM_COMPRESSED                        ||
+        newHandle->rt_unit.space != CHM_UNCOMPRESSED                      ||
         CHM_RESOLVE_SUCCESS != chm_resolve_object(newHandle,
                                                   _CHMU_CONTENT,
                                                   &newHandle->cn_unit)    ||
-        newHandle->cn_unit.space == CHM_COMPRESSED                        ||
+        newHandle->cn_unit.space != CHM_UNCOMPRESSED                      ||
         CHM_RESOLVE_SUCCESS != chm_resolve_object(newHandle,
                                                   _CHMU_LZXC_CONTROLDATA,
                                                   &uiLzxc)                ||
-        uiLzxc.space == CHM_COMPRESSED)
+        uiLzxc.space != CHM_UNCOMPRESSED)
     {
         newHandle->compression_enabled = 0;
     }
@@ -942,7 +1224,10 @@ struct chmFile *chm_open(const char *filename)
         {
             newHandle->compression_enabled = 0;
         }
+    }
 
+    if (newHandle->compression_enabled)
+    {
         newHandle->window_size = ctlData.windowSize;
         newHandle->reset_interval = ctlData.resetInterval;
 
@@ -957,6 +1242,15 @@ struct chmFile *chm_open(const char *filename)
                                     (newHandle->window_size / 2) *
                                     ctlData.windowsPerReset;
 #endif
+
+        /* a block has to fit in the LZX window, and we have to be able to
+         * tell where reset intervals start */
+        if (newHandle->reset_table.block_len == 0                           ||
+            newHandle->reset_table.block_len > newHandle->window_size      ||
+            newHandle->reset_blkcount == 0)
+        {
+            newHandle->compression_enabled = 0;
+        }
     }
 
     /* initialize cache */
@@ -966,6 +1260,8 @@ struct chmFile *chm_open(const char *filename)
     return newHandle;
 }
 
+static void _chm_end_run(struct chmDecoder *d);
+
 /* close an ITS archive */
 void chm_close(struct chmFile *h)
 {
@@ -975,42 +1271,128 @@ void chm_close(struct chmFile *h)
             CHM_CLOSE_FILE(h->fd);
         h->fd = CHM_NULL_FD;
 
+        int i, j;
+
 #ifdef CHM_MT
-#ifdef WIN32
-        DeleteCriticalSection(&h->mutex);
-        DeleteCriticalSection(&h->lzx_mutex);
-        DeleteCriticalSection(&h->cache_mutex);
-#else
-        pthread_mutex_destroy(&h->mutex);
-        pthread_mutex_destroy(&h->lzx_mutex);
-        pthread_mutex_destroy(&h->cache_mutex);
+        CHM_DESTROY_LOCK(h->mutex);
+        CHM_DESTROY_LOCK(h->lzx_mutex);
+        CHM_DESTROY_COND(h->lzx_cond);
 #endif
+
+        for (i=0; i<h->num_decoders; i++)
+        {
+            _chm_end_run(&h->decoders[i]);
+#ifdef CHM_USE_IO_URING
+            if (h->decoders[i].run.ring_ok)
+                io_uring_queue_exit(&h->decoders[i].run.ring);
 #endif
+            if (h->decoders[i].state)
+                LZXteardown(h->decoders[i].state);
+            free(h->decoders[i].ubuffer);
+            free(h->decoders[i].cbuffer);
+        }
+        h->num_decoders = 0;
 
-        if (h->lzx_state)
-            LZXteardown(h->lzx_state);
-        h->lzx_state = NULL;
+        free(h->rt_entries);
+        h->rt_entries = NULL;
 
-        if (h->cache_blocks)
+        for (i=0; i<CHM_CACHE_SHARDS; i++)
         {
-            int i;
-            for (i=0; i<h->cache_num_blocks; i++)
+            struct chmCacheShard *shard = &h->cache[i];
+
+#ifdef CHM_MT
+            CHM_DESTROY_LOCK(shard->mutex);
+#endif
+            if (shard->blocks)
             {
-                if (h->cache_blocks[i])
-                    free(h->cache_blocks[i]);
+                for (j=0; j<shard->num_blocks; j++)
+                {
+                    _chm_unref_block(shard->blocks[j]);
+                }
+                free(shard->blocks);
+                shard->blocks = NULL;
             }
-            free(h->cache_blocks);
-            h->cache_blocks = NULL;
-        }
 
-        if (h->cache_block_indices)
-            free(h->cache_block_indices);
-        h->cache_block_indices = NULL;
+            if (shard->indices)
+                free(shard->indices);
+            shard->indices = NULL;
+        }
 
         free(h);
     }
 }
 
+/* read the whole reset table into h->rt_entries, unless it's there already,
+ * or too large to keep */
+static void _chm_load_reset_table(struct chmFile *h)
+{
+    UInt64 count = h->reset_table.block_count;
+    UInt64 *entries;
+    UChar *buffer, *dummy;
+    unsigned int remain;
+    UInt64 i;
+    int loaded = 1;
+
+    if (! h->compression_enabled  ||  count == 0  ||  count > CHM_MAX_CACHED_RESET_TABLE)
+        return;
+
+    CHM_ACQUIRE_LOCK(h->mutex);
+    entries = h->rt_entries;
+    CHM_RELEASE_LOCK(h->mutex);
+    if (entries != NULL)
+        return;
+
+    entries = (UInt64 *)malloc((size_t)count * sizeof(UInt64));
+    buffer = (UChar *)malloc((size_t)count * 8);
+    remain = (unsigned int)count * 8;
+    if (entries == NULL  ||  buffer == NULL  ||
+        _chm_fetch_bytes(h, buffer,
+                         (UInt64)h->data_offset
+                            + (UInt64)h->rt_unit.start
+                            + (UInt64)h->reset_table.table_offset,
+                         remain) != remain)
+        loaded = 0;
+
+    dummy = buffer;
+    for (i=0; loaded  &&  i<count; i++)
+        loaded = _unmarshal_uint64(&dummy, &remain, &entries[i]);
+    free(buffer);
+
+    /* somebody else might have beaten us to it */
+    CHM_ACQUIRE_LOCK(h->mutex);
+    if (loaded  &&  h->rt_entries == NULL)
+    {
+        h->rt_entries = entries;
+        entries = NULL;
+    }
+    CHM_RELEASE_LOCK(h->mutex);
+    free(entries);
+}
+
+static void _chm_set_access_pattern(struct chmFile *h,
+                                    int pattern)
+{
+    if (pattern != CHM_ACCESS_RANDOM  &&  pattern != CHM_ACCESS_SEQUENTIAL)
+        return;
+
+    /* going through all the blocks, we'd be reading all of it anyway, a
+     * run's worth at a time */
+    if (pattern == CHM_ACCESS_SEQUENTIAL)
+        _chm_load_reset_table(h);
+
+    CHM_ACQUIRE_LOCK(h->mutex);
+    h->access_pattern = pattern;
+    h->readahead_end = 0;
+    CHM_RELEASE_LOCK(h->mutex);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    /* the uncompressed section gets the kernel's (larger) sequential read ahead */
+    posix_fadvise(h->fd, 0, 0,
+                  pattern == CHM_ACCESS_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+    CHM_STAT_ADD(CHM_STAT_SYSCALLS, 1);
+#endif
+}
+
 /*
  * set a parameter on the file handle.
  * valid parameter types:
@@ -1019,6 +1401,13 @@ void chm_close(struct chmFile *h)
  *                 caching scheme is used, wherein the index of the block is
  *                 used as a hash value, and hash collision results in the
  *                 invalidation of the previously cached block.
+ *          CHM_PARAM_ACCESS_PATTERN:
+ *                 CHM_ACCESS_SEQUENTIAL if (most of) the archive is about to
+ *                 be read in order, as when extracting or indexing it all:
+ *                 the kernel gets asked to read ahead, compressed blocks are
+ *                 read a run at a time, and the reset table is kept in
+ *                 memory.  CHM_ACCESS_RANDOM (the default) leaves read ahead
+ *                 to the kernel's own heuristics.
  */
 void chm_set_param(struct chmFile *h,
                    int paramType,
@@ -1027,58 +1416,80 @@ void chm_set_param(struct chmFile *h,
     switch (paramType)
     {
         case CHM_PARAM_MAX_BLOCKS_CACHED:
-            CHM_ACQUIRE_LOCK(h->cache_mutex);
-            if (paramVal != h->cache_num_blocks)
+        {
+            /* every shard gets its share, rounded up */
+            int perShard = (paramVal + CHM_CACHE_SHARDS - 1) / CHM_CACHE_SHARDS;
+            int shardIdx;
+
+            if (perShard < 1)
+                perShard = 1;
+
+            for (shardIdx=0; shardIdx<CHM_CACHE_SHARDS; shardIdx++)
             {
-                UChar **newBlocks;
-                UInt64 *newIndices;
-                int     i;
-
-                /* allocate new cached blocks */
-                newBlocks = (UChar **)malloc(paramVal * sizeof (UChar *));
-                if (newBlocks == NULL) return;
-                newIndices = (UInt64 *)malloc(paramVal * sizeof (UInt64));
-                if (newIndices == NULL) { free(newBlocks); return; }
-                for (i=0; i<paramVal; i++)
-                {
-                    newBlocks[i] = NULL;
-                    newIndices[i] = 0;
-                }
+                struct chmCacheShard *shard = &h->cache[shardIdx];
 
-                /* re-distribute old cached blocks */
-                if (h->cache_blocks)
+                CHM_ACQUIRE_LOCK(shard->mutex);
+                if (perShard != shard->num_blocks)
                 {
-                    for (i=0; i<h->cache_num_blocks; i++)
+                    struct chmBlock **newBlocks;
+                    UInt64 *newIndices;
+                    int     i;
+
+                    /* allocate new cached blocks */
+                    newBlocks = (struct chmBlock **)malloc(perShard * sizeof (struct chmBlock *));
+                    newIndices = (UInt64 *)malloc(perShard * sizeof (UInt64));
+                    if (newBlocks == NULL  ||  newIndices == NULL)
                     {
-                        int newSlot = (int)(h->cache_block_indices[i] % paramVal);
+                        free(newBlocks);
+                        free(newIndices);
+                        CHM_RELEASE_LOCK(shard->mutex);
+                        return;
+                    }
+                    for (i=0; i<perShard; i++)
+                    {
+                        newBlocks[i] = NULL;
+                        newIndices[i] = 0;
+                    }
 
-                        if (h->cache_blocks[i])
+                    /* re-distribute old cached blocks */
+                    if (shard->blocks)
+                    {
+                        for (i=0; i<shard->num_blocks; i++)
                         {
-                            /* in case of collision, destroy newcomer */
-                            if (newBlocks[newSlot])
-                            {
-                                free(h->cache_blocks[i]);
-                                h->cache_blocks[i] = NULL;
-                            }
-                            else
+                            int newSlot = (int)((shard->indices[i] / CHM_CACHE_SHARDS) % perShard);
+
+                            if (shard->blocks[i])
                             {
-                                newBlocks[newSlot] = h->cache_blocks[i];
-                                newIndices[newSlot] =
-                                            h->cache_block_indices[i];
+                                /* in case of collision, destroy newcomer */
+                                if (newBlocks[newSlot])
+                                {
+                                    _chm_unref_block(shard->blocks[i]);
+                                    shard->blocks[i] = NULL;
+                                }
+                                else
+                                {
+                                    newBlocks[newSlot] = shard->blocks[i];
+                                    newIndices[newSlot] = shard->indices[i];
+                                }
                             }
                         }
+
+                        free(shard->blocks);
+                        free(shard->indices);
                     }
 
-                    free(h->cache_blocks);
-                    free(h->cache_block_indices);
+                    /* now, set new values */
+                    shard->blocks = newBlocks;
+                    shard->indices = newIndices;
+                    shard->num_blocks = perShard;
                 }
-
-                /* now, set new values */
-                h->cache_blocks = newBlocks;
-                h->cache_block_indices = newIndices;
-                h->cache_num_blocks = paramVal;
+                CHM_RELEASE_LOCK(shard->mutex);
             }
-            CHM_RELEASE_LOCK(h->cache_mutex);
+            break;
+        }
+
+        case CHM_PARAM_ACCESS_PATTERN:
+            _chm_set_access_pattern(h, paramVal);
             break;
 
         default:
@@ -1090,37 +1501,43 @@ void chm_set_param(struct chmFile *h,
  * helper methods for chm_resolve_object
  */
 
-/* skip a compressed dword */
-static void _chm_skip_cword(UChar **pEntry)
-{
-    while (*(*pEntry)++ >= 0x80)
-        ;
-}
-
-/* skip the data from a PMGL entry */
-static void _chm_skip_PMGL_entry_data(UChar **pEntry)
-{
-    _chm_skip_cword(pEntry);
-    _chm_skip_cword(pEntry);
-    _chm_skip_cword(pEntry);
-}
-
-/* parse a compressed dword */
-static UInt64 _chm_parse_cword(UChar **pEntry)
+/* parse a compressed dword that must end before end; return 1 on success.
+ * more than 10 bytes can't be a 64-bit value, so that's malformed too */
+static int _chm_parse_cword(UChar **pEntry, const UChar *end, UInt64 *value)
 {
     UInt64 accum = 0;
     UChar temp;
-    while ((temp=*(*pEntry)++) >= 0x80)
+    int i;
+
+    for (i=0; i<10; i++)
     {
-        accum <<= 7;
-        accum += temp & 0x7f;
+        if (*pEntry >= end)
+            return 0;
+
+        temp = *(*pEntry)++;
+        accum = (accum << 7) + (temp & 0x7f);
+        if (temp < 0x80)
+        {
+            *value = accum;
+            return 1;
+        }
     }
 
-    return (accum << 7) + temp;
+    return 0;
+}
+
+/* skip the data from a PMGL entry */
+static int _chm_skip_PMGL_entry_data(UChar **pEntry, const UChar *end)
+{
+    UInt64 dummy;
+
+    return _chm_parse_cword(pEntry, end, &dummy)  &&
+           _chm_parse_cword(pEntry, end, &dummy)  &&
+           _chm_parse_cword(pEntry, end, &dummy);
 }
 
 /* parse a utf-8 string into an ASCII char buffer */
-static int _chm_parse_UTF8(UChar **pEntry, UInt64 count, char *path)
+static int _chm_parse_UTF8(UChar **pEntry, const UChar *end, UInt64 count, char *path)
 {
     /* XXX: implement UTF-8 support, including a real mapping onto
      *      ISO-8859-1?  probably there is a library to do this?  As is
@@ -1128,6 +1545,9 @@ static int _chm_parse_UTF8(UChar **pEntry, UInt64 count, char *path)
      *      any special handling for files in which none of the strings contain
      *      UTF-8 multi-byte characters.
      */
+    if (count > (UInt64)(end - *pEntry))
+        return 0;
+
     while (count != 0)
     {
         *path++ = (char)(*(*pEntry)++);
@@ -1138,31 +1558,51 @@ static int _chm_parse_UTF8(UChar **pEntry, UInt64 count, char *path)
     return 1;
 }
 
-/* parse a PMGL entry into a chmUnitInfo struct; return 1 on success. */
-static int _chm_parse_PMGL_entry(UChar **pEntry, struct chmUnitInfo *ui)
+/* parse a PMGL entry, ending before end, into a chmUnitInfo struct; return 1
+ * on success. */
+static int _chm_parse_PMGL_entry(UChar **pEntry, const UChar *end, struct chmUnitInfo *ui)
 {
-    UInt64 strLen;
+    UInt64 strLen, space, start, length;
 
     /* parse str len */
-    strLen = _chm_parse_cword(pEntry);
-    if (strLen > CHM_MAX_PATHLEN)
+    if (! _chm_parse_cword(pEntry, end, &strLen)  ||  strLen > CHM_MAX_PATHLEN)
         return 0;
 
     /* parse path */
-    if (! _chm_parse_UTF8(pEntry, strLen, ui->path))
+    if (! _chm_parse_UTF8(pEntry, end, strLen, ui->path))
         return 0;
 
     /* parse info */
-    ui->space  = (int)_chm_parse_cword(pEntry);
-    ui->start  = _chm_parse_cword(pEntry);
-    ui->length = _chm_parse_cword(pEntry);
+    if (! _chm_parse_cword(pEntry, end, &space)   ||
+        ! _chm_parse_cword(pEntry, end, &start)   ||
+        ! _chm_parse_cword(pEntry, end, &length))
+        return 0;
+
+    ui->space  = (int)space;
+    ui->start  = start;
+    ui->length = length;
     return 1;
 }
 
-/* find an exact entry in PMGL; return NULL if we fail */
+/* where the entries of a directory page with free_space bytes unused end;
+ * NULL if free_space doesn't even leave room for the header */
+static UChar *_chm_dir_page_end(UChar *page_buf,
+                                UInt32 block_len,
+                                UInt32 header_len,
+                                UInt32 free_space)
+{
+    if (free_space > block_len - header_len)
+        return NULL;
+
+    return page_buf + block_len - free_space;
+}
+
+/* find an exact entry in PMGL; return NULL if we fail.  pEnd receives the end
+ * of the page's entries */
 static UChar *_chm_find_in_PMGL(UChar *page_buf,
                          UInt32 block_len,
-                         const char *objPath)
+                         const char *objPath,
+                         UChar **pEnd)
 {
     /* XXX: modify this to do a binary search using the nice index structure
      *      that is provided for us.
@@ -1180,24 +1620,29 @@ static UChar *_chm_find_in_PMGL(UChar *page_buf,
     hremain = _CHM_PMGL_LEN;
     if (! _unmarshal_pmgl_header(&cur, &hremain, &header))
         return NULL;
-    end = page_buf + block_len - (header.free_space);
+    end = _chm_dir_page_end(page_buf, block_len, _CHM_PMGL_LEN, header.free_space);
+    if (end == NULL)
+        return NULL;
 
     /* now, scan progressively */
     while (cur < end)
     {
         /* grab the name */
         temp = cur;
-        strLen = _chm_parse_cword(&cur);
-        if (strLen > CHM_MAX_PATHLEN)
+        if (! _chm_parse_cword(&cur, end, &strLen)  ||  strLen > CHM_MAX_PATHLEN)
             return NULL;
-        if (! _chm_parse_UTF8(&cur, strLen, buffer))
+        if (! _chm_parse_UTF8(&cur, end, strLen, buffer))
             return NULL;
 
         /* check if it is the right name */
         if (! strcasecmp(buffer, objPath))
+        {
+            *pEnd = end;
             return temp;
+        }
 
-        _chm_skip_PMGL_entry_data(&cur);
+        if (! _chm_skip_PMGL_entry_data(&cur, end))
+            return NULL;
     }
 
     return NULL;
@@ -1216,7 +1661,7 @@ static Int32 _chm_find_in_PMGI(UChar *page_buf,
     int page=-1;
     UChar *end;
     UChar *cur;
-    UInt64 strLen;
+    UInt64 strLen, next;
     char buffer[CHM_MAX_PATHLEN+1];
 
     /* figure out where to start and end */
@@ -1224,16 +1669,17 @@ static Int32 _chm_find_in_PMGI(UChar *page_buf,
     hremain = _CHM_PMGI_LEN;
     if (! _unmarshal_pmgi_header(&cur, &hremain, &header))
         return -1;
-    end = page_buf + block_len - (header.free_space);
+    end = _chm_dir_page_end(page_buf, block_len, _CHM_PMGI_LEN, header.free_space);
+    if (end == NULL)
+        return -1;
 
     /* now, scan progressively */
     while (cur < end)
     {
         /* grab the name */
-        strLen = _chm_parse_cword(&cur);
-        if (strLen > CHM_MAX_PATHLEN)
+        if (! _chm_parse_cword(&cur, end, &strLen)  ||  strLen > CHM_MAX_PATHLEN)
             return -1;
-        if (! _chm_parse_UTF8(&cur, strLen, buffer))
+        if (! _chm_parse_UTF8(&cur, end, strLen, buffer))
             return -1;
 
         /* check if it is the right name */
@@ -1241,22 +1687,42 @@ static Int32 _chm_find_in_PMGI(UChar *page_buf,
             return page;
 
         /* load next value for path */
-        page = (int)_chm_parse_cword(&cur);
+        if (! _chm_parse_cword(&cur, end, &next)  ||  next > 0x7fffffff)
+            return -1;
+        page = (int)next;
     }
 
     return page;
 }
 
+/* fetch directory page number page; return 0 if there's no such page */
+static int _chm_fetch_dir_page(struct chmFile *h,
+                               UChar *page_buf,
+                               Int32 page)
+{
+    if (page < 0  ||  (UInt32)page >= h->num_blocks)
+        return 0;
+
+    if (_chm_fetch_bytes(h, page_buf,
+                         (UInt64)h->dir_offset + (UInt64)page*h->block_len,
+                         h->block_len) != h->block_len)
+        return 0;
+
+    CHM_STAT_ADD(CHM_STAT_DIR_PAGES, 1);
+    return 1;
+}
+
 /* resolve a particular object from the archive */
-int chm_resolve_object(struct chmFile *h,
-                       const char *objPath,
-                       struct chmUnitInfo *ui)
+static int _chm_resolve_object(struct chmFile *h,
+                               const char *objPath,
+                               struct chmUnitInfo *ui)
 {
     /*
      * XXX: implement caching scheme for dir pages
      */
 
     Int32 curPage;
+    UInt32 depth;
 
     /* buffer to hold whatever page we're looking at */
     /* RWE 6/12/2003 */
@@ -1264,17 +1730,18 @@ int chm_resolve_object(struct chmFile *h,
     if (page_buf == NULL)
         return CHM_RESOLVE_FAILURE;
 
+    CHM_STAT_ADD(CHM_STAT_RESOLVES, 1);
+
     /* starting page */
     curPage = h->index_root;
 
-    /* until we have either returned or given up */
-    while (curPage != -1)
+    /* until we have either returned or given up.  a path through the tree
+     * can't visit more pages than there are, unless it goes round in circles */
+    for (depth = 0; curPage != -1  &&  depth < h->num_blocks; depth++)
     {
 
         /* try to fetch the index page */
-        if (_chm_fetch_bytes(h, page_buf,
-                             (UInt64)h->dir_offset + (UInt64)curPage*h->block_len,
-                             h->block_len) != h->block_len)
+        if (! _chm_fetch_dir_page(h, page_buf, curPage))
         {
             free(page_buf);
             return CHM_RESOLVE_FAILURE;
@@ -1284,19 +1751,16 @@ int chm_resolve_object(struct chmFile *h,
         if (memcmp(page_buf, _chm_pmgl_marker, 4) == 0)
         {
             /* scan block */
+            UChar *pEnd;
             UChar *pEntry = _chm_find_in_PMGL(page_buf,
                                               h->block_len,
-                                              objPath);
-            if (pEntry == NULL)
-            {
-                free(page_buf);
-                return CHM_RESOLVE_FAILURE;
-            }
+                                              objPath,
+                                              &pEnd);
+            int found = pEntry != NULL  &&  _chm_parse_PMGL_entry(&pEntry, pEnd, ui);
 
             /* parse entry and return */
-            _chm_parse_PMGL_entry(&pEntry, ui);
             free(page_buf);
-            return CHM_RESOLVE_SUCCESS;
+            return found ? CHM_RESOLVE_SUCCESS : CHM_RESOLVE_FAILURE;
         }
 
         /* else, if it is a branch node: */
@@ -1316,194 +1780,664 @@ int chm_resolve_object(struct chmFile *h,
     return CHM_RESOLVE_FAILURE;
 }
 
+int chm_resolve_object(struct chmFile *h,
+                       const char *objPath,
+                       struct chmUnitInfo *ui)
+{
+    int rv;
+
+    CHM_TRACE("chm_resolve_object", 1);
+    rv = _chm_resolve_object(h, objPath, ui);
+    CHM_TRACE("chm_resolve_object", 0);
+
+    return rv;
+}
+
 /*
  * utility methods for dealing with compressed data
  */
 
-/* get the bounds of a compressed block.  return 0 on failure */
-static int _chm_get_cmpblock_bounds(struct chmFile *h,
-                             UInt64 block,
-                             UInt64 *start,
-                             Int64 *len)
+/* get where count compressed blocks from first on start in the file, and where
+ * the last of them ends, into bounds[0..count].  return 0 on failure */
+static int _chm_get_run_bounds(struct chmFile *h,
+                               UInt64 first,
+                               int count,
+                               UInt64 *bounds)
 {
-    UChar buffer[8], *dummy;
+    UChar buffer[8 * (CHM_MAX_RUN_BLOCKS + 1)], *dummy;
     unsigned int remain;
+    int entries = count + 1;
+    UInt64 *cached;
+    int i;
+
+    if (count <= 0  ||  count > CHM_MAX_RUN_BLOCKS  ||
+        first + count > h->reset_table.block_count)
+        return 0;
 
-    /* for all but the last block, use the reset table */
-    if (block < h->reset_table.block_count-1)
+    /* the last block ends where the section does, rather than where the
+     * reset table says the next one starts */
+    if (first + count == h->reset_table.block_count)
+        entries = count;
+
+    CHM_ACQUIRE_LOCK(h->mutex);
+    cached = h->rt_entries;
+    CHM_RELEASE_LOCK(h->mutex);
+
+    if (cached != NULL)
+        memcpy(bounds, cached + first, entries * sizeof(UInt64));
+
+    /* unpack the start addresses, all in one go */
+    else
     {
-        /* unpack the start address */
         dummy = buffer;
-        remain = 8;
+        remain = 8 * entries;
         if (_chm_fetch_bytes(h, buffer,
                              (UInt64)h->data_offset
                                 + (UInt64)h->rt_unit.start
                                 + (UInt64)h->reset_table.table_offset
-                                + (UInt64)block*8,
-                             remain) != remain                            ||
-            !_unmarshal_uint64(&dummy, &remain, start))
+                                + (UInt64)first*8,
+                             remain) != remain)
             return 0;
 
-        /* unpack the end address */
-        dummy = buffer;
-        remain = 8;
-        if (_chm_fetch_bytes(h, buffer,
-                         (UInt64)h->data_offset
-                                + (UInt64)h->rt_unit.start
-                                + (UInt64)h->reset_table.table_offset
-                                + (UInt64)block*8 + 8,
-                         remain) != remain                                ||
-            !_unmarshal_int64(&dummy, &remain, len))
-            return 0;
+        for (i=0; i<entries; i++)
+            if (!_unmarshal_uint64(&dummy, &remain, &bounds[i]))
+                return 0;
     }
 
-    /* for the last block, use the span in addition to the reset table */
-    else
+    if (entries == count)
+        bounds[count] = h->reset_table.compressed_len;
+
+    /* check the lengths and compute the absolute addresses */
+    for (i=0; i<=count; i++)
     {
-        /* unpack the start address */
-        dummy = buffer;
-        remain = 8;
-        if (_chm_fetch_bytes(h, buffer,
-                             (UInt64)h->data_offset
-                                + (UInt64)h->rt_unit.start
-                                + (UInt64)h->reset_table.table_offset
-                                + (UInt64)block*8,
-                             remain) != remain                            ||
-            !_unmarshal_uint64(&dummy, &remain, start))
+        if (i < count  &&
+            (bounds[i + 1] < bounds[i]  ||
+             bounds[i + 1] - bounds[i] > h->reset_table.block_len + 6144))
             return 0;
 
-        *len = h->reset_table.compressed_len;
+        bounds[i] += h->data_offset + h->cn_unit.start;
+    }
+
+    return 1;
+}
+
+#ifdef CHM_USE_IO_URING
+/* wait for one of the queued reads of a run to complete.  a read that fails or
+ * comes up short leaves its block to be read the plain way.  return 0 if there
+ * was nothing to wait for, or the wait failed */
+static int _chm_wait_run(struct chmRun *run)
+{
+    struct io_uring_cqe *cqe = NULL;
+    int rv, i;
+
+    if (run->inflight == 0)
+        return 0;
+
+    if (io_uring_peek_cqe(&run->ring, &cqe) != 0)
+    {
+        do {
+            CHM_STAT_ADD(CHM_STAT_SYSCALLS, 1);
+            rv = io_uring_wait_cqe(&run->ring, &cqe);
+        } while (rv == -EINTR);
+
+        if (rv != 0)
+            return 0;
     }
 
-    /* compute the length and absolute start address */
-    *len -= *start;
-    *start += h->data_offset + h->cn_unit.start;
+    i = (int)(uintptr_t)io_uring_cqe_get_data(cqe);
+    if (cqe->res > 0)
+        CHM_STAT_ADD(CHM_STAT_BYTES_READ, cqe->res);
+    run->ready[i] = (cqe->res >= 0  &&
+                     (UInt64)cqe->res == run->bounds[i + 1] - run->bounds[i]);
+    io_uring_cqe_seen(&run->ring, cqe);
+    run->inflight--;
 
     return 1;
 }
 
-/* decompress the block.  must have lzx_mutex. */
-static Int64 _chm_decompress_block(struct chmFile *h,
-                                   UInt64 block,
-                                   UChar **ubuffer)
+/* queue reads of the blocks of d's run that aren't read yet, all with one
+ * system call.  blocks that don't get queued are read when they're needed */
+static void _chm_queue_run(struct chmFile *h,
+                           struct chmDecoder *d)
 {
-    UChar *cbuffer = malloc(((unsigned int)h->reset_table.block_len + 6144));
-    UInt64 cmpStart;                                    /* compressed start  */
-    Int64 cmpLen;                                       /* compressed len    */
-    int indexSlot;                                      /* cache index slot  */
-    UChar *lbuffer;                                     /* local buffer ptr  */
-    UInt32 blockAlign = (UInt32)(block % h->reset_blkcount); /* reset intvl. aln. */
-    UInt32 i;                                           /* local loop index  */
+    struct chmRun *run = &d->run;
+    int queued = 0, submitted, i;
 
-    if (cbuffer == NULL)
-        return -1;
+    for (i=0; i<run->count; i++)
+    {
+        struct io_uring_sqe *sqe;
+
+        if (run->ready[i])
+            continue;
+
+        sqe = io_uring_get_sqe(&run->ring);
+        if (sqe == NULL)
+            break;
 
-    /* let the caching system pull its weight! */
-    if (block - blockAlign <= h->lzx_last_block  &&
-        block              >= h->lzx_last_block)
-        blockAlign = (block - h->lzx_last_block);
+        io_uring_prep_read(sqe, h->fd,
+                           d->cbuffer + (run->bounds[i] - run->bounds[0]),
+                           (unsigned int)(run->bounds[i + 1] - run->bounds[i]),
+                           run->bounds[i]);
+        io_uring_sqe_set_data(sqe, (void *)(uintptr_t)i);
+        run->ready[i] = -1;
+        queued++;
+    }
+
+    if (queued == 0)
+        return;
 
-    /* check if we need previous blocks */
-    if (blockAlign != 0)
+    submitted = io_uring_submit(&run->ring);
+    CHM_STAT_ADD(CHM_STAT_SYSCALLS, 1);
+    run->inflight = submitted > 0 ? submitted : 0;
+
+    /* the kernel took only some of them (or none): let those complete,
+     * then give up on the ring and read the plain way from now on */
+    if (submitted != queued)
     {
-        /* fetch all required previous blocks since last reset */
-        for (i = blockAlign; i > 0; i--)
+        while (_chm_wait_run(run))
+            ;
+        if (run->inflight == 0)
         {
-            UInt32 curBlockIdx = block - i;
+            io_uring_queue_exit(&run->ring);
+            run->ring_ok = 0;
+        }
+        for (i=0; i<run->count; i++)
+            if (run->ready[i] < 0)
+                run->ready[i] = 0;
+    }
+}
+#endif
 
-            /* check if we most recently decompressed the previous block */
-            if (h->lzx_last_block != curBlockIdx)
-            {
-                if ((curBlockIdx % h->reset_blkcount) == 0)
-                {
-#ifdef CHM_DEBUG
-                    fprintf(stderr, "***RESET (1)***\n");
+/* with CHM_ACCESS_SEQUENTIAL, ask the kernel to start reading the compressed
+ * data past end (where the run we're starting ends), so it's there by the time
+ * we get to it */
+static void _chm_advise_readahead(struct chmFile *h,
+                                  UInt64 end)
+{
+#ifdef POSIX_FADV_WILLNEED
+    UInt64 from = end;
+    UInt64 to = end + CHM_READAHEAD_BYTES;
+    UInt64 sectionEnd = h->data_offset + h->cn_unit.start + h->reset_table.compressed_len;
+
+    if (to > sectionEnd)
+        to = sectionEnd;
+
+    /* only what we haven't asked for already, unless we've gone back */
+    CHM_ACQUIRE_LOCK(h->mutex);
+    if (h->access_pattern != CHM_ACCESS_SEQUENTIAL)
+        to = from;
+    else if (h->readahead_end > from  &&  h->readahead_end <= to)
+        from = h->readahead_end;
+    if (from < to)
+        h->readahead_end = to;
+    CHM_RELEASE_LOCK(h->mutex);
+
+    if (from < to)
+    {
+        posix_fadvise(h->fd, (off_t)from, (off_t)(to - from), POSIX_FADV_WILLNEED);
+        CHM_STAT_ADD(CHM_STAT_SYSCALLS, 1);
+    }
+#else
+    (void)h;
+    (void)end;
 #endif
-                    LZXreset(h->lzx_state);
-                }
+}
 
-                indexSlot = (int)((curBlockIdx) % h->cache_num_blocks);
-                if (! h->cache_blocks[indexSlot])
-                    h->cache_blocks[indexSlot] = (UChar *)malloc((unsigned int)(h->reset_table.block_len));
-                if (! h->cache_blocks[indexSlot])
-                {
-                    free(cbuffer);
-                    return -1;
-                }
-                h->cache_block_indices[indexSlot] = curBlockIdx;
-                lbuffer = h->cache_blocks[indexSlot];
+/* make the blocks first..last (as many of them as fit in a run) d's run, and
+ * start reading them.  going through the archive in order, the run's as long
+ * as it gets regardless, as the next reads will want the blocks after last.
+ * return 0 on failure */
+static int _chm_start_run(struct chmFile *h,
+                          struct chmDecoder *d,
+                          UInt64 first,
+                          UInt64 last)
+{
+    struct chmRun *run = &d->run;
+    UInt64 len;
+    int count, i, pattern;
 
-                /* decompress the previous block */
-#ifdef CHM_DEBUG
-                fprintf(stderr, "Decompressing block #%4d (EXTRA)\n", curBlockIdx);
-#endif
-                if (!_chm_get_cmpblock_bounds(h, curBlockIdx, &cmpStart, &cmpLen) ||
-                    cmpLen < 0                                                    ||
-                    cmpLen > h->reset_table.block_len + 6144                      ||
-                    _chm_fetch_bytes(h, cbuffer, cmpStart, cmpLen) != cmpLen      ||
-                    LZXdecompress(h->lzx_state, cbuffer, lbuffer, (int)cmpLen,
-                                  (int)h->reset_table.block_len) != DECR_OK)
-                {
-#ifdef CHM_DEBUG
-                    fprintf(stderr, "   (DECOMPRESS FAILED!)\n");
+    if (first >= h->reset_table.block_count)
+        return 0;
+
+    /* chm_set_param() may be changing it from another thread */
+    CHM_ACQUIRE_LOCK(h->mutex);
+    pattern = h->access_pattern;
+    CHM_RELEASE_LOCK(h->mutex);
+
+    if (pattern == CHM_ACCESS_SEQUENTIAL)
+        last = first + CHM_MAX_RUN_BLOCKS - 1;
+    if (last >= h->reset_table.block_count)
+        last = h->reset_table.block_count - 1;
+    count = last - first < CHM_MAX_RUN_BLOCKS ? (int)(last - first + 1) : CHM_MAX_RUN_BLOCKS;
+
+    if (!_chm_get_run_bounds(h, first, count, run->bounds))
+        return 0;
+
+    len = run->bounds[count] - run->bounds[0];
+    if (len > d->cbuffer_len)
+    {
+        UChar *cbuffer = (UChar *)realloc(d->cbuffer, (size_t)len);
+
+        if (cbuffer == NULL)
+            return 0;
+        d->cbuffer = cbuffer;
+        d->cbuffer_len = len;
+    }
+
+    run->first = first;
+    run->count = count;
+    for (i=0; i<count; i++)
+        run->ready[i] = (run->bounds[i + 1] == run->bounds[i]);
+
+    _chm_advise_readahead(h, run->bounds[count]);
+
+#ifdef CHM_USE_IO_URING
+    if (run->ring_ok)
+    {
+        _chm_queue_run(h, d);
+        return 1;
+    }
 #endif
-                    free(cbuffer);
-                    return (Int64)0;
-                }
 
-                h->lzx_last_block = (int)curBlockIdx;
-            }
-        }
+    /* the blocks are back to back in the file: read them all at once */
+    if (len > 0  &&  _chm_fetch_bytes(h, d->cbuffer, run->bounds[0], (Int64)len) != (Int64)len)
+    {
+        run->count = 0;
+        return 0;
     }
-    else
+    for (i=0; i<count; i++)
+        run->ready[i] = 1;
+
+    return 1;
+}
+
+/* get the compressed data of block, which must be part of d's run, waiting
+ * for it to be read if need be.  return NULL on failure */
+static UChar *_chm_get_run_block(struct chmFile *h,
+                                 struct chmDecoder *d,
+                                 UInt64 block,
+                                 Int64 *len)
+{
+    struct chmRun *run = &d->run;
+    int i = (int)(block - run->first);
+    UChar *data = d->cbuffer + (run->bounds[i] - run->bounds[0]);
+
+    *len = (Int64)(run->bounds[i + 1] - run->bounds[i]);
+
+#ifdef CHM_USE_IO_URING
+    while (run->ready[i] < 0  &&  _chm_wait_run(run))
+        ;
+#endif
+
+    if (run->ready[i] == 0)
     {
-        if ((block % h->reset_blkcount) == 0)
+        if (_chm_fetch_bytes(h, data, run->bounds[i], *len) != *len)
+            return NULL;
+        run->ready[i] = 1;
+    }
+
+    return run->ready[i] > 0 ? data : NULL;
+}
+
+/* done with d's run: wait for whatever reads of it are still queued, so that
+ * cbuffer can be reused */
+static void _chm_end_run(struct chmDecoder *d)
+{
+#ifdef CHM_USE_IO_URING
+    struct chmRun *run = &d->run;
+
+    while (run->inflight > 0)
+    {
+        if (!_chm_wait_run(run))
         {
-#ifdef CHM_DEBUG
-            fprintf(stderr, "***RESET (2)***\n");
+            /* the kernel may still write to cbuffer: leave it (and the ring)
+             * alone, rather than having it scribble over somebody else */
+            d->cbuffer = NULL;
+            d->cbuffer_len = 0;
+            run->ring_ok = 0;
+            run->inflight = 0;
+        }
+    }
 #endif
-            LZXreset(h->lzx_state);
+    d->run.count = 0;
+}
+
+/* copy the part of block (decompressed into data) that overlaps region */
+static void _chm_copy_to_region(struct chmFile *h,
+                                UInt64 block,
+                                const UChar *data,
+                                const struct chmRegion *region)
+{
+    UInt64 blockStart = block * h->reset_table.block_len;
+    UInt64 from = blockStart > region->start ? blockStart : region->start;
+    UInt64 to = blockStart + h->reset_table.block_len;
+
+    if (to > region->start + region->len)
+        to = region->start + region->len;
+    if (from < to)
+        memcpy(region->buf + (from - region->start), data + (from - blockStart), (size_t)(to - from));
+}
+
+/* copy part of a block out of the cache.  return 0 if it isn't cached */
+static int _chm_get_cached_block(struct chmFile *h,
+                                 UInt64 block,
+                                 UChar *buf,
+                                 UInt64 offset,
+                                 UInt64 len)
+{
+    struct chmCacheShard *shard = &h->cache[block % CHM_CACHE_SHARDS];
+    int found = 0;
+    int slot;
+
+    CHM_ACQUIRE_LOCK(shard->mutex);
+    slot = (int)((block / CHM_CACHE_SHARDS) % shard->num_blocks);
+    if (shard->indices[slot] == block  &&  shard->blocks[slot] != NULL)
+    {
+        memcpy(buf, shard->blocks[slot]->data + offset, (unsigned int)len);
+        found = 1;
+    }
+    CHM_RELEASE_LOCK(shard->mutex);
+
+    return found;
+}
+
+/* return 1 if block is cached */
+static int _chm_is_cached_block(struct chmFile *h,
+                                UInt64 block)
+{
+    struct chmCacheShard *shard = &h->cache[block % CHM_CACHE_SHARDS];
+    int found;
+    int slot;
+
+    CHM_ACQUIRE_LOCK(shard->mutex);
+    slot = (int)((block / CHM_CACHE_SHARDS) % shard->num_blocks);
+    found = shard->indices[slot] == block  &&  shard->blocks[slot] != NULL;
+    CHM_RELEASE_LOCK(shard->mutex);
+
+    return found;
+}
+
+/* pin a cached block, return NULL if it isn't cached */
+static struct chmBlock *_chm_pin_cached_block(struct chmFile *h,
+                                              UInt64 block)
+{
+    struct chmCacheShard *shard = &h->cache[block % CHM_CACHE_SHARDS];
+    struct chmBlock *pinned = NULL;
+    int slot;
+
+    CHM_ACQUIRE_LOCK(shard->mutex);
+    slot = (int)((block / CHM_CACHE_SHARDS) % shard->num_blocks);
+    if (shard->indices[slot] == block  &&  shard->blocks[slot] != NULL)
+    {
+        pinned = shard->blocks[slot];
+        pinned->refs++;
+    }
+    CHM_RELEASE_LOCK(shard->mutex);
+
+    return pinned;
+}
+
+/* put a freshly decompressed block in the cache.  if pin is set, return it
+ * with an extra reference for the caller */
+static struct chmBlock *_chm_put_cached_block(struct chmFile *h,
+                                              UInt64 block,
+                                              const UChar *ubuffer,
+                                              int pin)
+{
+    struct chmCacheShard *shard = &h->cache[block % CHM_CACHE_SHARDS];
+    struct chmBlock *pinned = NULL;
+    int slot;
+
+    CHM_ACQUIRE_LOCK(shard->mutex);
+    slot = (int)((block / CHM_CACHE_SHARDS) % shard->num_blocks);
+
+    /* somebody's still reading the block in this slot, leave it to them */
+    if (shard->blocks[slot]  &&  shard->blocks[slot]->refs > 1)
+    {
+        _chm_unref_block(shard->blocks[slot]);
+        shard->blocks[slot] = NULL;
+    }
+    if (! shard->blocks[slot])
+        shard->blocks[slot] = _chm_new_block(h->reset_table.block_len);
+    if (shard->blocks[slot])
+    {
+        memcpy(shard->blocks[slot]->data, ubuffer, (unsigned int)h->reset_table.block_len);
+        shard->indices[slot] = block;
+        if (pin)
+        {
+            pinned = shard->blocks[slot];
+            pinned->refs++;
         }
     }
+    CHM_RELEASE_LOCK(shard->mutex);
+
+    return pinned;
+}
+
+/* how well suited d is to decompress block: 2 if it's part way through the
+ * block's reset interval, 1 if it has the block's compressed data read already
+ * (but would have to start the interval over), 0 otherwise */
+static int _chm_rate_decoder(struct chmFile *h,
+                             struct chmDecoder *d,
+                             UInt64 block)
+{
+    UInt64 intervalStart = block - block % h->reset_blkcount;
+
+    if (d->last_block >= 0                        &&
+        (UInt64)d->last_block >= intervalStart    &&
+        (UInt64)d->last_block <  block)
+        return 2;
+
+    if (d->run.count > 0                          &&
+        block >= d->run.first                     &&
+        block <  d->run.first + d->run.count)
+        return 1;
+
+    return 0;
+}
+
+/* get a decompressor for block, preferably one that's already part way through
+ * its reset interval, or at least has the block read.  waits if they're all
+ * busy.  return NULL on failure */
+static struct chmDecoder *_chm_acquire_decoder(struct chmFile *h,
+                                               UInt64 block)
+{
+    struct chmDecoder *best = NULL;
+    int bestRating = 0;
+    int i;
 
-    /* allocate slot in cache */
-    indexSlot = (int)(block % h->cache_num_blocks);
-    if (! h->cache_blocks[indexSlot])
-        h->cache_blocks[indexSlot] = (UChar *)malloc(((unsigned int)h->reset_table.block_len));
-    if (! h->cache_blocks[indexSlot])
+    CHM_ACQUIRE_LOCK(h->lzx_mutex);
+    for (;;)
     {
-        free(cbuffer);
-        return -1;
+        for (i=0; i<h->num_decoders; i++)
+        {
+            struct chmDecoder *d = &h->decoders[i];
+            int rating;
+
+            if (d->busy)
+                continue;
+
+            rating = _chm_rate_decoder(h, d, block);
+            if (best == NULL  ||  rating > bestRating  ||
+                (rating == 2  &&  bestRating == 2  &&  best->last_block < d->last_block))
+            {
+                best = d;
+                bestRating = rating;
+            }
+        }
+
+        /* nobody's on the way to this block: rather than resetting an idle
+         * decompressor that's midway through another interval, start a new one */
+        if ((best == NULL  ||  bestRating == 0)  &&  h->num_decoders < CHM_MAX_DECODERS)
+        {
+            struct chmDecoder *d = &h->decoders[h->num_decoders];
+
+            d->state = LZXinit(ffs(h->window_size) - 1);
+            d->ubuffer = (UChar *)malloc((unsigned int)h->reset_table.block_len);
+            d->cbuffer = (UChar *)malloc((unsigned int)h->reset_table.block_len + 6144);
+            d->cbuffer_len = h->reset_table.block_len + 6144;
+            d->run.count = 0;
+            d->last_block = -1;
+            d->busy = 0;
+
+            if (d->state  &&  d->ubuffer  &&  d->cbuffer)
+            {
+#ifdef CHM_USE_IO_URING
+                /* no io_uring here (too old a kernel, or not allowed to use
+                 * it): the run gets read the plain way */
+                d->run.ring_ok = io_uring_queue_init(CHM_MAX_RUN_BLOCKS, &d->run.ring, 0) == 0;
+                d->run.inflight = 0;
+#endif
+                h->num_decoders++;
+                best = d;
+            }
+            else
+            {
+                if (d->state)
+                    LZXteardown(d->state);
+                free(d->ubuffer);
+                free(d->cbuffer);
+                if (best == NULL  &&  h->num_decoders == 0)
+                    break;
+            }
+        }
+
+        if (best != NULL)
+            break;
+
+#ifdef CHM_MT
+        CHM_WAIT_COND(h->lzx_cond, h->lzx_mutex);
+#endif
     }
-    h->cache_block_indices[indexSlot] = block;
-    lbuffer = h->cache_blocks[indexSlot];
-    *ubuffer = lbuffer;
 
-    /* decompress the block we actually want */
-#ifdef CHM_DEBUG
-    fprintf(stderr, "Decompressing block #%4d (REAL )\n", block);
+    if (best != NULL)
+        best->busy = 1;
+    CHM_RELEASE_LOCK(h->lzx_mutex);
+
+    return best;
+}
+
+static void _chm_release_decoder(struct chmFile *h,
+                                 struct chmDecoder *d)
+{
+#ifndef CHM_MT
+    (void)h;
+#endif
+    CHM_ACQUIRE_LOCK(h->lzx_mutex);
+    d->busy = 0;
+#ifdef CHM_MT
+    CHM_SIGNAL_COND(h->lzx_cond);
 #endif
-    if (! _chm_get_cmpblock_bounds(h, block, &cmpStart, &cmpLen)          ||
-        _chm_fetch_bytes(h, cbuffer, cmpStart, cmpLen) != cmpLen          ||
-        LZXdecompress(h->lzx_state, cbuffer, lbuffer, (int)cmpLen,
-                      (int)h->reset_table.block_len) != DECR_OK)
+    CHM_RELEASE_LOCK(h->lzx_mutex);
+}
+
+/* decompress blocks block..last, caching them all and copying whatever overlaps
+ * region (if it isn't NULL) out of them.  must own d.  if pinned isn't NULL, it
+ * receives the cached copy of block, pinned.  return how many blocks from block
+ * on got decompressed */
+static UInt64 _chm_do_decompress_blocks(struct chmFile *h,
+                                        UInt64 block,
+                                        UInt64 last,
+                                        struct chmDecoder *d,
+                                        struct chmBlock **pinned,
+                                        const struct chmRegion *region)
+{
+    UChar *cmpData;                                     /* compressed data   */
+    Int64 cmpLen;                                       /* compressed len    */
+    UInt64 curBlockIdx;                                 /* local loop index  */
+    UInt64 done = 0;
+
+    /* let the caching system pull its weight: go on from where this
+     * decompressor stopped if that's in the same reset interval,
+     * otherwise start over from the beginning of the interval */
+    curBlockIdx = block - block % h->reset_blkcount;
+    if (d->last_block >= 0                      &&
+        (UInt64)d->last_block >= curBlockIdx    &&
+        (UInt64)d->last_block <  block)
+        curBlockIdx = (UInt64)d->last_block + 1;
+
+    for (; curBlockIdx <= last; curBlockIdx++)
     {
+        /* read the compressed blocks ahead, a run at a time, so reading the
+         * ones further down the run overlaps with decompressing this one.
+         * the run outlives the call: the next one is likely to pick up where
+         * this one leaves off */
+        if (d->run.count == 0                   ||
+            curBlockIdx <  d->run.first         ||
+            curBlockIdx >= d->run.first + d->run.count)
+        {
+            _chm_end_run(d);
+            if (!_chm_start_run(h, d, curBlockIdx, last))
+            {
+                d->last_block = -1;
+                return done;
+            }
+        }
+
+        if ((curBlockIdx % h->reset_blkcount) == 0)
+        {
 #ifdef CHM_DEBUG
-        fprintf(stderr, "   (DECOMPRESS FAILED!)\n");
+            fprintf(stderr, "***RESET***\n");
 #endif
-        free(cbuffer);
-        return (Int64)0;
+            LZXreset(d->state);
+        }
+
+#ifdef CHM_DEBUG
+        fprintf(stderr, "Decompressing block #%4d (%s)\n", (int)curBlockIdx,
+                curBlockIdx >= block ? "REAL " : "EXTRA");
+#endif
+        if ((cmpData = _chm_get_run_block(h, d, curBlockIdx, &cmpLen)) == NULL ||
+            LZXdecompress(d->state, cmpData, d->ubuffer, (int)cmpLen,
+                          (int)h->reset_table.block_len) != DECR_OK)
+        {
+#ifdef CHM_DEBUG
+            fprintf(stderr, "   (DECOMPRESS FAILED!)\n");
+#endif
+            /* the LZX state is garbage now, start over next time */
+            d->last_block = -1;
+            _chm_end_run(d);
+            return done;
+        }
+
+        d->last_block = (int)curBlockIdx;
+        CHM_STAT_ADD(CHM_STAT_BLOCKS_DECOMPRESSED, 1);
+        CHM_STAT_ADD(CHM_STAT_BYTES_INFLATED, h->reset_table.block_len);
+        if (curBlockIdx == block  &&  pinned != NULL)
+            *pinned = _chm_put_cached_block(h, curBlockIdx, d->ubuffer, 1);
+        else
+            _chm_put_cached_block(h, curBlockIdx, d->ubuffer, 0);
+
+        if (curBlockIdx >= block)
+        {
+            if (region != NULL)
+                _chm_copy_to_region(h, curBlockIdx, d->ubuffer, region);
+            done++;
+        }
     }
-    h->lzx_last_block = (int)block;
 
     /* XXX: modify LZX routines to return the length of the data they
-     * decompressed and return that instead, for an extra sanity check.
+     * decompressed and use that instead, for an extra sanity check.
      */
-    free(cbuffer);
-    return h->reset_table.block_len;
+    return done;
 }
 
-/* grab a region from a compressed block */
+static UInt64 _chm_decompress_blocks(struct chmFile *h,
+                                     UInt64 block,
+                                     UInt64 last,
+                                     struct chmDecoder *d,
+                                     struct chmBlock **pinned,
+                                     const struct chmRegion *region)
+{
+    UInt64 rv;
+
+    CHM_TRACE("_chm_decompress_blocks", 1);
+    rv = _chm_do_decompress_blocks(h, block, last, d, pinned, region);
+    CHM_TRACE("_chm_decompress_blocks", 0);
+
+    return rv;
+}
+
+/* grab a region from the compressed blocks */
 static Int64 _chm_decompress_region(struct chmFile *h,
                                     UChar *buf,
                                     UInt64 start,
@@ -1512,7 +2446,9 @@ static Int64 _chm_decompress_region(struct chmFile *h,
     UInt64 nBlock, nOffset;
     UInt64 nLen;
     UInt64 gotLen;
-    UChar *ubuffer;
+    UInt64 lastBlock, endBlock;
+    struct chmDecoder *d;
+    struct chmRegion region;
 
     if (len <= 0)
         return (Int64)0;
@@ -1525,35 +2461,45 @@ static Int64 _chm_decompress_region(struct chmFile *h,
         nLen = h->reset_table.block_len - nOffset;
 
     /* if block is cached, return data from it. */
-    CHM_ACQUIRE_LOCK(h->lzx_mutex);
-    CHM_ACQUIRE_LOCK(h->cache_mutex);
-    if (h->cache_block_indices[nBlock % h->cache_num_blocks] == nBlock    &&
-        h->cache_blocks[nBlock % h->cache_num_blocks] != NULL)
+    if (_chm_get_cached_block(h, nBlock, buf, nOffset, nLen))
     {
-        memcpy(buf,
-               h->cache_blocks[nBlock % h->cache_num_blocks] + nOffset,
-               (unsigned int)nLen);
-        CHM_RELEASE_LOCK(h->cache_mutex);
-        CHM_RELEASE_LOCK(h->lzx_mutex);
+        CHM_STAT_ADD(CHM_STAT_CACHE_HITS, 1);
         return nLen;
     }
-    CHM_RELEASE_LOCK(h->cache_mutex);
+    CHM_STAT_ADD(CHM_STAT_CACHE_MISSES, 1);
 
     /* data request not satisfied, so... start up the decompressor machine */
-    if (! h->lzx_state)
+    d = _chm_acquire_decoder(h, nBlock);
+    if (d == NULL)
+        return (Int64)0;
+
+    /* somebody else might have decompressed it while we were waiting */
+    if (_chm_get_cached_block(h, nBlock, buf, nOffset, nLen))
     {
-        int window_size = ffs(h->window_size) - 1;
-        h->lzx_last_block = -1;
-        h->lzx_state = LZXinit(window_size);
+        _chm_release_decoder(h, d);
+        return nLen;
     }
 
-    /* decompress some data */
-    gotLen = _chm_decompress_block(h, nBlock, &ubuffer);
-    if (gotLen < nLen)
-        nLen = gotLen;
-    memcpy(buf, ubuffer+nOffset, (unsigned int)nLen);
-    CHM_RELEASE_LOCK(h->lzx_mutex);
-    return nLen;
+    /* decompress as much of the rest of the region as fits in a run along
+     * with this block, stopping short of blocks that are cached already.
+     * the decompressor goes back to the others in between runs */
+    endBlock = (start + len - 1) / h->reset_table.block_len;
+    lastBlock = nBlock;
+    while (lastBlock < endBlock                          &&
+           lastBlock - nBlock + 1 < CHM_MAX_RUN_BLOCKS   &&
+           !_chm_is_cached_block(h, lastBlock + 1))
+        lastBlock++;
+
+    region.buf = buf;
+    region.start = start;
+    region.len = len;
+    gotLen = _chm_decompress_blocks(h, nBlock, lastBlock, d, NULL, &region) * h->reset_table.block_len;
+    _chm_release_decoder(h, d);
+
+    if (gotLen <= nOffset)
+        return (Int64)0;
+    gotLen -= nOffset;
+    return gotLen < (UInt64)len ? (Int64)gotLen : len;
 }
 
 /* retrieve (part of) an object */
@@ -1615,6 +2561,126 @@ LONGINT64 chm_retrieve_object(struct chmFile *h,
     }
 }
 
+/* pin (part of) an object, without copying it if it's compressed */
+LONGINT64 chm_retrieve_span(struct chmFile *h,
+                            struct chmUnitInfo *ui,
+                            LONGUINT64 addr,
+                            LONGINT64 len,
+                            struct chmSpan *span)
+{
+    UInt64 start, nBlock, nOffset;
+    struct chmBlock *block = NULL;
+
+    span->data = NULL;
+    span->len = 0;
+    span->pin = NULL;
+    span->block = 0;
+
+    /* must be valid file handle */
+    if (h == NULL)
+        return (Int64)0;
+
+    /* starting address must be in correct range */
+    if (addr >= ui->length  ||  len <= 0)
+        return (Int64)0;
+
+    /* clip length */
+    if (addr + len > ui->length)
+        len = ui->length - addr;
+
+    /* if the file is uncompressed, read it into a private block */
+    if (ui->space == CHM_UNCOMPRESSED)
+    {
+        if (len > CHM_MAX_UNCOMPRESSED_SPAN)
+            len = CHM_MAX_UNCOMPRESSED_SPAN;
+
+        block = _chm_new_block(len);
+        if (block == NULL)
+            return (Int64)0;
+
+        len = _chm_fetch_bytes(h,
+                               block->data,
+                               (UInt64)h->data_offset + (UInt64)ui->start + (UInt64)addr,
+                               len);
+        if (len <= 0)
+        {
+            _chm_unref_block(block);
+            return (Int64)0;
+        }
+
+        span->data = block->data;
+        span->len = len;
+        span->pin = block;
+        span->block = (LONGUINT64)-1;
+        return len;
+    }
+
+    /* if compression is not enabled for this file... */
+    if (! h->compression_enabled)
+        return (Int64)0;
+
+    start = ui->start + addr;
+    nBlock = start / h->reset_table.block_len;
+    nOffset = start % h->reset_table.block_len;
+    if ((UInt64)len > h->reset_table.block_len - nOffset)
+        len = h->reset_table.block_len - nOffset;
+
+    block = _chm_pin_cached_block(h, nBlock);
+    CHM_STAT_ADD(block != NULL ? CHM_STAT_CACHE_HITS : CHM_STAT_CACHE_MISSES, 1);
+    if (block == NULL)
+    {
+        struct chmDecoder *d = _chm_acquire_decoder(h, nBlock);
+
+        if (d == NULL)
+            return (Int64)0;
+
+        /* somebody else might have decompressed it while we were waiting */
+        block = _chm_pin_cached_block(h, nBlock);
+        if (block == NULL)
+            _chm_decompress_blocks(h, nBlock, nBlock, d, &block, NULL);
+        _chm_release_decoder(h, d);
+
+        if (block == NULL)
+            return (Int64)0;
+    }
+
+    span->data = block->data + nOffset;
+    span->len = len;
+    span->pin = block;
+    span->block = nBlock;
+    return len;
+}
+
+/* unpin a span */
+void chm_release_span(struct chmFile *h,
+                      struct chmSpan *span)
+{
+    struct chmBlock *block = (struct chmBlock *)span->pin;
+
+    if (block == NULL)
+        return;
+
+    if (span->block == (LONGUINT64)-1)
+        _chm_unref_block(block);
+    else
+    {
+#ifdef CHM_MT
+        struct chmCacheShard *shard = &h->cache[span->block % CHM_CACHE_SHARDS];
+
+        CHM_ACQUIRE_LOCK(shard->mutex);
+        _chm_unref_block(block);
+        CHM_RELEASE_LOCK(shard->mutex);
+#else
+        (void)h;
+        _chm_unref_block(block);
+#endif
+    }
+
+    span->data = NULL;
+    span->len = 0;
+    span->pin = NULL;
+}
+
 /* enumerate the objects in the .chm archive */
 int chm_enumerate(struct chmFile *h,
                   int what,
@@ -1622,6 +2688,7 @@ int chm_enumerate(struct chmFile *h,
                   void *context)
 {
     Int32 curPage;
+    UInt32 pages;
 
     /* buffer to hold whatever page we're looking at */
     /* RWE 6/12/2003 */
@@ -1643,15 +2710,13 @@ int chm_enumerate(struct chmFile *h,
     /* starting page */
     curPage = h->index_head;
 
-    /* until we have either returned or given up */
-    while (curPage != -1)
+    /* until we have either returned or given up.  the chain of leaf pages
+     * can't be longer than the directory, unless it goes round in circles */
+    for (pages = 0; curPage != -1  &&  pages < h->num_blocks; pages++)
     {
 
         /* try to fetch the index page */
-        if (_chm_fetch_bytes(h,
-                             page_buf,
-                             (UInt64)h->dir_offset + (UInt64)curPage*h->block_len,
-                             h->block_len) != h->block_len)
+        if (! _chm_fetch_dir_page(h, page_buf, curPage))
         {
             free(page_buf);
             return 0;
@@ -1660,24 +2725,28 @@ int chm_enumerate(struct chmFile *h,
         /* figure out start and end for this page */
         cur = page_buf;
         lenRemain = _CHM_PMGL_LEN;
-        if (! _unmarshal_pmgl_header(&cur, &lenRemain, &header))
+        if (! _unmarshal_pmgl_header(&cur, &lenRemain, &header)  ||
+            (end = _chm_dir_page_end(page_buf, h->block_len, _CHM_PMGL_LEN, header.free_space)) == NULL)
         {
             free(page_buf);
             return 0;
         }
-        end = page_buf + h->block_len - (header.free_space);
 
         /* loop over this page */
         while (cur < end)
         {
             ui.flags = 0;
 
-            if (! _chm_parse_PMGL_entry(&cur, &ui))
+            if (! _chm_parse_PMGL_entry(&cur, end, &ui))
             {
                 free(page_buf);
                 return 0;
             }
 
+            /* nameless entries are garbage, and would trip up the checks below */
+            if (ui.path[0] == '\0')
+                continue;
+
             /* get the length of the path */
             ui_path_len = strlen(ui.path)-1;
 
@@ -1746,6 +2815,7 @@ int chm_enumerate_dir(struct chmFile *h,
      */
 
     Int32 curPage;
+    UInt32 pages;
 
     /* buffer to hold whatever page we're looking at */
     /* RWE 6/12/2003 */
@@ -1792,15 +2862,13 @@ int chm_enumerate_dir(struct chmFile *h,
     lastPath[0] = '\0';
     lastPathLen = -1;
 
-    /* until we have either returned or given up */
-    while (curPage != -1)
+    /* until we have either returned or given up.  the chain of leaf pages
+     * can't be longer than the directory, unless it goes round in circles */
+    for (pages = 0; curPage != -1  &&  pages < h->num_blocks; pages++)
     {
 
         /* try to fetch the index page */
-        if (_chm_fetch_bytes(h,
-                             page_buf,
-                             (UInt64)h->dir_offset + (UInt64)curPage*h->block_len,
-                             h->block_len) != h->block_len)
+        if (! _chm_fetch_dir_page(h, page_buf, curPage))
         {
             free(page_buf);
             return 0;
@@ -1809,24 +2877,28 @@ int chm_enumerate_dir(struct chmFile *h,
         /* figure out start and end for this page */
         cur = page_buf;
         lenRemain = _CHM_PMGL_LEN;
-        if (! _unmarshal_pmgl_header(&cur, &lenRemain, &header))
+        if (! _unmarshal_pmgl_header(&cur, &lenRemain, &header)  ||
+            (end = _chm_dir_page_end(page_buf, h->block_len, _CHM_PMGL_LEN, header.free_space)) == NULL)
         {
             free(page_buf);
             return 0;
         }
-        end = page_buf + h->block_len - (header.free_space);
 
         /* loop over this page */
         while (cur < end)
         {
             ui.flags = 0;
 
-            if (! _chm_parse_PMGL_entry(&cur, &ui))
+            if (! _chm_parse_PMGL_entry(&cur, end, &ui))
             {
                 free(page_buf);
                 return 0;
             }
 
+            /* nameless entries are garbage, and would trip up the checks below */
+            if (ui.path[0] == '\0')
+                continue;
+
             /* check if we should start */
             if (! it_has_begun)
             {
@@ -21,66 +21,72 @@
 */
 
 #include <chmapp.h>
+#include <chmbench.h>
 #include <chmfile.h>
 #include <chmframe.h>
 #include <chmfshandler.h>
+#include <chmrpcserver.h>
+#include <chmserver.h>
+#include <chmstats.h>
+#include <chmtrace.h>
+#include <csignal>
+#include <cstring>
 #include <wx/config.h>
 #include <wx/filefn.h>
 #include <wx/fs_inet.h>
 #include <wx/fs_mem.h>
 #include <wx/image.h>
 #include <wx/stdpaths.h>
-#include <wxstringutils.h>
+#include <wx/utils.h>
 
 #ifdef __WXMAC__
 #include <ApplicationServices/ApplicationServices.h>
 #endif
 
-#ifdef WITH_LIBXMLRPC
-
-constexpr int TIMER_ID {wxID_HIGHEST + 1};
+namespace {
 
-XmlRpc::XmlRpcServer& getXmlRpcServer()
+void DumpStats()
 {
-    static XmlRpc::XmlRpcServer s;
-    return s;
+    wxFprintf(stderr, wxT("%s"), CHMStats::Report());
 }
 
-CHMApp::CHMApp() : XmlRpc::XmlRpcServerMethod("xCHM", &getXmlRpcServer())
+// --trace=<file> wins over XCHM_TRACE=<file>.
+void StartTracing(const wxCmdLineParser& parser)
 {
+    wxString file;
+
+    if (!parser.Found(wxT("trace"), &file))
+        wxGetEnv(wxT("XCHM_TRACE"), &file);
+
+    if (!file.IsEmpty())
+        CHMTrace::Enable(file);
 }
 
-void CHMApp::execute(XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result)
+void StopTracing()
 {
-    using namespace XmlRpc;
-
-    result = false;
+    if (CHMTrace::Enabled() && !CHMTrace::Write())
+        wxFprintf(stderr, wxT("xchm: can't write the trace file\n"));
+}
 
-    if (params.size() > 0 && params[0].getType() == XmlRpcValue::TypeInt)
-        switch (static_cast<int>(params[0])) {
+} // end of anonymous namespace
 
-        case 0: // we want to shut everything down!
-            ExitMainLoop();
-            result = true;
-            break;
+#ifdef WITH_LIBXMLRPC
+CHMApp::~CHMApp() = default;
+#endif
 
-        case 1:
-            if (params.size() == 2 && params[1].getType() == XmlRpcValue::TypeString)
-                result = _frame->LoadCHM(CURRENT_CHAR_STRING(std::string(params[1]).c_str()));
+int CHMApp::OnExit()
+{
+#ifdef WITH_LIBXMLRPC
+    // Still around if the main loop was exited without closing the frame (an XMLRPC shutdown request).
+    _rpcServer.reset();
+#endif
+    if (_dumpStats)
+        DumpStats();
 
-            if (params.size() == 3 && params[1].getType() == XmlRpcValue::TypeString
-                && params[2].getType() == XmlRpcValue::TypeInt)
-                result = _frame->LoadCHM(CURRENT_CHAR_STRING(std::string(params[1]).c_str()))
-                    && _frame->LoadContextID(static_cast<int>(params[2]));
-            break;
+    StopTracing();
 
-        case 2:
-            if (params.size() == 2 && params[1].getType() == XmlRpcValue::TypeInt)
-                result = _frame->LoadContextID(static_cast<int>(params[1]));
-            break;
-        }
+    return wxApp::OnExit();
 }
-#endif
 
 bool CHMApp::OnInit()
 {
@@ -100,14 +106,25 @@ bool CHMApp::OnInit()
     _cmdLP.AddOption(wxT("x"), wxT("xmlrpc"), wxT("starts xCHM in XML-RPC server mode listening on port <num>"),
                      wxCMD_LINE_VAL_NUMBER);
 #endif
+#ifndef __WXMSW__
+    // Only here for the usage message, main() hands --serve over to CHMServerApp.
+    _cmdLP.AddLongOption(wxT("serve"), wxT("serves file, or the .chm files in a directory, over HTTP on port <num>"),
+                         wxCMD_LINE_VAL_NUMBER);
+    _cmdLP.AddLongSwitch(wxT("bench"), wxT("benchmarks file, printing the results as JSON"));
+#endif
 
     _cmdLP.AddSwitch(wxT("t"), wxT("notopics"), wxT("don't load the topics tree"));
     _cmdLP.AddSwitch(wxT("i"), wxT("noindex"), wxT("don't load the index"));
+    _cmdLP.AddLongSwitch(wxT("stats"), wxT("prints performance counters to stderr on exit"));
+    _cmdLP.AddLongOption(wxT("trace"), wxT("records a timeline, written to <str> on exit (also XCHM_TRACE=<str>)"));
     _cmdLP.AddSwitch(wxT("h"), wxT("help"), wxT("displays this message."), wxCMD_LINE_OPTION_HELP);
 
     if (_cmdLP.Parse() != 0) // 0 means everything is ok
         return false;
 
+    _dumpStats = _cmdLP.Found(wxT("stats"));
+    StartTracing(_cmdLP);
+
     auto loadTopics = !_cmdLP.Found(wxT("notopics"));
     auto loadIndex  = !_cmdLP.Found(wxT("noindex"));
 
@@ -168,10 +185,15 @@ bool CHMApp::OnInit()
 
 #ifdef WITH_LIBXMLRPC
     if (port != -1L) {
-        _timer.SetOwner(this, TIMER_ID);
-        _timer.Start(100);
-        Bind(wxEVT_TIMER, &CHMApp::WatchForXMLRPC, this, TIMER_ID);
-        getXmlRpcServer().bindAndListen(port);
+        _rpcServer = std::make_unique<CHMRpcServer>(_frame);
+        _rpcServer->Start(port);
+
+        // The server calls into the frame from its own thread, so it has to be gone before the frame is. Bound
+        // after the frame's own handler, so this runs first.
+        _frame->Bind(wxEVT_CLOSE_WINDOW, [this](wxCloseEvent& event) {
+            _rpcServer.reset();
+            event.Skip();
+        });
     }
 #endif
 
@@ -220,12 +242,163 @@ void CHMApp::MacOpenFile(const wxString& filename)
 }
 #endif
 
-#ifdef WITH_LIBXMLRPC
-void CHMApp::WatchForXMLRPC(wxTimerEvent&)
+#ifndef __WXMSW__
+CHMServerApp::~CHMServerApp()
 {
-    getXmlRpcServer().work(0.0); // check for a XMLRPC message
+    if (_server)
+        _server->Stop();
+}
+
+void CHMServerApp::OnInitCmdLine(wxCmdLineParser& parser)
+{
+    parser.AddParam(wxT("file or directory"), wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption(wxT("serve"), wxT("serves file, or the .chm files in directory, over HTTP on port <num>"),
+                         wxCMD_LINE_VAL_NUMBER, wxCMD_LINE_OPTION_MANDATORY);
+    parser.AddOption(wxT("j"), wxT("threads"), wxT("handles up to <num> requests at the same time"),
+                     wxCMD_LINE_VAL_NUMBER);
+    parser.AddLongSwitch(wxT("stats"), wxT("prints performance counters to stderr on exit"));
+    parser.AddLongOption(wxT("trace"), wxT("records a timeline, written to <str> on exit (also XCHM_TRACE=<str>)"));
+    parser.AddSwitch(wxT("h"), wxT("help"), wxT("displays this message."), wxCMD_LINE_OPTION_HELP);
+}
+
+bool CHMServerApp::OnCmdLineParsed(wxCmdLineParser& parser)
+{
+    auto port = 0L, threads = 0L;
+
+    parser.Found(wxT("serve"), &port);
+    parser.Found(wxT("threads"), &threads);
+    _dumpStats = parser.Found(wxT("stats"));
+    StartTracing(parser);
+
+    if (port <= 0 || port > 65535 || threads < 0) {
+        parser.Usage();
+        return false;
+    }
+
+    // Archive paths are handed to CHMLIB as multibyte strings.
+    std::setlocale(LC_CTYPE, "");
+
+    // Clients hanging up mid-response are routine, and not a reason to die.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    SetSignalHandler(SIGINT, &CHMServerApp::OnSignal);
+    SetSignalHandler(SIGTERM, &CHMServerApp::OnSignal);
+
+    auto root = parser.GetParam(0);
+    _server   = std::make_unique<CHMServer>(root, threads);
+
+    if (!_server->ArchiveCount()) {
+        wxFprintf(stderr, wxT("xchm: no .chm files in %s\n"), root);
+        return false;
+    }
+
+    if (!_server->Start(port)) {
+        wxFprintf(stderr, wxT("xchm: can't listen on port %ld\n"), port);
+        return false;
+    }
+
+    wxPrintf(wxT("Serving %lu book(s) on http://localhost:%ld/\n"), static_cast<unsigned long>(_server->ArchiveCount()),
+             port);
+    fflush(stdout);
+
+    return true;
 }
-#endif
 
+int CHMServerApp::OnExit()
+{
+    // Only count finished requests.
+    if (_server && (_dumpStats || CHMTrace::Enabled()))
+        _server->Stop();
+
+    if (_dumpStats)
+        DumpStats();
+
+    StopTracing();
+
+    return wxAppConsole::OnExit();
+}
+
+void CHMServerApp::OnSignal(int)
+{
+    // wxWidgets calls signal handlers set this way from the main loop, not from the signal context.
+    if (wxTheApp)
+        wxTheApp->ExitMainLoop();
+}
+
+void CHMBenchApp::OnInitCmdLine(wxCmdLineParser& parser)
+{
+    parser.AddParam(wxT("file"), wxCMD_LINE_VAL_STRING);
+    parser.AddLongSwitch(wxT("bench"), wxT("benchmarks file, printing the results as JSON"));
+    parser.AddOption(wxT("n"), wxT("samples"), wxT("times <num> lookups and searches (default 1000)"),
+                     wxCMD_LINE_VAL_NUMBER);
+    parser.AddLongSwitch(wxT("stats"), wxT("prints performance counters to stderr on exit"));
+    parser.AddLongOption(wxT("trace"), wxT("records a timeline, written to <str> on exit (also XCHM_TRACE=<str>)"));
+    parser.AddSwitch(wxT("h"), wxT("help"), wxT("displays this message."), wxCMD_LINE_OPTION_HELP);
+}
+
+bool CHMBenchApp::OnCmdLineParsed(wxCmdLineParser& parser)
+{
+    _samples = 1000;
+
+    parser.Found(wxT("samples"), &_samples);
+    _dumpStats = parser.Found(wxT("stats"));
+    StartTracing(parser);
+
+    if (_samples <= 0) {
+        parser.Usage();
+        return false;
+    }
+
+    // Archive paths are handed to CHMLIB as multibyte strings.
+    std::setlocale(LC_CTYPE, "");
+
+    _archive = parser.GetParam(0);
+    return true;
+}
+
+int CHMBenchApp::OnRun()
+{
+    wxString json;
+
+    if (!CHMBench(_archive, _samples).Run(json)) {
+        wxFprintf(stderr, wxT("xchm: can't open %s\n"), _archive);
+        return 1;
+    }
+
+    wxPrintf(wxT("%s\n"), json);
+    return 0;
+}
+
+int CHMBenchApp::OnExit()
+{
+    if (_dumpStats)
+        DumpStats();
+
+    StopTracing();
+
+    return wxAppConsole::OnExit();
+}
+
+wxIMPLEMENT_APP_NO_MAIN(CHMApp);
+
+int main(int argc, char** argv)
+{
+    // --serve and --bench must never initialize the GUI, there might not even be a display to connect to.
+    for (auto i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--serve") || !std::strncmp(argv[i], "--serve=", 8)) {
+            wxApp::SetInstance(new CHMServerApp);
+            break;
+        }
+
+        if (!std::strcmp(argv[i], "--bench")) {
+            wxApp::SetInstance(new CHMBenchApp);
+            break;
+        }
+    }
+
+    return wxEntry(argc, argv);
+}
+#else
 // Apparently this macro gets main() pumping.
 wxIMPLEMENT_APP(CHMApp);
+#endif
@@ -24,16 +24,15 @@
 #include <config.h>
 #endif
 
+#include <memory>
 #include <wx/cmdline.h>
 #include <wx/intl.h>
 #include <wx/wx.h>
 
-#ifdef WITH_LIBXMLRPC
-#include <XmlRpc.h>
-#endif
-
-// Forward declaration.
+// Forward declarations.
 class CHMFrame;
+class CHMRpcServer;
+class CHMServer;
 
 /*!
   \class wxApp
@@ -41,16 +40,11 @@ class CHMFrame;
 */
 
 //! This is the application class.
-#ifdef WITH_LIBXMLRPC
-class CHMApp : public wxApp, public XmlRpc::XmlRpcServerMethod {
-#else
 class CHMApp : public wxApp {
-#endif
-
 #ifdef WITH_LIBXMLRPC
 public:
-    //! Default constructor, also links the XMLRPC method
-    CHMApp();
+    //! Destructor. Out of line, for the sake of std::unique_ptr<CHMRpcServer>.
+    ~CHMApp() override;
 #endif
 
 private:
@@ -62,13 +56,8 @@ private:
     void MacOpenFile(const wxString& filename) override;
 #endif
 
-#ifdef WITH_LIBXMLRPC
-    //! Handles actual XMLRPC requests and parameter parsing.
-    void execute(XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result);
-
-    //! Watches for XMLRPC requests
-    void WatchForXMLRPC(wxTimerEvent& event);
-#endif
+    //! Stops the XMLRPC server, unless closing the frame already has, and dumps statistics if asked to.
+    int OnExit() override;
 
     // Try to figure out the absolute file path of the executable.
     wxString getAppPath(const wxString& argv0, const wxString& cwd);
@@ -77,9 +66,62 @@ private:
     CHMFrame* _frame {nullptr};
     wxLocale  _loc;
 #ifdef WITH_LIBXMLRPC
-    wxTimer _timer;
+    std::unique_ptr<CHMRpcServer> _rpcServer;
 #endif
     wxCmdLineParser _cmdLP;
+    bool            _dumpStats {false};
+};
+
+#ifndef __WXMSW__
+
+/*!
+  \brief Application class for xchm --serve. Console only: it never initializes the GUI, so it runs fine without a
+  display.
+*/
+class CHMServerApp : public wxAppConsole {
+public:
+    //! Shuts the server down.
+    ~CHMServerApp() override;
+
+private:
+    //! Sets up the command line the server takes.
+    void OnInitCmdLine(wxCmdLineParser& parser) override;
+
+    //! Starts the server, or returns false (exiting) if it can't.
+    bool OnCmdLineParsed(wxCmdLineParser& parser) override;
+
+    //! Dumps statistics, if asked to.
+    int OnExit() override;
+
+    //! Ends the main loop on SIGINT / SIGTERM.
+    static void OnSignal(int signal);
+
+private:
+    std::unique_ptr<CHMServer> _server;
+    bool                       _dumpStats {false};
+};
+
+//! Application class for xchm --bench. Console only, like CHMServerApp.
+class CHMBenchApp : public wxAppConsole {
+private:
+    //! Sets up the command line the benchmark takes.
+    void OnInitCmdLine(wxCmdLineParser& parser) override;
+
+    //! Remembers what to benchmark, and how.
+    bool OnCmdLineParsed(wxCmdLineParser& parser) override;
+
+    //! Runs the benchmark, printing the results to stdout. There's no main loop to run.
+    int OnRun() override;
+
+    //! Dumps statistics, if asked to.
+    int OnExit() override;
+
+private:
+    wxString _archive;
+    long     _samples {0};
+    bool     _dumpStats {false};
 };
 
+#endif
+
 #endif // __CHMAPP_H_
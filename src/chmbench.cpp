@@ -0,0 +1,279 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <algorithm>
+#include <chmbench.h>
+#include <chmfile.h>
+#include <chmlibrary.h>
+#include <chrono>
+#include <random>
+#include <set>
+#include <stringutils.h>
+#include <vector>
+#include <wx/filename.h>
+
+#ifndef VERSION
+#define VERSION "unknown"
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+//! How many times the archive gets opened, the median time is reported.
+constexpr unsigned OPEN_RUNS {21};
+
+//! Searches are much slower than lookups, cap how many of them get timed.
+constexpr unsigned MAX_SEARCHES {100};
+
+//! Shortest word worth searching for.
+constexpr size_t MIN_WORD_LENGTH {3};
+
+//! Same seed, same lookups and searches, same archive: comparable numbers.
+constexpr unsigned SEED {1};
+
+struct ArchiveFile {
+    std::string path;
+    chmUnitInfo ui;
+};
+
+double Elapsed(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// The q-th quantile of samples, in whatever unit they come in.
+double Percentile(std::vector<double> samples, double q)
+{
+    if (samples.empty())
+        return 0;
+
+    std::sort(samples.begin(), samples.end());
+    return samples[static_cast<size_t>(q * (samples.size() - 1) + 0.5)];
+}
+
+int CollectFile(chmFile*, chmUnitInfo* ui, void* context)
+{
+    if (ui->length)
+        static_cast<std::vector<ArchiveFile>*>(context)->push_back({ui->path, *ui});
+
+    return CHM_ENUMERATOR_CONTINUE;
+}
+
+// MiB/s reading all of files, in the order given, through a handle of their own (so nothing's cached yet).
+double ReadThroughput(const wxString& archive, const std::vector<ArchiveFile>& files, [[maybe_unused]] bool sequential)
+{
+    auto h = chm_open(static_cast<const char*>(archive.mb_str()));
+
+    if (!h)
+        return 0;
+
+#ifdef ENABLE_BUILTIN_CHMLIB
+    if (sequential)
+        chm_set_param(h, CHM_PARAM_ACCESS_PATTERN, CHM_ACCESS_SEQUENTIAL);
+#endif
+
+    std::vector<unsigned char> buffer;
+    uint64_t                   total {0};
+    auto                       start = Clock::now();
+
+    for (auto&& file : files) {
+        auto ui = file.ui;
+
+        buffer.resize(ui.length);
+        total += chm_retrieve_object(h, &ui, buffer.data(), 0, buffer.size());
+    }
+
+    auto us = Elapsed(start);
+    chm_close(h);
+
+    return us > 0 ? total / us * 1e6 / (1024 * 1024) : 0;
+}
+
+wxString JsonString(const wxString& value)
+{
+    return wxString::FromUTF8(jsonString(std::string(value.utf8_str())).c_str());
+}
+
+//! Builds a flat JSON object, a key at a time.
+class JsonObject {
+public:
+    void Add(const char* key, const wxString& value) { Key(key) << JsonString(value); }
+
+    void Add(const char* key, double value) { Key(key) << wxString::Format(wxT("%.3f"), value); }
+
+    void Add(const char* key, unsigned long long value) { Key(key) << wxString::Format(wxT("%llu"), value); }
+
+    void Add(const char* key, bool value) { Key(key) << (value ? wxT("true") : wxT("false")); }
+
+    wxString Close() const { return _json + wxT("}"); }
+
+private:
+    wxString& Key(const char* key)
+    {
+        return _json << (_json.IsEmpty() ? wxT("{") : wxT(",")) << JsonString(wxString::FromUTF8(key)) << wxT(":");
+    }
+
+private:
+    wxString _json;
+};
+
+} // end of anonymous namespace
+
+CHMBench::CHMBench(const wxString& archive, unsigned samples) : _archive(archive), _samples(std::max(samples, 1U))
+{
+}
+
+bool CHMBench::Run(wxString& json)
+{
+    JsonObject   results;
+    std::mt19937 rng(SEED);
+
+    results.Add("archive", _archive);
+    results.Add("version", wxString(wxT(VERSION)));
+    results.Add("bytes", static_cast<unsigned long long>(wxFileName::GetSize(_archive).GetValue()));
+
+    // Opening: header, directory and reset table parsing.
+    std::vector<double> opens;
+
+    for (unsigned i = 0; i < OPEN_RUNS; ++i) {
+        auto start = Clock::now();
+        auto h     = chm_open(static_cast<const char*>(_archive.mb_str()));
+
+        if (!h)
+            return false;
+
+        opens.push_back(Elapsed(start));
+        chm_close(h);
+    }
+
+    results.Add("open_us", Percentile(opens, 0.5));
+
+    auto    start = Clock::now();
+    CHMFile chmFile(_archive);
+
+    if (!chmFile.IsOk())
+        return false;
+
+    results.Add("load_us", Elapsed(start));
+
+    // Lookups, of files picked at random.
+    std::vector<ArchiveFile> files;
+    auto                     h = chm_open(static_cast<const char*>(_archive.mb_str()));
+
+    if (!h)
+        return false;
+
+    chm_enumerate(h, CHM_ENUMERATE_ALL, CollectFile, &files);
+    results.Add("files", static_cast<unsigned long long>(files.size()));
+
+    std::vector<double> resolves;
+
+    if (!files.empty()) {
+        std::uniform_int_distribution<size_t> pick(0, files.size() - 1);
+
+        for (unsigned i = 0; i < _samples; ++i) {
+            chmUnitInfo ui;
+            auto&       path = files[pick(rng)].path;
+
+            start = Clock::now();
+            chm_resolve_object(h, path.c_str(), &ui);
+            resolves.push_back(Elapsed(start) * 1000);
+        }
+    }
+
+    chm_close(h);
+
+    results.Add("resolve_ns_p50", Percentile(resolves, 0.5));
+    results.Add("resolve_ns_p99", Percentile(resolves, 0.99));
+
+    // Reading everything, first in the order it's stored in, then shuffled.
+    std::sort(files.begin(), files.end(), [](const ArchiveFile& a, const ArchiveFile& b) {
+        return a.ui.space != b.ui.space ? a.ui.space < b.ui.space : a.ui.start < b.ui.start;
+    });
+
+    results.Add("sequential_mib_s", ReadThroughput(_archive, files, true));
+    std::shuffle(files.begin(), files.end(), rng);
+    results.Add("random_mib_s", ReadThroughput(_archive, files, false));
+
+    // The contents, parsed without a tree control to fill. Its names are what we'll be searching for.
+    std::set<wxString> words;
+    unsigned long long tocEntries {0};
+    CHMIndexCallback   addTopic = [&](const wxString& name, const wxString&) {
+        ++tocEntries;
+
+        for (auto&& word : CHMLibrary::QueryWords(name))
+            if (word.length() >= MIN_WORD_LENGTH)
+                words.insert(word);
+    };
+
+    start = Clock::now();
+    chmFile.GetTopics(addTopic);
+    results.Add("toc_us", Elapsed(start));
+    results.Add("toc_entries", tocEntries);
+
+    unsigned long long indexEntries {0};
+
+    start = Clock::now();
+    chmFile.GetIndex([&indexEntries](const wxString&, const wxString&) { ++indexEntries; });
+    results.Add("index_us", Elapsed(start));
+    results.Add("index_entries", indexEntries);
+
+    // Searching. Without $FIftiMain, the first search pays for building the index, so that's timed separately. It's
+    // always built from scratch, and kept out of the user's cache directory, so every run times the same work.
+    auto hasFIftiMain = chmFile.HasFIftiMain();
+    results.Add("fiftimain", hasFIftiMain);
+
+    if (!hasFIftiMain) {
+        start = Clock::now();
+        chmFile.PrepareFullTextIndex(0, false);
+        results.Add("fulltext_build_us", Elapsed(start));
+    }
+
+    std::vector<wxString> queries(words.begin(), words.end());
+    std::shuffle(queries.begin(), queries.end(), rng);
+    queries.resize(std::min<size_t>(queries.size(), std::min(_samples, MAX_SEARCHES)));
+
+    std::vector<double> searches, prefixSearches;
+    unsigned long long  hits {0};
+
+    for (auto&& query : queries) {
+        CHMSearchResults found;
+
+        start = Clock::now();
+        chmFile.IndexSearch(query, true, false, found);
+        searches.push_back(Elapsed(start));
+        hits += found.size();
+
+        found.clear();
+        start = Clock::now();
+        chmFile.IndexSearch(query.Left(MIN_WORD_LENGTH), false, false, found);
+        prefixSearches.push_back(Elapsed(start));
+    }
+
+    results.Add("searches", static_cast<unsigned long long>(queries.size()));
+    results.Add("search_hits", hits);
+    results.Add("search_us_p50", Percentile(searches, 0.5));
+    results.Add("search_us_p99", Percentile(searches, 0.99));
+    results.Add("prefix_search_us_p50", Percentile(prefixSearches, 0.5));
+    results.Add("prefix_search_us_p99", Percentile(prefixSearches, 0.99));
+
+    json = results.Close();
+    return true;
+}
@@ -0,0 +1,52 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMBENCH_H_
+#define __CHMBENCH_H_
+
+#include <wx/string.h>
+
+/*!
+  \brief Times the things that make xCHM feel slow or fast, on one archive: opening it, looking files up, reading them
+  in archive and in random order, loading the contents and the index, and searching. The results come out as one
+  line of JSON, so that they can be collected and compared over time. Use with chmgen's archives for numbers anybody
+  can reproduce.
+ */
+class CHMBench {
+public:
+    /*!
+      \brief Prepares to benchmark archive.
+      \param archive The .chm file.
+      \param samples How many lookups and searches to time (percentiles are computed over them).
+     */
+    CHMBench(const wxString& archive, unsigned samples);
+
+    /*!
+      \brief Runs all the benchmarks.
+      \param json Receives the results, as a JSON object on a single line.
+      \return false if the archive can't be opened.
+     */
+    bool Run(wxString& json);
+
+private:
+    wxString _archive;
+    unsigned _samples;
+};
+
+#endif // __CHMBENCH_H_
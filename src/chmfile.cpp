@@ -21,26 +21,31 @@
   MA 02110-1301, USA.
 */
 
+#include <algorithm>
 #include <chmfile.h>
+#include <chmfulltextindex.h>
 #include <chmlistctrl.h>
+#include <chmstats.h>
+#include <chmtrace.h>
 #include <hhcparser.h>
 #include <wx/defs.h>
 #include <wx/filename.h>
 #include <wx/fontmap.h>
 #include <wx/progdlg.h>
 #include <wx/strconv.h>
+#include <wx/thread.h>
 #include <wx/treectrl.h>
 #include <wx/wx.h>
 #include <wxstringutils.h>
 
 namespace {
 
-//! Maximum allowed number of search-returned items.
-constexpr size_t MAX_SEARCH_RESULTS {512};
-
 // Big-enough buffer size for use with various routines.
 constexpr size_t BUF_SIZE {4096};
 
+// Decompressed blocks (usually 32 KiB each) cached per archive: a page and the images etc. the prefetcher reads for it.
+constexpr int BLOCKS_CACHED {64};
+
 #ifndef _WIN32
 // Thanks to Vadim Zeitlin.
 constexpr int ANSI_CHARSET {0};
@@ -125,7 +130,14 @@ inline uint32_t UINT32_FROM_ARRAY(const unsigned char* x)
 #define INT32ARRAY(x) static_cast<int32_t>(UINT32_FROM_ARRAY(x))
 #define INT16ARRAY(x) static_cast<int16_t>(UINT16_FROM_ARRAY(x))
 
-inline uint64_t be_encint(unsigned char* buffer, size_t& length)
+//! What sr_int() returns when the code runs past the end of the buffer, or is too large to be real.
+constexpr uint64_t BAD_SR_INT {~static_cast<uint64_t>(0)};
+
+/*
+   Decodes an ENCINT from the avail bytes at buffer. length is set to 0 if it doesn't end there, or if it's too large
+   for 64 bits.
+*/
+inline uint64_t be_encint(const unsigned char* buffer, size_t avail, size_t& length)
 {
     uint64_t result {0};
     auto     shift = 0;
@@ -133,30 +145,39 @@ inline uint64_t be_encint(unsigned char* buffer, size_t& length)
     length = 0;
 
     do {
-        result |= ((*buffer) & 0x7f) << shift;
+        if (length == avail || shift >= 64) {
+            length = 0;
+            return 0;
+        }
+
+        result |= static_cast<uint64_t>(buffer[length] & 0x7f) << shift;
         shift += 7;
-        ++length;
 
-    } while (*(buffer++) & 0x80);
+    } while (buffer[length++] & 0x80);
 
     return result;
 }
 
 /*
-   Finds the first unset bit in memory. Returns the number of set bits found.
+   Finds the first unset bit in the avail bytes at byte. Returns the number of set bits found.
    Returns -1 if the buffer runs out before we find an unset bit.
 */
-inline int ffus(unsigned char* byte, int* bit, size_t& length)
+inline int ffus(const unsigned char* byte, size_t avail, int* bit, size_t& length)
 {
     auto bits = 0;
 
     length = 0;
 
-    while (*byte & (1 << *bit)) {
+    for (;;) {
+        if (length == avail)
+            return -1;
+
+        if (!(byte[length] & (1 << *bit)))
+            break;
+
         if (*bit)
             --(*bit);
         else {
-            ++byte;
             ++length;
             *bit = 7;
         }
@@ -173,7 +194,9 @@ inline int ffus(unsigned char* byte, int* bit, size_t& length)
     return bits;
 }
 
-inline uint64_t sr_int(unsigned char* byte, int* bit, unsigned char s, unsigned char r, size_t& length)
+// Decodes a scale and root code from the avail bytes at byte. Returns BAD_SR_INT if it can't.
+inline uint64_t sr_int(const unsigned char* byte, size_t avail, int* bit, unsigned char s, unsigned char r,
+                       size_t& length)
 {
     uint64_t ret {0};
     size_t   fflen;
@@ -181,16 +204,27 @@ inline uint64_t sr_int(unsigned char* byte, int* bit, unsigned char s, unsigned
     length = 0;
 
     if (!bit || *bit > 7 || s != 2)
-        return ~static_cast<uint64_t>(0);
+        return BAD_SR_INT;
+
+    auto count = ffus(byte, avail, bit, fflen);
+
+    if (count < 0)
+        return BAD_SR_INT;
 
-    auto count = ffus(byte, bit, fflen);
     length += fflen;
     byte += length;
 
-    int  n_bits = r + (count ? count - 1 : 0);
-    auto n      = n_bits;
+    int n_bits = r + (count ? count - 1 : 0);
+
+    if (n_bits >= 64)
+        return BAD_SR_INT;
+
+    auto n = n_bits;
 
     while (n > 0) {
+        if (length == avail)
+            return BAD_SR_INT;
+
         auto num_bits = n > *bit ? *bit : n - 1;
         auto base     = n > *bit ? 0 : *bit - (n - 1);
         auto mask     = static_cast<unsigned char>((0xff >> (7 - num_bits)) << base);
@@ -213,6 +247,16 @@ inline uint64_t sr_int(unsigned char* byte, int* bit, unsigned char s, unsigned
     return ret;
 }
 
+// The NUL-terminated string at offset in buffer. Cut short at the end of the buffer if the NUL is missing.
+std::string StringAt(const UCharVector& buffer, size_t offset)
+{
+    if (offset >= buffer.size())
+        return {};
+
+    auto begin = buffer.begin() + offset;
+    return std::string(begin, std::find(begin, buffer.end(), 0));
+}
+
 } // end of anonymous namespace
 
 CHMFile::CHMFile(const wxString& archiveName)
@@ -234,6 +278,8 @@ bool CHMFile::LoadCHM(const wxString& archiveName)
     if (!_chmFile)
         return false;
 
+    chm_set_param(_chmFile, CHM_PARAM_MAX_BLOCKS_CACHED, BLOCKS_CACHED);
+
     wxFileName chiFn(archiveName);
     chiFn.SetExt("chi");
     wxString chiName = chiFn.GetFullPath();
@@ -252,6 +298,8 @@ bool CHMFile::LoadCHM(const wxString& archiveName)
     GetArchiveInfo();
     LoadContextIDs();
 
+    _cvPtr = createCSConvPtr(_enc);
+
 #if wxUSE_UNICODE
     _title = translateEncoding(_title, _enc);
 #endif
@@ -271,6 +319,8 @@ void CHMFile::CloseCHM()
     _chmChiFile = nullptr;
 
     _cidMap.clear();
+    _ftIndex.reset();
+    _cvPtr.reset();
     _filename = _topicsFile = _indexFile = _title = _font = wxEmptyString;
     _home                                                 = wxT("/");
 }
@@ -279,7 +329,7 @@ void CHMFile::CloseCHM()
 #define MSG_RETR_IDX _("Retrieving index..")
 #define EMPTY_INDEX _("Untitled in index")
 
-bool CHMFile::BinaryTOC(wxTreeCtrl& toBuild)
+bool CHMFile::BinaryTOC(wxTreeCtrl* tree, CHMStringArena* treeStrings, const CHMIndexCallback* list)
 {
     chmUnitInfo ti_ui, ts_ui, st_ui, ut_ui, us_ui;
 
@@ -296,42 +346,47 @@ bool CHMFile::BinaryTOC(wxTreeCtrl& toBuild)
     UCharVector topidx(ti_ui.length), topics(ts_ui.length), strings(st_ui.length), urltbl(ut_ui.length),
         urlstr(us_ui.length);
 
-    if (chm_retrieve_object(_chmChiFile, &ti_ui, &topidx[0], 0, ti_ui.length) != static_cast<int64_t>(ti_ui.length)
-        || chm_retrieve_object(_chmChiFile, &ts_ui, &topics[0], 0, ts_ui.length) != static_cast<int64_t>(ts_ui.length)
-        || chm_retrieve_object(_chmChiFile, &st_ui, &strings[0], 0, st_ui.length) != static_cast<int64_t>(st_ui.length)
-        || chm_retrieve_object(_chmChiFile, &ut_ui, &urltbl[0], 0, ut_ui.length) != static_cast<int64_t>(ut_ui.length)
-        || chm_retrieve_object(_chmChiFile, &us_ui, &urlstr[0], 0, us_ui.length) != static_cast<int64_t>(us_ui.length))
+    if (chm_retrieve_object(_chmChiFile, &ti_ui, topidx.data(), 0, ti_ui.length) != static_cast<int64_t>(ti_ui.length)
+        || chm_retrieve_object(_chmChiFile, &ts_ui, topics.data(), 0, ts_ui.length) != static_cast<int64_t>(ts_ui.length)
+        || chm_retrieve_object(_chmChiFile, &st_ui, strings.data(), 0, st_ui.length) != static_cast<int64_t>(st_ui.length)
+        || chm_retrieve_object(_chmChiFile, &ut_ui, urltbl.data(), 0, ut_ui.length) != static_cast<int64_t>(ut_ui.length)
+        || chm_retrieve_object(_chmChiFile, &us_ui, urlstr.data(), 0, us_ui.length) != static_cast<int64_t>(us_ui.length))
         return false;
 
-    auto off = UINT32_FROM_ARRAY(&topidx[0]);
-    RecurseLoadBTOC(topidx, topics, strings, urltbl, urlstr, off, toBuild, 1);
+    auto off = UINT32_FROM_ARRAY(topidx.data());
+
+    // No more entries than there's room for in #TOCIDX. A bound on how long a looping list can keep us busy.
+    auto entriesLeft = topidx.size() / 20;
+    RecurseLoadBTOC(topidx, topics, strings, urltbl, urlstr, off, tree, treeStrings, list, 1, entriesLeft);
 
     return true;
 }
 
 void CHMFile::RecurseLoadBTOC(UCharVector& topidx, UCharVector& topics, UCharVector& strings, UCharVector& urltbl,
-                              UCharVector& urlstr, uint32_t offset, wxTreeCtrl& toBuild, int level)
+                              UCharVector& urlstr, uint32_t offset, wxTreeCtrl* tree, CHMStringArena* treeStrings,
+                              const CHMIndexCallback* list, int level, size_t& entriesLeft)
 {
     while (offset) {
-        if (topidx.size() < offset + 20)
+        if (topidx.size() < static_cast<size_t>(offset) + 20 || entriesLeft-- == 0)
             return;
 
         auto flags = UINT32_FROM_ARRAY(&topidx[offset + 4]);
         auto index = UINT32_FROM_ARRAY(&topidx[offset + 8]);
 
         if ((flags & 0x4) || (flags & 0x8)) // book or local
-            if (!GetItem(topics, strings, urltbl, urlstr, index, &toBuild, nullptr, wxEmptyString, level,
+            if (!GetItem(topics, strings, urltbl, urlstr, index, tree, treeStrings, list, nullptr, level,
                          (flags & 0x8) == 0))
                 return;
 
         if (flags & 0x4) { // book
-            if (topidx.size() < offset + 24)
+            if (topidx.size() < static_cast<size_t>(offset) + 24)
                 return;
 
             auto child = UINT32_FROM_ARRAY(&topidx[offset + 20]);
 
             if (child)
-                RecurseLoadBTOC(topidx, topics, strings, urltbl, urlstr, child, toBuild, level + 1);
+                RecurseLoadBTOC(topidx, topics, strings, urltbl, urlstr, child, tree, treeStrings, list, level + 1,
+                                entriesLeft);
         }
 
         offset = UINT32_FROM_ARRAY(&topidx[offset + 0x10]);
@@ -339,8 +394,8 @@ void CHMFile::RecurseLoadBTOC(UCharVector& topidx, UCharVector& topics, UCharVec
 }
 
 bool CHMFile::GetItem(UCharVector& topics, UCharVector& strings, UCharVector& urltbl, UCharVector& urlstr,
-                      uint32_t index, wxTreeCtrl* tree, CHMListCtrl* list, const wxString& idxName, int level,
-                      bool local)
+                      uint32_t index, wxTreeCtrl* tree, CHMStringArena* treeStrings, const CHMIndexCallback* list,
+                      const wxString* idxName, int level, bool local)
 {
     if (level < 0 || level >= static_cast<int>(TREE_BUF_SIZE))
         return false;
@@ -349,9 +404,8 @@ bool CHMFile::GetItem(UCharVector& topics, UCharVector& strings, UCharVector& ur
     static auto           calls      = 0;
     static constexpr auto YIELD_TIME = 256;
 
-    ++calls;
-
-    if (calls % YIELD_TIME == 0)
+    // Only the GUI thread has anything to yield to.
+    if (wxThread::IsMain() && ++calls % YIELD_TIME == 0)
         wxYield();
 
     if (tree)
@@ -360,36 +414,38 @@ bool CHMFile::GetItem(UCharVector& topics, UCharVector& strings, UCharVector& ur
     std::string name, value;
 
     if (local) {
-        if (strings.size() < index + 1)
+        if (strings.size() <= index)
             return false;
 
-        name = reinterpret_cast<char*>(&strings[index]);
+        name = StringAt(strings, index);
 
     } else {
-        if (topics.size() < (index * 16) + 12)
+        auto entry = static_cast<size_t>(index) * 16;
+
+        if (topics.size() < entry + 12)
             return false;
 
-        auto offset = UINT32_FROM_ARRAY(&topics[index * 16 + 4]);
+        auto offset = UINT32_FROM_ARRAY(&topics[entry + 4]);
         auto test   = static_cast<int32_t>(offset);
 
-        if (strings.size() < offset + 1 || test == -1)
+        if (strings.size() <= offset || test == -1)
             return false;
 
-        if (!list)
-            name = reinterpret_cast<char*>(&strings[offset]);
+        if (!idxName)
+            name = StringAt(strings, offset);
 
         // #URLTBL index
-        offset = UINT32_FROM_ARRAY(&topics[index * 16 + 8]);
+        offset = UINT32_FROM_ARRAY(&topics[entry + 8]);
 
-        if (urltbl.size() < offset + 12)
+        if (urltbl.size() < static_cast<size_t>(offset) + 12)
             return false;
 
         offset = UINT32_FROM_ARRAY(&urltbl[offset + 8]);
 
-        if (urlstr.size() < offset)
+        if (urlstr.size() <= static_cast<size_t>(offset) + 8)
             return false;
 
-        value = reinterpret_cast<char*>(&urlstr[offset + 8]);
+        value = StringAt(urlstr, static_cast<size_t>(offset) + 8);
     }
 
     if (!value.empty() && value[0] != '/')
@@ -399,9 +455,9 @@ bool CHMFile::GetItem(UCharVector& topics, UCharVector& strings, UCharVector& ur
 
     if (tree && !name.empty()) {
         auto parentIndex = level ? level - 1 : 0;
-        auto tname       = translateEncoding(CURRENT_CHAR_STRING(name.c_str()), _enc);
+        auto tname       = FromArchive(name.c_str());
 
-        parents[level] = tree->AppendItem(parents[parentIndex], tname, 2, 2, new URLTreeItem(tvalue));
+        parents[level] = tree->AppendItem(parents[parentIndex], tname, 2, 2, new URLTreeItem(*treeStrings, tvalue));
 
         if (level && tree->GetItemImage(parents[parentIndex]) != 0) {
             tree->SetItemImage(parents[parentIndex], 0, wxTreeItemIcon_Normal);
@@ -411,24 +467,24 @@ bool CHMFile::GetItem(UCharVector& topics, UCharVector& strings, UCharVector& ur
     }
 
     if (list) {
-        auto tname = idxName;
+        auto tname = idxName ? *idxName : FromArchive(name.c_str());
         if (!value.empty() && tname.IsEmpty())
             tname = EMPTY_INDEX;
 
-        list->AddPairItem(tname, tvalue);
+        (*list)(tname, tvalue);
     }
 
     return true;
 }
 
-bool CHMFile::GetTopicsTree(wxTreeCtrl& toBuild)
+bool CHMFile::GetTopicsTree(wxTreeCtrl& toBuild, CHMStringArena& strings)
 {
-    chmUnitInfo ui;
-    char        buffer[BUF_SIZE] {};
-    size_t      ret {BUF_SIZE - 1}, curr {0};
+    CHMTrace::Scope trace("CHMFile::GetTopicsTree");
+    CHMStats::Timer timer(CHMStats::TOC_LOADS, CHMStats::TOC_LOAD_US);
+    chmUnitInfo     ui;
 
     toBuild.Freeze();
-    bool btoc = BinaryTOC(toBuild);
+    bool btoc = BinaryTOC(&toBuild, &strings, nullptr);
     toBuild.Thaw();
 
     if (btoc)
@@ -440,26 +496,38 @@ bool CHMFile::GetTopicsTree(wxTreeCtrl& toBuild)
 
     toBuild.Freeze();
 
-    HHCParser p(_enc, &toBuild, nullptr);
-
-    do {
-        ret         = RetrieveObject(&ui, reinterpret_cast<unsigned char*>(buffer), curr, BUF_SIZE - 1);
-        buffer[ret] = '\0';
+    HHCParser p(_enc, &toBuild, &strings, nullptr);
 
-        p.parse(buffer);
-        curr += ret;
-    } while (ret == BUF_SIZE - 1);
+    ParseSitemap(&ui, p);
 
     toBuild.Thaw();
 
     return true;
 }
 
+bool CHMFile::GetTopics(const CHMIndexCallback& add)
+{
+    chmUnitInfo ui;
+
+    if (BinaryTOC(nullptr, nullptr, &add))
+        return true;
+
+    if (_topicsFile.IsEmpty() || !ResolveObject(_topicsFile, &ui))
+        return false;
+
+    HHCParser p(_enc, nullptr, nullptr, &add);
+
+    ParseSitemap(&ui, p);
+
+    return true;
+}
+
 // This function is too long: prime candidate for refactoring someday
-bool CHMFile::BinaryIndex(CHMListCtrl& toBuild, const wxCSConv& cv)
+bool CHMFile::BinaryIndex(const CHMIndexCallback& add, const wxCSConv& cv)
 {
-    chmUnitInfo bt_ui, ts_ui, st_ui, ut_ui, us_ui;
-    auto        items = 0UL;
+    CHMTrace::Scope trace("CHMFile::BinaryIndex");
+    chmUnitInfo     bt_ui, ts_ui, st_ui, ut_ui, us_ui;
+    auto            items = 0UL;
 
     if (chm_resolve_object(_chmChiFile, "/$WWKeywordLinks/BTree", &bt_ui) != CHM_RESOLVE_SUCCESS
         || chm_resolve_object(_chmChiFile, "/#TOPICS", &ts_ui) != CHM_RESOLVE_SUCCESS
@@ -471,11 +539,11 @@ bool CHMFile::BinaryIndex(CHMListCtrl& toBuild, const wxCSConv& cv)
     UCharVector btree(bt_ui.length), topics(ts_ui.length), strings(st_ui.length), urltbl(ut_ui.length),
         urlstr(us_ui.length);
 
-    if (chm_retrieve_object(_chmChiFile, &bt_ui, &btree[0], 0, bt_ui.length) != static_cast<int64_t>(bt_ui.length)
-        || chm_retrieve_object(_chmChiFile, &ts_ui, &topics[0], 0, ts_ui.length) != static_cast<int64_t>(ts_ui.length)
-        || chm_retrieve_object(_chmChiFile, &st_ui, &strings[0], 0, st_ui.length) != static_cast<int64_t>(st_ui.length)
-        || chm_retrieve_object(_chmChiFile, &ut_ui, &urltbl[0], 0, ut_ui.length) != static_cast<int64_t>(ut_ui.length)
-        || chm_retrieve_object(_chmChiFile, &us_ui, &urlstr[0], 0, us_ui.length) != static_cast<int64_t>(us_ui.length))
+    if (chm_retrieve_object(_chmChiFile, &bt_ui, btree.data(), 0, bt_ui.length) != static_cast<int64_t>(bt_ui.length)
+        || chm_retrieve_object(_chmChiFile, &ts_ui, topics.data(), 0, ts_ui.length) != static_cast<int64_t>(ts_ui.length)
+        || chm_retrieve_object(_chmChiFile, &st_ui, strings.data(), 0, st_ui.length) != static_cast<int64_t>(st_ui.length)
+        || chm_retrieve_object(_chmChiFile, &ut_ui, urltbl.data(), 0, ut_ui.length) != static_cast<int64_t>(ut_ui.length)
+        || chm_retrieve_object(_chmChiFile, &us_ui, urlstr.data(), 0, us_ui.length) != static_cast<int64_t>(us_ui.length))
         return false;
 
     if (bt_ui.length < 0x4c + 12)
@@ -535,7 +603,7 @@ bool CHMFile::BinaryIndex(CHMListCtrl& toBuild, const wxCSConv& cv)
 
                     auto index = UINT32_FROM_ARRAY(&btree[offset]);
 
-                    GetItem(topics, strings, urltbl, urlstr, index, nullptr, &toBuild, name, 0, false);
+                    GetItem(topics, strings, urltbl, urlstr, index, nullptr, nullptr, &add, &name, 0, false);
                     ++items;
 
                     offset += sizeof(uint32_t);
@@ -550,6 +618,10 @@ bool CHMFile::BinaryIndex(CHMListCtrl& toBuild, const wxCSConv& cv)
             spaceLeft -= 8;
         }
 
+        // A block that claims more than it holds would send us back over it, possibly forever.
+        if (spaceLeft < 0)
+            return items != 0;
+
         offset += spaceLeft;
 
     } while (next != -1);
@@ -559,38 +631,67 @@ bool CHMFile::BinaryIndex(CHMListCtrl& toBuild, const wxCSConv& cv)
 
 bool CHMFile::GetIndex(CHMListCtrl& toBuild)
 {
-    chmUnitInfo ui;
-    char        buffer[BUF_SIZE] {};
-    size_t      ret {BUF_SIZE - 1}, curr {0};
-
-    std::unique_ptr<wxCSConv> cvPtr = createCSConvPtr(_enc);
+    CHMIndexCallback add = [&toBuild](const wxString& name, const wxString& url) { toBuild.AddPairItem(name, url); };
 
     toBuild.Freeze();
-    bool bindex = BinaryIndex(toBuild, *cvPtr);
+    auto ok = GetIndex(add);
     toBuild.UpdateItemCount();
     toBuild.Thaw();
 
-    if (bindex)
+    return ok;
+}
+
+bool CHMFile::GetIndex(const CHMIndexCallback& add)
+{
+    CHMStats::Timer timer(CHMStats::INDEX_LOADS, CHMStats::INDEX_LOAD_US);
+    chmUnitInfo     ui;
+
+    if (!_cvPtr)
+        return false;
+
+    if (BinaryIndex(add, *_cvPtr))
         return true;
 
     if (_indexFile.IsEmpty() || !ResolveObject(_indexFile, &ui))
         return false;
 
-    toBuild.Freeze();
+    HHCParser p(_enc, nullptr, nullptr, &add);
 
-    HHCParser p(_enc, nullptr, &toBuild);
+    ParseSitemap(&ui, p);
 
-    do {
-        ret         = RetrieveObject(&ui, reinterpret_cast<unsigned char*>(buffer), curr, BUF_SIZE - 1);
-        buffer[ret] = '\0';
+    return true;
+}
 
-        p.parse(buffer);
-        curr += ret;
-    } while (ret == BUF_SIZE - 1);
+void CHMFile::ParseSitemap(chmUnitInfo* ui, HHCParser& parser)
+{
+#ifdef ENABLE_BUILTIN_CHMLIB
+    // Straight from the decompressed blocks, a block at a time.
+    chmSpan span;
 
-    toBuild.Thaw();
+    for (off_t curr = 0; static_cast<LONGUINT64>(curr) < ui->length;) {
+        auto len = RetrieveSpan(ui, curr, ui->length - curr, &span);
 
-    return true;
+        if (!len)
+            break;
+
+        parser.parse(reinterpret_cast<const char*>(span.data), len);
+        ReleaseSpan(&span);
+        curr += len;
+    }
+#else
+    std::vector<char> buffer(ui->length);
+
+    parser.parse(buffer.data(), RetrieveObject(ui, reinterpret_cast<unsigned char*>(buffer.data()), 0, buffer.size()));
+#endif
+}
+
+wxString CHMFile::FromArchive(const char* str) const
+{
+    // Without a charset of its own, the text is taken byte for byte.
+    if (_enc == wxFONTENCODING_SYSTEM || !_cvPtr)
+        return CURRENT_CHAR_STRING(str);
+
+    return CURRENT_CHAR_STRING_CV(str, *_cvPtr);
 }
 
 bool CHMFile::LoadContextIDs()
@@ -608,7 +709,7 @@ bool CHMFile::LoadContextIDs()
     UCharVector ivb_buf(ivb_ui.length);
     uint64_t    ivb_len {0};
 
-    if ((ivb_len = chm_retrieve_object(_chmFile, &ivb_ui, &ivb_buf[0], 0, ivb_ui.length)) == 0)
+    if ((ivb_len = chm_retrieve_object(_chmFile, &ivb_ui, ivb_buf.data(), 0, ivb_ui.length)) < sizeof(uint32_t))
         return false; // failed to retrieve data
 
     // always odd (DWORD + 2(n)*DWORD, so make even
@@ -628,12 +729,12 @@ bool CHMFile::LoadContextIDs()
 
     UCharVector strs_buf(strs_ui.length);
 
-    if (chm_retrieve_object(_chmChiFile, &strs_ui, &strs_buf[0], 0, strs_ui.length) == 0)
+    if (chm_retrieve_object(_chmChiFile, &strs_ui, strs_buf.data(), 0, strs_ui.length) == 0)
         return false; // failed to retrieve data
 
     for (unsigned int i = 0; i < ivb_len; i += 2)
         // context-IDs as KEY, fileName from #STRINGS as VALUE
-        _cidMap[ivbs[i]] = CURRENT_CHAR_STRING(&strs_buf[ivbs[i + 1]]);
+        _cidMap[ivbs[i]] = CURRENT_CHAR_STRING(StringAt(strs_buf, ivbs[i + 1]).c_str());
 
     // everything went well!
     return true;
@@ -654,125 +755,172 @@ wxString CHMFile::GetPageByCID(int contextID)
     return wxT("/") + itr->second;
 }
 
-bool CHMFile::IndexSearch(const wxString& text, bool wholeWords, bool titlesOnly, CHMSearchResults& results)
+bool CHMFile::IndexSearch(const wxString& text, bool wholeWords, bool titlesOnly, CHMSearchResults& results,
+                          const CHMCancelCheck& cancelled)
 {
     auto partial = false;
 
     if (text.IsEmpty())
         return false;
 
-    IndexSearchUnitsInfo uis {.fileMain    = _chmFile,
-                              .fileTopics  = _chmChiFile,
-                              .fileStrings = _chmChiFile,
-                              .fileUrltbl  = _chmChiFile,
-                              .fileUrlstr  = _chmChiFile};
+    CHMTrace::Scope trace("CHMFile::IndexSearch");
+    CHMStats::Timer timer(CHMStats::SEARCHES, CHMStats::SEARCH_US);
 
-    if (chm_resolve_object(uis.fileMain, "/$FIftiMain", &uis.uiMain) != CHM_RESOLVE_SUCCESS
-        || chm_resolve_object(uis.fileTopics, "/#TOPICS", &uis.uiTopics) != CHM_RESOLVE_SUCCESS
-        || chm_resolve_object(uis.fileStrings, "/#STRINGS", &uis.uiStrings) != CHM_RESOLVE_SUCCESS
-        || chm_resolve_object(uis.fileUrltbl, "/#URLTBL", &uis.uiUrltbl) != CHM_RESOLVE_SUCCESS
-        || chm_resolve_object(uis.fileUrlstr, "/#URLSTR", &uis.uiUrlstr) != CHM_RESOLVE_SUCCESS)
-        return false;
+    FullTextSearchInfo fts;
 
-    constexpr size_t FTS_HEADER_LEN {0x32};
-    unsigned char    header[FTS_HEADER_LEN];
+    if (!OpenFullTextSearch(fts))
+        return FullTextIndexSearch(text, wholeWords, titlesOnly, results);
 
-    if (chm_retrieve_object(uis.fileMain, &uis.uiMain, header, 0, FTS_HEADER_LEN) == 0)
-        return false;
+    wxString      word;
+    UCharVector   buffer(fts.nodeLen);
+    CHMIndexWords entries;
 
-    auto doc_index_s = header[0x1E], doc_index_r = header[0x1F], code_count_s = header[0x20],
-         code_count_r = header[0x21], loc_codes_s = header[0x22], loc_codes_r = header[0x23];
+    auto node_offset = GetLeafNodeOffset(text, fts.rootOffset, fts.nodeLen, fts.treeDepth, fts.uis.fileMain,
+                                         &fts.uis.uiMain);
 
-    if (doc_index_s != 2 || code_count_s != 2 || loc_codes_s != 2)
-        // Don't know how to use values other than 2 yet. Maybe next chmspec.
+    if (!node_offset)
         return false;
 
-    auto cursor32    = header + 0x14;
-    auto node_offset = UINT32_FROM_ARRAY(cursor32);
+    do {
+        if (cancelled && cancelled())
+            return false;
 
-    cursor32      = header + 0x2e;
-    auto node_len = UINT32_FROM_ARRAY(cursor32);
+        // got a leaf node here.
+        if (!ReadLeafNode(fts, node_offset, buffer, word, entries, node_offset))
+            return false;
 
-    auto cursor16   = header + 0x18;
-    auto tree_depth = UINT16_FROM_ARRAY(cursor16);
+        for (auto&& entry : entries) {
+            if (!entry.title && titlesOnly)
+                continue;
 
-    wxString    word;
-    UCharVector buffer(node_len);
+            if (wholeWords && !text.CmpNoCase(entry.word))
+                return ProcessWLC(entry.wlcCount, entry.wlcSize, entry.wlcOffset, fts, results, cancelled);
 
-    node_offset = GetLeafNodeOffset(text, node_offset, node_len, tree_depth, uis.fileMain, &uis.uiMain);
+            if (!wholeWords) {
+                if (entry.word.StartsWith(text.c_str())) {
+                    partial = true;
+                    ProcessWLC(entry.wlcCount, entry.wlcSize, entry.wlcOffset, fts, results, cancelled);
 
-    if (!node_offset)
+                } else if (text.CmpNoCase(entry.word.Mid(0, text.Length())) < -1)
+                    break;
+            }
+
+            if (results.size() >= MAX_SEARCH_RESULTS)
+                break;
+        }
+    } while (!wholeWords && word.StartsWith(text.c_str()) && node_offset);
+
+    return partial;
+}
+
+bool CHMFile::HasFIftiMain()
+{
+    chmUnitInfo ui;
+    return _chmFile && chm_resolve_object(_chmFile, "/$FIftiMain", &ui) == CHM_RESOLVE_SUCCESS;
+}
+
+bool CHMFile::PrepareFullTextIndex(unsigned threads, bool useCache)
+{
+    if (!_chmFile)
         return false;
 
-    do {
-        // got a leaf node here.
-        if (chm_retrieve_object(uis.fileMain, &uis.uiMain, &buffer[0], node_offset, node_len) == 0)
-            return false;
+    // Searches running on other threads might get here at the same time.
+    std::lock_guard<std::mutex> lock(_ftIndexMutex);
 
-        cursor16        = &buffer[6];
-        auto free_space = UINT16_FROM_ARRAY(cursor16);
+    if (!_ftIndex) {
+        _ftIndex = std::make_unique<CHMFullTextIndex>();
 
-        auto i = sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t);
+        if ((!useCache || !_ftIndex->Load(_filename)) && _ftIndex->Build(_filename, threads) && useCache)
+            _ftIndex->Save();
+    }
 
-        while (i < node_len - free_space) {
-            auto word_len = buffer[i];
+    return _ftIndex->IsOk();
+}
 
-            if (word_len == 0 || i + 2 + word_len > node_len - free_space)
-                break;
+bool CHMFile::FullTextIndexSearch(const wxString& text, bool wholeWords, bool titlesOnly, CHMSearchResults& results)
+{
+    if (!PrepareFullTextIndex() || results.size() >= MAX_SEARCH_RESULTS)
+        return false;
 
-            auto pos = buffer[i + 1];
+    auto        cvPtr = _enc != wxFONTENCODING_SYSTEM ? _cvPtr.get() : nullptr;
+    std::string word(cvPtr ? text.mb_str(*cvPtr) : text.mb_str(wxConvISO8859_1));
+    std::vector<uint32_t> docs;
 
-            std::vector<char> wrd_buf(word_len);
+    _ftIndex->Search(word, !wholeWords, titlesOnly, MAX_SEARCH_RESULTS - results.size(), docs);
 
-            memcpy(&wrd_buf[0], &buffer[i + 2], word_len - 1);
-            wrd_buf[word_len - 1] = 0;
+    for (auto index : docs) {
+        auto& doc = _ftIndex->Doc(index);
 
-            if (pos == 0)
-                word = CURRENT_CHAR_STRING(&wrd_buf[0]);
-            else
-                word = word.Mid(0, pos) + CURRENT_CHAR_STRING(&wrd_buf[0]);
+        if (doc.url.empty())
+            continue;
 
-            i += 2 + word_len;
+        auto url   = CURRENT_CHAR_STRING(doc.url.c_str());
+        auto title = cvPtr ? CURRENT_CHAR_STRING_CV(doc.title.c_str(), *cvPtr) : CURRENT_CHAR_STRING(doc.title.c_str());
 
-            auto   title = buffer[i - 1];
-            size_t encsz;
+        results[url] = title.IsEmpty() ? url : title;
+    }
 
-            auto wlc_count = be_encint(&buffer[i], encsz);
-            i += encsz;
+    return !docs.empty();
+}
 
-            cursor32        = &buffer[i];
-            auto wlc_offset = UINT32_FROM_ARRAY(cursor32);
+uint32_t CHMFile::IndexLeafOffset(const wxString& prefix)
+{
+    FullTextSearchInfo fts;
 
-            i += sizeof(uint32_t) + sizeof(uint16_t);
-            auto wlc_size = be_encint(&buffer[i], encsz);
-            i += encsz;
+    if (prefix.IsEmpty() || !OpenFullTextSearch(fts))
+        return 0;
 
-            cursor32    = &buffer[0];
-            node_offset = UINT32_FROM_ARRAY(cursor32);
+    return GetLeafNodeOffset(prefix, fts.rootOffset, fts.nodeLen, fts.treeDepth, fts.uis.fileMain, &fts.uis.uiMain);
+}
 
-            if (!title && titlesOnly)
-                continue;
+bool CHMFile::IndexPrefixWords(const wxString& prefix, uint32_t& leafOffset, size_t maxWords, CHMIndexWords& words,
+                               bool& truncated, const CHMCancelCheck& cancelled)
+{
+    FullTextSearchInfo fts;
 
-            if (wholeWords && !text.CmpNoCase(word))
-                return ProcessWLC(wlc_count, wlc_size, wlc_offset, doc_index_s, doc_index_r, code_count_s, code_count_r,
-                                  loc_codes_s, loc_codes_r, uis, results);
+    truncated = false;
 
-            if (!wholeWords) {
-                if (word.StartsWith(text.c_str())) {
-                    partial = true;
-                    ProcessWLC(wlc_count, wlc_size, wlc_offset, doc_index_s, doc_index_r, code_count_s, code_count_r,
-                               loc_codes_s, loc_codes_r, uis, results);
+    if (!leafOffset || !OpenFullTextSearch(fts))
+        return false;
 
-                } else if (text.CmpNoCase(word.Mid(0, text.Length())) < -1)
-                    break;
-            }
+    wxString      word;
+    UCharVector   buffer(fts.nodeLen);
+    CHMIndexWords entries;
 
-            if (results.size() >= MAX_SEARCH_RESULTS)
-                break;
+    for (auto current = leafOffset; current;) {
+        if (cancelled && cancelled())
+            return false;
+
+        leafOffset = current;
+
+        if (!ReadLeafNode(fts, leafOffset, buffer, word, entries, current))
+            return false;
+
+        for (auto&& entry : entries) {
+            if (entry.word.StartsWith(prefix)) {
+                if (words.size() == maxWords) {
+                    truncated = true;
+                    return true;
+                }
+                words.push_back(entry);
+
+            } else if (entry.word.Cmp(prefix) > 0)
+                // Words are sorted, once we're past the prefix there's nothing left to find.
+                return true;
         }
-    } while (!wholeWords && word.StartsWith(text.c_str()) && node_offset);
+    }
 
-    return partial;
+    return true;
+}
+
+bool CHMFile::IndexWordResults(const CHMIndexWord& word, CHMSearchResults& results, const CHMCancelCheck& cancelled)
+{
+    FullTextSearchInfo fts;
+
+    if (!OpenFullTextSearch(fts))
+        return false;
+
+    return ProcessWLC(word.wlcCount, word.wlcSize, word.wlcOffset, fts, results, cancelled);
 }
 
 bool CHMFile::ResolveObject(const wxString& fileName, chmUnitInfo* ui)
@@ -786,6 +934,18 @@ size_t CHMFile::RetrieveObject(chmUnitInfo* ui, unsigned char* buffer, off_t fil
     return chm_retrieve_object(_chmFile, ui, buffer, fileOffset, bufferSize);
 }
 
+#ifdef ENABLE_BUILTIN_CHMLIB
+size_t CHMFile::RetrieveSpan(chmUnitInfo* ui, off_t fileOffset, size_t size, chmSpan* span)
+{
+    return chm_retrieve_span(_chmFile, ui, fileOffset, size, span);
+}
+
+void CHMFile::ReleaseSpan(chmSpan* span)
+{
+    chm_release_span(_chmFile, span);
+}
+#endif
+
 bool CHMFile::GetArchiveInfo()
 {
     // Order counts, parse #SYSTEM before #WINDOWS (thanks to Kuang-che Wu for pointing that out)
@@ -795,13 +955,54 @@ bool CHMFile::GetArchiveInfo()
     return retw || rets;
 }
 
+bool CHMFile::OpenFullTextSearch(FullTextSearchInfo& fts)
+{
+    auto& uis = fts.uis;
+
+    uis.fileMain    = _chmFile;
+    uis.fileTopics  = _chmChiFile;
+    uis.fileStrings = _chmChiFile;
+    uis.fileUrltbl  = _chmChiFile;
+    uis.fileUrlstr  = _chmChiFile;
+
+    if (!_chmFile || chm_resolve_object(uis.fileMain, "/$FIftiMain", &uis.uiMain) != CHM_RESOLVE_SUCCESS
+        || chm_resolve_object(uis.fileTopics, "/#TOPICS", &uis.uiTopics) != CHM_RESOLVE_SUCCESS
+        || chm_resolve_object(uis.fileStrings, "/#STRINGS", &uis.uiStrings) != CHM_RESOLVE_SUCCESS
+        || chm_resolve_object(uis.fileUrltbl, "/#URLTBL", &uis.uiUrltbl) != CHM_RESOLVE_SUCCESS
+        || chm_resolve_object(uis.fileUrlstr, "/#URLSTR", &uis.uiUrlstr) != CHM_RESOLVE_SUCCESS)
+        return false;
+
+    constexpr size_t FTS_HEADER_LEN {0x32};
+    unsigned char    header[FTS_HEADER_LEN];
+
+    if (chm_retrieve_object(uis.fileMain, &uis.uiMain, header, 0, FTS_HEADER_LEN) == 0)
+        return false;
+
+    fts.ds = header[0x1E];
+    fts.dr = header[0x1F];
+    fts.cs = header[0x20];
+    fts.cr = header[0x21];
+    fts.ls = header[0x22];
+    fts.lr = header[0x23];
+
+    if (fts.ds != 2 || fts.cs != 2 || fts.ls != 2)
+        // Don't know how to use values other than 2 yet. Maybe next chmspec.
+        return false;
+
+    fts.rootOffset = UINT32_FROM_ARRAY(header + 0x14);
+    fts.nodeLen    = UINT32_FROM_ARRAY(header + 0x2e);
+    fts.treeDepth  = UINT16_FROM_ARRAY(header + 0x18);
+
+    return fts.nodeLen != 0;
+}
+
 uint32_t CHMFile::GetLeafNodeOffset(const wxString& text, uint32_t initialOffset, uint32_t buffSize, uint16_t treeDepth,
                                     chmFile* file, chmUnitInfo* ui)
 {
     uint32_t test_offset {0};
     wxString word;
 
-    if (!buffSize)
+    if (buffSize < sizeof(uint16_t) || buffSize > ui->length)
         return 0;
 
     UCharVector buffer(buffSize);
@@ -811,13 +1012,16 @@ uint32_t CHMFile::GetLeafNodeOffset(const wxString& text, uint32_t initialOffset
             return 0;
 
         test_offset = initialOffset;
-        if (chm_retrieve_object(file, ui, &buffer[0], initialOffset, buffSize) == 0)
+        if (chm_retrieve_object(file, ui, buffer.data(), initialOffset, buffSize) == 0)
             return 0;
 
-        auto     cursor16   = &buffer[0];
+        auto     cursor16   = buffer.data();
         auto     free_space = UINT16_FROM_ARRAY(cursor16);
         uint32_t i {sizeof(uint16_t)};
 
+        if (free_space > buffSize)
+            return 0;
+
         while (i < buffSize - free_space) {
             auto word_len = buffer[i];
 
@@ -851,32 +1055,126 @@ uint32_t CHMFile::GetLeafNodeOffset(const wxString& text, uint32_t initialOffset
     return initialOffset == test_offset ? 0 : initialOffset;
 }
 
-bool CHMFile::ProcessWLC(uint64_t wlc_count, uint64_t wlc_size, uint32_t wlc_offset, unsigned char ds, unsigned char dr,
-                         unsigned char cs, unsigned char cr, unsigned char ls, unsigned char lr,
-                         IndexSearchUnitsInfo& uis, CHMSearchResults& results)
+bool CHMFile::ReadLeafNode(FullTextSearchInfo& fts, uint32_t offset, UCharVector& buffer, wxString& word,
+                           CHMIndexWords& entries, uint32_t& nextOffset)
+{
+    auto node_len = fts.nodeLen;
+    auto i        = sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t);
+
+    entries.clear();
+
+    if (node_len < i || node_len > fts.uis.uiMain.length)
+        return false;
+
+    buffer.resize(node_len);
+
+    if (chm_retrieve_object(fts.uis.fileMain, &fts.uis.uiMain, buffer.data(), offset, node_len) == 0)
+        return false;
+
+    nextOffset      = UINT32_FROM_ARRAY(buffer.data());
+    auto free_space = UINT16_FROM_ARRAY(&buffer[6]);
+
+    if (free_space > node_len - i)
+        return false;
+
+    auto end = node_len - free_space;
+
+    while (i < end) {
+        auto word_len = buffer[i];
+
+        if (word_len == 0 || i + 2 + word_len > end)
+            break;
+
+        auto pos = buffer[i + 1];
+
+        std::vector<char> wrd_buf(word_len);
+
+        memcpy(&wrd_buf[0], &buffer[i + 2], word_len - 1);
+        wrd_buf[word_len - 1] = 0;
+
+        if (pos == 0)
+            word = CURRENT_CHAR_STRING(&wrd_buf[0]);
+        else
+            word = word.Mid(0, pos) + CURRENT_CHAR_STRING(&wrd_buf[0]);
+
+        i += 2 + word_len;
+
+        CHMIndexWord entry;
+        size_t       encsz;
+
+        entry.word  = word;
+        entry.title = buffer[i - 1];
+
+        entry.wlcCount = be_encint(&buffer[i], end - i, encsz);
+        i += encsz;
+
+        if (encsz == 0 || i + sizeof(uint32_t) + sizeof(uint16_t) >= end)
+            break;
+
+        entry.wlcOffset = UINT32_FROM_ARRAY(&buffer[i]);
+
+        i += sizeof(uint32_t) + sizeof(uint16_t);
+        entry.wlcSize = be_encint(&buffer[i], end - i, encsz);
+        i += encsz;
+
+        if (encsz == 0)
+            break;
+
+        entries.push_back(entry);
+    }
+
+    return true;
+}
+
+bool CHMFile::ProcessWLC(uint64_t wlc_count, uint64_t wlc_size, uint32_t wlc_offset, FullTextSearchInfo& fts,
+                         CHMSearchResults& results, const CHMCancelCheck& cancelled)
 {
+    CHMTrace::Scope trace("CHMFile::ProcessWLC");
+    auto&           uis = fts.uis;
+
     auto        wlc_bit = 7;
     uint64_t    index {0};
     size_t      length, off {0};
+
+    if (wlc_size == 0 || wlc_size > uis.uiMain.length)
+        return false;
+
     UCharVector buffer(wlc_size);
 
+    // The next code in the word location list, or BAD_SR_INT past its end.
+    auto nextCode = [&](unsigned char s, unsigned char r) {
+        if (off >= wlc_size)
+            return BAD_SR_INT;
+
+        auto code = sr_int(buffer.data() + off, wlc_size - off, &wlc_bit, s, r, length);
+        off += length;
+        return code;
+    };
+
     constexpr size_t TOPICS_ENTRY_LEN {16};
     unsigned char    entry[TOPICS_ENTRY_LEN];
 
     constexpr size_t COMMON_BUF_LEN {1025};
     unsigned char    combuf[COMMON_BUF_LEN];
 
-    if (chm_retrieve_object(uis.fileMain, &uis.uiMain, &buffer[0], wlc_offset, wlc_size) == 0)
+    if (chm_retrieve_object(uis.fileMain, &uis.uiMain, buffer.data(), wlc_offset, wlc_size) == 0)
         return false;
 
     for (uint64_t i = 0; i < wlc_count; ++i) {
+        if (cancelled && cancelled())
+            return false;
+
         if (wlc_bit != 7) {
             ++off;
             wlc_bit = 7;
         }
 
-        index += sr_int(&buffer[off], &wlc_bit, ds, dr, length);
-        off += length;
+        auto delta = nextCode(fts.ds, fts.dr);
+
+        if (delta == BAD_SR_INT)
+            return false;
+
+        index += delta;
 
         if (chm_retrieve_object(uis.fileTopics, &uis.uiTopics, entry, index * 16, TOPICS_ENTRY_LEN) == 0)
             return false;
@@ -891,17 +1189,7 @@ bool CHMFile::ProcessWLC(uint64_t wlc_count, uint64_t wlc_size, uint32_t wlc_off
             topic = EMPTY_INDEX;
         else {
             combuf[COMMON_BUF_LEN - 1] = 0;
-
-#if wxUSE_UNICODE
-            if (_enc == wxFONTENCODING_SYSTEM)
-#endif
-                topic = CURRENT_CHAR_STRING(combuf);
-#if wxUSE_UNICODE
-            else {
-                std::unique_ptr<wxCSConv> cvPtr = createCSConvPtr(_enc);
-                topic                           = wxString(reinterpret_cast<const char*>(combuf), *cvPtr);
-            }
-#endif
+            topic                      = FromArchive(reinterpret_cast<const char*>(combuf));
         }
 
         cursor32    = entry + 8;
@@ -926,13 +1214,14 @@ bool CHMFile::ProcessWLC(uint64_t wlc_count, uint64_t wlc_size, uint32_t wlc_off
             results[url] = topic;
         }
 
-        auto count = sr_int(&buffer[off], &wlc_bit, cs, cr, length);
-        off += length;
+        auto count = nextCode(fts.cs, fts.cr);
 
-        for (uint64_t j = 0; j < count; ++j) {
-            sr_int(&buffer[off], &wlc_bit, ls, lr, length);
-            off += length;
-        }
+        if (count == BAD_SR_INT)
+            return false;
+
+        for (uint64_t j = 0; j < count; ++j)
+            if (nextCode(fts.ls, fts.lr) == BAD_SR_INT)
+                return false;
     }
 
     return true;
@@ -25,6 +25,9 @@
 #endif
 
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #ifdef ENABLE_BUILTIN_CHMLIB
 #include "xchm_chm_lib.h"
 #else
@@ -40,15 +43,48 @@
 // Forward declarations.
 class wxTreeCtrl;
 class CHMListCtrl;
+class CHMFullTextIndex;
+class HHCParser;
+class CHMStringArena;
 class wxCSConv;
 
 using UCharVector = std::vector<unsigned char>;
 
+//! Maximum allowed number of search-returned items.
+constexpr size_t MAX_SEARCH_RESULTS {512};
+
+/*!
+  \brief Can several threads read from the same CHMFile at once? The builtin CHMLIB, built with CHM_MT, gives each
+  reader its own LZX state. With any other CHMLIB every thread has to open its own CHMFile.
+ */
+#if defined(ENABLE_BUILTIN_CHMLIB) && defined(CHM_MT)
+constexpr bool CHM_CONCURRENT_READERS {true};
+#else
+constexpr bool CHM_CONCURRENT_READERS {false};
+#endif
+
 //! <string, string> hashmap for search results.
 using CHMSearchResults = std::unordered_map<wxString, wxString>;
 //! <int, string> hashmap for context ID mapping.
 using CHMIDMap = std::unordered_map<int, wxString>;
 
+//! A word found in a $FIftiMain leaf node, along with where its word location codes are stored.
+struct CHMIndexWord {
+    wxString word;
+    bool     title {false};
+    uint64_t wlcCount {0};
+    uint64_t wlcSize {0};
+    uint32_t wlcOffset {0};
+};
+
+using CHMIndexWords = std::vector<CHMIndexWord>;
+
+//! Polled by long running searches. Returning true abandons the search.
+using CHMCancelCheck = std::function<bool()>;
+
+//! Receives the entries of a book's index, as (keyword, URL) pairs.
+using CHMIndexCallback = std::function<void(const wxString& name, const wxString& url)>;
+
 //! C++ wrapper around CHMLIB. Concrete class.
 class CHMFile {
     //! Helper. To avoid a large list of parameters in 'ProcessWLC', and slightly improve readability
@@ -69,6 +105,19 @@ class CHMFile {
         chmUnitInfo uiUrlstr {};
     };
 
+    //! Helper. What we need to know from the $FIftiMain header to walk the B-tree and decode WLCs.
+    struct FullTextSearchInfo {
+        IndexSearchUnitsInfo uis {};
+
+        unsigned char ds {0}, dr {0};
+        unsigned char cs {0}, cr {0};
+        unsigned char ls {0}, lr {0};
+
+        uint32_t rootOffset {0};
+        uint32_t nodeLen {0};
+        uint16_t treeDepth {0};
+    };
+
 public:
     //! Default constructor.
     CHMFile() = default;
@@ -103,6 +152,12 @@ public:
     */
     wxString Title() const { return _title; }
 
+    /*!
+      \brief Gets the name of the contents (.hhc) file.
+      \return The contents file name, relative to the root of the archive, or an empty string if there's none.
+    */
+    wxString TopicsFile() const { return _topicsFile; }
+
     /*!
       \brief Checks if the last attempt to load a .chm file was succesful.
       \return true, if the last attempt to load a .chm file was succesful, false otherwise.
@@ -139,9 +194,17 @@ public:
       \brief Attempts to fill a wxTreeCtrl by parsing the topics file.
       \param toBuild Pointer to the tree to be filled. If the topics file is not available, the tree is unmodified.
       The tree must be empty before passing it to this function.
+      \param strings Where the URLs of the tree items are kept. Has to outlive the items.
       \return true if it's possible to build the tree, false otherwise.
      */
-    bool GetTopicsTree(wxTreeCtrl& toBuild);
+    bool GetTopicsTree(wxTreeCtrl& toBuild, CHMStringArena& strings);
+
+    /*!
+      \brief Reads the topics without a tree control, so that it can be done from any thread.
+      \param add Called for every entry, in contents order.
+      \return true if the archive has a topics tree, false otherwise.
+     */
+    bool GetTopics(const CHMIndexCallback& add);
 
     /*!
       \brief Attempts to fill a CHMListCtrl by parsing the index file.
@@ -151,6 +214,13 @@ public:
      */
     bool GetIndex(CHMListCtrl& toBuild);
 
+    /*!
+      \brief Reads the index without a list control, so that it can be done from any thread.
+      \param add Called for every entry, in the order they're stored in the archive.
+      \return true if the archive has an index, false otherwise.
+     */
+    bool GetIndex(const CHMIndexCallback& add);
+
     /*!
       \brief Attempts to build an index of context-ID/page pairs from the file.
       \return true if it's possible to buld the tree, false otherwise.
@@ -171,16 +241,61 @@ public:
      */
     wxString GetPageByCID(int contextID);
 
+    //! Does the archive come with a $FIftiMain full-text index?
+    bool HasFIftiMain();
+
+    /*!
+      \brief Makes our own full-text index available, for archives without a $FIftiMain. It's loaded from the cache
+      directory if possible, otherwise it gets built and saved there. Happens automatically on the first search too.
+      \param threads How many threads to build the index on. 0 means one per core.
+      \param useCache If false, the index is always built, and never saved.
+      \return true if the index is available.
+     */
+    bool PrepareFullTextIndex(unsigned threads = 0, bool useCache = true);
+
     /*!
-      \brief Fast search using the $FIftiMain file in the .chm.
+      \brief Fast search using the $FIftiMain file in the .chm. Archives without one are searched with our own
+      full-text index, which gets built (and cached on disk) the first time it's needed.
       \param text The text we're looking for.
       \param wholeWords Are we looking for whole words only?
       \param titlesOnly Are we looking for titles only?
       \param results A string-string hashmap that will hold the results in case of successful search. The keys are
       the URLs and the values are the page titles.
+      \param cancelled Optional. Polled while searching, the search is abandoned if it returns true.
       \return true if the search succeeded, false otherwise.
      */
-    bool IndexSearch(const wxString& text, bool wholeWords, bool titlesOnly, CHMSearchResults& results);
+    bool IndexSearch(const wxString& text, bool wholeWords, bool titlesOnly, CHMSearchResults& results,
+                     const CHMCancelCheck& cancelled = {});
+
+    /*!
+      \brief Walks the $FIftiMain B-tree down to the first leaf node that could hold words starting with prefix.
+      \param prefix The (lowercase) prefix we're interested in.
+      \return The offset of the leaf node, or 0 if there is no full-text index or the prefix can't be in it.
+     */
+    uint32_t IndexLeafOffset(const wxString& prefix);
+
+    /*!
+      \brief Collects the $FIftiMain words starting with prefix, scanning leaf nodes from leafOffset on.
+      \param prefix The (lowercase) prefix words have to start with.
+      \param leafOffset A leaf node offset returned by IndexLeafOffset() for prefix, or one where a previous scan for a
+      prefix of prefix has stopped. On return, it holds the offset of the leaf node where this scan stopped.
+      \param maxWords Stop after collecting this many words.
+      \param words Receives the matching words, in index order.
+      \param truncated Set to true if there were more than maxWords matching words.
+      \param cancelled Optional. Polled between leaf nodes, the scan is abandoned if it returns true.
+      \return false if the index could not be read or the scan has been cancelled, true otherwise.
+     */
+    bool IndexPrefixWords(const wxString& prefix, uint32_t& leafOffset, size_t maxWords, CHMIndexWords& words,
+                          bool& truncated, const CHMCancelCheck& cancelled = {});
+
+    /*!
+      \brief Adds the pages a word found with IndexPrefixWords() occurs in to results.
+      \param word The word.
+      \param results URL / title pairs, at most MAX_SEARCH_RESULTS of them.
+      \param cancelled Optional. Polled between pages, the lookup is abandoned if it returns true.
+      \return false on error or cancellation, true otherwise.
+     */
+    bool IndexWordResults(const CHMIndexWord& word, CHMSearchResults& results, const CHMCancelCheck& cancelled = {});
 
     /*!
       \brief Looks up fileName in the archive.
@@ -202,6 +317,21 @@ public:
      */
     size_t RetrieveObject(chmUnitInfo* ui, unsigned char* buffer, off_t fileOffset, size_t bufferSize);
 
+#ifdef ENABLE_BUILTIN_CHMLIB
+    /*!
+      \brief Pins a chunk of a file in the .chm, seen right in the decompressed blocks cache instead of copied out.
+      \param ui Pointer to a CHMLIB specific data structure obtained from a succesful call to ResolveObject().
+      \param fileOffset Where does the chunk we want begin in the file?
+      \param size How much we'd like. The chunk might be shorter, it never crosses a compressed block boundary.
+      \param span Receives the chunk. Has to be released with ReleaseSpan() before this object goes away.
+      \return 0 on error, length of the chunk otherwise.
+     */
+    size_t RetrieveSpan(chmUnitInfo* ui, off_t fileOffset, size_t size, chmSpan* span);
+
+    //! Unpins a chunk obtained from RetrieveSpan().
+    void ReleaseSpan(chmSpan* span);
+#endif
+
 public:
     //! No copy construction allowed.
     CHMFile(const CHMFile&) = delete;
@@ -219,14 +349,27 @@ private:
     //! Helper. Initializes most of the private data members.
     bool GetArchiveInfo();
 
+    //! Helper. Resolves the units full-text search needs and reads the $FIftiMain header.
+    bool OpenFullTextSearch(FullTextSearchInfo& fts);
+
+    //! Helper. Searches our own full-text index, building it first if necessary.
+    bool FullTextIndexSearch(const wxString& text, bool wholeWords, bool titlesOnly, CHMSearchResults& results);
+
     //! Helper. Returns the $FIftiMain offset of leaf node or 0.
     uint32_t GetLeafNodeOffset(const wxString& text, uint32_t initalOffset, uint32_t buffSize, uint16_t treeDepth,
                                chmFile* file, chmUnitInfo* ui);
 
+    /*!
+      \brief Helper. Decodes all the entries of a $FIftiMain leaf node.
+      \param word The last word decoded, since leaf entries are prefix-compressed. Updated on return.
+      \param nextOffset Receives the offset of the next leaf node, or 0 if this was the last one.
+     */
+    bool ReadLeafNode(FullTextSearchInfo& fts, uint32_t offset, UCharVector& buffer, wxString& word,
+                      CHMIndexWords& entries, uint32_t& nextOffset);
+
     //! Helper. Processes the word location code entries while searching.
-    bool ProcessWLC(uint64_t wlc_count, uint64_t wlc_size, uint32_t wlc_offset, unsigned char ds, unsigned char dr,
-                    unsigned char cs, unsigned char cr, unsigned char ls, unsigned char lr, IndexSearchUnitsInfo& uis,
-                    CHMSearchResults& results);
+    bool ProcessWLC(uint64_t wlc_count, uint64_t wlc_size, uint32_t wlc_offset, FullTextSearchInfo& fts,
+                    CHMSearchResults& results, const CHMCancelCheck& cancelled);
 
     //! Looks up as much information as possible from #WINDOWS/#STRINGS.
     bool InfoFromWindows();
@@ -234,19 +377,27 @@ private:
     //! Looks up as much information as possible from #SYSTEM.
     bool InfoFromSystem();
 
-    //! Load binary TOC (if available)
-    bool BinaryTOC(wxTreeCtrl& toBuild);
+    //! Load binary TOC (if available), into tree (its URLs kept in treeStrings) or list
+    bool BinaryTOC(wxTreeCtrl* tree, CHMStringArena* treeStrings, const CHMIndexCallback* list);
 
-    //! Try to recursively load the binary topics tree
+    //! Try to recursively load the binary topics tree, visiting at most entriesLeft entries
     void RecurseLoadBTOC(UCharVector& topidx, UCharVector& topics, UCharVector& strings, UCharVector& urltbl,
-                         UCharVector& urlstr, uint32_t offset, wxTreeCtrl& toBuild, int level);
+                         UCharVector& urlstr, uint32_t offset, wxTreeCtrl* tree, CHMStringArena* treeStrings,
+                         const CHMIndexCallback* list, int level, size_t& entriesLeft);
 
-    //! Retrieve the data (name/URL) for a single entry (TOC or index)
+    //! Retrieve the data (name/URL) for a single entry (TOC or index). Index entries pass their name in idxName.
     bool GetItem(UCharVector& topics, UCharVector& strings, UCharVector& urltbl, UCharVector& urlstr, uint32_t index,
-                 wxTreeCtrl* tree, CHMListCtrl* list, const wxString& idxName, int level, bool local);
+                 wxTreeCtrl* tree, CHMStringArena* treeStrings, const CHMIndexCallback* list, const wxString* idxName,
+                 int level, bool local);
 
     //! Get the binary index (if available)
-    bool BinaryIndex(CHMListCtrl& toBuild, const wxCSConv& cv);
+    bool BinaryIndex(const CHMIndexCallback& add, const wxCSConv& cv);
+
+    //! Feeds a whole HTML TOC or index file to parser, in as few contiguous pieces as possible.
+    void ParseSitemap(chmUnitInfo* ui, HHCParser& parser);
+
+    //! Converts a NUL-terminated string from the archive's encoding.
+    wxString FromArchive(const char* str) const;
 
 private:
     chmFile*       _chmFile {nullptr};
@@ -259,6 +410,10 @@ private:
     wxString       _font;
     wxFontEncoding _enc;
     CHMIDMap       _cidMap;
+
+    std::unique_ptr<CHMFullTextIndex> _ftIndex;
+    std::mutex                        _ftIndexMutex;
+    std::unique_ptr<wxCSConv>         _cvPtr;
 };
 
 #endif // __CHMFILE_H_
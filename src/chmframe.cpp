@@ -22,6 +22,7 @@
 */
 
 #include <algorithm>
+#include <vector>
 #include <chmfontdialog.h>
 #include <chmframe.h>
 #include <chmhtmlnotebook.h>
@@ -30,6 +31,8 @@
 #include <chminputstream.h>
 #include <chmlistctrl.h>
 #include <chmsearchpanel.h>
+#include <chmstatsdialog.h>
+#include <chmtrace.h>
 #include <hhcparser.h>
 #include <wx/accel.h>
 #include <wx/artprov.h>
@@ -57,6 +60,7 @@
 #define FORWARD_HELP _("Go forward in history. Per book.")
 #define BACK_HELP _("Back to the last visited page. Per book.")
 #define ABOUT_HELP _("About the program.")
+#define STATISTICS_HELP _("Show performance counters.")
 #define COPY_HELP _("Copy selection.")
 #define FIND_HELP _("Find word in page.")
 #define FULLSCREEN_HELP _("Toggle fullscreen mode.")
@@ -104,6 +108,66 @@ const wxChar* about_txt = wxT("xCHM v. " VERSION
 #include <logo.xpm>
 #include <xchm.xpm>
 
+// Contents tree pages read ahead after the current one, and before it.
+constexpr size_t PREFETCH_NEXT_PAGES {2};
+constexpr size_t PREFETCH_PRIOR_PAGES {1};
+
+// The item after id in the contents tree, in reading order (depth first).
+wxTreeItemId NextInReadingOrder(wxTreeCtrl* tcl, wxTreeItemId id)
+{
+    wxTreeItemIdValue cookie;
+
+    if (tcl->ItemHasChildren(id))
+        return tcl->GetFirstChild(id, cookie);
+
+    for (; id.IsOk(); id = tcl->GetItemParent(id)) {
+        auto next = tcl->GetNextSibling(id);
+
+        if (next.IsOk())
+            return next;
+    }
+
+    return {};
+}
+
+// The item before id in the contents tree, in reading order.
+wxTreeItemId PriorInReadingOrder(wxTreeCtrl* tcl, wxTreeItemId id)
+{
+    auto prior = tcl->GetPrevSibling(id);
+
+    if (!prior.IsOk())
+        return tcl->GetItemParent(id);
+
+    while (tcl->ItemHasChildren(prior))
+        prior = tcl->GetLastChild(prior);
+
+    return prior;
+}
+
+// Collects up to count page URLs (archive paths) walking away from id, skipping items without one.
+void NeighbourPages(wxTreeCtrl* tcl, wxTreeItemId id, size_t count, bool forward, std::vector<wxString>& pages)
+{
+    wxString last;
+
+    while (count && (id = forward ? NextInReadingOrder(tcl, id) : PriorInReadingOrder(tcl, id)).IsOk()) {
+        auto data = dynamic_cast<URLTreeItem*>(tcl->GetItemData(id));
+
+        if (!data)
+            continue;
+
+        // Several items often point into the same page.
+        auto target = data->URL();
+        auto url    = wxT("/") + target.BeforeFirst(wxT('#'));
+
+        if (target.IsEmpty() || url == last)
+            continue;
+
+        pages.push_back(url);
+        last = url;
+        --count;
+    }
+}
+
 } // namespace
 
 CHMFrame::CHMFrame(const wxString& title, const wxString& booksDir, const wxPoint& pos, const wxSize& size,
@@ -172,6 +236,7 @@ CHMFrame::CHMFrame(const wxString& title, const wxString& booksDir, const wxPoin
     // Event bindings
     Bind(wxEVT_MENU, &CHMFrame::OnQuit, this, ID_Quit);
     Bind(wxEVT_MENU, &CHMFrame::OnAbout, this, ID_About);
+    Bind(wxEVT_MENU, &CHMFrame::OnStatistics, this, ID_Statistics);
     Bind(wxEVT_MENU, &CHMFrame::OnOpen, this, ID_Open);
     Bind(wxEVT_MENU, &CHMFrame::OnChangeFonts, this, ID_Fonts);
     Bind(wxEVT_MENU, &CHMFrame::OnHome, this, ID_Home);
@@ -214,6 +279,12 @@ void CHMFrame::OnAbout(wxCommandEvent&)
     wxMessageBox(about_txt, _("About xCHM"), wxOK | wxICON_INFORMATION, this);
 }
 
+void CHMFrame::OnStatistics(wxCommandEvent&)
+{
+    CHMStatsDialog dlg(this);
+    dlg.ShowModal();
+}
+
 void CHMFrame::OnOpen(wxCommandEvent&)
 {
     auto selection = wxFileSelector(_("Choose a file.."), _openPath, wxEmptyString, wxT("chm"),
@@ -386,10 +457,10 @@ void CHMFrame::OnAddBookmark(wxCommandEvent&)
 
     auto data = dynamic_cast<URLTreeItem*>(_tcl->GetItemData(id));
 
-    if (!data || (data->_url).IsEmpty())
+    if (!data || !data->_url.length)
         return;
 
-    _cb->Append(title, new wxString(data->_url));
+    _cb->Append(title, new wxString(data->URL()));
 
     _bookmarkSel = false;
     _cb->SetSelection(_cb->GetCount() - 1);
@@ -445,14 +516,22 @@ void CHMFrame::OnSelectionChanged(wxTreeEvent& event)
 
     auto data = dynamic_cast<URLTreeItem*>(_tcl->GetItemData(id));
 
-    if (!data || data->_url.IsEmpty())
+    if (!data || !data->_url.length)
         return;
 
     if (!_nbhtml->GetCurrentPage()->IsCaller()) {
         _nbhtml->GetCurrentPage()->SetSync(false);
-        _nbhtml->LoadPageInCurrentView(wxT("file:") + chmf->ArchiveName() + wxT("#xchm:/") + data->_url);
+        _nbhtml->LoadPageInCurrentView(wxT("file:") + chmf->ArchiveName() + wxT("#xchm:/") + data->URL());
         _nbhtml->GetCurrentPage()->SetSync(true);
     }
+
+    // Sequential reading: have the pages around this one ready before they're asked for.
+    std::vector<wxString> pages;
+
+    NeighbourPages(_tcl, id, PREFETCH_NEXT_PAGES, true, pages);
+    NeighbourPages(_tcl, id, PREFETCH_PRIOR_PAGES, false, pages);
+
+    CHMInputStream::GetPrefetcher()->Speculate(chmf->ArchiveName(), pages);
 }
 
 void CHMFrame::OnCloseWindow(wxCloseEvent&)
@@ -474,8 +553,9 @@ void CHMFrame::OnChar(wxKeyEvent& event)
 
 bool CHMFrame::LoadCHM(const wxString& archive)
 {
-    wxBusyCursor bc;
-    wxLogNull    wln;
+    CHMTrace::Scope trace("CHMFrame::LoadCHM");
+    wxBusyCursor    bc;
+    wxLogNull       wln;
 
     auto rtn = false;
 
@@ -501,6 +581,7 @@ bool CHMFrame::LoadCHM(const wxString& archive)
         if (_tcl->GetCount()) {
             _tcl->Unselect();
             _tcl->DeleteChildren(_tcl->GetRootItem());
+            _tocStrings.Clear();
         }
 
         if (_sw->IsSplit()) {
@@ -537,6 +618,8 @@ bool CHMFrame::LoadContextID(int contextID)
 
 void CHMFrame::UpdateCHMInfo()
 {
+    CHMTrace::Scope trace("CHMFrame::UpdateCHMInfo");
+
 #if !wxUSE_UNICODE
     static auto noSpecialFont = true;
     static auto enc           = wxFont::GetDefaultEncoding();
@@ -569,6 +652,7 @@ void CHMFrame::UpdateCHMInfo()
         _tcl->Freeze();
         _tcl->DeleteChildren(_tcl->GetRootItem());
         _tcl->Thaw();
+        _tocStrings.Clear();
     }
 
 #if !wxUSE_UNICODE
@@ -615,7 +699,7 @@ void CHMFrame::UpdateCHMInfo()
     }
 #endif
     if (_loadTopics)
-        chmf->GetTopicsTree(*_tcl);
+        chmf->GetTopicsTree(*_tcl, _tocStrings);
 
     if (_loadIndex)
         chmf->GetIndex(*_cip->GetResultsList());
@@ -686,6 +770,7 @@ wxMenuBar* CHMFrame::CreateMenu()
     menuHistory->Append(ID_Back, _("&Back\tAlt-LEFT"), BACK_HELP);
 
     auto menuHelp = new wxMenu;
+    menuHelp->Append(ID_Statistics, _("&Statistics.."), STATISTICS_HELP);
     menuHelp->Append(ID_About, _("&About..\tF1"), ABOUT_HELP);
 
     auto menuEdit = new wxMenu;
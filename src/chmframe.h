@@ -21,6 +21,7 @@
 #define __CHMFRAME_H_
 
 #include <array>
+#include <chmstringarena.h>
 #include <memory>
 #include <wx/combobox.h>
 #include <wx/docview.h>
@@ -76,6 +77,7 @@ enum {
     ID_NewTab,
     ID_FullScreen,
     ID_ToggleToolbar,
+    ID_Statistics,
     ID_TreeCtrl = 1000,
 };
 
@@ -145,6 +147,9 @@ protected:
     //! Called when the user clicks on About.
     void OnAbout(wxCommandEvent& event);
 
+    //! Called when the user wants to see the performance counters.
+    void OnStatistics(wxCommandEvent& event);
+
     //! Called when the user wants to open a file.
     void OnOpen(wxCommandEvent& event);
 
@@ -232,6 +237,7 @@ private:
 private:
     CHMHtmlNotebook*                    _nbhtml;
     wxTreeCtrl*                         _tcl {nullptr};
+    CHMStringArena                      _tocStrings;
     wxSplitterWindow*                   _sw {nullptr};
     wxMenu*                             _menuFile {nullptr};
     wxToolBar*                          _tb {nullptr};
@@ -17,8 +17,30 @@
   MA 02110-1301, USA.
 */
 
+#include <algorithm>
 #include <chmfshandler.h>
 #include <chminputstream.h>
+#include <chmprefetcher.h>
+#include <string>
+#include <stringutils.h>
+
+namespace {
+
+// Archive names remembered by ArchiveFileName().
+constexpr size_t ARCHIVE_NAMES_MEMO {8};
+
+wxString FromBytes(const std::string& bytes)
+{
+    auto str = wxString::FromUTF8(bytes.c_str(), bytes.size());
+
+    // Some books escape their Latin-1 file names byte by byte.
+    if (str.IsEmpty() && !bytes.empty())
+        str = wxString(bytes.c_str(), wxConvISO8859_1, bytes.size());
+
+    return str;
+}
+
+} // end of anonymous namespace
 
 CHMFSHandler::~CHMFSHandler()
 {
@@ -45,29 +67,12 @@ wxFSFile* CHMFSHandler::OpenFile(wxFileSystem& fs, const wxString& location)
     } else if (GetProtocol(left) != wxT("file"))
         return nullptr;
 
-    // HTML code for space is %20
-    right.Replace(wxT("%20"), wxT(" "), true);
-    right.Replace(wxT("%5F"), wxT("_"), true);
-    right.Replace(wxT("%2E"), wxT("."), true);
-    right.Replace(wxT("%2D"), wxT("-"), true);
-    right.Replace(wxT("%26"), wxT("&"), true);
+    right = NormalizeRight(cwd, right);
 
-    auto filename = wxFileSystem::URLToFileName(left);
-    filename.Normalize(wxPATH_NORM_ENV_VARS | wxPATH_NORM_DOTS | wxPATH_NORM_TILDE | wxPATH_NORM_ABSOLUTE
-                       | wxPATH_NORM_LONG | wxPATH_NORM_SHORTCUT);
-
-    auto len = cwd.Length();
-    if (right.Length() > len && right.StartsWith(cwd) && right[len] == wxT('/'))
-        right = right.Mid(len);
-
-    wxFileName fwfn(right, wxPATH_UNIX);
-    fwfn.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE, cwd, wxPATH_UNIX);
-    right = fwfn.GetFullPath(wxPATH_UNIX);
-
-    auto s = std::make_unique<CHMInputStream>(left.IsEmpty() ? left : filename.GetFullPath(), right);
+    auto s = std::make_unique<CHMInputStream>(left.IsEmpty() ? left : ArchiveFileName(left), right);
 
     if (s && s->IsOk()) {
-        auto cache = s->GetCache();
+        auto cache = s->Archive();
 
         if (right.IsSameAs(wxT("/")))
             right = cache->HomePage();
@@ -77,9 +82,50 @@ wxFSFile* CHMFSHandler::OpenFile(wxFileSystem& fs, const wxString& location)
             right = right.AfterLast(wxT(':'));
 
         auto newLocation = wxT("file:") + cache->ArchiveName() + wxT("#xchm:") + right;
+        auto mimeType    = GetMimeTypeFromExt(right.Lower());
 
-        return new wxFSFile(s.release(), newLocation, GetMimeTypeFromExt(right.Lower()), GetAnchor(location), {});
+        // Get the images, stylesheets etc. decompressed while wxHtml is still busy with the page itself.
+        if (CHM_CONCURRENT_READERS && mimeType == wxT("text/html"))
+            CHMInputStream::GetPrefetcher()->Submit(cache, right);
+
+        return new wxFSFile(s.release(), newLocation, mimeType, GetAnchor(location), {});
     }
 
     return nullptr;
 }
+
+wxString CHMFSHandler::ArchiveFileName(const wxString& left)
+{
+    for (auto it = _archiveNames.begin(); it != _archiveNames.end(); ++it)
+        if (it->first == left) {
+            if (it != _archiveNames.begin())
+                std::rotate(_archiveNames.begin(), it, it + 1);
+
+            return _archiveNames.front().second;
+        }
+
+    auto filename = wxFileSystem::URLToFileName(left);
+    filename.Normalize(wxPATH_NORM_ENV_VARS | wxPATH_NORM_DOTS | wxPATH_NORM_TILDE | wxPATH_NORM_ABSOLUTE
+                       | wxPATH_NORM_LONG | wxPATH_NORM_SHORTCUT);
+
+    if (_archiveNames.size() == ARCHIVE_NAMES_MEMO)
+        _archiveNames.pop_back();
+
+    _archiveNames.emplace(_archiveNames.begin(), left, filename.GetFullPath());
+    return _archiveNames.front().second;
+}
+
+wxString CHMFSHandler::NormalizeRight(const wxString& cwd, const wxString& right)
+{
+    std::string dir(cwd.utf8_str());
+    auto        path = percentDecode(std::string(right.utf8_str()));
+
+    auto len = dir.size();
+    if (len && path.size() > len && !path.compare(0, len, dir) && path[len] == '/')
+        path.erase(0, len);
+
+    if (path.empty() || path[0] != '/')
+        path.insert(0, dir + '/');
+
+    return FromBytes(normalizePath(path));
+}
@@ -20,6 +20,8 @@
 #ifndef __CHMFSHANDLER_H_
 #define __CHMFSHANDLER_H_
 
+#include <utility>
+#include <vector>
 #include <wx/filesys.h>
 
 /*!
@@ -62,6 +64,21 @@ public:
 
     //! No assignment.
     CHMFSHandler& operator=(const CHMFSHandler&) = delete;
+
+private:
+    //! Helper. Returns the full path of the archive a "file:" URL points to, remembering the last few.
+    wxString ArchiveFileName(const wxString& left);
+
+    /*!
+      \brief Helper. Percent-decodes right and makes it an absolute, normalized path inside the archive.
+      \param cwd The current directory inside the archive.
+      \param right The right location of the URL being opened.
+      \return The normalized path.
+     */
+    static wxString NormalizeRight(const wxString& cwd, const wxString& right);
+
+private:
+    std::vector<std::pair<wxString, wxString>> _archiveNames;
 };
 
 #endif // __CHMFSHANDLER_H_
@@ -0,0 +1,602 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <algorithm>
+#include <chmfile.h>
+#include <chmfulltextindex.h>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <wx/ffile.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/stdpaths.h>
+
+namespace {
+
+constexpr char   INDEX_MAGIC[] {"XCHMFTI1"};
+constexpr size_t INDEX_MAGIC_LEN {sizeof(INDEX_MAGIC) - 1};
+
+// Longer "words" are almost always base64 blobs or similar garbage.
+constexpr size_t MAX_WORD_LEN {64};
+
+// Pages larger than this are not worth indexing (and are most likely not text anyway).
+constexpr uint64_t MAX_PAGE_SIZE {16 * 1024 * 1024};
+
+// No point in spinning up a thread for just a handful of pages.
+constexpr size_t MIN_PAGES_PER_THREAD {16};
+
+using Postings = std::vector<uint32_t>;
+using TermMap  = std::unordered_map<std::string, Postings>;
+
+inline bool IsWordByte(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+inline unsigned char FoldByte(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+inline bool IsHTMLFile(const char* path)
+{
+    auto len = strlen(path);
+
+    auto endsWith = [path, len](const char* ext) {
+        auto extLen = strlen(ext);
+
+        if (len <= extLen)
+            return false;
+
+        for (size_t i = 0; i < extLen; ++i)
+            if (FoldByte(path[len - extLen + i]) != ext[i])
+                return false;
+
+        return true;
+    };
+
+    return endsWith(".htm") || endsWith(".html");
+}
+
+//! Case-insensitive search for an ASCII (lowercase) needle.
+size_t FindNoCase(const unsigned char* data, size_t len, size_t from, const char* needle)
+{
+    auto needleLen = strlen(needle);
+
+    for (auto i = from; i + needleLen <= len; ++i) {
+        size_t j = 0;
+
+        while (j < needleLen && FoldByte(data[i + j]) == static_cast<unsigned char>(needle[j]))
+            ++j;
+
+        if (j == needleLen)
+            return i;
+    }
+
+    return len;
+}
+
+/*!
+  Strips the markup off a page and calls addWord for every word (folded to lowercase) in it. Script and style
+  contents, comments and entities are skipped. The (raw) contents of the <title> tag end up in title.
+ */
+void TokenizePage(const unsigned char* data, size_t len, std::string& title,
+                  const std::function<void(const std::string&, bool)>& addWord)
+{
+    std::string word;
+    auto        inTitle = false;
+
+    auto flush = [&] {
+        if (!word.empty() && word.length() <= MAX_WORD_LEN)
+            addWord(word, inTitle);
+        word.clear();
+    };
+
+    for (size_t i = 0; i < len;) {
+        auto c = data[i];
+
+        if (c == '<') {
+            flush();
+
+            if (len - i >= 4 && memcmp(data + i, "<!--", 4) == 0) {
+                auto end = FindNoCase(data, len, i + 4, "-->");
+                i        = end < len ? end + 3 : len;
+                continue;
+            }
+
+            auto j       = i + 1;
+            auto closing = j < len && data[j] == '/';
+
+            if (closing)
+                ++j;
+
+            std::string name;
+
+            while (j < len && IsWordByte(data[j]) && data[j] < 0x80 && name.length() < 16)
+                name += static_cast<char>(FoldByte(data[j++]));
+
+            auto gt = std::find(data + j, data + len, '>') - data;
+            i       = gt < static_cast<ptrdiff_t>(len) ? gt + 1 : len;
+
+            if (closing) {
+                if (name == "title")
+                    inTitle = false;
+
+            } else if (name == "title")
+                inTitle = true;
+
+            else if (name == "script" || name == "style") {
+                auto end = FindNoCase(data, len, i, name == "script" ? "</script" : "</style");
+                i        = end;
+            }
+
+            continue;
+        }
+
+        if (c == '&') {
+            flush();
+
+            // Skip the entity, if it looks like one.
+            auto j = i + 1;
+            while (j < len && j - i < 10 && (IsWordByte(data[j]) || data[j] == '#'))
+                ++j;
+
+            if (j < len && data[j] == ';') {
+                if (inTitle) {
+                    std::string entity(data + i + 1, data + j);
+                    title += entity == "amp" ? "&" : entity == "lt" ? "<" : entity == "gt" ? ">" : " ";
+                }
+                i = j + 1;
+
+            } else {
+                if (inTitle)
+                    title += '&';
+                ++i;
+            }
+
+            continue;
+        }
+
+        if (inTitle)
+            title += static_cast<char>(c);
+
+        if (IsWordByte(c))
+            word += static_cast<char>(FoldByte(c));
+        else
+            flush();
+
+        ++i;
+    }
+
+    flush();
+
+    // Collapse the whitespace in the title.
+    std::string collapsed;
+
+    for (auto c : title)
+        if (!isspace(static_cast<unsigned char>(c)))
+            collapsed += c;
+        else if (!collapsed.empty() && collapsed.back() != ' ')
+            collapsed += ' ';
+
+    if (!collapsed.empty() && collapsed.back() == ' ')
+        collapsed.pop_back();
+
+    title = std::move(collapsed);
+}
+
+//! Indexes pages [begin, end) into terms, using its own CHMLIB handle, counting the ones it could in indexed.
+void IndexPages(const std::string& archiveName, const std::vector<chmUnitInfo>& pages, size_t begin, size_t end,
+                std::vector<CHMFullTextIndex::Document>& docs, TermMap& terms, size_t& indexed)
+{
+    auto file = chm_open(archiveName.c_str());
+
+    if (!file)
+        return;
+
+#ifdef ENABLE_BUILTIN_CHMLIB
+    // The pages are sorted in archive order.
+    chm_set_param(file, CHM_PARAM_ACCESS_PATTERN, CHM_ACCESS_SEQUENTIAL);
+#endif
+
+    std::vector<unsigned char>            buffer;
+    std::unordered_map<std::string, bool> pageTerms;
+
+    for (auto i = begin; i < end; ++i) {
+        auto ui = pages[i];
+
+        if (ui.length > MAX_PAGE_SIZE)
+            continue;
+
+        buffer.resize(ui.length);
+
+        if (ui.length && chm_retrieve_object(file, &ui, &buffer[0], 0, ui.length) != static_cast<LONGINT64>(ui.length))
+            continue;
+
+        auto& doc = docs[i];
+        doc.url   = ui.path;
+
+        pageTerms.clear();
+        TokenizePage(buffer.data(), buffer.size(), doc.title, [&pageTerms](const std::string& word, bool inTitle) {
+            auto& title = pageTerms[word];
+            title       = title || inTitle;
+        });
+
+        for (auto&& term : pageTerms)
+            terms[term.first].push_back((static_cast<uint32_t>(i) << 1) | term.second);
+
+        ++indexed;
+    }
+
+    chm_close(file);
+}
+
+int CollectPages(chmFile*, chmUnitInfo* ui, void* context)
+{
+    if (IsHTMLFile(ui->path))
+        static_cast<std::vector<chmUnitInfo>*>(context)->push_back(*ui);
+
+    return CHM_ENUMERATOR_CONTINUE;
+}
+
+void PutVarint(std::vector<unsigned char>& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+bool GetVarint(const unsigned char*& p, const unsigned char* end, uint64_t& value)
+{
+    value = 0;
+
+    for (auto shift = 0; p < end && shift < 64; shift += 7) {
+        auto c = *p++;
+        value |= static_cast<uint64_t>(c & 0x7f) << shift;
+
+        if (!(c & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+void PutString(std::vector<unsigned char>& out, const std::string& s)
+{
+    PutVarint(out, s.length());
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+bool GetString(const unsigned char*& p, const unsigned char* end, std::string& s)
+{
+    uint64_t len;
+
+    if (!GetVarint(p, end, len) || len > static_cast<uint64_t>(end - p))
+        return false;
+
+    s.assign(reinterpret_cast<const char*>(p), len);
+    p += len;
+
+    return true;
+}
+
+} // end of anonymous namespace
+
+bool CHMFullTextIndex::Stat(const wxString& archiveName)
+{
+    wxFileName fn(archiveName);
+
+    if (!fn.FileExists())
+        return false;
+
+    _archive     = fn.GetFullPath();
+    _archiveSize = fn.GetSize().GetValue();
+    _archiveTime = fn.GetModificationTime().GetTicks();
+
+    return true;
+}
+
+wxString CHMFullTextIndex::CacheFileName() const
+{
+#if wxCHECK_VERSION(3, 1, 0)
+    auto dir = wxStandardPaths::Get().GetUserDir(wxStandardPaths::Dir_Cache);
+#else
+    auto dir = wxStandardPaths::Get().GetUserLocalDataDir();
+#endif
+    wxFileName fn(dir, wxEmptyString);
+
+    fn.AppendDir(wxT("xchm"));
+    fn.AppendDir(wxT("fti"));
+
+    // FNV-1a of the archive path: stable across runs and builds, unlike std::hash.
+    uint64_t hash {0xcbf29ce484222325ULL};
+
+    for (auto c : std::string(_archive.utf8_str())) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+
+    fn.SetFullName(wxString::Format(wxT("%016llx.idx"), static_cast<unsigned long long>(hash)));
+
+    return fn.GetFullPath();
+}
+
+bool CHMFullTextIndex::Build(const wxString& archiveName, unsigned threads)
+{
+    _docs.clear();
+    _indexed = 0;
+    _terms.clear();
+    _dict.clear();
+    _postings.clear();
+
+    if (!Stat(archiveName))
+        return false;
+
+    std::string name(archiveName.mb_str());
+    auto        file = chm_open(name.c_str());
+
+    if (!file)
+        return false;
+
+    std::vector<chmUnitInfo> pages;
+    chm_enumerate(file, CHM_ENUMERATE_NORMAL | CHM_ENUMERATE_FILES, CollectPages, &pages);
+    chm_close(file);
+
+    if (pages.empty())
+        return false;
+
+    // Read the content section in storage order, so each thread decompresses contiguous blocks.
+    std::sort(pages.begin(), pages.end(), [](const chmUnitInfo& a, const chmUnitInfo& b) {
+        return a.space != b.space ? a.space < b.space : a.start < b.start;
+    });
+
+    if (!threads)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+
+    threads = std::min<size_t>(threads, std::max<size_t>(1, pages.size() / MIN_PAGES_PER_THREAD));
+
+    _docs.resize(pages.size());
+
+    std::vector<TermMap>     terms(threads);
+    std::vector<size_t>      indexed(threads);
+    std::vector<std::thread> workers;
+    auto                     chunk = (pages.size() + threads - 1) / threads;
+
+    for (unsigned t = 0; t < threads; ++t) {
+        auto begin = std::min(pages.size(), t * chunk);
+        auto end   = std::min(pages.size(), begin + chunk);
+
+        workers.emplace_back(IndexPages, std::cref(name), std::cref(pages), begin, end, std::ref(_docs),
+                             std::ref(terms[t]), std::ref(indexed[t]));
+    }
+
+    for (auto&& worker : workers)
+        worker.join();
+
+    for (auto count : indexed)
+        _indexed += count;
+
+    // Every page skipped or unreadable: nothing worth keeping, or saving.
+    if (!_indexed) {
+        _docs.clear();
+        return false;
+    }
+
+    // Chunks hold increasing document ranges, so appending them in order keeps the postings sorted.
+    auto& merged = terms[0];
+
+    for (unsigned t = 1; t < threads; ++t) {
+        for (auto&& term : terms[t]) {
+            auto& postings = merged[term.first];
+            postings.insert(postings.end(), term.second.begin(), term.second.end());
+        }
+        terms[t].clear();
+    }
+
+    std::vector<const TermMap::value_type*> sorted;
+    sorted.reserve(merged.size());
+
+    for (auto&& term : merged)
+        sorted.push_back(&term);
+
+    std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return a->first < b->first; });
+
+    _dict.reserve(sorted.size());
+
+    for (auto term : sorted) {
+        Term entry {static_cast<uint32_t>(_terms.length()), static_cast<uint32_t>(term->first.length()),
+                    static_cast<uint32_t>(_postings.size()), 0};
+
+        _terms += term->first;
+
+        uint32_t last {0};
+
+        for (auto posting : term->second) {
+            auto doc = posting >> 1;
+            PutVarint(_postings, ((doc - last) << 1) | (posting & 1));
+            last = doc;
+        }
+
+        entry.postingsLength = static_cast<uint32_t>(_postings.size()) - entry.postingsOffset;
+        _dict.push_back(entry);
+    }
+
+    return true;
+}
+
+bool CHMFullTextIndex::Save() const
+{
+    if (!IsOk())
+        return false;
+
+    std::vector<unsigned char> out(INDEX_MAGIC, INDEX_MAGIC + INDEX_MAGIC_LEN);
+
+    PutString(out, std::string(_archive.utf8_str()));
+    PutVarint(out, _archiveSize);
+    PutVarint(out, static_cast<uint64_t>(_archiveTime));
+
+    PutVarint(out, _docs.size());
+    for (auto&& doc : _docs) {
+        PutString(out, doc.url);
+        PutString(out, doc.title);
+    }
+
+    PutVarint(out, _dict.size());
+    for (auto&& term : _dict) {
+        PutVarint(out, term.length);
+        PutVarint(out, term.postingsLength);
+    }
+
+    PutString(out, _terms);
+    out.insert(out.end(), _postings.begin(), _postings.end());
+
+    wxFileName fn(CacheFileName());
+
+    if (!fn.Mkdir(0700, wxPATH_MKDIR_FULL) && !wxFileName::DirExists(fn.GetPath()))
+        return false;
+
+    wxTempFile tmp(fn.GetFullPath());
+
+    return tmp.IsOpened() && tmp.Write(out.data(), out.size()) && tmp.Commit();
+}
+
+bool CHMFullTextIndex::Load(const wxString& archiveName)
+{
+    if (!Stat(archiveName))
+        return false;
+
+    auto cacheName = CacheFileName();
+
+    if (!wxFileName::FileExists(cacheName))
+        return false;
+
+    wxFFile file(cacheName, "rb");
+
+    if (!file.IsOpened())
+        return false;
+
+    std::vector<unsigned char> in(file.Length());
+
+    if (in.empty() || file.Read(in.data(), in.size()) != in.size() || in.size() < INDEX_MAGIC_LEN
+        || memcmp(in.data(), INDEX_MAGIC, INDEX_MAGIC_LEN))
+        return false;
+
+    const unsigned char* p   = in.data() + INDEX_MAGIC_LEN;
+    const unsigned char* end = in.data() + in.size();
+
+    std::string archive;
+    uint64_t    size, mtime, count;
+
+    if (!GetString(p, end, archive) || !GetVarint(p, end, size) || !GetVarint(p, end, mtime)
+        || wxString::FromUTF8(archive.c_str()) != _archive || size != _archiveSize
+        || static_cast<int64_t>(mtime) != _archiveTime || !GetVarint(p, end, count) || count > in.size())
+        return false;
+
+    std::vector<Document> docs(count);
+    size_t                indexed {0};
+
+    // Pages that couldn't be indexed are kept with an empty URL, so that document numbers stay the same.
+    for (auto&& doc : docs) {
+        if (!GetString(p, end, doc.url) || !GetString(p, end, doc.title))
+            return false;
+
+        if (!doc.url.empty())
+            ++indexed;
+    }
+
+    // Written by a build that saved empty indexes.
+    if (!indexed)
+        return false;
+
+    if (!GetVarint(p, end, count) || count > in.size())
+        return false;
+
+    std::vector<Term> dict(count);
+    uint64_t          termsLen {0}, postingsLen {0};
+
+    for (auto&& term : dict) {
+        uint64_t length, postingsLength;
+
+        if (!GetVarint(p, end, length) || !GetVarint(p, end, postingsLength))
+            return false;
+
+        term = {static_cast<uint32_t>(termsLen), static_cast<uint32_t>(length), static_cast<uint32_t>(postingsLen),
+                static_cast<uint32_t>(postingsLength)};
+
+        termsLen += length;
+        postingsLen += postingsLength;
+    }
+
+    std::string terms;
+
+    if (!GetString(p, end, terms) || terms.length() != termsLen
+        || postingsLen != static_cast<uint64_t>(end - p))
+        return false;
+
+    _docs     = std::move(docs);
+    _indexed  = indexed;
+    _dict     = std::move(dict);
+    _terms    = std::move(terms);
+    _postings = std::vector<unsigned char>(p, end);
+
+    return true;
+}
+
+void CHMFullTextIndex::Search(const std::string& word, bool prefix, bool titlesOnly, size_t maxDocs,
+                              std::vector<uint32_t>& docs) const
+{
+    docs.clear();
+
+    if (word.empty())
+        return;
+
+    auto first = std::lower_bound(_dict.begin(), _dict.end(), word, [this](const Term& term, const std::string& w) {
+        return _terms.compare(term.offset, term.length, w) < 0;
+    });
+
+    std::vector<bool> seen(_docs.size());
+
+    for (auto it = first; it != _dict.end() && docs.size() < maxDocs; ++it) {
+        auto matches = prefix ? it->length >= word.length() && _terms.compare(it->offset, word.length(), word) == 0
+                              : _terms.compare(it->offset, it->length, word) == 0;
+        if (!matches)
+            break;
+
+        auto     p   = _postings.data() + it->postingsOffset;
+        auto     end = p + it->postingsLength;
+        uint64_t doc {0}, value;
+
+        while (docs.size() < maxDocs && GetVarint(p, end, value)) {
+            doc += value >> 1;
+
+            if (doc >= _docs.size())
+                break;
+
+            if ((!titlesOnly || (value & 1)) && !seen[doc]) {
+                seen[doc] = true;
+                docs.push_back(static_cast<uint32_t>(doc));
+            }
+        }
+    }
+}
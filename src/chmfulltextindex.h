@@ -0,0 +1,108 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMFULLTEXTINDEX_H_
+#define __CHMFULLTEXTINDEX_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <wx/string.h>
+
+/*!
+  \brief Our own full-text index, for archives that don't come with a $FIftiMain.
+
+  Built by enumerating every HTML page in the archive and stripping the markup, on as many threads as there are
+  cores. Words are indexed as raw bytes in the archive's encoding, with ASCII letters folded to lowercase. The index
+  is a sorted term dictionary, each term pointing to a list of varint-encoded (document delta << 1 | in title) postings.
+  Once built, it's persisted in the user cache directory and reused for as long as the archive doesn't change.
+ */
+class CHMFullTextIndex {
+public:
+    //! An indexed page. Both strings are raw bytes, in the archive's encoding.
+    struct Document {
+        std::string url;
+        std::string title;
+    };
+
+    //! Has at least one page been indexed?
+    bool IsOk() const { return _indexed != 0; }
+
+    //! How many pages have been indexed. The others were too big, or couldn't be read.
+    size_t Indexed() const { return _indexed; }
+
+    /*!
+      \brief Loads the index of archiveName from the cache directory.
+      \param archiveName The .chm filename on disk.
+      \return true if a cached index exists and the archive hasn't changed since it's been built.
+     */
+    bool Load(const wxString& archiveName);
+
+    /*!
+      \brief Builds the index of archiveName.
+      \param archiveName The .chm filename on disk.
+      \param threads How many threads to index on. 0 means one per core.
+      \return true if at least one page has been indexed.
+     */
+    bool Build(const wxString& archiveName, unsigned threads = 0);
+
+    //! Writes the index to the cache directory, where Load() will find it.
+    bool Save() const;
+
+    /*!
+      \brief Looks up a word.
+      \param word The word, in the archive's encoding. Folded to lowercase the same way the pages have been.
+      \param prefix Match all the words starting with word, rather than just word?
+      \param titlesOnly Only match words found in page titles?
+      \param maxDocs Stop after finding this many documents.
+      \param docs Receives the indices of the matching documents, to be passed to Doc().
+     */
+    void Search(const std::string& word, bool prefix, bool titlesOnly, size_t maxDocs,
+                std::vector<uint32_t>& docs) const;
+
+    //! Returns the document with the given index.
+    const Document& Doc(uint32_t index) const { return _docs[index]; }
+
+private:
+    //! A dictionary entry.
+    struct Term {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t postingsOffset;
+        uint32_t postingsLength;
+    };
+
+    //! Helper. Where the index of the current archive lives in the cache directory.
+    wxString CacheFileName() const;
+
+    //! Helper. Records the archive's identity, so that a stale cached index can be told apart.
+    bool Stat(const wxString& archiveName);
+
+private:
+    wxString                   _archive;
+    uint64_t                   _archiveSize {0};
+    int64_t                    _archiveTime {0};
+    std::vector<Document>      _docs;
+    size_t                     _indexed {0};
+    std::string                _terms;
+    std::vector<Term>          _dict;
+    std::vector<unsigned char> _postings;
+};
+
+#endif // __CHMFULLTEXTINDEX_H_
@@ -0,0 +1,1088 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+/*
+  chmgen: writes synthetic, but valid, .chm archives (ITSF/ITSP headers, PMGL/PMGI directory, LZX compressed section,
+  #SYSTEM, contents, index, their binary forms and $FIftiMain full-text index), so that benchmarks and bug reports can be reproduced
+  without sharing anybody's books. The same options and seed always give the same archive.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Sizes fixed by the format, or by what the Microsoft tools write.
+constexpr uint32_t DIR_BLOCK_LEN {0x1000};
+constexpr uint32_t LZX_BLOCK_LEN {0x8000};
+constexpr uint32_t FTS_NODE_LEN {0x1000};
+constexpr uint32_t FTS_HEADER_LEN {0x400};
+constexpr uint32_t BTREE_BLOCK_LEN {0x800};
+constexpr uint32_t BTREE_HEADER_LEN {0x4c};
+constexpr uint32_t LANG_ID {0x409};
+
+// Scale and root of the $FIftiMain word location codes (document, count and location).
+constexpr unsigned char FTS_DR {2};
+constexpr unsigned char FTS_CR {1};
+constexpr unsigned char FTS_LR {3};
+
+using Bytes = std::string;
+
+struct Options {
+    unsigned    pages {500};
+    unsigned    pageSize {4096};
+    unsigned    tocDepth {3};
+    unsigned    indexEntries {0};
+    unsigned    words {2000};
+    unsigned    resetInterval {2};
+    unsigned    seed {1};
+    bool        fts {true};
+    bool        binary {false};
+    std::string lzxSeed;
+    std::string output;
+};
+
+// A file in the archive. Section 0 is stored as is, section 1 is LZX compressed.
+struct File {
+    std::string path;
+    Bytes       data;
+    int         section;
+    uint64_t    start {0};
+};
+
+// Where a word shows up: page -> word positions.
+using Occurrences = std::map<uint32_t, std::vector<uint32_t>>;
+
+struct Word {
+    Occurrences body;
+    Occurrences title;
+};
+
+void Put16(Bytes& out, uint16_t value)
+{
+    out += static_cast<char>(value & 0xff);
+    out += static_cast<char>(value >> 8);
+}
+
+void Put32(Bytes& out, uint32_t value)
+{
+    Put16(out, value & 0xffff);
+    Put16(out, value >> 16);
+}
+
+void Put64(Bytes& out, uint64_t value)
+{
+    Put32(out, value & 0xffffffff);
+    Put32(out, value >> 32);
+}
+
+void Set32(Bytes& out, size_t offset, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+}
+
+bool WriteFile(const std::string& path, const Bytes& data)
+{
+    auto file = std::fopen(path.c_str(), "wb");
+
+    if (!file)
+        return false;
+
+    auto ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+
+    return std::fclose(file) == 0 && ok;
+}
+
+// The directory's ENCINT: big endian groups of 7 bits, the high bit set on all but the last.
+void PutCWord(Bytes& out, uint64_t value)
+{
+    unsigned char groups[10];
+    int           count = 0;
+
+    do {
+        groups[count++] = value & 0x7f;
+        value >>= 7;
+    } while (value);
+
+    while (count--)
+        out += static_cast<char>(groups[count] | (count ? 0x80 : 0));
+}
+
+// $FIftiMain's ENCINT: little endian groups of 7 bits.
+void PutEncInt(Bytes& out, uint64_t value)
+{
+    do {
+        auto group = static_cast<unsigned char>(value & 0x7f);
+        value >>= 7;
+        out += static_cast<char>(group | (value ? 0x80 : 0));
+    } while (value);
+}
+
+void PutUTF16(Bytes& out, const char* str)
+{
+    while (*str)
+        Put16(out, static_cast<unsigned char>(*str++));
+}
+
+void PutGuid(Bytes& out, uint32_t d1, uint16_t d2, uint16_t d3, uint64_t d4)
+{
+    Put32(out, d1);
+    Put16(out, d2);
+    Put16(out, d3);
+
+    for (int i = 7; i >= 0; --i)
+        out += static_cast<char>((d4 >> (8 * i)) & 0xff);
+}
+
+// Most significant bit first, the way both LZX and the word location codes want them.
+class BitWriter {
+public:
+    explicit BitWriter(bool words) : _words(words) {}
+
+    void Put(uint64_t value, unsigned bits)
+    {
+        while (bits--) {
+            _acc = (_acc << 1) | ((value >> bits) & 1);
+
+            if (++_count == (_words ? 16U : 8U))
+                Flush();
+        }
+    }
+
+    // Pads with zeroes to the next byte (or 16-bit word, for LZX).
+    void Align()
+    {
+        while (_count)
+            Put(0, 1);
+    }
+
+    Bytes& Data() { return _out; }
+
+private:
+    void Flush()
+    {
+        if (_words)
+            Put16(_out, static_cast<uint16_t>(_acc));
+        else
+            _out += static_cast<char>(_acc);
+
+        _acc = _count = 0;
+    }
+
+private:
+    bool     _words;
+    uint32_t _acc {0};
+    unsigned _count {0};
+    Bytes    _out;
+};
+
+// Scale 2, root r encoding of the word location codes.
+void PutSR(BitWriter& bits, uint64_t value, unsigned root)
+{
+    if (value < (uint64_t {1} << root)) {
+        bits.Put(0, 1);
+        bits.Put(value, root);
+        return;
+    }
+
+    auto nBits = root;
+
+    while (value >= (uint64_t {1} << (nBits + 1)))
+        ++nBits;
+
+    // count - 1 == nBits - root
+    bits.Put((uint64_t {1} << (nBits - root + 1)) - 1, nBits - root + 1);
+    bits.Put(0, 1);
+    bits.Put(value - (uint64_t {1} << nBits), nBits);
+}
+
+// The order CHMLIB expects the directory in: strcasecmp()'s.
+bool PathLess(const std::string& a, const std::string& b)
+{
+    auto lower = [](unsigned char c) { return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c; };
+
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+                                        [&lower](char x, char y) { return lower(x) < lower(y); });
+}
+
+// Deterministic, pronounceable, and all different.
+std::string MakeWord(unsigned index)
+{
+    static const char* syllables[] = {"ka", "lo", "mi", "nu", "pe", "ra", "si", "to",
+                                      "vu", "ze", "bo", "da", "fi", "gu", "he", "jo"};
+    std::string word;
+
+    for (auto n = index + 16; n; n /= 16)
+        word += syllables[n % 16];
+
+    return word;
+}
+
+std::string PageName(unsigned page)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "page%05u.html", page);
+    return name;
+}
+
+std::string HtmlEscape(const std::string& str)
+{
+    std::string escaped;
+
+    for (auto c : str)
+        if (c == '"')
+            escaped += "&quot;";
+        else if (c == '&')
+            escaped += "&amp;";
+        else if (c == '<')
+            escaped += "&lt;";
+        else
+            escaped += c;
+
+    return escaped;
+}
+
+class Generator {
+public:
+    explicit Generator(const Options& options) : _options(options), _rng(options.seed)
+    {
+        for (unsigned i = 0; i < options.words; ++i)
+            _vocabulary.push_back(MakeWord(i));
+    }
+
+    bool Write();
+
+private:
+    // Skewed towards the first words, like real text.
+    const std::string& PickWord()
+    {
+        auto bound = static_cast<unsigned>(_rng() % _vocabulary.size()) + 1;
+        return _vocabulary[_rng() % bound];
+    }
+
+    void MakePages();
+    void MakeContents();
+    void MakeBinaryContents();
+    void MakeIndex();
+    void MakeBinaryIndex();
+    void MakeSystem();
+    void MakeTopics();
+    void MakeFullTextIndex();
+    void AddFile(const std::string& path, Bytes data, int section) { _files.push_back({path, std::move(data), section}); }
+
+    void     EmitContents(Bytes& out, unsigned first, unsigned last, unsigned level, unsigned fanout);
+    uint32_t EmitBinaryContents(Bytes& out, unsigned first, unsigned last, unsigned level, unsigned fanout);
+    Bytes CompressedSection(std::vector<uint64_t>& resetTable, uint64_t& uncompressedLen);
+    Bytes Directory(unsigned& depth, int& root, unsigned& blocks);
+
+private:
+    const Options&           _options;
+    std::mt19937_64          _rng;
+    std::vector<std::string> _vocabulary;
+    std::vector<std::string> _titles;
+    std::vector<std::pair<std::string, unsigned>> _keywords;
+    std::map<std::string, Word> _index;
+    std::vector<File>        _files;
+};
+
+void Generator::MakePages()
+{
+    for (unsigned page = 0; page < _options.pages; ++page) {
+        std::string title = "Topic " + std::to_string(page + 1);
+        uint32_t    position {0};
+
+        for (int i = 0; i < 2; ++i) {
+            auto& word = PickWord();
+            title += " " + word;
+            _index[word].title[page].push_back(position++);
+        }
+
+        _titles.push_back(title);
+
+        Bytes html = "<html><head><title>" + title + "</title></head><body>\n<h1>" + title + "</h1>\n<p>";
+
+        for (position = 0; html.size() < _options.pageSize; ++position) {
+            auto& word = PickWord();
+
+            _index[word].body[page].push_back(position);
+            html += word;
+            html += position % 12 == 11 ? ".\n" : " ";
+
+            if (position % 120 == 119) {
+                auto target = _rng() % _options.pages;
+                html += "<a href=\"" + PageName(target) + "\">see also</a></p>\n<p>";
+            }
+        }
+
+        html += "</p>\n</body></html>\n";
+        AddFile("/" + PageName(page), std::move(html), 1);
+    }
+}
+
+void Generator::EmitContents(Bytes& out, unsigned first, unsigned last, unsigned level, unsigned fanout)
+{
+    auto chunk = level > 1 ? std::max(1U, (last - first + fanout - 1) / fanout) : 1U;
+
+    out += "<UL>\n";
+
+    for (auto page = first; page < last; page += chunk) {
+        auto end = std::min(page + chunk, last);
+
+        out += "<LI> <OBJECT type=\"text/sitemap\">\n\t<param name=\"Name\" value=\"" + HtmlEscape(_titles[page])
+            + "\">\n\t<param name=\"Local\" value=\"" + PageName(page) + "\">\n\t</OBJECT>\n";
+
+        // The first page of a chunk is the book, the rest its chapters.
+        if (end > page + 1)
+            EmitContents(out, page + 1, end, level - 1, fanout);
+    }
+
+    out += "</UL>\n";
+}
+
+void Generator::MakeContents()
+{
+    auto depth  = std::max(1U, _options.tocDepth);
+    auto fanout = std::max(2U, static_cast<unsigned>(std::ceil(std::pow(_options.pages, 1.0 / depth))));
+
+    Bytes hhc = "<!DOCTYPE HTML PUBLIC \"-//IETF//DTD HTML//EN\">\n<HTML>\n<HEAD>\n</HEAD><BODY>\n"
+                "<OBJECT type=\"text/site properties\">\n\t<param name=\"ImageType\" value=\"Folder\">\n</OBJECT>\n";
+
+    EmitContents(hhc, 0, _options.pages, depth, fanout);
+    hhc += "</BODY></HTML>\n";
+
+    AddFile("/toc.hhc", std::move(hhc), 1);
+}
+
+// #TOCIDX entries: parent, flags, #TOPICS index, unknown, next sibling and, for books, first child. Returns the
+// offset of the first one.
+uint32_t Generator::EmitBinaryContents(Bytes& out, unsigned first, unsigned last, unsigned level, unsigned fanout)
+{
+    auto     chunk = level > 1 ? std::max(1U, (last - first + fanout - 1) / fanout) : 1U;
+    uint32_t head {0}, previous {0};
+
+    for (auto page = first; page < last; page += chunk) {
+        auto end    = std::min(page + chunk, last);
+        auto book   = end > page + 1;
+        auto offset = static_cast<uint32_t>(out.size());
+
+        Put32(out, 0);
+        Put32(out, book ? 0xc : 0x8); // 0x4: book, 0x8: #TOPICS entry
+        Put32(out, page);
+        Put32(out, 0);
+        Put32(out, 0);
+
+        if (book)
+            Put32(out, 0);
+
+        if (previous)
+            Set32(out, previous + 0x10, offset);
+        else
+            head = offset;
+
+        previous = offset;
+
+        if (book)
+            Set32(out, offset + 0x14, EmitBinaryContents(out, page + 1, end, level - 1, fanout));
+    }
+
+    return head;
+}
+
+// The same tree as /toc.hhc, as CHM compilers write it for books with a binary TOC.
+void Generator::MakeBinaryContents()
+{
+    auto depth  = std::max(1U, _options.tocDepth);
+    auto fanout = std::max(2U, static_cast<unsigned>(std::ceil(std::pow(_options.pages, 1.0 / depth))));
+
+    Bytes tocidx;
+
+    // Header: the first entry's offset, and three fields we leave empty.
+    Put32(tocidx, 0);
+    Put32(tocidx, 0);
+    Put32(tocidx, 0);
+    Put32(tocidx, 0);
+
+    Set32(tocidx, 0, EmitBinaryContents(tocidx, 0, _options.pages, depth, fanout));
+
+    AddFile("/#TOCIDX", std::move(tocidx), 1);
+}
+
+void Generator::MakeIndex()
+{
+    auto count = _options.indexEntries ? _options.indexEntries : _options.pages;
+
+    for (unsigned i = 0; i < count; ++i) {
+        auto keyword = _vocabulary[i % _vocabulary.size()];
+
+        if (i >= _vocabulary.size())
+            keyword += " " + std::to_string(i / _vocabulary.size());
+
+        _keywords.emplace_back(keyword, static_cast<unsigned>(_rng() % _options.pages));
+    }
+
+    std::sort(_keywords.begin(), _keywords.end());
+
+    Bytes hhk = "<!DOCTYPE HTML PUBLIC \"-//IETF//DTD HTML//EN\">\n<HTML>\n<HEAD>\n</HEAD><BODY>\n<UL>\n";
+
+    for (auto&& keyword : _keywords)
+        hhk += "<LI> <OBJECT type=\"text/sitemap\">\n\t<param name=\"Name\" value=\"" + HtmlEscape(keyword.first)
+            + "\">\n\t<param name=\"Local\" value=\"" + PageName(keyword.second) + "\">\n\t</OBJECT>\n";
+
+    hhk += "</UL>\n</BODY></HTML>\n";
+
+    AddFile("/index.hhk", std::move(hhk), 1);
+}
+
+// The index as a $WWKeywordLinks/BTree: a chain of leaf blocks, each a header (free space, entry count, previous and
+// next block) and the entries that fit. No index blocks, readers only walk the leaves.
+void Generator::MakeBinaryIndex()
+{
+    Bytes btree(BTREE_HEADER_LEN, '\0'), block;
+    int32_t blocks {0};
+
+    auto flush = [&](bool last) {
+        Bytes header;
+
+        Put16(header, static_cast<uint16_t>(BTREE_BLOCK_LEN - 12 - block.size()));
+        Put16(header, 0);
+        Put32(header, static_cast<uint32_t>(blocks - 1));
+        Put32(header, static_cast<uint32_t>(last ? -1 : blocks + 1));
+
+        block.resize(BTREE_BLOCK_LEN - 12, '\0');
+        btree += header + block;
+        block.clear();
+        ++blocks;
+    };
+
+    for (auto&& keyword : _keywords) {
+        Bytes entry;
+
+        for (auto c : keyword.first)
+            Put16(entry, static_cast<unsigned char>(c));
+
+        Put16(entry, 0);
+        Put16(entry, 0); // not a "see also"
+        Put16(entry, 0); // depth
+        Put32(entry, 0); // character index
+        Put32(entry, 0);
+        Put32(entry, 1); // topics
+        Put32(entry, keyword.second);
+        Put32(entry, 1);
+        Put32(entry, 0);
+
+        if (block.size() + entry.size() > BTREE_BLOCK_LEN - 12)
+            flush(false);
+
+        block += entry;
+    }
+
+    flush(true);
+
+    AddFile("/$WWKeywordLinks/BTree", std::move(btree), 1);
+}
+
+void Generator::MakeSystem()
+{
+    Bytes system;
+
+    auto add = [&system](uint16_t code, const Bytes& data) {
+        Put16(system, code);
+        Put16(system, static_cast<uint16_t>(data.size()));
+        system += data;
+    };
+
+    Bytes lcid;
+    Put32(lcid, LANG_ID);
+    lcid.resize(28, '\0');
+
+    Put32(system, 3);
+    add(0, Bytes("toc.hhc") + '\0');
+    add(1, Bytes("index.hhk") + '\0');
+    add(2, PageName(0) + '\0');
+    add(3, "Synthetic book, seed " + std::to_string(_options.seed) + '\0');
+    add(4, lcid);
+
+    AddFile("/#SYSTEM", std::move(system), 1);
+}
+
+void Generator::MakeTopics()
+{
+    Bytes topics, strings(1, '\0'), urltbl, urlstr(1, '\0');
+
+    for (unsigned page = 0; page < _options.pages; ++page) {
+        Put32(topics, 0);
+        Put32(topics, static_cast<uint32_t>(strings.size()));
+        Put32(topics, static_cast<uint32_t>(urltbl.size()));
+        Put32(topics, 0);
+
+        strings += _titles[page] + '\0';
+
+        Put32(urltbl, 0);
+        Put32(urltbl, page);
+        Put32(urltbl, static_cast<uint32_t>(urlstr.size()));
+
+        Put32(urlstr, 0);
+        Put32(urlstr, 0);
+        urlstr += PageName(page) + '\0';
+    }
+
+    AddFile("/#TOPICS", std::move(topics), 1);
+    AddFile("/#STRINGS", std::move(strings), 1);
+    AddFile("/#URLTBL", std::move(urltbl), 1);
+    AddFile("/#URLSTR", std::move(urlstr), 1);
+}
+
+void Generator::MakeFullTextIndex()
+{
+    struct Entry {
+        const std::string* word;
+        bool               title;
+        uint64_t           docs;
+        uint32_t           offset;
+        uint64_t           size;
+    };
+
+    std::vector<Entry> entries;
+    Bytes              wlcs;
+
+    auto addWord = [&](const std::string& word, const Occurrences& where, bool title) {
+        if (where.empty())
+            return;
+
+        BitWriter bits(false);
+        uint32_t  previous {0};
+
+        for (auto&& [page, positions] : where) {
+            PutSR(bits, page - previous, FTS_DR);
+            PutSR(bits, positions.size(), FTS_CR);
+            previous = page;
+
+            uint32_t last {0};
+
+            for (auto position : positions) {
+                PutSR(bits, position - last, FTS_LR);
+                last = position;
+            }
+
+            // Every document starts on a byte boundary.
+            bits.Align();
+        }
+
+        entries.push_back({&word, title, where.size(), static_cast<uint32_t>(FTS_HEADER_LEN + wlcs.size()),
+                           bits.Data().size()});
+        wlcs += bits.Data();
+    };
+
+    for (auto&& [word, where] : _index) {
+        addWord(word, where.title, true);
+        addWord(word, where.body, false);
+    }
+
+    // Leaf nodes, right after the word location codes.
+    std::vector<Bytes>       nodes;
+    std::vector<std::string> lastWords;
+    std::string              previous;
+    auto                     leavesStart = FTS_HEADER_LEN + static_cast<uint32_t>(wlcs.size());
+
+    for (auto&& entry : entries) {
+        auto& word = *entry.word;
+
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (nodes.empty() || attempt) {
+                nodes.emplace_back(8, '\0');
+                previous.clear();
+                lastWords.emplace_back();
+            }
+
+            size_t pos {0};
+
+            while (pos < previous.size() && pos < word.size() && pos < 255 && previous[pos] == word[pos])
+                ++pos;
+
+            Bytes record;
+            record += static_cast<char>(word.size() - pos + 1);
+            record += static_cast<char>(pos);
+            record += word.substr(pos);
+            record += static_cast<char>(entry.title ? 1 : 0);
+            PutEncInt(record, entry.docs);
+            Put32(record, entry.offset);
+            Put16(record, 0);
+            PutEncInt(record, entry.size);
+
+            if (nodes.back().size() + record.size() <= FTS_NODE_LEN) {
+                nodes.back() += record;
+                previous         = word;
+                lastWords.back() = word;
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        auto& node = nodes[i];
+
+        Set32(node, 0, i + 1 < nodes.size() ? leavesStart + (i + 1) * FTS_NODE_LEN : 0);
+        node[6] = static_cast<char>((FTS_NODE_LEN - node.size()) & 0xff);
+        node[7] = static_cast<char>((FTS_NODE_LEN - node.size()) >> 8);
+        node.resize(FTS_NODE_LEN, '\0');
+    }
+
+    // Index nodes on top, each entry the last word of a node one level down, until there's only one.
+    std::vector<uint32_t> offsets;
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+        offsets.push_back(leavesStart + i * FTS_NODE_LEN);
+
+    uint16_t depth {1};
+
+    for (size_t levelStart = 0; offsets.size() - levelStart > 1; ++depth) {
+        auto                  levelEnd = offsets.size();
+        std::vector<Bytes>    level;
+        std::vector<std::string> levelLast;
+
+        for (auto i = levelStart; i < levelEnd; ++i) {
+            auto& word = lastWords[i];
+
+            for (int attempt = 0; attempt < 2; ++attempt) {
+                if (level.empty() || attempt) {
+                    level.emplace_back(2, '\0');
+                    levelLast.emplace_back();
+                    previous.clear();
+                }
+
+                size_t pos {0};
+
+                while (pos < previous.size() && pos < word.size() && pos < 255 && previous[pos] == word[pos])
+                    ++pos;
+
+                Bytes record;
+                record += static_cast<char>(word.size() - pos + 1);
+                record += static_cast<char>(pos);
+                record += word.substr(pos);
+                Put32(record, offsets[i]);
+                Put16(record, 0);
+
+                if (level.back().size() + record.size() <= FTS_NODE_LEN) {
+                    level.back() += record;
+                    previous         = word;
+                    levelLast.back() = word;
+                    break;
+                }
+            }
+        }
+
+        for (auto& node : level) {
+            node[0] = static_cast<char>((FTS_NODE_LEN - node.size()) & 0xff);
+            node[1] = static_cast<char>((FTS_NODE_LEN - node.size()) >> 8);
+            node.resize(FTS_NODE_LEN, '\0');
+
+            offsets.push_back(leavesStart + nodes.size() * FTS_NODE_LEN);
+            nodes.push_back(std::move(node));
+        }
+
+        lastWords.insert(lastWords.end(), levelLast.begin(), levelLast.end());
+        levelStart = levelEnd;
+    }
+
+    Bytes header(FTS_HEADER_LEN, '\0');
+
+    Set32(header, 0x14, offsets.back());
+    header[0x18] = static_cast<char>(depth & 0xff);
+    header[0x19] = static_cast<char>(depth >> 8);
+    header[0x1e] = 2;
+    header[0x1f] = FTS_DR;
+    header[0x20] = 2;
+    header[0x21] = FTS_CR;
+    header[0x22] = 2;
+    header[0x23] = FTS_LR;
+    Set32(header, 0x2e, FTS_NODE_LEN);
+
+    auto fiftiMain = header + wlcs;
+
+    for (auto&& node : nodes)
+        fiftiMain += node;
+
+    AddFile("/$FIftiMain", std::move(fiftiMain), 1);
+}
+
+Bytes Generator::CompressedSection(std::vector<uint64_t>& resetTable, uint64_t& uncompressedLen)
+{
+    Bytes stream;
+
+    for (auto& file : _files)
+        if (file.section == 1) {
+            file.start = stream.size();
+            stream += file.data;
+        }
+
+    // LZX always decodes whole blocks.
+    stream.resize(std::max<size_t>(1, (stream.size() + LZX_BLOCK_LEN - 1) / LZX_BLOCK_LEN) * LZX_BLOCK_LEN, '\0');
+    uncompressedLen = stream.size();
+
+    // Every block is an LZX "uncompressed" block: not small, but valid, and quick to both write and read.
+    Bytes content;
+
+    for (size_t block = 0; block * LZX_BLOCK_LEN < stream.size(); ++block) {
+        BitWriter bits(true);
+
+        resetTable.push_back(content.size());
+
+        // No Intel E8 translation, at every reset.
+        if (block % _options.resetInterval == 0)
+            bits.Put(0, 1);
+
+        bits.Put(3, 3);
+        bits.Put(LZX_BLOCK_LEN, 24);
+        bits.Align();
+
+        content += bits.Data();
+
+        // R0, R1, R2.
+        for (int i = 0; i < 3; ++i)
+            Put32(content, 1);
+
+        content.append(stream, block * LZX_BLOCK_LEN, LZX_BLOCK_LEN);
+    }
+
+    return content;
+}
+
+Bytes Generator::Directory(unsigned& depth, int& root, unsigned& blocks)
+{
+    std::vector<const File*> sorted;
+    File                     rootDir {"/", {}, 0};
+
+    sorted.push_back(&rootDir);
+
+    for (auto&& file : _files)
+        sorted.push_back(&file);
+
+    std::sort(sorted.begin(), sorted.end(), [](const File* a, const File* b) { return PathLess(a->path, b->path); });
+
+    std::vector<Bytes>                            chunks;
+    std::vector<std::pair<std::string, unsigned>> firsts;
+
+    for (auto file : sorted) {
+        Bytes record;
+
+        PutCWord(record, file->path.size());
+        record += file->path;
+        PutCWord(record, file->section);
+        PutCWord(record, file->start);
+        PutCWord(record, file->data.size());
+
+        if (chunks.empty() || chunks.back().size() + record.size() > DIR_BLOCK_LEN) {
+            chunks.emplace_back(20, '\0');
+            firsts.emplace_back(file->path, static_cast<unsigned>(chunks.size() - 1));
+        }
+
+        chunks.back() += record;
+    }
+
+    auto leaves = static_cast<int>(chunks.size());
+
+    for (int i = 0; i < leaves; ++i) {
+        auto& chunk = chunks[i];
+
+        chunk.replace(0, 4, "PMGL");
+        Set32(chunk, 4, DIR_BLOCK_LEN - chunk.size());
+        Set32(chunk, 12, i ? i - 1 : -1);
+        Set32(chunk, 16, i + 1 < leaves ? i + 1 : -1);
+    }
+
+    // PMGI levels, each entry the first path of a block one level down.
+    depth = 1;
+    root  = -1;
+
+    while (firsts.size() > 1) {
+        std::vector<std::pair<std::string, unsigned>> next;
+        auto                                          levelStart = chunks.size();
+
+        for (auto&& [path, block] : firsts) {
+            Bytes record;
+
+            PutCWord(record, path.size());
+            record += path;
+            PutCWord(record, block);
+
+            if (chunks.size() == levelStart || chunks.back().size() + record.size() > DIR_BLOCK_LEN) {
+                chunks.emplace_back(8, '\0');
+                next.emplace_back(path, static_cast<unsigned>(chunks.size() - 1));
+            }
+
+            chunks.back() += record;
+        }
+
+        for (auto i = levelStart; i < chunks.size(); ++i) {
+            chunks[i].replace(0, 4, "PMGI");
+            Set32(chunks[i], 4, DIR_BLOCK_LEN - chunks[i].size());
+        }
+
+        firsts.swap(next);
+        root = static_cast<int>(chunks.size() - 1);
+        ++depth;
+    }
+
+    Bytes directory;
+
+    for (auto& chunk : chunks) {
+        chunk.resize(DIR_BLOCK_LEN, '\0');
+        directory += chunk;
+    }
+
+    blocks = static_cast<unsigned>(chunks.size());
+
+    return directory;
+}
+
+bool Generator::Write()
+{
+    MakePages();
+    MakeContents();
+    MakeIndex();
+    MakeSystem();
+    MakeTopics();
+
+    if (_options.binary) {
+        MakeBinaryContents();
+        MakeBinaryIndex();
+    }
+
+    if (_options.fts)
+        MakeFullTextIndex();
+
+    std::vector<uint64_t> resetTable;
+    uint64_t              uncompressedLen {0};
+    auto                  content = CompressedSection(resetTable, uncompressedLen);
+
+    if (!_options.lzxSeed.empty()) {
+        // The window size byte, as the LZX fuzz target reads it: 15 + n % 7 bits. 16 bits is our 64 KiB window.
+        Bytes seed(1, '\x01');
+
+        seed.append(content, 0, resetTable.size() > 1 ? resetTable[1] : content.size());
+
+        if (!WriteFile(_options.lzxSeed, seed))
+            return false;
+    }
+
+    Bytes nameList;
+    Put16(nameList, 30);
+    Put16(nameList, 2);
+
+    for (auto name : {"Uncompressed", "MSCompressed"}) {
+        Put16(nameList, static_cast<uint16_t>(std::strlen(name)));
+        PutUTF16(nameList, name);
+        Put16(nameList, 0);
+    }
+
+    Bytes spanInfo;
+    Put64(spanInfo, uncompressedLen);
+
+    Bytes controlData;
+    Put32(controlData, 6);
+    controlData += "LZXC";
+    Put32(controlData, 2);
+    Put32(controlData, _options.resetInterval); // in 32 KiB units
+    Put32(controlData, 2);                      // 64 KiB window
+    Put32(controlData, 1);
+    Put32(controlData, 0);
+
+    Bytes transforms;
+    PutUTF16(transforms, "{7FC28940-9D31-11D0-9B27-00A0C91E9C7C}");
+
+    Bytes reset;
+    Put32(reset, 2);
+    Put32(reset, static_cast<uint32_t>(resetTable.size()));
+    Put32(reset, 8);
+    Put32(reset, 0x28);
+    Put64(reset, uncompressedLen);
+    Put64(reset, content.size());
+    Put64(reset, LZX_BLOCK_LEN);
+
+    for (auto offset : resetTable)
+        Put64(reset, offset);
+
+    const std::string storage = "::DataSpace/Storage/MSCompressed/";
+
+    AddFile("::DataSpace/NameList", std::move(nameList), 0);
+    AddFile(storage + "SpanInfo", std::move(spanInfo), 0);
+    AddFile(storage + "ControlData", std::move(controlData), 0);
+    AddFile(storage + "Transform/List", std::move(transforms), 0);
+    AddFile(storage + "Transform/{7FC28940-9D31-11D0-9B27-00A0C91E9C7C}/InstanceData/ResetTable", std::move(reset),
+            0);
+    AddFile(storage + "Content", std::move(content), 0);
+
+    Bytes data;
+
+    for (auto& file : _files)
+        if (file.section == 0) {
+            file.start = data.size();
+            data += file.data;
+        }
+
+    unsigned depth, blocks;
+    int      root;
+    auto     directory = Directory(depth, root, blocks);
+
+    constexpr uint32_t ITSF_LEN {0x60}, SECTION0_LEN {0x18}, ITSP_LEN {0x54};
+
+    uint64_t dirOffset  = ITSF_LEN + SECTION0_LEN;
+    uint64_t dirLen     = ITSP_LEN + directory.size();
+    uint64_t dataOffset = dirOffset + dirLen;
+
+    Bytes out;
+    out += "ITSF";
+    Put32(out, 3);
+    Put32(out, ITSF_LEN);
+    Put32(out, 1);
+    Put32(out, 0); // timestamp, kept at 0 so that archives are reproducible
+    Put32(out, LANG_ID);
+    PutGuid(out, 0x7C01FD10, 0x7BAA, 0x11D0, 0x9E0C00A0C922E6ECULL);
+    PutGuid(out, 0x7C01FD11, 0x7BAA, 0x11D0, 0x9E0C00A0C922E6ECULL);
+    Put64(out, ITSF_LEN);
+    Put64(out, SECTION0_LEN);
+    Put64(out, dirOffset);
+    Put64(out, dirLen);
+    Put64(out, dataOffset);
+
+    Put32(out, 0x01FE);
+    Put32(out, 0);
+    Put64(out, dataOffset + data.size());
+    Put32(out, 0);
+    Put32(out, 0);
+
+    out += "ITSP";
+    Put32(out, 1);
+    Put32(out, ITSP_LEN);
+    Put32(out, 0x0a);
+    Put32(out, DIR_BLOCK_LEN);
+    Put32(out, 2);
+    Put32(out, depth);
+    Put32(out, root);
+    Put32(out, 0);
+    Put32(out, -1);
+    Put32(out, blocks);
+    Put32(out, -1);
+    Put32(out, LANG_ID);
+    PutGuid(out, 0x5D02926A, 0x212E, 0x11D0, 0x9DF900A0C922E6ECULL);
+    out.append(16, '\xff');
+
+    out += directory;
+    out += data;
+
+    return WriteFile(_options.output, out);
+}
+
+bool ParseArgs(int argc, char** argv, Options& options)
+{
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg.size() == 2 && arg[0] == '-' && std::strchr("psdkwrS", arg[1]) && i + 1 < argc) {
+            auto value = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+
+            switch (arg[1]) {
+            case 'p':
+                options.pages = value;
+                break;
+            case 's':
+                options.pageSize = value;
+                break;
+            case 'd':
+                options.tocDepth = value;
+                break;
+            case 'k':
+                options.indexEntries = value;
+                break;
+            case 'w':
+                options.words = value;
+                break;
+            case 'r':
+                options.resetInterval = value;
+                break;
+            default:
+                options.seed = value;
+            }
+
+        } else if (arg == "-l" && i + 1 < argc)
+            options.lzxSeed = argv[++i];
+        else if (arg == "-n")
+            options.fts = false;
+        else if (arg == "-b")
+            options.binary = true;
+        else if (!arg.empty() && arg[0] == '-')
+            return false;
+        else
+            positional.push_back(arg);
+    }
+
+    if (positional.size() != 1 || !options.pages || !options.tocDepth || !options.words || !options.resetInterval)
+        return false;
+
+    options.output = positional[0];
+
+    return true;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    if (!ParseArgs(argc, argv, options)) {
+        std::fprintf(stderr,
+                     "Usage: %s [-p pages] [-s bytes] [-d depth] [-k entries] [-w words] [-r blocks] [-S seed] [-n] [-b] "
+                     "[-l file] out.chm\n"
+                     "  -p pages    number of pages (default: 500)\n"
+                     "  -s bytes    approximate size of a page (default: 4096)\n"
+                     "  -d depth    depth of the contents tree (default: 3)\n"
+                     "  -k entries  number of index entries (default: one per page)\n"
+                     "  -w words    vocabulary size (default: 2000)\n"
+                     "  -r blocks   LZX reset interval, in 32 KiB blocks (default: 2)\n"
+                     "  -S seed     random seed (default: 1)\n"
+                     "  -n          no $FIftiMain full-text index\n"
+                     "  -b          also write the binary contents (#TOCIDX) and index ($WWKeywordLinks/BTree)\n"
+                     "  -l file     also write the first LZX block to file, after a byte for the window size (seeds "
+                     "the LZX fuzz target)\n",
+                     argv[0]);
+        return 2;
+    }
+
+    Generator generator(options);
+
+    if (!generator.Write()) {
+        std::fprintf(stderr, "%s: can't write %s%s%s\n", argv[0], options.output.c_str(),
+                     options.lzxSeed.empty() ? "" : " or ", options.lzxSeed.c_str());
+        return 1;
+    }
+
+    return 0;
+}
@@ -23,10 +23,17 @@
 #include <chmhtmlnotebook.h>
 #include <chmhtmlwindow.h>
 
+namespace {
+
+// Raw bytes of the recently viewed pages, shared by all the tabs.
+constexpr size_t PAGE_CACHE_BYTES {4 * 1024 * 1024};
+
+} // end of anonymous namespace
+
 CHMHtmlNotebook::CHMHtmlNotebook(wxWindow* parent, wxTreeCtrl* tc, const wxString& normalFont,
                                  const wxString& fixedFont, int fontSize, CHMFrame* frame)
     : wxAuiNotebook(parent), _tcl(tc), _frame(frame), _fontsNormalFace(normalFont), _fontsFixedFace(fixedFont),
-      _fontSize(fontSize)
+      _fontSize(fontSize), _pageCache(PAGE_CACHE_BYTES)
 {
     wxAcceleratorEntry entries[] = {{wxACCEL_CTRL, WXK_PAGEUP, ID_PriorPage},
                                     {wxACCEL_CTRL, WXK_PAGEDOWN, ID_NextPage},
@@ -50,6 +57,7 @@ CHMHtmlWindow* CHMHtmlNotebook::CreateView()
     auto htmlWin = new CHMHtmlWindow(this, _tcl, _frame);
     auto sizes   = _frame->ComputeFontSizes(_fontSize);
 
+    htmlWin->SetPageCache(&_pageCache);
     htmlWin->SetRelatedStatusBar(_frame->GetStatusBar());
     htmlWin->SetFonts(_fontsNormalFace, _fontsFixedFace, sizes.data());
 
@@ -22,6 +22,7 @@
 #ifndef __CHMHTMLNOTEBOOK_H_
 #define __CHMHTMLNOTEBOOK_H_
 
+#include <chmpagecache.h>
 #include <wx/aui/auibook.h>
 #include <wx/treectrl.h>
 
@@ -92,11 +93,12 @@ protected:
     void OnGoToPriorPage(wxCommandEvent&);
 
 private:
-    wxTreeCtrl* _tcl;
-    CHMFrame*   _frame;
-    wxString    _fontsNormalFace;
-    wxString    _fontsFixedFace;
-    int         _fontSize;
+    wxTreeCtrl*  _tcl;
+    CHMFrame*    _frame;
+    wxString     _fontsNormalFace;
+    wxString     _fontsFixedFace;
+    int          _fontSize;
+    CHMPageCache _pageCache;
 };
 
 #endif // __CHMHTMLNOTEBOOK_H_
@@ -25,6 +25,7 @@
 #include <chmhtmlnotebook.h>
 #include <chmhtmlwindow.h>
 #include <chminputstream.h>
+#include <chmtrace.h>
 #include <hhcparser.h>
 #include <memory>
 #include <wx/clipbrd.h>
@@ -87,8 +88,9 @@ CHMHtmlWindow::CHMHtmlWindow(wxWindow* parent, wxTreeCtrl* tc, CHMFrame* frame)
 
 bool CHMHtmlWindow::LoadPage(const wxString& location)
 {
-    wxLogNull log;
-    auto      tmp = location;
+    CHMTrace::Scope trace("CHMHtmlWindow::LoadPage");
+    wxLogNull       log;
+    auto            tmp = location;
 
     if (!tmp.Left(19).CmpNoCase(wxT("javascript:fullsize")))
         tmp = tmp.AfterFirst(wxT('\'')).BeforeLast(wxT('\''));
@@ -111,7 +113,12 @@ bool CHMHtmlWindow::LoadPage(const wxString& location)
 
     Scroll(0, 0);
 
-    return wxHtmlWindow::LoadPage(tmp);
+    // History navigation comes through here too, so going back and forth skips the decompression.
+    auto previous = CHMInputStream::SetPageCache(_pageCache);
+    auto rv       = wxHtmlWindow::LoadPage(tmp);
+    CHMInputStream::SetPageCache(previous);
+
+    return rv;
 }
 
 void CHMHtmlWindow::Sync(wxTreeItemId root, const wxString& page)
@@ -124,7 +131,7 @@ void CHMHtmlWindow::Sync(wxTreeItemId root, const wxString& page)
     wxString url;
 
     if (data)
-        url = (data->_url).BeforeFirst(wxT('#'));
+        url = data->URL().BeforeFirst(wxT('#'));
 
     if (data && !url.CmpNoCase(page)) {
         _found = true;
@@ -41,6 +41,7 @@ enum {
 
 //! Minimize dependencies. Forward declaration.
 class CHMFrame;
+class CHMPageCache;
 
 /*!
   \class wxHtmlWindow
@@ -80,6 +81,9 @@ public:
     */
     bool IsCaller() const { return _found; }
 
+    //! Pages loaded by LoadPage() will be looked up in, and added to, cache.
+    void SetPageCache(CHMPageCache* cache) { _pageCache = cache; }
+
 public:
     /*!
       \brief Finds the first occurence of word in the displayed page.
@@ -154,6 +158,7 @@ private:
     CHMFrame*                      _frame;
     wxString                       _link;
     std::unique_ptr<CHMFindDialog> _fdlg;
+    CHMPageCache*                  _pageCache {nullptr};
 };
 
 #endif // __CHMHTMLWINDOW_H_
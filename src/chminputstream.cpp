@@ -17,23 +17,80 @@
   MA 02110-1301, USA.
 */
 
+#include <algorithm>
 #include <chminputstream.h>
+#include <cstring>
+
+namespace {
+
+// Archives kept open at once (unless streams are still reading from more).
+constexpr size_t MAX_OPEN_ARCHIVES {8};
+
+bool IsPage(const wxString& filename)
+{
+    auto ext = filename.AfterLast(wxT('/')).AfterLast(wxT('.')).Lower();
+    return ext == wxT("htm") || ext == wxT("html");
+}
+
+} // end of anonymous namespace
 
 /*----------------------------------------------------------------------
  * class CHMInputStream static members
  */
 
-std::unique_ptr<CHMFile> CHMInputStream::_archiveCache;
-wxString                 CHMInputStream::_path;
+std::mutex                           CHMInputStream::_mutex;
+std::list<std::shared_ptr<CHMFile>> CHMInputStream::_archives;
+CHMFile*                             CHMInputStream::_current {nullptr};
+std::unique_ptr<CHMPrefetcher>       CHMInputStream::_prefetcher;
+CHMPageCache*                        CHMInputStream::_pageCache {nullptr};
+wxString                             CHMInputStream::_path;
 
 void CHMInputStream::Cleanup()
 {
-    _archiveCache.reset();
+    std::unique_ptr<CHMPrefetcher> prefetcher;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        prefetcher = std::move(_prefetcher);
+        _current   = nullptr;
+        _archives.clear();
+    }
+
+    // Joins the worker thread, which might still be reading from the archives.
+    prefetcher.reset();
+}
+
+CHMPageCache* CHMInputStream::SetPageCache(CHMPageCache* cache)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::swap(cache, _pageCache);
+    return cache;
+}
+
+CHMPrefetcher* CHMInputStream::GetPrefetcher()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (!_prefetcher)
+        _prefetcher = std::make_unique<CHMPrefetcher>();
+
+    return _prefetcher.get();
 }
 
 CHMFile* CHMInputStream::GetCache()
 {
-    return _archiveCache.get();
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _current;
+}
+
+void CHMInputStream::Evict()
+{
+    // The front is the current archive, it stays.
+    for (auto it = _archives.end(); _archives.size() > MAX_OPEN_ARCHIVES && --it != _archives.begin();)
+        if (it->use_count() == 1)
+            it = _archives.erase(it);
 }
 
 /*----------------------------------------------------------------------
@@ -44,20 +101,29 @@ CHMInputStream::CHMInputStream(const wxString& archive, const wxString& file)
 {
     auto filename = file;
 
+    std::unique_lock<std::mutex> lock(_mutex);
+
     if (!archive.IsEmpty())
         _path = archive.BeforeLast(wxT('/')) + wxT("/");
 
-    // Maybe the cached chmFile* isn't valid anymore, or maybe there is no chached chmFile* yet.
+    // Maybe the archive isn't open yet, or it's not the current one.
     if (!archive.IsEmpty() && !Init(archive)) {
         m_lasterror = wxSTREAM_READ_ERROR;
         return;
     }
 
-    assert(_archiveCache);
+    if (archive.IsEmpty()) {
+        if (!_current) {
+            m_lasterror = wxSTREAM_READ_ERROR;
+            return;
+        }
+
+        _archive = _archives.front();
+    }
 
     // Somebody's looking for the homepage.
     if (file.IsSameAs(wxT("/")))
-        filename = _archiveCache->HomePage();
+        filename = _archive->HomePage();
 
     if (!filename.Left(8).CmpNoCase(wxT("/MS-ITS:"))) {
         // If this ever happens chances are Microsoft decided that even if we went through the
@@ -68,7 +134,7 @@ CHMInputStream::CHMInputStream(const wxString& archive, const wxString& file)
 
         filename = filename.AfterLast(wxT(':'));
 
-        // Reset the cached chmFile* and all.
+        // Switch to the other archive, reopening it only if it's not in the pool anymore.
         if (!Init(arch_link))
             if (!Init(_path + arch_link)) {
                 m_lasterror = wxSTREAM_READ_ERROR;
@@ -76,11 +142,48 @@ CHMInputStream::CHMInputStream(const wxString& archive, const wxString& file)
             }
     }
 
+    auto prefetcher = _prefetcher.get();
+    auto pageCache  = _pageCache;
+
+    lock.unlock();
+
     // See if the file really is in the archive.
-    if (!_archiveCache->ResolveObject(filename, &_ui)) {
+    if (!_archive->ResolveObject(filename, &_ui)) {
         m_lasterror = wxSTREAM_READ_ERROR;
         return;
     }
+
+    if (prefetcher)
+        _bytes = prefetcher->Cached(_archive->ArchiveName(), filename);
+
+    if (pageCache && IsPage(filename)) {
+        auto key   = _archive->ArchiveName() + wxT("#xchm:") + filename;
+        auto found = _bytes ? nullptr : pageCache->Find(key);
+
+        if (found)
+            _bytes = found;
+        else if (_bytes || pageCache->Accepts(_ui.length)) {
+            // Read it whole now, wxHtml is going to anyway. Pages too big to keep (or damaged directory entries
+            // claiming to be) are streamed like any other file.
+            if (!_bytes) {
+                auto page = std::make_shared<std::string>(_ui.length, '\0');
+
+                if (_archive->RetrieveObject(&_ui, reinterpret_cast<unsigned char*>(&(*page)[0]), 0, _ui.length)
+                    == _ui.length)
+                    _bytes = page;
+            }
+
+            pageCache->Store(key, _bytes);
+        }
+    }
+}
+
+CHMInputStream::~CHMInputStream()
+{
+#ifdef ENABLE_BUILTIN_CHMLIB
+    if (_span.pin)
+        _archive->ReleaseSpan(&_span);
+#endif
 }
 
 size_t CHMInputStream::GetSize() const
@@ -100,16 +203,50 @@ size_t CHMInputStream::OnSysRead(void* buffer, size_t bufsize)
         return 0;
     }
 
-    if (!_archiveCache)
+    if (!_archive)
         return 0;
 
     if (static_cast<uint64_t>(_currPos + bufsize) > _ui.length)
         bufsize = _ui.length - _currPos;
 
-    bufsize = _archiveCache->RetrieveObject(&_ui, static_cast<unsigned char*>(buffer), _currPos, bufsize);
+    // Read ahead by the prefetcher, nothing left to decompress.
+    if (_bytes && _bytes->size() == _ui.length) {
+        std::memcpy(buffer, _bytes->data() + _currPos, bufsize);
+        _currPos += bufsize;
+        return bufsize;
+    }
+
+#ifdef ENABLE_BUILTIN_CHMLIB
+    // Copy straight out of the pinned block, no cache lookups (or locks) until we're past it.
+    auto   out   = static_cast<unsigned char*>(buffer);
+    size_t total = 0;
+
+    while (total < bufsize) {
+        if (!_span.pin || _currPos < _spanPos || _currPos >= _spanPos + _span.len) {
+            if (_span.pin)
+                _archive->ReleaseSpan(&_span);
+
+            if (!_archive->RetrieveSpan(&_ui, _currPos, _ui.length - _currPos, &_span))
+                break;
+
+            _spanPos = _currPos;
+        }
+
+        auto offset = static_cast<size_t>(_currPos - _spanPos);
+        auto len    = std::min(static_cast<size_t>(_span.len) - offset, bufsize - total);
+
+        std::memcpy(out + total, _span.data + offset, len);
+        total += len;
+        _currPos += len;
+    }
+
+    return total;
+#else
+    bufsize = _archive->RetrieveObject(&_ui, static_cast<unsigned char*>(buffer), _currPos, bufsize);
     _currPos += bufsize;
 
     return bufsize;
+#endif
 }
 
 wxFileOffset CHMInputStream::OnSysSeek(wxFileOffset seek, wxSeekMode mode)
@@ -133,14 +270,25 @@ wxFileOffset CHMInputStream::OnSysSeek(wxFileOffset seek, wxSeekMode mode)
 
 bool CHMInputStream::Init(const wxString& archive)
 {
-    if (!_archiveCache || !_archiveCache->ArchiveName().IsSameAs(archive)) {
-        _archiveCache = std::make_unique<CHMFile>(archive);
+    auto it = std::find_if(_archives.begin(), _archives.end(),
+                           [&archive](const auto& chmf) { return chmf->ArchiveName().IsSameAs(archive); });
 
-        if (!_archiveCache->IsOk()) {
-            Cleanup();
+    if (it != _archives.end())
+        _archives.splice(_archives.begin(), _archives, it);
+    else {
+        auto chmf = std::make_shared<CHMFile>(archive);
+
+        if (!chmf->IsOk()) {
+            _current = nullptr;
             return false;
         }
+
+        _archives.push_front(std::move(chmf));
     }
 
+    _archive = _archives.front();
+    _current = _archive.get();
+
+    Evict();
     return true;
 }
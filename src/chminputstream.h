@@ -21,7 +21,11 @@
 #define __CHMINPUTSTREAM_H_
 
 #include <chmfile.h>
+#include <chmpagecache.h>
+#include <chmprefetcher.h>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <wx/stream.h>
 
 /*!
@@ -41,6 +45,9 @@ public:
      */
     CHMInputStream(const wxString& archive, const wxString& file);
 
+    //! Unpins the block being read, if any.
+    ~CHMInputStream() override;
+
     //! Returns the size of the file.
     size_t GetSize() const override;
 
@@ -48,16 +55,34 @@ public:
     bool Eof() const override;
 
     /*!
-      \brief Returns the static CHMFile pointer associated with
-      this stream. Archives are being cached until it is
-      explicitly requested to open a different one.
+      \brief Returns the most recently used archive, i.e. the
+      book being viewed. Archives are kept open in a small LRU
+      pool, so going back and forth between cross-linked books
+      doesn't reopen them.
       \return A valid pointer to a CHMFile object or nullptr if no
-      .chm file has been opened yet.
+      .chm file has been opened yet (or the last one failed to open).
      */
     static CHMFile* GetCache();
 
+    //! The archive this stream reads from.
+    std::shared_ptr<CHMFile> Archive() const { return _archive; }
+
+    /*!
+      \brief Returns the prefetcher shared by all streams, starting it the first time around. Reads are served from
+      the files it has read ahead, when possible.
+     */
+    static CHMPrefetcher* GetPrefetcher();
+
     /*!
-      \brief Cleans up the cache. Has to be public and static
+      \brief Makes the pages opened from now on go through cache (CHMHtmlWindow sets its notebook's cache while
+      loading a page). Only the UI thread should call this.
+      \param cache The cache, or nullptr for none.
+      \return The cache set before.
+     */
+    static CHMPageCache* SetPageCache(CHMPageCache* cache);
+
+    /*!
+      \brief Stops the prefetcher and closes all the pooled archives. Has to be public and static
       since the stream doesn't know how many other streams using
       the same cache will be created after it. Somebody else has
       to turn off the lights, and in this case it's CHMFSHandler.
@@ -88,14 +113,28 @@ protected:
     wxFileOffset OnSysTell() const override { return _currPos; }
 
 private:
-    //! Helper. Inits the cache.
+    //! Helper. Gets the archive from the pool (opening it if it's not there) and makes it the current one.
     bool Init(const wxString& archive);
 
+    //! Helper. Closes least recently used archives no stream is reading from, if there are too many open.
+    //! Needs _mutex.
+    static void Evict();
+
 private:
-    static std::unique_ptr<CHMFile> _archiveCache;
-    off_t                           _currPos {0};
-    chmUnitInfo                     _ui {};
-    static wxString                 _path;
+    static std::mutex                           _mutex;
+    static std::list<std::shared_ptr<CHMFile>> _archives;
+    static CHMFile*                             _current;
+    static std::unique_ptr<CHMPrefetcher>       _prefetcher;
+    static CHMPageCache*                        _pageCache;
+    std::shared_ptr<CHMFile>                    _archive;
+    std::shared_ptr<const std::string>          _bytes;
+    off_t                                       _currPos {0};
+    chmUnitInfo                                 _ui {};
+    static wxString                             _path;
+#ifdef ENABLE_BUILTIN_CHMLIB
+    chmSpan _span {};
+    off_t   _spanPos {0};
+#endif
 };
 
 #endif // __CHMINPUTSTREAM_H_
@@ -0,0 +1,176 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <algorithm>
+#include <chmlibrary.h>
+#include <wx/dir.h>
+#include <wx/filename.h>
+#include <wx/tokenzr.h>
+
+size_t CHMLibrary::SetDirectory(const wxString& dir)
+{
+    _dir = dir;
+    _books.clear();
+
+    wxArrayString files;
+
+    if (wxDir::Exists(dir))
+        wxDir::GetAllFiles(dir, &files);
+
+    files.Sort();
+
+    // Not passing "*.chm" to GetAllFiles(), wildcards are case-sensitive on some platforms.
+    for (auto&& file : files)
+        if (wxFileName(file).GetExt().IsSameAs(wxT("chm"), false))
+            _books.push_back({file, nullptr});
+
+    return _books.size();
+}
+
+bool CHMLibrary::Search(const std::vector<wxString>& words, bool wholeWords, bool titlesOnly, CHMLibraryHits& hits)
+{
+    hits.clear();
+
+    if (words.empty())
+        return false;
+
+    std::vector<std::future<CHMLibraryHits>> pending;
+    pending.reserve(_books.size());
+
+    for (auto&& book : _books)
+        pending.push_back(_pool.Submit([&book, &words, wholeWords, titlesOnly] {
+            return SearchBook(book, words, wholeWords, titlesOnly);
+        }));
+
+    for (auto&& result : pending) {
+        auto bookHits = result.get();
+        std::move(bookHits.begin(), bookHits.end(), std::back_inserter(hits));
+    }
+
+    Rank(hits);
+
+    return !hits.empty();
+}
+
+void CHMLibrary::Rank(CHMLibraryHits& hits)
+{
+    std::stable_sort(hits.begin(), hits.end(), [](const CHMLibraryHit& a, const CHMLibraryHit& b) {
+        if (a.score != b.score)
+            return a.score > b.score;
+
+        auto cmp = a.book.CmpNoCase(b.book);
+        return cmp ? cmp < 0 : a.title.CmpNoCase(b.title) < 0;
+    });
+
+    if (hits.size() > MAX_SEARCH_RESULTS)
+        hits.resize(MAX_SEARCH_RESULTS);
+}
+
+CHMLibraryHits CHMLibrary::SearchBook(Book& book, const std::vector<wxString>& words, bool wholeWords,
+                                      bool titlesOnly)
+{
+    if (!book.file)
+        book.file = std::make_unique<CHMFile>(book.archive);
+
+    // The pool is already busy with the other books, so index this one on the current thread only.
+    return SearchFile(*book.file, words, wholeWords, titlesOnly, 1);
+}
+
+CHMLibraryHits CHMLibrary::SearchFile(CHMFile& chmf, const std::vector<wxString>& words, bool wholeWords,
+                                      bool titlesOnly, unsigned threads)
+{
+    CHMLibraryHits hits;
+
+    if (!chmf.IsOk() || words.empty())
+        return hits;
+
+    if (!chmf.HasFIftiMain())
+        chmf.PrepareFullTextIndex(threads);
+
+    CHMSearchResults results;
+
+    for (size_t i = 0; i < words.size(); ++i) {
+        CHMSearchResults wordResults;
+        chmf.IndexSearch(words[i], wholeWords, titlesOnly, wordResults);
+
+        if (i == 0)
+            results = std::move(wordResults);
+        else
+            for (auto it = results.begin(); it != results.end();)
+                if (wordResults.find(it->first) == wordResults.end())
+                    it = results.erase(it);
+                else
+                    ++it;
+
+        if (results.empty())
+            return hits;
+    }
+
+    auto bookTitle = chmf.Title();
+
+    if (bookTitle.IsEmpty())
+        bookTitle = wxFileName(chmf.ArchiveName()).GetName();
+
+    for (auto&& result : results) {
+        CHMLibraryHit hit;
+
+        hit.archive = chmf.ArchiveName();
+        hit.book    = bookTitle;
+        hit.url     = result.first.StartsWith(wxT("/")) ? result.first : (wxT("/") + result.first);
+        hit.title   = result.second;
+
+        // Pages with the words in their titles first, and even more so if the title starts with the query.
+        auto title = hit.title.Lower();
+
+        for (auto&& word : words)
+            if (title.Contains(word))
+                hit.score += 2;
+
+        if (title.StartsWith(words[0]))
+            ++hit.score;
+
+        hits.push_back(hit);
+    }
+
+    return hits;
+}
+
+wxString CHMLibrary::CleanQuery(const wxString& query)
+{
+    auto text = query.Lower();
+
+    for (auto ch : {wxT('+'), wxT('-'), wxT('#'), wxT('@'), wxT('^'), wxT('&'), wxT('%')})
+        text.Replace(wxString(ch), wxT(" "));
+
+    return text;
+}
+
+std::vector<wxString> CHMLibrary::QueryWords(const wxString& query)
+{
+    std::vector<wxString> words;
+    wxStringTokenizer     tkz(CleanQuery(query), wxT(" \t\r\n"));
+
+    while (tkz.HasMoreTokens()) {
+        auto token = tkz.GetNextToken();
+        if (!token.IsEmpty())
+            words.push_back(token);
+    }
+
+    return words;
+}
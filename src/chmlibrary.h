@@ -0,0 +1,122 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMLIBRARY_H_
+#define __CHMLIBRARY_H_
+
+#include <chmfile.h>
+#include <chmthreadpool.h>
+#include <memory>
+#include <vector>
+#include <wx/string.h>
+
+//! A page found while searching the library.
+struct CHMLibraryHit {
+    //! The .chm file the page is in.
+    wxString archive;
+    //! The title of the book (or its file name, if it has no title).
+    wxString book;
+    //! The page, relative to the root of the archive.
+    wxString url;
+    //! The title of the page.
+    wxString title;
+    //! Higher is better.
+    int score {0};
+};
+
+using CHMLibraryHits = std::vector<CHMLibraryHit>;
+
+/*!
+  \brief A directory full of .chm files, searched as a whole.
+
+  Every book is searched on its own thread pool task, through its own CHMFile handle (kept open between searches) and
+  either its $FIftiMain index or our own persisted one. Results get merged into a single ranked list.
+ */
+class CHMLibrary {
+public:
+    //! Creates an empty library.
+    CHMLibrary() = default;
+
+    /*!
+      \brief Looks for .chm files in dir (and its subdirectories). Closes the books of the previous directory.
+      \param dir The directory.
+      \return The number of books found.
+     */
+    size_t SetDirectory(const wxString& dir);
+
+    //! The directory the books are in.
+    wxString Directory() const { return _dir; }
+
+    /*!
+      \brief Searches all the books.
+      \param words The (lowercase) words to search for. Pages have to contain all of them.
+      \param wholeWords Are we looking for whole words only?
+      \param titlesOnly Are we looking for titles only?
+      \param hits Receives at most MAX_SEARCH_RESULTS hits, best first.
+      \return true if anything has been found.
+     */
+    bool Search(const std::vector<wxString>& words, bool wholeWords, bool titlesOnly, CHMLibraryHits& hits);
+
+    /*!
+      \brief Searches a single book. With the builtin CHMLIB, several threads can search the same chmf at once.
+      \param chmf An opened book.
+      \param words The (lowercase) words to search for. Pages have to contain all of them.
+      \param wholeWords Are we looking for whole words only?
+      \param titlesOnly Are we looking for titles only?
+      \param threads How many threads to build our own full-text index on, if the book has no $FIftiMain and it
+      hasn't been built yet. 0 means one per core.
+      \return The hits, unsorted and unranked among other books' hits.
+     */
+    static CHMLibraryHits SearchFile(CHMFile& chmf, const std::vector<wxString>& words, bool wholeWords,
+                                     bool titlesOnly, unsigned threads = 1);
+
+    //! Sorts hits best first, keeping at most MAX_SEARCH_RESULTS of them.
+    static void Rank(CHMLibraryHits& hits);
+
+    //! Lowercases a query and blanks out the characters the indexes don't know about.
+    static wxString CleanQuery(const wxString& query);
+
+    //! Splits a query into the words to search for: the ones CleanQuery() leaves in it.
+    static std::vector<wxString> QueryWords(const wxString& query);
+
+public:
+    //! No copy construction allowed.
+    CHMLibrary(const CHMLibrary&) = delete;
+
+    //! No assignments.
+    CHMLibrary& operator=(const CHMLibrary&) = delete;
+
+private:
+    //! A .chm file in the directory, opened the first time it's searched.
+    struct Book {
+        wxString                 archive;
+        std::unique_ptr<CHMFile> file;
+    };
+
+    //! Helper. Searches a single book (on a pool thread).
+    static CHMLibraryHits SearchBook(Book& book, const std::vector<wxString>& words, bool wholeWords,
+                                     bool titlesOnly);
+
+private:
+    wxString          _dir;
+    std::vector<Book> _books;
+    CHMThreadPool     _pool;
+};
+
+#endif // __CHMLIBRARY_H_
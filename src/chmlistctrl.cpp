@@ -27,9 +27,9 @@
 namespace {
 
 //! Comparator for sorted insertion: case-insensitive by title.
-bool ItemLessThan(const std::unique_ptr<CHMListPairItem>& a, const std::unique_ptr<CHMListPairItem>& b)
+bool ItemLessThan(const CHMListPairItem& a, const CHMListPairItem& b)
 {
-    return a->_title.CmpNoCase(b->_title) < 0;
+    return a._title.CmpNoCase(b._title) < 0;
 }
 
 } // namespace
@@ -54,6 +54,7 @@ CHMListCtrl::CHMListCtrl(wxWindow* parent, CHMHtmlNotebook* nbhtml, wxWindowID i
 void CHMListCtrl::Reset()
 {
     _items.clear();
+    _urls.Clear();
     DeleteAllItems();
     UpdateUI();
 }
@@ -65,11 +66,32 @@ void CHMListCtrl::UpdateItemCount()
 
 void CHMListCtrl::AddPairItem(const wxString& title, const wxString& url)
 {
-    auto item = std::make_unique<CHMListPairItem>(title, url);
-    auto pos  = std::lower_bound(_items.begin(), _items.end(), item, ItemLessThan);
+    CHMListPairItem item(title, _urls.Add(url));
+
+    auto pos = std::lower_bound(_items.begin(), _items.end(), item, ItemLessThan);
     _items.insert(pos, std::move(item));
 }
 
+void CHMListCtrl::AppendPairItem(const wxString& title, const wxString& url)
+{
+    _items.emplace_back(title, _urls.Add(url));
+}
+
+wxString CHMListCtrl::GetSelectedURL() const
+{
+    auto item = GetNextItem(-1L, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+
+    if (item == -1L || item >= static_cast<long>(_items.size()))
+        return wxEmptyString;
+
+    return CHMStringArena::Get(_items[item]._url);
+}
+
+wxString CHMListCtrl::GetItemURL(size_t index) const
+{
+    return index < _items.size() ? CHMStringArena::Get(_items[index]._url) : wxString();
+}
+
 void CHMListCtrl::LoadSelected()
 {
     auto item = -1L;
@@ -81,10 +103,11 @@ void CHMListCtrl::LoadSelected()
     auto chmf = CHMInputStream::GetCache();
 
     if (chmf) {
-        auto fname = _items[item]->_url;
+        auto url   = CHMStringArena::Get(_items[item]._url);
+        auto fname = url;
 
         if (!fname.StartsWith(wxT("file:")))
-            fname = wxT("file:") + chmf->ArchiveName() + wxT("#xchm:/") + _items[item]->_url;
+            fname = wxT("file:") + chmf->ArchiveName() + wxT("#xchm:/") + url;
 
         _nbhtml->LoadPageInCurrentView(fname);
     }
@@ -98,7 +121,7 @@ void CHMListCtrl::UpdateUI()
 void CHMListCtrl::FindBestMatch(const wxString& title)
 {
     for (size_t i = 0; i < _items.size(); ++i) {
-        if (!_items[i]->_title.Left(title.length()).CmpNoCase(title)) {
+        if (!_items[i]._title.Left(title.length()).CmpNoCase(title)) {
             EnsureVisible(i);
             SetItemState(i, wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
             break;
@@ -121,5 +144,5 @@ wxString CHMListCtrl::OnGetItemText(long item, long column) const
     if (column != 0 || item == -1L || item >= static_cast<long>(_items.size()))
         return wxT("");
 
-    return _items[item]->_title;
+    return _items[item]._title;
 }
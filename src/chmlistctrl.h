@@ -23,7 +23,7 @@
 #define __CHMLISTCTRL_H_
 
 #include <algorithm>
-#include <memory>
+#include <chmstringarena.h>
 #include <vector>
 #include <wx/listctrl.h>
 #include <wx/string.h>
@@ -34,16 +34,16 @@ class CHMHtmlNotebook;
 //! Item to store in the virtual list control
 struct CHMListPairItem {
     //! Trivial constructor
-    CHMListPairItem(const wxString& title, const wxString& url) : _title(title), _url(url) {}
+    CHMListPairItem(const wxString& title, const CHMStringRef& url) : _title(title), _url(url) {}
 
     //! This will show up in the list.
     wxString _title;
-    //! This is what the title points to.
-    wxString _url;
+    //! This is what the title points to, kept in the list control's arena.
+    CHMStringRef _url;
 };
 
-//! Sorted container of list items with RAII ownership.
-using ItemPairArray = std::vector<std::unique_ptr<CHMListPairItem>>;
+//! Sorted container of list items.
+using ItemPairArray = std::vector<CHMListPairItem>;
 
 /*!
   \class wxListCtrl
@@ -79,6 +79,20 @@ public:
      */
     void AddPairItem(const wxString& title, const wxString& url);
 
+    /*!
+      \brief Adds a title:url pair at the end of the list, for lists that are already in the order they should be
+      displayed in (search results ranked by relevance, for example).
+      \param title The title to add.
+      \param url The title's associated url.
+     */
+    void AppendPairItem(const wxString& title, const wxString& url);
+
+    //! Returns the url of the item currently selected, or the empty string if there's no selection.
+    wxString GetSelectedURL() const;
+
+    //! Returns the url of the item at position index, or the empty string if there's no such item.
+    wxString GetItemURL(size_t index) const;
+
     //! Loads the page that corresponds to the item currently selected.
     void LoadSelected();
 
@@ -100,6 +114,7 @@ protected:
 
 private:
     ItemPairArray    _items;
+    CHMStringArena   _urls;
     CHMHtmlNotebook* _nbhtml;
 };
 
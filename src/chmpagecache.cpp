@@ -0,0 +1,65 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <chmpagecache.h>
+
+CHMPageCache::CHMPageCache(size_t maxBytes) : _maxBytes(maxBytes)
+{
+}
+
+std::shared_ptr<const std::string> CHMPageCache::Find(const wxString& key)
+{
+    auto it = _index.find(key);
+
+    if (it == _index.end())
+        return nullptr;
+
+    _pages.splice(_pages.begin(), _pages, it->second);
+    return it->second->bytes;
+}
+
+void CHMPageCache::Store(const wxString& key, const std::shared_ptr<const std::string>& bytes)
+{
+    if (!bytes || !Accepts(bytes->size()))
+        return;
+
+    auto it = _index.find(key);
+
+    if (it != _index.end()) {
+        _bytes -= it->second->bytes->size();
+        _pages.erase(it->second);
+    }
+
+    _pages.push_front({key, bytes});
+    _index[key] = _pages.begin();
+    _bytes += bytes->size();
+
+    while (_bytes > _maxBytes) {
+        _bytes -= _pages.back().bytes->size();
+        _index.erase(_pages.back().key);
+        _pages.pop_back();
+    }
+}
+
+void CHMPageCache::Clear()
+{
+    _pages.clear();
+    _index.clear();
+    _bytes = 0;
+}
@@ -0,0 +1,88 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMPAGECACHE_H_
+#define __CHMPAGECACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <wx/string.h>
+
+/*!
+  \brief Recently viewed pages, as read from the archive, kept by each CHMHtmlNotebook so going back and forward
+  through the history doesn't decompress them again. Least recently used pages go first once the cache is over its
+  memory budget. Only used from the UI thread.
+ */
+class CHMPageCache {
+public:
+    /*!
+      \brief Creates an empty cache.
+      \param maxBytes How much page data it may hold.
+     */
+    explicit CHMPageCache(size_t maxBytes);
+
+    /*!
+      \brief Looks up a page, making it the most recently used one.
+      \param key The archive and path of the page.
+      \return The page, or nullptr if it's not in the cache.
+     */
+    std::shared_ptr<const std::string> Find(const wxString& key);
+
+    /*!
+      \brief Adds a page. Pages bigger than a quarter of the budget aren't kept.
+      \param key The archive and path of the page.
+      \param bytes The page, as read from the archive.
+     */
+    void Store(const wxString& key, const std::shared_ptr<const std::string>& bytes);
+
+    /*!
+      \brief Tells whether a page this big would be kept, so that bigger ones don't get read whole for nothing.
+      \param size The size of the page.
+      \return true if Store() would keep it, false otherwise.
+     */
+    bool Accepts(uint64_t size) const { return size <= _maxBytes / 4; }
+
+    //! Forgets all the pages.
+    void Clear();
+
+public:
+    //! No copy construction allowed.
+    CHMPageCache(const CHMPageCache&) = delete;
+
+    //! No assignments.
+    CHMPageCache& operator=(const CHMPageCache&) = delete;
+
+private:
+    //! A page, in the LRU list.
+    struct Entry {
+        wxString                           key;
+        std::shared_ptr<const std::string> bytes;
+    };
+
+private:
+    size_t                                                   _maxBytes;
+    size_t                                                   _bytes {0};
+    std::list<Entry>                                         _pages;
+    std::unordered_map<wxString, std::list<Entry>::iterator> _index;
+};
+
+#endif // __CHMPAGECACHE_H_
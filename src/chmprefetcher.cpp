@@ -0,0 +1,418 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <chmprefetcher.h>
+#include <string>
+#include <stringutils.h>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// Pages waiting for their turn. Following links faster than that leaves nothing worth prefetching anyway.
+constexpr size_t MAX_QUEUED_PAGES {4};
+
+// Pages bigger than this only get their beginning scanned.
+constexpr size_t MAX_PAGE_SIZE {1024 * 1024};
+
+// Don't decompress more than the archive's blocks cache can hold, or the page itself gets evicted.
+constexpr size_t MAX_PREFETCH_BYTES {1024 * 1024};
+
+constexpr size_t MAX_REFERENCES {128};
+
+constexpr size_t CHUNK_SIZE {64 * 1024};
+
+// Memory for read ahead files, and how much of it a single Speculate() call may fill.
+constexpr size_t MAX_CACHE_BYTES {8 * 1024 * 1024};
+constexpr size_t MAX_SPECULATIVE_BYTES {4 * 1024 * 1024};
+
+// Bigger files aren't worth keeping whole.
+constexpr size_t MAX_CACHED_FILE_SIZE {1024 * 1024};
+
+std::string CacheKey(const std::string& archive, const std::string& path)
+{
+    return archive + '\n' + path;
+}
+
+bool IsHTML(const std::string& path)
+{
+    auto ext = lowerCase(path.substr(path.find_last_of("./") + 1));
+    return ext == "htm" || ext == "html";
+}
+
+
+// Attributes naming something the page needs to render, as opposed to links the user might follow.
+bool IsResourceAttribute(const std::string& tag, const std::string& attribute)
+{
+    return attribute == "src" || attribute == "background" || (tag == "link" && attribute == "href");
+}
+
+// Collects the values of resource attributes, in page order.
+std::vector<std::string> References(const std::string& html)
+{
+    std::vector<std::string> refs;
+    auto                     n = html.size();
+    size_t                   i = 0;
+
+    auto skipSpaces = [&] {
+        while (i < n && std::isspace(static_cast<unsigned char>(html[i])))
+            ++i;
+    };
+
+    while ((i = html.find('<', i)) != std::string::npos) {
+        ++i;
+
+        if (!html.compare(i, 3, "!--")) {
+            i = html.find("-->", i);
+
+            if (i == std::string::npos)
+                break;
+
+            continue;
+        }
+
+        auto start = i;
+
+        while (i < n && std::isalnum(static_cast<unsigned char>(html[i])))
+            ++i;
+
+        auto tag = lowerCase(html.substr(start, i - start));
+
+        if (tag.empty())
+            continue;
+
+        for (skipSpaces(); i < n && html[i] != '>' && html[i] != '<'; skipSpaces()) {
+            start = i;
+
+            while (i < n && html[i] != '=' && html[i] != '>' && html[i] != '<'
+                   && !std::isspace(static_cast<unsigned char>(html[i])))
+                ++i;
+
+            auto attribute = lowerCase(html.substr(start, i - start));
+
+            skipSpaces();
+
+            if (i >= n || html[i] != '=') {
+                if (attribute.empty())
+                    ++i;
+                continue;
+            }
+
+            ++i;
+            skipSpaces();
+
+            std::string value;
+
+            if (i < n && (html[i] == '"' || html[i] == '\'')) {
+                auto end = html.find(html[i], i + 1);
+
+                if (end == std::string::npos)
+                    end = n;
+
+                value = html.substr(i + 1, end - i - 1);
+                i     = end + 1;
+
+            } else {
+                start = i;
+
+                while (i < n && html[i] != '>' && !std::isspace(static_cast<unsigned char>(html[i])))
+                    ++i;
+
+                value = html.substr(start, i - start);
+            }
+
+            if (!value.empty() && IsResourceAttribute(tag, attribute))
+                refs.push_back(value);
+        }
+    }
+
+    return refs;
+}
+
+// Turns a reference into a path in the archive, or returns an empty string if it points outside of it.
+std::string Resolve(std::string ref, const std::string& pageDir)
+{
+    auto b = ref.find_first_not_of(" \t\r\n");
+
+    if (b == std::string::npos)
+        return {};
+
+    ref = ref.substr(b, ref.find_last_not_of(" \t\r\n") - b + 1);
+    ref = ref.substr(0, ref.find_first_of("#?"));
+
+    // Schemes (http:, mailto:, MS-ITS: and friends) and protocol-relative URLs.
+    auto colon = ref.find(':');
+
+    if (ref.empty() || (colon != std::string::npos && colon < ref.find('/')) || !ref.compare(0, 2, "//"))
+        return {};
+
+    // Windows-style separators, as some books have them.
+    std::replace(ref.begin(), ref.end(), '\\', '/');
+
+    auto decoded = percentDecode(ref);
+
+    if (decoded[0] != '/')
+        decoded = pageDir + decoded;
+
+    auto path = normalizePath(decoded);
+
+    // Directories have nothing to prefetch.
+    return path.back() == '/' ? std::string() : path;
+}
+
+} // end of anonymous namespace
+
+CHMPrefetcher::CHMPrefetcher() : _thread(&CHMPrefetcher::Run, this)
+{
+}
+
+CHMPrefetcher::~CHMPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _pending.clear();
+        _speculative.clear();
+    }
+
+    _cv.notify_one();
+    _thread.join();
+}
+
+void CHMPrefetcher::Submit(const std::shared_ptr<CHMFile>& archive, const wxString& page)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_pending.size() == MAX_QUEUED_PAGES)
+            _pending.pop_front();
+
+        _pending.push_back({archive, page});
+    }
+
+    _cv.notify_one();
+}
+
+void CHMPrefetcher::Run()
+{
+    for (;;) {
+        Request request;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait(lock, [this] { return _stop || !_pending.empty() || !_speculative.empty(); });
+
+            if (_stop)
+                return;
+
+            // Pages being loaded right now come first, reading ahead only happens when idle.
+            if (_pending.empty()) {
+                lock.unlock();
+                SpeculateNext();
+                continue;
+            }
+
+            request = std::move(_pending.front());
+            _pending.pop_front();
+        }
+
+        Process(request);
+    }
+}
+
+void CHMPrefetcher::Speculate(const wxString& archive, const std::vector<wxString>& pages)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _speculativeArchive = std::string(archive.mb_str());
+        _speculativeBudget  = MAX_SPECULATIVE_BYTES;
+        ++_speculativeGeneration;
+        _speculative.clear();
+
+        for (auto&& page : pages)
+            _speculative.push_back(std::string(page.mb_str()));
+    }
+
+    _cv.notify_one();
+}
+
+std::shared_ptr<const std::string> CHMPrefetcher::Cached(const wxString& archive, const wxString& path)
+{
+    auto key = CacheKey(std::string(archive.mb_str()), std::string(path.mb_str()));
+
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+
+    auto it = _cacheIndex.find(key);
+
+    if (it == _cacheIndex.end())
+        return nullptr;
+
+    _cache.splice(_cache.begin(), _cache, it->second);
+    return it->second->bytes;
+}
+
+bool CHMPrefetcher::SpeculateNext()
+{
+    std::string archive, path;
+    unsigned    generation;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_speculative.empty())
+            return false;
+
+        if (!_speculativeBudget) {
+            _speculative.clear();
+            return false;
+        }
+
+        archive    = _speculativeArchive;
+        generation = _speculativeGeneration;
+        path       = _speculative.front();
+        _speculative.pop_front();
+    }
+
+    auto key = CacheKey(archive, path);
+
+    {
+        std::lock_guard<std::mutex> lock(_cacheMutex);
+
+        if (_cacheIndex.find(key) != _cacheIndex.end())
+            return true;
+    }
+
+    wxString name(archive.c_str(), wxConvLibc);
+
+    // Our own handle: this works with any CHMLIB, and doesn't disturb the UI's decompressed blocks cache.
+    if (!_chmFile || _chmFile->ArchiveName() != name)
+        _chmFile = std::make_unique<CHMFile>(name);
+
+    chmUnitInfo ui;
+
+    if (!_chmFile->IsOk() || !_chmFile->ResolveObject(wxString(path.c_str(), wxConvLibc), &ui)
+        || ui.length > MAX_CACHED_FILE_SIZE)
+        return true;
+
+    std::string bytes(ui.length, '\0');
+
+    for (size_t offset = 0; offset < bytes.size() && !_stop;) {
+        auto len = _chmFile->RetrieveObject(&ui, reinterpret_cast<unsigned char*>(&bytes[offset]), offset,
+                                            std::min(CHUNK_SIZE, bytes.size() - offset));
+
+        if (!len)
+            return true;
+
+        offset += len;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (generation == _speculativeGeneration)
+            _speculativeBudget -= std::min(bytes.size(), _speculativeBudget);
+    }
+
+    if (IsHTML(path)) {
+        std::vector<std::string>        resources;
+        std::unordered_set<std::string> seen;
+        auto                            dir = path.substr(0, path.rfind('/') + 1);
+
+        for (auto&& ref : References(bytes)) {
+            auto resource = Resolve(ref, dir);
+
+            if (!resource.empty() && seen.insert(resource).second)
+                resources.push_back(resource);
+
+            if (resources.size() == MAX_REFERENCES)
+                break;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // Right after the page they belong to, before the next page.
+        if (generation == _speculativeGeneration)
+            _speculative.insert(_speculative.begin(), resources.begin(), resources.end());
+    }
+
+    Store(key, std::move(bytes));
+    return true;
+}
+
+void CHMPrefetcher::Store(const std::string& key, std::string&& bytes)
+{
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+
+    _cacheBytes += bytes.size();
+    _cache.push_front({key, std::make_shared<const std::string>(std::move(bytes))});
+    _cacheIndex[key] = _cache.begin();
+
+    while (_cacheBytes > MAX_CACHE_BYTES && _cache.size() > 1) {
+        _cacheBytes -= _cache.back().bytes->size();
+        _cacheIndex.erase(_cache.back().key);
+        _cache.pop_back();
+    }
+}
+
+void CHMPrefetcher::Process(const Request& request)
+{
+    auto&       chmf = *request.archive;
+    chmUnitInfo ui;
+
+    if (!chmf.ResolveObject(request.page, &ui))
+        return;
+
+    std::string html(std::min<size_t>(ui.length, MAX_PAGE_SIZE), '\0');
+
+    html.resize(chmf.RetrieveObject(&ui, reinterpret_cast<unsigned char*>(&html[0]), 0, html.size()));
+
+    std::string pageDir(request.page.mb_str());
+    pageDir = pageDir.substr(0, pageDir.rfind('/') + 1);
+
+    std::unordered_set<std::string> seen;
+    std::vector<unsigned char>      chunk(CHUNK_SIZE);
+    size_t                          budget = MAX_PREFETCH_BYTES;
+
+    for (auto&& ref : References(html)) {
+        if (_stop || seen.size() == MAX_REFERENCES || !budget)
+            return;
+
+        auto path = Resolve(ref, pageDir);
+
+        if (path.empty() || !seen.insert(path).second)
+            continue;
+
+        // Uncompressed files have nothing to gain from us reading them first.
+        if (!chmf.ResolveObject(wxString(path.c_str(), wxConvLibc), &ui) || ui.space != CHM_COMPRESSED)
+            continue;
+
+        for (uint64_t offset = 0; offset < ui.length && budget && !_stop;) {
+            auto len = chmf.RetrieveObject(&ui, chunk.data(), offset, std::min(chunk.size(), budget));
+
+            if (!len)
+                break;
+
+            offset += len;
+            budget -= std::min(len, budget);
+        }
+    }
+}
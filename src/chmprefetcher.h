@@ -0,0 +1,133 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMPREFETCHER_H_
+#define __CHMPREFETCHER_H_
+
+#include <atomic>
+#include <chmfile.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <wx/string.h>
+
+/*!
+  \brief Decompresses the images, stylesheets, scripts and frames a page pulls in, on a background thread.
+
+  wxHtml fetches them one by one, on the UI thread, as its parser gets to them. The prefetcher scans the page as soon
+  as it's opened and reads everything it refers to through the same CHMFile, so by the time wxHtml asks, their blocks
+  are already in the archive's decompressed blocks cache. Only useful when CHM_CONCURRENT_READERS is true.
+
+  When there's nothing else to do, it also reads pages the user is likely to go to next (the neighbours of the current
+  page in the contents tree, the top search results) along with their resources, through its own CHMFile. Those are
+  kept whole, in a memory-bounded LRU that CHMInputStream serves reads from.
+ */
+class CHMPrefetcher {
+public:
+    //! Starts the worker thread.
+    CHMPrefetcher();
+
+    //! Drops the queued pages and joins the worker thread.
+    ~CHMPrefetcher();
+
+    /*!
+      \brief Queues a page. If too many pages are already waiting, the oldest one is dropped.
+      \param archive The archive the page is in. Shared with the UI, so it has to allow concurrent readers.
+      \param page The page, relative to the root of the archive.
+     */
+    void Submit(const std::shared_ptr<CHMFile>& archive, const wxString& page);
+
+    /*!
+      \brief Replaces the pages to read ahead when idle.
+      \param archive The .chm file name on disk.
+      \param pages The pages, relative to the root of the archive, most likely first.
+     */
+    void Speculate(const wxString& archive, const std::vector<wxString>& pages);
+
+    /*!
+      \brief Looks up a file read ahead by Speculate().
+      \param archive The .chm file name on disk.
+      \param path The file, relative to the root of the archive.
+      \return Its contents, or nullptr if it hasn't been read (or has been evicted since).
+     */
+    std::shared_ptr<const std::string> Cached(const wxString& archive, const wxString& path);
+
+public:
+    //! No copy construction allowed.
+    CHMPrefetcher(const CHMPrefetcher&) = delete;
+
+    //! No assignments.
+    CHMPrefetcher& operator=(const CHMPrefetcher&) = delete;
+
+private:
+    //! A queued page.
+    struct Request {
+        std::shared_ptr<CHMFile> archive;
+        wxString                 page;
+    };
+
+    //! Thread entry point.
+    void Run();
+
+    //! Prefetches everything a page refers to.
+    void Process(const Request& request);
+
+    //! Reads the next speculative file into the cache. Returns false if there was nothing left to read.
+    bool SpeculateNext();
+
+    //! Helper. Adds a file to the cache, evicting least recently used ones if it's over budget.
+    void Store(const std::string& key, std::string&& bytes);
+
+private:
+    //! A file read ahead, in the LRU list.
+    struct CacheEntry {
+        std::string                        key;
+        std::shared_ptr<const std::string> bytes;
+    };
+
+    std::mutex              _mutex;
+    std::condition_variable _cv;
+    std::deque<Request>     _pending;
+    std::atomic<bool>       _stop {false};
+
+    // Speculative reads, guarded by _mutex.
+    std::string             _speculativeArchive;
+    std::deque<std::string> _speculative;
+    size_t                  _speculativeBudget {0};
+    unsigned                _speculativeGeneration {0};
+
+    // Read ahead files, most recently used first.
+    std::mutex                                                       _cacheMutex;
+    std::list<CacheEntry>                                            _cache;
+    std::unordered_map<std::string, std::list<CacheEntry>::iterator> _cacheIndex;
+    size_t                                                           _cacheBytes {0};
+
+    // Only ever touched from the worker thread.
+    std::unique_ptr<CHMFile> _chmFile;
+
+    std::thread _thread;
+};
+
+#endif // __CHMPREFETCHER_H_
@@ -0,0 +1,345 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <chmrpcserver.h>
+
+#ifdef WITH_LIBXMLRPC
+
+#include <algorithm>
+#include <chmframe.h>
+#include <chmlibrary.h>
+#include <chrono>
+#include <future>
+#include <wx/app.h>
+#include <wxstringutils.h>
+
+namespace {
+
+// How long the server thread waits for requests before checking whether it should stop, in seconds.
+constexpr double WORK_SLICE {0.25};
+
+// Finished jobs nobody asks about are forgotten, oldest first, past this many.
+constexpr size_t MAX_FINISHED_JOBS {1024};
+
+// Archives kept open for the next jobs.
+constexpr size_t OPEN_ARCHIVES {4};
+
+// Files bigger than this aren't sent. More than any page, and the directory of a damaged archive can claim anything.
+constexpr uint64_t MAX_PAGE_BYTES {64 * 1024 * 1024};
+
+bool IsString(XmlRpc::XmlRpcValue& value)
+{
+    return value.getType() == XmlRpc::XmlRpcValue::TypeString;
+}
+
+bool IsInt(XmlRpc::XmlRpcValue& value)
+{
+    return value.getType() == XmlRpc::XmlRpcValue::TypeInt;
+}
+
+bool IsBool(XmlRpc::XmlRpcValue& value)
+{
+    return value.getType() == XmlRpc::XmlRpcValue::TypeBoolean;
+}
+
+// New calls take UTF-8, like XML itself. The old ones never did, and keep taking Latin-1.
+wxString FromUTF8(XmlRpc::XmlRpcValue& value)
+{
+    return wxString::FromUTF8(static_cast<std::string&>(value).c_str());
+}
+
+} // end of anonymous namespace
+
+CHMRpcServer::CHMRpcServer(CHMFrame* frame)
+    : XmlRpc::XmlRpcServerMethod("xCHM"), _frame(frame), _pool(std::make_unique<CHMThreadPool>())
+{
+    _server.addMethod(this);
+}
+
+CHMRpcServer::~CHMRpcServer()
+{
+    _stop = true;
+
+    if (_thread.joinable())
+        _thread.join();
+
+    // Lets the jobs still running finish, before what they use goes away.
+    _pool.reset();
+
+    _server.shutdown();
+}
+
+bool CHMRpcServer::Start(int port)
+{
+    if (_thread.joinable() || !_server.bindAndListen(port))
+        return false;
+
+    _thread = std::thread(&CHMRpcServer::Run, this);
+    return true;
+}
+
+void CHMRpcServer::Run()
+{
+    // Requests are answered as soon as they come in, the time slice only bounds how long stopping takes.
+    while (!_stop)
+        _server.work(WORK_SLICE);
+}
+
+void CHMRpcServer::execute(XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result)
+{
+    using namespace XmlRpc;
+
+    result = false;
+
+    if (params.size() == 0 || !IsInt(params[0]))
+        return;
+
+    switch (static_cast<int>(params[0])) {
+
+    case 0: // we want to shut everything down!
+        _frame->CallAfter([] { wxTheApp->ExitMainLoop(); });
+        result = true;
+        break;
+
+    case 1:
+        if (params.size() == 2 && IsString(params[1])) {
+            auto file = CURRENT_CHAR_STRING(std::string(params[1]).c_str());
+            result    = OnMainThread([frame = _frame, file] { return frame->LoadCHM(file); });
+        }
+
+        if (params.size() == 3 && IsString(params[1]) && IsInt(params[2])) {
+            auto file = CURRENT_CHAR_STRING(std::string(params[1]).c_str());
+            auto id   = static_cast<int>(params[2]);
+            result    = OnMainThread(
+                [frame = _frame, file, id] { return frame->LoadCHM(file) && frame->LoadContextID(id); });
+        }
+        break;
+
+    case 2:
+        if (params.size() == 2 && IsInt(params[1])) {
+            auto id = static_cast<int>(params[1]);
+            result  = OnMainThread([frame = _frame, id] { return frame->LoadContextID(id); });
+        }
+        break;
+
+    case 3: // 1, without waiting for it
+        if ((params.size() == 2 || (params.size() == 3 && IsInt(params[2]))) && IsString(params[1])) {
+            auto file  = FromUTF8(params[1]);
+            auto hasId = params.size() == 3;
+            auto id    = hasId ? static_cast<int>(params[2]) : 0;
+
+            result = NewJob([this, file, hasId, id] {
+                return XmlRpcValue(OnMainThread([frame = _frame, file, hasId, id] {
+                    return frame->LoadCHM(file) && (!hasId || frame->LoadContextID(id));
+                }));
+            });
+        }
+        break;
+
+    case 4: // search file, optionally for whole words and / or in titles only
+        if (params.size() >= 3 && params.size() <= 5 && IsString(params[1]) && IsString(params[2])
+            && (params.size() < 4 || IsBool(params[3])) && (params.size() < 5 || IsBool(params[4]))) {
+            auto file       = FromUTF8(params[1]);
+            auto query      = FromUTF8(params[2]);
+            auto wholeWords = params.size() >= 4 && static_cast<bool>(params[3]);
+            auto titlesOnly = params.size() >= 5 && static_cast<bool>(params[4]);
+
+            result = NewJob(
+                [this, file, query, wholeWords, titlesOnly] { return Search(file, query, wholeWords, titlesOnly); });
+        }
+        break;
+
+    case 5: // the contents of a file inside file
+        if (params.size() == 3 && IsString(params[1]) && IsString(params[2])) {
+            auto file = FromUTF8(params[1]);
+            auto path = FromUTF8(params[2]);
+
+            result = NewJob([this, file, path] { return PageBytes(file, path); });
+        }
+        break;
+
+    case 6: // the result of a finished job
+        if (params.size() == 2 && IsInt(params[1]))
+            result = JobResult(static_cast<int>(params[1]));
+        break;
+    }
+}
+
+bool CHMRpcServer::OnMainThread(std::function<bool()> task)
+{
+    auto done   = std::make_shared<std::promise<bool>>();
+    auto result = done->get_future();
+
+    _frame->CallAfter([task, done] { done->set_value(task()); });
+
+    // The main loop might be gone by the time the task's turn would come.
+    while (result.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+        if (_stop)
+            return false;
+
+    return result.get();
+}
+
+int CHMRpcServer::NewJob(std::function<XmlRpc::XmlRpcValue()> work)
+{
+    int id;
+
+    {
+        std::lock_guard<std::mutex> lock(_jobsMutex);
+
+        id = ++_lastJob;
+        _jobs[id];
+
+        // Jobs are numbered in order, so the first finished ones found are also the oldest.
+        auto finished = std::count_if(_jobs.begin(), _jobs.end(), [](auto& job) { return job.second.done; });
+
+        for (auto it = _jobs.begin(); it != _jobs.end() && static_cast<size_t>(finished) > MAX_FINISHED_JOBS;)
+            if (it->second.done) {
+                it = _jobs.erase(it);
+                --finished;
+            } else
+                ++it;
+    }
+
+    _pool->Submit([this, id, work] {
+        auto result = work();
+
+        std::lock_guard<std::mutex> lock(_jobsMutex);
+
+        auto it = _jobs.find(id);
+
+        if (it != _jobs.end()) {
+            it->second.result = result;
+            it->second.done   = true;
+        }
+    });
+
+    return id;
+}
+
+XmlRpc::XmlRpcValue CHMRpcServer::JobResult(int id)
+{
+    XmlRpc::XmlRpcValue status;
+
+    std::lock_guard<std::mutex> lock(_jobsMutex);
+
+    auto it = _jobs.find(id);
+
+    if (it == _jobs.end())
+        return false;
+
+    status["done"] = it->second.done;
+
+    if (it->second.done) {
+        status["result"] = it->second.result;
+        _jobs.erase(it);
+    }
+
+    return status;
+}
+
+XmlRpc::XmlRpcValue CHMRpcServer::Search(const wxString& archive, const wxString& query, bool wholeWords,
+                                         bool titlesOnly)
+{
+    XmlRpc::XmlRpcValue hits;
+    auto                served = OpenArchive(archive);
+
+    if (!served)
+        return false;
+
+    std::unique_lock<std::mutex> lock(served->mutex, std::defer_lock);
+
+    if (!CHM_CONCURRENT_READERS)
+        lock.lock();
+
+    auto found = CHMLibrary::SearchFile(*served->file, CHMLibrary::QueryWords(query), wholeWords, titlesOnly, 0);
+
+    if (lock.owns_lock())
+        lock.unlock();
+
+    CHMLibrary::Rank(found);
+
+    hits.setSize(found.size());
+
+    for (size_t i = 0; i < found.size(); ++i) {
+        hits[i]["url"]   = std::string(found[i].url.utf8_str());
+        hits[i]["title"] = std::string(found[i].title.utf8_str());
+    }
+
+    return hits;
+}
+
+XmlRpc::XmlRpcValue CHMRpcServer::PageBytes(const wxString& archive, const wxString& path)
+{
+    auto served = OpenArchive(archive);
+
+    if (!served)
+        return false;
+
+    std::unique_lock<std::mutex> lock(served->mutex, std::defer_lock);
+
+    if (!CHM_CONCURRENT_READERS)
+        lock.lock();
+
+    chmUnitInfo ui;
+
+    if (!served->file->ResolveObject(path.StartsWith(wxT("/")) ? path : wxT("/") + path, &ui))
+        return false;
+
+    if (ui.length > MAX_PAGE_BYTES)
+        return false;
+
+    std::vector<unsigned char> buffer(ui.length);
+
+    if (ui.length && served->file->RetrieveObject(&ui, buffer.data(), 0, ui.length) != ui.length)
+        return false;
+
+    return XmlRpc::XmlRpcValue(buffer.data(), static_cast<int>(buffer.size()));
+}
+
+std::shared_ptr<CHMRpcServer::Archive> CHMRpcServer::OpenArchive(const wxString& path)
+{
+    std::lock_guard<std::mutex> lock(_archivesMutex);
+
+    for (auto it = _archives.begin(); it != _archives.end(); ++it)
+        if ((*it)->path == path) {
+            auto archive = *it;
+
+            _archives.erase(it);
+            _archives.push_front(archive);
+
+            return archive;
+        }
+
+    auto archive  = std::make_shared<Archive>();
+    archive->path = path;
+    archive->file = std::make_unique<CHMFile>(path);
+
+    if (!archive->file->IsOk())
+        return nullptr;
+
+    _archives.push_front(archive);
+
+    if (_archives.size() > OPEN_ARCHIVES)
+        _archives.pop_back();
+
+    return archive;
+}
+
+#endif // WITH_LIBXMLRPC
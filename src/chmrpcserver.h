@@ -0,0 +1,129 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMRPCSERVER_H_
+#define __CHMRPCSERVER_H_
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WITH_LIBXMLRPC
+
+#include <XmlRpc.h>
+#include <atomic>
+#include <chmfile.h>
+#include <chmthreadpool.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <wx/string.h>
+
+// Forward declarations.
+class CHMFrame;
+
+/*!
+  \brief The xCHM XML-RPC method (see README.xmlrpc), served on its own thread.
+
+  Requests are read and answered on the server thread, so a slow request in the GUI doesn't hold up the other
+  clients. Only what touches the GUI (loading a book or a context-ID) is handed over to the main thread. Searches and
+  page reads run as jobs on a thread pool, on archive handles of their own: the asynchronous calls return a job ID
+  right away, whose result is then picked up with another call.
+ */
+class CHMRpcServer : public XmlRpc::XmlRpcServerMethod {
+public:
+    //! Sets up the method, to act on frame.
+    explicit CHMRpcServer(CHMFrame* frame);
+
+    //! Stops serving, waiting for the jobs still running.
+    ~CHMRpcServer() override;
+
+    /*!
+      \brief Starts serving.
+      \param port The TCP port to listen on.
+      \return false if the port can't be listened on.
+     */
+    bool Start(int port);
+
+public:
+    //! No copy construction allowed.
+    CHMRpcServer(const CHMRpcServer&) = delete;
+
+    //! No assignments.
+    CHMRpcServer& operator=(const CHMRpcServer&) = delete;
+
+private:
+    //! Handles actual XMLRPC requests and parameter parsing. Called on the server thread.
+    void execute(XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result) override;
+
+    //! Server thread entry point.
+    void Run();
+
+    //! Helper. Runs task on the main thread and waits for it. Returns false if the server is stopped meanwhile. The
+    //! task may still run after the server is gone, so it must not use it: tasks capture the frame, not this.
+    bool OnMainThread(std::function<bool()> task);
+
+    //! Helper. Queues work on the thread pool, returning the ID its result can be picked up with.
+    int NewJob(std::function<XmlRpc::XmlRpcValue()> work);
+
+    //! Helper. The result of a finished job (which is then forgotten), or false if there's no such finished job.
+    XmlRpc::XmlRpcValue JobResult(int id);
+
+    //! Helper. Searches archive for query. Called on a pool thread.
+    XmlRpc::XmlRpcValue Search(const wxString& archive, const wxString& query, bool wholeWords, bool titlesOnly);
+
+    //! Helper. Reads the file at path in archive, base64-encoded. Called on a pool thread.
+    XmlRpc::XmlRpcValue PageBytes(const wxString& archive, const wxString& path);
+
+private:
+    //! An archive jobs are run on, kept open for the next ones.
+    struct Archive {
+        wxString                 path;
+        std::mutex               mutex;
+        std::unique_ptr<CHMFile> file;
+    };
+
+    //! A queued, running or finished job.
+    struct Job {
+        bool                done {false};
+        XmlRpc::XmlRpcValue result;
+    };
+
+    //! Helper. Opens path, or finds it among the recently used archives.
+    std::shared_ptr<Archive> OpenArchive(const wxString& path);
+
+private:
+    CHMFrame*                            _frame;
+    XmlRpc::XmlRpcServer                 _server;
+    std::atomic<bool>                    _stop {false};
+    std::thread                          _thread;
+    std::mutex                           _jobsMutex;
+    std::map<int, Job>                   _jobs;
+    int                                  _lastJob {0};
+    std::mutex                           _archivesMutex;
+    std::deque<std::shared_ptr<Archive>> _archives;
+    std::unique_ptr<CHMThreadPool>       _pool;
+};
+
+#endif // WITH_LIBXMLRPC
+
+#endif // __CHMRPCSERVER_H_
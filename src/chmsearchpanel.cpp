@@ -18,10 +18,13 @@
 */
 
 #include <algorithm>
+#include <chmframe.h>
 #include <chmhtmlnotebook.h>
 #include <chminputstream.h>
+#include <chmlibrary.h>
 #include <chmlistctrl.h>
 #include <chmsearchpanel.h>
+#include <chmsearchworker.h>
 #include <hhcparser.h>
 #include <vector>
 #include <wx/config.h>
@@ -30,8 +33,18 @@
 #include <wx/utils.h>
 #include <wx/wx.h>
 
+namespace {
+
+// How long to wait after the last keystroke before searching as you type.
+constexpr int TYPING_DELAY_MS {60};
+
+// Search results read ahead.
+constexpr size_t PREFETCH_RESULTS {3};
+
+} // end of anonymous namespace
+
 CHMSearchPanel::CHMSearchPanel(wxWindow* parent, wxTreeCtrl* topics, CHMHtmlNotebook* nbhtml)
-    : wxPanel(parent), _tcl(topics)
+    : wxPanel(parent), _tcl(topics), _typingTimer(this, ID_SearchTimer)
 {
     auto sizer = new wxBoxSizer(wxVERTICAL);
 
@@ -41,12 +54,18 @@ CHMSearchPanel::CHMSearchPanel(wxWindow* parent, wxTreeCtrl* topics, CHMHtmlNote
     _text = new wxTextCtrl(this, ID_SearchText, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
 
     _partial = new wxCheckBox(this, wxID_ANY, _("Get partial matches"));
-    _titles  = new wxCheckBox(this, wxID_ANY, _("Search titles only"));
-    _search  = new wxButton(this, ID_SearchButton, _("Search"));
+    _titles    = new wxCheckBox(this, wxID_ANY, _("Search titles only"));
+    _asYouType  = new wxCheckBox(this, wxID_ANY, _("Search as you type"));
+    _inLibrary  = new wxCheckBox(this, wxID_ANY, _("Search the library"));
+    _libraryDir = new wxButton(this, ID_LibraryButton, _("Library..."));
+    _search     = new wxButton(this, ID_SearchButton, _("Search"));
 
 #if wxUSE_TOOLTIPS
     _partial->SetToolTip(_("Allow partial matches."));
     _titles->SetToolTip(_("Only search in the contents' titles."));
+    _asYouType->SetToolTip(_("Update the results while typing, treating the last word as a prefix."));
+    _inLibrary->SetToolTip(_("Search all the books in the library folder, not just the open one."));
+    _libraryDir->SetToolTip(_("Choose the library folder."));
     _search->SetToolTip(_("Search contents for occurrences of the specified text."));
 #endif
     _results = new CHMListCtrl(this, nbhtml, ID_Results);
@@ -54,18 +73,31 @@ CHMSearchPanel::CHMSearchPanel(wxWindow* parent, wxTreeCtrl* topics, CHMHtmlNote
     sizer->Add(_text, 0, wxEXPAND | wxLEFT | wxRIGHT | wxTOP, 2);
     sizer->Add(_partial, 0, wxLEFT | wxRIGHT | wxTOP, 10);
     sizer->Add(_titles, 0, wxLEFT | wxRIGHT, 10);
+    sizer->Add(_asYouType, 0, wxLEFT | wxRIGHT | wxTOP, 10);
+
+    auto librarySizer = new wxBoxSizer(wxHORIZONTAL);
+    librarySizer->Add(_inLibrary, 1, wxALIGN_CENTER_VERTICAL);
+    librarySizer->Add(_libraryDir, 0, wxLEFT, 5);
+
+    sizer->Add(librarySizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxTOP, 10);
     sizer->Add(_search, 0, wxALL, 10);
     sizer->Add(_results, 1, wxALL | wxEXPAND, 2);
 
     Bind(wxEVT_LIST_ITEM_SELECTED, &CHMSearchPanel::OnSearchSel, this, ID_Results);
     Bind(wxEVT_BUTTON, &CHMSearchPanel::OnSearch, this, ID_SearchButton);
     Bind(wxEVT_TEXT_ENTER, &CHMSearchPanel::OnSearch, this, ID_SearchText);
+    Bind(wxEVT_TEXT, &CHMSearchPanel::OnSearchText, this, ID_SearchText);
+    Bind(wxEVT_TIMER, &CHMSearchPanel::OnSearchTimer, this, ID_SearchTimer);
+    Bind(wxEVT_BUTTON, &CHMSearchPanel::OnLibraryDir, this, ID_LibraryButton);
 
     GetConfig();
 }
 
 CHMSearchPanel::~CHMSearchPanel()
 {
+    _typingTimer.Stop();
+    _worker.reset();
+
     SetConfig();
 }
 
@@ -73,54 +105,38 @@ void CHMSearchPanel::OnSearch(wxCommandEvent&)
 {
     wxBusyCursor bcr;
 
+    _typingTimer.Stop();
+    if (_worker)
+        _worker->Cancel();
+
     _results->Reset();
 
-    auto     sr = _text->GetLineText(0);
-    wxString word;
+    auto sr = _text->GetLineText(0);
 
     if (sr.IsEmpty())
         return;
 
+    if (_inLibrary->IsChecked()) {
+        LibrarySearch(sr);
+        return;
+    }
+
     auto chmf = CHMInputStream::GetCache();
 
     if (!chmf)
         return;
 
-    sr.MakeLower();
-
-    auto srLen = sr.length();
+    auto words = CHMLibrary::QueryWords(sr);
 
-    for (size_t i = 0; i < srLen; ++i)
-        switch (static_cast<wxChar>(sr[i])) {
-        case wxT('+'):
-        case wxT('-'):
-        case wxT('#'):
-        case wxT('@'):
-        case wxT('^'):
-        case wxT('&'):
-        case wxT('%'):
-            sr[i] = wxT(' ');
-            break;
-        default:
-            break;
-        }
-
-    wxStringTokenizer tkz(sr, wxT(" \t\r\n"));
-
-    while (word.IsEmpty())
-        if (tkz.HasMoreTokens())
-            word = tkz.GetNextToken();
+    if (words.empty())
+        return;
 
     CHMSearchResults h1;
-    chmf->IndexSearch(word, !_partial->IsChecked(), _titles->IsChecked(), h1);
-
-    while (tkz.HasMoreTokens()) {
-        auto token = tkz.GetNextToken();
-        if (token.IsEmpty())
-            continue;
+    chmf->IndexSearch(words[0], !_partial->IsChecked(), _titles->IsChecked(), h1);
 
+    for (size_t i = 1; i < words.size(); ++i) {
         CHMSearchResults h2, tmp;
-        chmf->IndexSearch(token, !_partial->IsChecked(), _titles->IsChecked(), h2);
+        chmf->IndexSearch(words[i], !_partial->IsChecked(), _titles->IsChecked(), h2);
 
         if (!h2.empty()) {
             for (auto&& item : h2)
@@ -133,35 +149,142 @@ void CHMSearchPanel::OnSearch(wxCommandEvent&)
         }
     }
 
-    if (_titles->IsChecked() && h1.empty()) {
-        PopulateList(_tcl->GetRootItem(), sr, !_partial->IsChecked());
-        _results->UpdateItemCount();
-        _results->UpdateUI();
+    if (_titles->IsChecked() && h1.empty())
+        PopulateList(_tcl->GetRootItem(), CHMLibrary::CleanQuery(sr), !_partial->IsChecked());
+
+    for (auto&& item : h1) {
+        auto url = item.first.StartsWith(wxT("/")) ? item.first : (wxT("/") + item.first);
+        _results->AddPairItem(item.second, url);
+    }
+
+    _results->UpdateItemCount();
+    _results->UpdateUI();
+    PrefetchTopResults();
+}
+
+void CHMSearchPanel::PrefetchTopResults()
+{
+    auto chmf = CHMInputStream::GetCache();
+
+    if (!chmf)
         return;
+
+    std::vector<wxString> pages;
+
+    for (size_t i = 0; i < PREFETCH_RESULTS; ++i) {
+        auto url = _results->GetItemURL(i).BeforeFirst(wxT('#'));
+
+        if (url.IsEmpty())
+            break;
+
+        pages.push_back(url.StartsWith(wxT("/")) ? url : wxT("/") + url);
     }
 
-    for (auto&& item : h1) {
+    if (!pages.empty())
+        CHMInputStream::GetPrefetcher()->Speculate(chmf->ArchiveName(), pages);
+}
+
+void CHMSearchPanel::LibrarySearch(const wxString& text)
+{
+    if (_libraryPath.IsEmpty()) {
+        wxCommandEvent dummy;
+        OnLibraryDir(dummy);
+
+        if (_libraryPath.IsEmpty())
+            return;
+    }
+
+    if (!_library)
+        _library = std::make_unique<CHMLibrary>();
+
+    if (_library->Directory() != _libraryPath)
+        _library->SetDirectory(_libraryPath);
+
+    CHMLibraryHits hits;
+    _library->Search(CHMLibrary::QueryWords(text), !_partial->IsChecked(), _titles->IsChecked(), hits);
+
+    for (auto&& hit : hits)
+        _results->AppendPairItem(hit.title + wxT(" (") + hit.book + wxT(")"),
+                                 wxT("file:") + hit.archive + wxT("#xchm:") + hit.url);
+
+    _results->UpdateItemCount();
+    _results->UpdateUI();
+}
+
+void CHMSearchPanel::OnLibraryDir(wxCommandEvent&)
+{
+    auto dir = wxDirSelector(_("Choose the library folder"), _libraryPath, wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST,
+                             wxDefaultPosition, this);
+
+    if (!dir.IsEmpty())
+        _libraryPath = dir;
+}
+
+void CHMSearchPanel::OnSearchText(wxCommandEvent&)
+{
+    if (_asYouType->IsChecked() && !_inLibrary->IsChecked())
+        _typingTimer.StartOnce(TYPING_DELAY_MS);
+}
+
+void CHMSearchPanel::OnSearchTimer(wxTimerEvent&)
+{
+    auto chmf = CHMInputStream::GetCache();
+    auto sr    = CHMLibrary::CleanQuery(_text->GetLineText(0));
+    auto words = CHMLibrary::QueryWords(sr);
+
+    if (!chmf || words.empty()) {
+        if (_worker)
+            _worker->Cancel();
+        _results->Reset();
+        return;
+    }
+
+    if (!_worker)
+        _worker = std::make_unique<CHMSearchWorker>(
+            [this](unsigned generation, const CHMSearchResults& results, bool done) {
+                CallAfter([this, generation, results, done] { OnIncrementalResults(generation, results, done); });
+            });
+
+    auto lastIsPrefix = !wxIsspace(sr.Last());
+
+    _worker->Submit(chmf->ArchiveName(), words, lastIsPrefix, !_partial->IsChecked(), _titles->IsChecked());
+}
+
+void CHMSearchPanel::OnIncrementalResults(unsigned generation, const CHMSearchResults& results, bool done)
+{
+    if (!_worker || generation != _worker->Generation())
+        return;
+
+    _results->Reset();
+
+    if (done && results.empty() && _titles->IsChecked())
+        PopulateList(_tcl->GetRootItem(), CHMLibrary::CleanQuery(_text->GetLineText(0)), !_partial->IsChecked());
+
+    for (auto&& item : results) {
         auto url = item.first.StartsWith(wxT("/")) ? item.first : (wxT("/") + item.first);
         _results->AddPairItem(item.second, url);
     }
 
     _results->UpdateItemCount();
     _results->UpdateUI();
+
+    if (done)
+        PrefetchTopResults();
 }
 
 void CHMSearchPanel::PopulateList(wxTreeItemId root, const wxString& text, bool wholeWords)
 {
-    static auto chmf = CHMInputStream::GetCache();
+    auto chmf = CHMInputStream::GetCache();
 
     if (!chmf)
         return;
 
     auto data = dynamic_cast<URLTreeItem*>(_tcl->GetItemData(root));
 
-    if (data && (!data->_url.IsEmpty())) {
+    if (data && data->_url.length) {
         auto title = _tcl->GetItemText(root);
         if (TitleSearch(title, text, wholeWords))
-            _results->AddPairItem(title, data->_url);
+            _results->AddPairItem(title, data->URL());
     }
 
     wxTreeItemIdValue cookie;
@@ -209,11 +332,33 @@ bool CHMSearchPanel::TitleSearch(const wxString& title, const wxString& text, bo
 
 void CHMSearchPanel::OnSearchSel(wxListEvent&)
 {
+    auto url  = _results->GetSelectedURL();
+    auto chmf = CHMInputStream::GetCache();
+
+    // Library hits from other books: only open the archive now that the user wants to see the page.
+    if (url.StartsWith(wxT("file:"))
+        && (!chmf || !url.StartsWith(wxT("file:") + chmf->ArchiveName() + wxT("#xchm:")))) {
+        auto frame = dynamic_cast<CHMFrame*>(wxGetTopLevelParent(this));
+
+        if (frame) {
+            frame->LoadCHM(url);
+            return;
+        }
+    }
+
     _results->LoadSelected();
 }
 
 void CHMSearchPanel::Reset()
 {
+    _typingTimer.Stop();
+    if (_worker)
+        _worker->Cancel();
+
+    // Library results span all the books, they're still good after another one has been opened.
+    if (_inLibrary->IsChecked())
+        return;
+
     _text->Clear();
     _results->Reset();
 }
@@ -229,11 +374,14 @@ void CHMSearchPanel::SetConfig()
 
     config.Write(wxT("/Search/partialWords"), static_cast<long>(_partial->GetValue()));
     config.Write(wxT("/Search/titlesOnly"), static_cast<long>(_titles->GetValue()));
+    config.Write(wxT("/Search/asYouType"), static_cast<long>(_asYouType->GetValue()));
+    config.Write(wxT("/Search/library"), static_cast<long>(_inLibrary->GetValue()));
+    config.Write(wxT("/Search/libraryDir"), _libraryPath);
 }
 
 void CHMSearchPanel::GetConfig()
 {
-    long     partial, titles;
+    long     partial, titles, asYouType, library;
     wxConfig config(wxT("xchm"));
 
     if (config.Read(wxT("/Search/partialWords"), &partial)) {
@@ -241,4 +389,12 @@ void CHMSearchPanel::GetConfig()
         _partial->SetValue(partial);
         _titles->SetValue(titles);
     }
+
+    if (config.Read(wxT("/Search/asYouType"), &asYouType))
+        _asYouType->SetValue(asYouType);
+
+    if (config.Read(wxT("/Search/library"), &library))
+        _inLibrary->SetValue(library);
+
+    config.Read(wxT("/Search/libraryDir"), &_libraryPath);
 }
@@ -20,6 +20,9 @@
 #ifndef __CHMSEARCHPANEL_HPP_
 #define __CHMSEARCHPANEL_HPP_
 
+#include <chmfile.h>
+#include <memory>
+#include <vector>
 #include <wx/button.h>
 #include <wx/checkbox.h>
 #include <wx/font.h>
@@ -29,11 +32,14 @@
 #include <wx/panel.h>
 #include <wx/string.h>
 #include <wx/textctrl.h>
+#include <wx/timer.h>
 #include <wx/treectrl.h>
 
 // Forward declaration.
 class CHMListCtrl;
 class CHMHtmlNotebook;
+class CHMSearchWorker;
+class CHMLibrary;
 
 /*!
   \class wxPanel
@@ -45,6 +51,8 @@ enum {
     ID_SearchText = 1024,
     ID_SearchButton,
     ID_Results,
+    ID_SearchTimer,
+    ID_LibraryButton,
 };
 
 //! Custom built search panel.
@@ -62,7 +70,7 @@ public:
      */
     CHMSearchPanel(wxWindow* parent, wxTreeCtrl* topics, CHMHtmlNotebook* nbhtml);
 
-    //! Calls SetConfig().
+    //! Stops the search-as-you-type worker and calls SetConfig().
     ~CHMSearchPanel();
 
     //! Resets the panel (clears the result list and the textbox.)
@@ -81,10 +89,28 @@ protected:
     //! This gets called when the user clicks on a result.
     void OnSearchSel(wxListEvent& event);
 
+    //! Restarts the search-as-you-type timer whenever the text changes.
+    void OnSearchText(wxCommandEvent& event);
+
+    //! The user has stopped typing for a bit, hand the query over to the worker.
+    void OnSearchTimer(wxTimerEvent& event);
+
+    //! Lets the user pick the library directory.
+    void OnLibraryDir(wxCommandEvent& event);
+
 private:
     //! Helper. Searches through the tree recursively.
     void PopulateList(wxTreeItemId root, const wxString& text, bool wholeWords);
 
+    //! Helper. Searches every book in the library directory, rather than just the one that's open.
+    void LibrarySearch(const wxString& text);
+
+    //! Helper. Shows search-as-you-type results, unless a newer query has been submitted since.
+    void OnIncrementalResults(unsigned generation, const CHMSearchResults& results, bool done);
+
+    //! Helper. Has the prefetcher read the first few results ahead, they're the likeliest to be clicked.
+    void PrefetchTopResults();
+
     //! Helper. Grep searches page titles for the given text.
     bool TitleSearch(const wxString& title, const wxString& text, bool wholeWords);
 
@@ -99,8 +125,16 @@ private:
     wxTextCtrl*  _text;
     wxCheckBox*  _partial;
     wxCheckBox*  _titles;
+    wxCheckBox*  _asYouType;
+    wxCheckBox*  _inLibrary;
+    wxButton*    _libraryDir;
     wxButton*    _search;
     CHMListCtrl* _results;
+    wxTimer      _typingTimer;
+    wxString     _libraryPath;
+
+    std::unique_ptr<CHMSearchWorker> _worker;
+    std::unique_ptr<CHMLibrary>      _library;
 };
 
 #endif // __CHMSEARCHPANEL_HPP_
@@ -0,0 +1,262 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <chmsearchworker.h>
+#include <chrono>
+
+namespace {
+
+// Candidate words kept per prefix. Short prefixes match more than that, their candidates get rescanned on demand.
+constexpr size_t MAX_PREFIX_WORDS {4096};
+
+// Complete words whose results are remembered between queries.
+constexpr size_t MAX_CACHED_WORDS {16};
+
+// Partial results are handed over at most this often, so the list keeps up with a 60 Hz display.
+constexpr std::chrono::milliseconds REPORT_INTERVAL {16};
+
+void Intersect(CHMSearchResults& results, const CHMSearchResults& other)
+{
+    for (auto it = results.begin(); it != results.end();)
+        if (other.find(it->first) == other.end())
+            it = results.erase(it);
+        else
+            ++it;
+}
+
+} // end of anonymous namespace
+
+CHMSearchWorker::CHMSearchWorker(const ResultsCallback& callback)
+    : _callback(callback), _thread(&CHMSearchWorker::Run, this)
+{
+}
+
+CHMSearchWorker::~CHMSearchWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        ++_generation;
+    }
+
+    _cv.notify_one();
+    _thread.join();
+}
+
+unsigned CHMSearchWorker::Submit(const wxString& archive, const std::vector<wxString>& words, bool lastIsPrefix,
+                                 bool wholeWords, bool titlesOnly)
+{
+    auto request = std::make_unique<Request>();
+
+    request->archive      = archive;
+    request->words        = words;
+    request->lastIsPrefix = lastIsPrefix;
+    request->wholeWords   = wholeWords;
+    request->titlesOnly   = titlesOnly;
+
+    unsigned generation;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        generation = request->generation = ++_generation;
+        _pending                         = std::move(request);
+    }
+
+    _cv.notify_one();
+    return generation;
+}
+
+void CHMSearchWorker::Cancel()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_generation;
+    _pending.reset();
+}
+
+void CHMSearchWorker::Run()
+{
+    for (;;) {
+        std::unique_ptr<Request> request;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait(lock, [this] { return _stop || _pending; });
+
+            if (_stop)
+                return;
+
+            request = std::move(_pending);
+        }
+
+        Process(*request);
+    }
+}
+
+void CHMSearchWorker::Process(const Request& request)
+{
+    auto           generation = request.generation;
+    CHMCancelCheck cancelled  = [this, generation] { return _generation != generation; };
+
+    if (!_chmFile || _chmFile->ArchiveName() != request.archive) {
+        _prefixes.clear();
+        _wordResults.clear();
+        _chmFile = std::make_unique<CHMFile>(request.archive);
+    }
+
+    CHMSearchResults results;
+
+    if (!_chmFile->IsOk() || request.words.empty()) {
+        if (!cancelled())
+            _callback(generation, results, true);
+        return;
+    }
+
+    auto complete = request.words.size() - (request.lastIsPrefix ? 1 : 0);
+
+    for (size_t i = 0; i < complete; ++i) {
+        CHMSearchResults wordResults;
+
+        if (!WordResults(request.words[i], request, wordResults, cancelled))
+            return;
+
+        if (i == 0)
+            results = std::move(wordResults);
+        else
+            Intersect(results, wordResults);
+
+        if (results.empty())
+            break;
+    }
+
+    if (request.lastIsPrefix && (complete == 0 || !results.empty())) {
+        auto&            prefix = request.words.back();
+        CHMSearchResults prefixResults;
+
+        if (!_chmFile->HasFIftiMain()) {
+            // Our own full-text index keeps its dictionary in memory, prefix lookups are cheap enough as they are.
+            _chmFile->IndexSearch(prefix, request.wholeWords, request.titlesOnly, prefixResults, cancelled);
+
+            if (cancelled())
+                return;
+
+        } else {
+            auto state = Candidates(prefix, cancelled);
+
+            if (!state)
+                return;
+
+            auto lastReport = std::chrono::steady_clock::now();
+
+            for (auto&& word : state->words) {
+                if ((request.titlesOnly && !word.title) || (request.wholeWords && word.word != prefix))
+                    continue;
+
+                if (!_chmFile->IndexWordResults(word, prefixResults, cancelled) && cancelled())
+                    return;
+
+                if (prefixResults.size() >= MAX_SEARCH_RESULTS)
+                    break;
+
+                auto now = std::chrono::steady_clock::now();
+
+                if (complete == 0 && now - lastReport >= REPORT_INTERVAL) {
+                    _callback(generation, prefixResults, false);
+                    lastReport = now;
+                }
+            }
+        }
+
+        if (complete == 0)
+            results = std::move(prefixResults);
+        else
+            Intersect(results, prefixResults);
+    }
+
+    if (!cancelled())
+        _callback(generation, results, true);
+}
+
+const CHMSearchWorker::PrefixState* CHMSearchWorker::Candidates(const wxString& prefix,
+                                                                const CHMCancelCheck& cancelled)
+{
+    // Backspacing, or typing a different word: forget the prefixes this one doesn't extend.
+    while (!_prefixes.empty() && !prefix.StartsWith(_prefixes.back().prefix))
+        _prefixes.pop_back();
+
+    if (!_prefixes.empty() && _prefixes.back().prefix == prefix)
+        return &_prefixes.back();
+
+    PrefixState state;
+    uint32_t    leafOffset {0};
+
+    state.prefix = prefix;
+
+    if (!_prefixes.empty()) {
+        auto& parent   = _prefixes.back();
+        auto  lastWord = parent.words.empty() ? wxString() : parent.words.back().word;
+
+        if (!parent.truncated || (lastWord.Cmp(prefix) > 0 && !lastWord.StartsWith(prefix))) {
+            // Every word starting with prefix is already among the parent's candidates.
+            for (auto&& word : parent.words)
+                if (word.word.StartsWith(prefix))
+                    state.words.push_back(word);
+
+            state.resumeOffset = parent.resumeOffset;
+            _prefixes.push_back(std::move(state));
+            return &_prefixes.back();
+        }
+
+        if (lastWord.Cmp(prefix) < 0)
+            // They all come after the parent's candidates, pick up where its scan stopped.
+            leafOffset = parent.resumeOffset;
+    }
+
+    if (!leafOffset)
+        leafOffset = _chmFile->IndexLeafOffset(prefix);
+
+    if (leafOffset
+        && !_chmFile->IndexPrefixWords(prefix, leafOffset, MAX_PREFIX_WORDS, state.words, state.truncated, cancelled)
+        && cancelled())
+        return nullptr;
+
+    state.resumeOffset = leafOffset;
+    _prefixes.push_back(std::move(state));
+    return &_prefixes.back();
+}
+
+bool CHMSearchWorker::WordResults(const wxString& word, const Request& request, CHMSearchResults& results,
+                                  const CHMCancelCheck& cancelled)
+{
+    for (auto&& entry : _wordResults)
+        if (entry.word == word && entry.wholeWords == request.wholeWords && entry.titlesOnly == request.titlesOnly) {
+            results = entry.results;
+            return true;
+        }
+
+    _chmFile->IndexSearch(word, request.wholeWords, request.titlesOnly, results, cancelled);
+
+    if (cancelled())
+        return false;
+
+    if (_wordResults.size() == MAX_CACHED_WORDS)
+        _wordResults.pop_front();
+
+    _wordResults.push_back({word, request.wholeWords, request.titlesOnly, results});
+    return true;
+}
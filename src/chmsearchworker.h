@@ -0,0 +1,139 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMSEARCHWORKER_H_
+#define __CHMSEARCHWORKER_H_
+
+#include <atomic>
+#include <chmfile.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <wx/string.h>
+
+/*!
+  \brief Runs search-as-you-type queries against the $FIftiMain index on a background thread.
+
+  The worker opens its own CHMFile, so it never competes with the UI for the (non thread-safe) CHMLIB handle. For the
+  word being typed it remembers the leaf node cursor and the candidate words found for each prefix, so extending the
+  prefix only narrows the previous candidate set, and backspacing goes back to it. Submitting a new query cancels
+  the one in progress.
+ */
+class CHMSearchWorker {
+public:
+    /*!
+      \brief Called from the worker thread with results, possibly more than once per query as they come in.
+      \param generation The generation returned by Submit() for the query.
+      \param results URL / title pairs found so far.
+      \param done true if this is the last call for this query.
+     */
+    using ResultsCallback = std::function<void(unsigned generation, const CHMSearchResults& results, bool done)>;
+
+    //! Starts the worker thread.
+    explicit CHMSearchWorker(const ResultsCallback& callback);
+
+    //! Cancels the current query and joins the worker thread.
+    ~CHMSearchWorker();
+
+    /*!
+      \brief Queues a query, cancelling the one in progress (if any).
+      \param archive The .chm file name on disk.
+      \param words The (lowercase) words to search for. Pages have to contain all of them.
+      \param lastIsPrefix Is the last word still being typed? If so, it's treated as a prefix.
+      \param wholeWords Are we looking for whole words only?
+      \param titlesOnly Are we looking for titles only?
+      \return The generation of the query, which will be passed back to the callback.
+     */
+    unsigned Submit(const wxString& archive, const std::vector<wxString>& words, bool lastIsPrefix, bool wholeWords,
+                    bool titlesOnly);
+
+    //! Cancels the query in progress, if any. No more results will be reported for it.
+    void Cancel();
+
+    //! The generation of the most recently submitted (or cancelled) query.
+    unsigned Generation() const { return _generation; }
+
+public:
+    //! No copy construction allowed.
+    CHMSearchWorker(const CHMSearchWorker&) = delete;
+
+    //! No assignments.
+    CHMSearchWorker& operator=(const CHMSearchWorker&) = delete;
+
+private:
+    //! A queued query.
+    struct Request {
+        unsigned              generation {0};
+        wxString              archive;
+        std::vector<wxString> words;
+        bool                  lastIsPrefix {false};
+        bool                  wholeWords {false};
+        bool                  titlesOnly {false};
+    };
+
+    //! Candidate words for a prefix, and the leaf node cursor where their scan stopped.
+    struct PrefixState {
+        wxString      prefix;
+        uint32_t      resumeOffset {0};
+        CHMIndexWords words;
+        bool          truncated {false};
+    };
+
+    //! Pages found for a complete word of an earlier query.
+    struct WordResultsEntry {
+        wxString         word;
+        bool             wholeWords {false};
+        bool             titlesOnly {false};
+        CHMSearchResults results;
+    };
+
+    //! Thread entry point.
+    void Run();
+
+    //! Runs a single query.
+    void Process(const Request& request);
+
+    //! Helper. Returns the candidate words for prefix, narrowing or reusing the ones already found.
+    const PrefixState* Candidates(const wxString& prefix, const CHMCancelCheck& cancelled);
+
+    //! Helper. Returns the pages containing a complete word, remembering them for the next query.
+    bool WordResults(const wxString& word, const Request& request, CHMSearchResults& results,
+                     const CHMCancelCheck& cancelled);
+
+private:
+    ResultsCallback          _callback;
+    std::atomic<unsigned>    _generation {0};
+    std::mutex               _mutex;
+    std::condition_variable  _cv;
+    std::unique_ptr<Request> _pending;
+    bool                     _stop {false};
+
+    // Only ever touched from the worker thread.
+    std::unique_ptr<CHMFile>     _chmFile;
+    std::vector<PrefixState>     _prefixes;
+    std::deque<WordResultsEntry> _wordResults;
+
+    std::thread _thread;
+};
+
+#endif // __CHMSEARCHWORKER_H_
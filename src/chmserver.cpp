@@ -0,0 +1,984 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <chmserver.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stringutils.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wx/dir.h>
+#include <wx/filename.h>
+
+namespace {
+
+// Biggest request head accepted.
+constexpr size_t MAX_HEAD_SIZE {16 * 1024};
+
+// Keep-alive connections with nothing to say for this long get closed.
+constexpr int64_t IDLE_TIMEOUT_MS {30 * 1000};
+
+// Send/receive timeout, so a stalled client can't hold on to a pool thread forever.
+constexpr int IO_TIMEOUT_S {30};
+
+// Archive data is sent in pieces this big.
+constexpr size_t SEND_BUF_SIZE {64 * 1024};
+
+// Search hits / index entries per JSON response, unless asked otherwise.
+constexpr size_t DEFAULT_PAGE_SIZE {20};
+
+// And at most.
+constexpr size_t MAX_PAGE_SIZE {200};
+
+// How many recent searches are kept around for paging.
+constexpr size_t SEARCH_CACHE_SIZE {64};
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS {MSG_NOSIGNAL};
+#else
+constexpr int SEND_FLAGS {0};
+#endif
+
+int64_t NowMs()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::string Trim(const std::string& str)
+{
+    auto begin = str.find_first_not_of(" \t");
+
+    if (begin == std::string::npos)
+        return {};
+
+    return str.substr(begin, str.find_last_not_of(" \t") - begin + 1);
+}
+
+// Value of the (first) header called name, without the surrounding blanks.
+std::string HeaderValue(const std::string& head, const std::string& name)
+{
+    for (auto pos = head.find("\r\n"); pos != std::string::npos;) {
+        auto start = pos + 2, end = head.find("\r\n", start);
+
+        if (end == std::string::npos)
+            break;
+
+        auto colon = head.find(':', start);
+
+        if (colon < end && colon - start == name.size() && lowerCase(head.substr(start, colon - start)) == name)
+            return Trim(head.substr(colon + 1, end - colon - 1));
+
+        pos = end;
+    }
+
+    return {};
+}
+
+// Splits a query string into its (decoded) name / value pairs.
+std::map<std::string, std::string> ParseQuery(const std::string& query)
+{
+    std::map<std::string, std::string> params;
+
+    for (size_t pos = 0; pos <= query.size();) {
+        auto end = query.find('&', pos);
+
+        if (end == std::string::npos)
+            end = query.size();
+
+        auto param = query.substr(pos, end - pos);
+        std::replace(param.begin(), param.end(), '+', ' ');
+
+        auto equals = param.find('=');
+
+        if (!param.empty())
+            params.emplace(percentDecode(param.substr(0, equals)),
+                           equals == std::string::npos ? std::string() : percentDecode(param.substr(equals + 1)));
+
+        pos = end + 1;
+    }
+
+    return params;
+}
+
+size_t NumberParam(const std::map<std::string, std::string>& params, const char* name, size_t fallback)
+{
+    auto it = params.find(name);
+
+    if (it == params.end() || it->second.empty() || it->second.find_first_not_of("0123456789") != std::string::npos)
+        return fallback;
+
+    return std::strtoull(it->second.c_str(), nullptr, 10);
+}
+
+bool FlagParam(const std::map<std::string, std::string>& params, const char* name)
+{
+    auto it = params.find(name);
+    return it != params.end() && (it->second == "1" || it->second == "true");
+}
+
+std::string JsonError(const std::string& message)
+{
+    return "{\"error\":" + jsonString(message) + "}\n";
+}
+
+std::string PercentEncode(const std::string& path)
+{
+    static const char* hex = "0123456789ABCDEF";
+    std::string        encoded;
+
+    for (unsigned char c : path) {
+        if (std::isalnum(c) || std::strchr("/-._~!$&'()*+,;=:@", c))
+            encoded += static_cast<char>(c);
+        else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 0xf];
+        }
+    }
+
+    return encoded;
+}
+
+// The URL of path inside the archive called name, leaving the anchor (if any) alone.
+std::string BookUrl(const std::string& name, const std::string& path)
+{
+    auto hash = path.find('#');
+    auto url  = "/" + PercentEncode(name + path.substr(0, hash));
+
+    return hash == std::string::npos ? url : url + path.substr(hash);
+}
+
+std::string HtmlEscape(const std::string& str)
+{
+    std::string escaped;
+
+    for (auto c : str) {
+        switch (c) {
+        case '<':
+            escaped += "&lt;";
+            break;
+        case '>':
+            escaped += "&gt;";
+            break;
+        case '&':
+            escaped += "&amp;";
+            break;
+        case '"':
+            escaped += "&quot;";
+            break;
+        default:
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+const char* MimeType(const std::string& path)
+{
+    static const std::pair<const char*, const char*> types[] = {
+        {"htm", "text/html"},        {"html", "text/html"},      {"css", "text/css"},
+        {"js", "text/javascript"},   {"txt", "text/plain"},      {"xml", "text/xml"},
+        {"gif", "image/gif"},        {"jpg", "image/jpeg"},      {"jpeg", "image/jpeg"},
+        {"png", "image/png"},        {"bmp", "image/bmp"},       {"ico", "image/x-icon"},
+        {"svg", "image/svg+xml"},    {"pdf", "application/pdf"}, {"swf", "application/x-shockwave-flash"},
+        {"json", "application/json"}};
+
+    auto slash = path.rfind('/'), dot = path.rfind('.');
+
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        auto ext = lowerCase(path.substr(dot + 1));
+
+        for (auto&& type : types)
+            if (ext == type.first)
+                return type.second;
+    }
+
+    return "application/octet-stream";
+}
+
+const char* StatusText(int status)
+{
+    switch (status) {
+    case 200:
+        return "OK";
+    case 206:
+        return "Partial Content";
+    case 301:
+        return "Moved Permanently";
+    case 302:
+        return "Found";
+    case 304:
+        return "Not Modified";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 416:
+        return "Range Not Satisfiable";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+enum class RangeResult { NONE, OK, UNSATISFIABLE };
+
+// Parses a string of decimal digits. False if there's anything else in there, or the number doesn't fit.
+bool ParseNumber(const std::string& str, uint64_t& number)
+{
+    if (str.empty() || str.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+
+    errno  = 0;
+    number = std::strtoull(str.c_str(), nullptr, 10);
+
+    return errno != ERANGE;
+}
+
+// Single "bytes=" ranges only, anything fancier gets the whole file.
+RangeResult ParseRange(const std::string& value, uint64_t length, uint64_t& first, uint64_t& last)
+{
+    if (value.compare(0, 6, "bytes=") || value.find(',') != std::string::npos)
+        return RangeResult::NONE;
+
+    auto spec = Trim(value.substr(6));
+    auto dash = spec.find('-');
+
+    if (dash == std::string::npos)
+        return RangeResult::NONE;
+
+    auto     from = spec.substr(0, dash), to = spec.substr(dash + 1);
+    uint64_t suffix, start, end;
+
+    if (from.empty()) { // The last "to" bytes.
+        if (!ParseNumber(to, suffix))
+            return RangeResult::NONE;
+
+        if (!suffix || !length)
+            return RangeResult::UNSATISFIABLE;
+
+        first = suffix >= length ? 0 : length - suffix;
+        last  = length - 1;
+        return RangeResult::OK;
+    }
+
+    // Numbers too big to parse are as good as malformed ones: the client gets the whole file.
+    if (!ParseNumber(from, start) || (!to.empty() && !ParseNumber(to, end)))
+        return RangeResult::NONE;
+
+    end = to.empty() ? length - 1 : std::min<uint64_t>(end, length - 1);
+
+    if (start >= length || end < start)
+        return RangeResult::UNSATISFIABLE;
+
+    first = start;
+    last  = end;
+    return RangeResult::OK;
+}
+
+bool SendAll(int fd, const char* data, size_t length)
+{
+    while (length) {
+        auto sent = send(fd, data, length, SEND_FLAGS);
+
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        data += sent;
+        length -= sent;
+    }
+
+    return true;
+}
+
+} // end of anonymous namespace
+
+CHMServer::CHMServer(const wxString& root, unsigned threads)
+    : _threads(threads ? threads : std::max(8U, 2 * std::thread::hardware_concurrency()))
+{
+    wxArrayString files;
+    wxString      base;
+
+    if (wxDir::Exists(root)) {
+        wxDir::GetAllFiles(root, &files);
+        base = root;
+    } else if (wxFileName::FileExists(root)) {
+        files.Add(root);
+        base = wxFileName(root).GetPath();
+    }
+
+    for (auto&& file : files) {
+        wxFileName fn(file);
+
+        // Not passing "*.chm" to GetAllFiles(), wildcards are case-sensitive on some platforms.
+        if (!fn.GetExt().IsSameAs(wxT("chm"), false))
+            continue;
+
+        fn.MakeRelativeTo(base);
+
+        auto archive  = std::make_unique<Archive>();
+        archive->path = file;
+
+        // The file's size and age identify this version of it.
+        struct stat st;
+        if (stat(file.fn_str(), &st) == 0) {
+            char etag[64];
+            std::snprintf(etag, sizeof(etag), "%llx-%llx", static_cast<unsigned long long>(st.st_size),
+                          static_cast<unsigned long long>(st.st_mtime));
+            archive->etag = etag;
+        }
+
+        _archives[std::string(fn.GetFullPath(wxPATH_UNIX).utf8_str())] = std::move(archive);
+    }
+}
+
+CHMServer::~CHMServer()
+{
+    Stop();
+}
+
+bool CHMServer::Start(unsigned short port)
+{
+    if (_archives.empty() || _listener != -1)
+        return false;
+
+    _listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (_listener < 0)
+        return false;
+
+    int one = 1;
+    setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+
+    if (bind(_listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(_listener, SOMAXCONN) < 0
+        || pipe(_wake) < 0) {
+        Stop();
+        return false;
+    }
+
+    fcntl(_listener, F_SETFL, fcntl(_listener, F_GETFL) | O_NONBLOCK);
+    fcntl(_wake[0], F_SETFL, fcntl(_wake[0], F_GETFL) | O_NONBLOCK);
+
+    _stop   = false;
+    _pool       = std::make_unique<CHMThreadPool>(_threads);
+    _searchPool = std::make_unique<CHMThreadPool>();
+    _poller     = std::thread(&CHMServer::Poll, this);
+
+    return true;
+}
+
+void CHMServer::Stop()
+{
+    _stop = true;
+
+    if (_poller.joinable()) {
+        char byte = 0;
+
+        if (write(_wake[1], &byte, 1) < 0) {
+            // The poller notices _stop within a second anyway.
+        }
+
+        _poller.join();
+    }
+
+    // Lets the requests being handled finish. Their connections come back closed.
+    _pool.reset();
+    _searchPool.reset();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _resumed.clear();
+    }
+
+    for (auto fd : {&_listener, &_wake[0], &_wake[1]})
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+}
+
+void CHMServer::Poll()
+{
+    std::vector<std::unique_ptr<Connection>> idle, stillIdle;
+    std::vector<pollfd>                      fds;
+
+    while (!_stop) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            for (auto&& connection : _resumed)
+                idle.push_back(std::move(connection));
+
+            _resumed.clear();
+        }
+
+        fds.clear();
+        fds.push_back({_listener, POLLIN, 0});
+        fds.push_back({_wake[0], POLLIN, 0});
+
+        for (auto&& connection : idle)
+            fds.push_back({connection->fd, POLLIN, 0});
+
+        auto polled = idle.size();
+
+        if (poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR)
+            break;
+
+        if (fds[1].revents) {
+            char buffer[64];
+
+            while (read(_wake[0], buffer, sizeof(buffer)) > 0)
+                ;
+        }
+
+        if (fds[0].revents & POLLIN)
+            for (int fd; (fd = accept(_listener, nullptr, nullptr)) >= 0;) {
+                timeval timeout {IO_TIMEOUT_S, 0};
+                int     one = 1;
+
+                // BSDs pass the listener's O_NONBLOCK on, the timeouts need blocking sockets.
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+                setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+                idle.push_back(std::make_unique<Connection>(fd, NowMs()));
+            }
+
+        auto now = NowMs();
+
+        stillIdle.clear();
+
+        for (size_t i = 0; i < idle.size(); ++i) {
+            if (i < polled && fds[i + 2].revents) {
+                _pool->Submit([this, connection = std::move(idle[i])]() mutable { Serve(std::move(connection)); });
+                continue;
+            }
+
+            // Timed out connections get closed as they go.
+            if (now - idle[i]->idleSince <= IDLE_TIMEOUT_MS)
+                stillIdle.push_back(std::move(idle[i]));
+        }
+
+        idle.swap(stillIdle);
+    }
+}
+
+void CHMServer::Serve(std::unique_ptr<Connection> connection)
+{
+    // Pipelined requests already read get answered right away.
+    do {
+        Request request;
+
+        if (_stop || !ReadRequest(*connection, request) || !Respond(*connection, request))
+            return;
+    } while (connection->buffer.find("\r\n\r\n") != std::string::npos);
+
+    connection->idleSince = NowMs();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_stop)
+        return;
+
+    _resumed.push_back(std::move(connection));
+
+    char byte = 0;
+    if (write(_wake[1], &byte, 1) < 0) {
+        // The poller picks it up within a second anyway.
+    }
+}
+
+bool CHMServer::ReadRequest(Connection& connection, Request& request)
+{
+    size_t end;
+
+    while ((end = connection.buffer.find("\r\n\r\n")) == std::string::npos) {
+        char buffer[4096];
+
+        if (connection.buffer.size() > MAX_HEAD_SIZE)
+            return false;
+
+        auto got = recv(connection.fd, buffer, sizeof(buffer), 0);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got <= 0)
+            return false;
+
+        connection.buffer.append(buffer, got);
+    }
+
+    request.head = connection.buffer.substr(0, end + 2);
+    connection.buffer.erase(0, end + 4);
+
+    auto lineEnd = request.head.find("\r\n");
+    auto line    = request.head.substr(0, lineEnd);
+    auto space1 = line.find(' '), space2 = line.rfind(' ');
+
+    if (space1 == std::string::npos || space1 == space2)
+        return false;
+
+    request.method = line.substr(0, space1);
+
+    auto target  = line.substr(space1 + 1, space2 - space1 - 1);
+    auto version = line.substr(space2 + 1);
+
+    // Absolute form, as sent to proxies.
+    if (!lowerCase(target.substr(0, 7)).compare("http://")) {
+        auto slash = target.find('/', 7);
+        target     = slash == std::string::npos ? "/" : target.substr(slash);
+    }
+
+    target = target.substr(0, target.find('#'));
+
+    auto question = target.find('?');
+
+    if (question != std::string::npos) {
+        request.query = target.substr(question + 1);
+        target.erase(question);
+    }
+
+    request.path = percentDecode(target);
+
+    if (request.path.empty() || request.path[0] != '/')
+        return false;
+
+    auto connectionHeader = lowerCase(HeaderValue(request.head, "connection"));
+
+    request.keepAlive = version == "HTTP/1.1" ? connectionHeader.find("close") == std::string::npos
+                                              : connectionHeader.find("keep-alive") != std::string::npos;
+
+    // Request bodies aren't read, so there's no telling where the next request starts.
+    auto contentLength = HeaderValue(request.head, "content-length");
+
+    if ((!contentLength.empty() && contentLength != "0") || !HeaderValue(request.head, "transfer-encoding").empty())
+        request.keepAlive = false;
+
+    return true;
+}
+
+bool CHMServer::Respond(Connection& connection, const Request& request)
+{
+    if (request.method != "GET" && request.method != "HEAD")
+        return SendResponse(connection, request, 405, "text/plain", "Method not allowed.\n",
+                            "Allow: GET, HEAD\r\n");
+
+    if (request.path == "/search")
+        return SendSearch(connection, request);
+
+    if (request.path == "/index")
+        return SendIndex(connection, request);
+
+    if (request.path == "/") {
+        std::string body = "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>xCHM</title></head><body>\n"
+                           "<h1>Books</h1>\n<ul>\n";
+
+        for (auto&& archive : _archives)
+            body += "<li><a href=\"/" + HtmlEscape(PercentEncode(archive.first)) + "/\">" + HtmlEscape(archive.first)
+                + "</a></li>\n";
+
+        body += "</ul>\n</body></html>\n";
+
+        return SendResponse(connection, request, 200, "text/html; charset=utf-8", body);
+    }
+
+    std::string rest;
+    auto        archive = FindArchive(request.path, rest);
+
+    if (!archive)
+        return SendResponse(connection, request, 404, "text/plain", "No such book.\n");
+
+    if (rest.empty())
+        return SendResponse(connection, request, 301, "text/plain", {},
+                            "Location: " + PercentEncode(request.path) + "/\r\n");
+
+    if (rest == "/") {
+        auto file = Open(*archive);
+
+        if (!file)
+            return SendResponse(connection, request, 404, "text/plain", "Can't open the book.\n");
+
+        auto home = std::string(file->HomePage().utf8_str());
+        auto name = request.path.substr(1, request.path.size() - 2);
+
+        return SendResponse(connection, request, 302, "text/plain", {}, "Location: " + BookUrl(name, home) + "\r\n");
+    }
+
+    return SendObject(connection, request, *archive, rest);
+}
+
+bool CHMServer::SendObject(Connection& connection, const Request& request, Archive& archive, const std::string& path)
+{
+    auto file = Open(archive);
+
+    if (!file)
+        return SendResponse(connection, request, 404, "text/plain", "Can't open the book.\n");
+
+    // Without the builtin CHMLIB, a handle is only good for one reader at a time.
+    std::unique_lock<std::mutex> lock(archive.mutex, std::defer_lock);
+
+    chmUnitInfo ui;
+
+    if (!CHM_CONCURRENT_READERS)
+        lock.lock();
+
+    auto found = file->ResolveObject(wxString::FromUTF8(path.c_str()), &ui);
+
+    if (lock.owns_lock())
+        lock.unlock();
+
+    if (!found)
+        return SendResponse(connection, request, 404, "text/plain", "No such page.\n");
+
+    char etag[128];
+    std::snprintf(etag, sizeof(etag), "\"%s-%llx-%d\"", archive.etag.c_str(),
+                  static_cast<unsigned long long>(ui.start), ui.space);
+
+    auto ifNoneMatch = HeaderValue(request.head, "if-none-match");
+
+    if (ifNoneMatch == "*" || ifNoneMatch.find(etag) != std::string::npos)
+        return SendResponse(connection, request, 304, {}, {}, std::string("ETag: ") + etag + "\r\n");
+
+    uint64_t length = ui.length, first = 0, last = length ? length - 1 : 0;
+    auto     status = 200;
+    auto     range  = HeaderValue(request.head, "range");
+    auto     ifRange = HeaderValue(request.head, "if-range");
+
+    if (!range.empty() && (ifRange.empty() || ifRange == etag)) {
+        switch (ParseRange(range, length, first, last)) {
+        case RangeResult::OK:
+            status = 206;
+            break;
+        case RangeResult::UNSATISFIABLE:
+            return SendResponse(connection, request, 416, "text/plain", {},
+                                "Content-Range: bytes */" + std::to_string(length) + "\r\n");
+        case RangeResult::NONE:
+            break;
+        }
+    }
+
+    auto bodyLength = length ? last - first + 1 : 0;
+    auto head       = std::string("HTTP/1.1 ") + std::to_string(status) + " " + StatusText(status) + "\r\n"
+        + "Content-Type: " + MimeType(path) + "\r\n" + "Content-Length: " + std::to_string(bodyLength) + "\r\n"
+        + "Accept-Ranges: bytes\r\n" + "ETag: " + etag + "\r\n"
+        + "Connection: " + (request.keepAlive ? "keep-alive" : "close") + "\r\n";
+
+    if (status == 206)
+        head += "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/"
+            + std::to_string(length) + "\r\n";
+
+    head += "\r\n";
+
+    if (!SendAll(connection.fd, head.data(), head.size()))
+        return false;
+
+    if (request.method == "HEAD" || !bodyLength)
+        return request.keepAlive;
+
+    std::vector<unsigned char> buffer(std::min<uint64_t>(SEND_BUF_SIZE, bodyLength));
+
+    for (auto offset = first; offset <= last;) {
+        auto want = std::min<uint64_t>(buffer.size(), last - offset + 1);
+
+        if (!CHM_CONCURRENT_READERS)
+            lock.lock();
+
+        auto got = file->RetrieveObject(&ui, buffer.data(), offset, want);
+
+        if (lock.owns_lock())
+            lock.unlock();
+
+        if (!got || !SendAll(connection.fd, reinterpret_cast<const char*>(buffer.data()), got))
+            return false;
+
+        offset += got;
+    }
+
+    return request.keepAlive;
+}
+
+bool CHMServer::SendSearch(Connection& connection, const Request& request)
+{
+    constexpr auto JSON = "application/json; charset=utf-8";
+
+    auto params = ParseQuery(request.query);
+    auto words  = CHMLibrary::QueryWords(wxString::FromUTF8(params["q"].c_str()));
+    auto book   = params["book"];
+
+    if (words.empty())
+        return SendResponse(connection, request, 400, JSON, JsonError("Nothing to search for."));
+
+    if (!book.empty() && _archives.find(book) == _archives.end())
+        return SendResponse(connection, request, 404, JSON, JsonError("No such book."));
+
+    auto hits   = Search(words, book, FlagParam(params, "whole"), FlagParam(params, "titles"));
+    auto offset = std::min(NumberParam(params, "offset", 0), hits->size());
+    auto limit  = std::min(NumberParam(params, "limit", DEFAULT_PAGE_SIZE), MAX_PAGE_SIZE);
+    auto end    = std::min(offset + limit, hits->size());
+
+    std::string body = "{\"query\":" + jsonString(params["q"]) + ",\"total\":" + std::to_string(hits->size())
+        + ",\"offset\":" + std::to_string(offset) + ",\"limit\":" + std::to_string(limit) + ",\"results\":[";
+
+    for (auto i = offset; i < end; ++i) {
+        auto& hit = (*hits)[i];
+
+        body += (i == offset ? "" : ",");
+        body += "{\"book\":" + jsonString(hit.book) + ",\"bookTitle\":" + jsonString(hit.bookTitle)
+            + ",\"title\":" + jsonString(hit.title) + ",\"url\":" + jsonString(hit.url) + "}";
+    }
+
+    body += "]}\n";
+
+    return SendResponse(connection, request, 200, JSON, body);
+}
+
+bool CHMServer::SendIndex(Connection& connection, const Request& request)
+{
+    constexpr auto JSON = "application/json; charset=utf-8";
+
+    auto params = ParseQuery(request.query);
+    auto it     = _archives.find(params["book"]);
+
+    if (it == _archives.end())
+        return SendResponse(connection, request, 404, JSON, JsonError("No such book."));
+
+    auto index = Index(*it->second);
+
+    if (!index || index->empty())
+        return SendResponse(connection, request, 404, JSON, JsonError("The book has no index."));
+
+    // Entries are sorted by key, so the ones starting with prefix are all next to each other.
+    auto prefix = std::string(wxString::FromUTF8(params["q"].c_str()).Lower().utf8_str());
+    auto first  = std::lower_bound(index->begin(), index->end(), prefix,
+                                  [](const IndexEntry& entry, const std::string& key) { return entry.key < key; });
+    auto last   = prefix.empty() ? index->end() : first;
+
+    while (last != index->end() && !last->key.compare(0, prefix.size(), prefix))
+        ++last;
+
+    size_t total  = last - first;
+    auto   offset = std::min(NumberParam(params, "offset", 0), total);
+    auto   limit  = std::min(NumberParam(params, "limit", DEFAULT_PAGE_SIZE), MAX_PAGE_SIZE);
+    auto   end    = std::min(offset + limit, total);
+
+    std::string body = "{\"book\":" + jsonString(it->first) + ",\"total\":" + std::to_string(total)
+        + ",\"offset\":" + std::to_string(offset) + ",\"limit\":" + std::to_string(limit) + ",\"entries\":[";
+
+    for (auto i = offset; i < end; ++i) {
+        auto& entry = first[i];
+
+        body += (i == offset ? "" : ",");
+        body += "{\"name\":" + jsonString(entry.name) + ",\"url\":" + jsonString(BookUrl(it->first, entry.url))
+            + "}";
+    }
+
+    body += "]}\n";
+
+    return SendResponse(connection, request, 200, JSON, body);
+}
+
+std::shared_ptr<const CHMServer::SearchHits> CHMServer::Search(const std::vector<wxString>& words,
+                                                               const std::string& book, bool wholeWords,
+                                                               bool titlesOnly)
+{
+    auto key = book + '\n' + (wholeWords ? '1' : '0') + (titlesOnly ? '1' : '0');
+
+    for (auto&& word : words)
+        key += '\n' + std::string(word.utf8_str());
+
+    {
+        std::lock_guard<std::mutex> lock(_searchMutex);
+
+        for (auto&& search : _searches)
+            if (search.key == key)
+                return search.hits;
+    }
+
+    // Every book on its own search pool thread. Not the request pool, whose threads could all end up waiting here.
+    std::vector<std::pair<std::string, std::future<CHMLibraryHits>>> pending;
+
+    for (auto&& archive : _archives) {
+        if (!book.empty() && archive.first != book)
+            continue;
+
+        auto& served  = *archive.second;
+        auto  threads = book.empty() ? 1U : 0U;
+
+        auto searchBook = [this, &served, &words, wholeWords, titlesOnly, threads] {
+            auto file = Open(served);
+
+            if (!file)
+                return CHMLibraryHits();
+
+            std::unique_lock<std::mutex> lock(served.mutex, std::defer_lock);
+
+            if (!CHM_CONCURRENT_READERS)
+                lock.lock();
+
+            return CHMLibrary::SearchFile(*file, words, wholeWords, titlesOnly, threads);
+        };
+
+        pending.emplace_back(archive.first, _searchPool->Submit(searchBook));
+    }
+
+    CHMLibraryHits hits;
+
+    for (auto&& result : pending)
+        for (auto&& hit : result.second.get()) {
+            hit.archive = wxString::FromUTF8(result.first.c_str());
+            hits.push_back(std::move(hit));
+        }
+
+    CHMLibrary::Rank(hits);
+
+    auto found = std::make_shared<SearchHits>();
+    found->reserve(hits.size());
+
+    for (auto&& hit : hits) {
+        std::string name(hit.archive.utf8_str());
+
+        found->push_back({name, std::string(hit.book.utf8_str()), std::string(hit.title.utf8_str()),
+                          BookUrl(name, std::string(hit.url.utf8_str()))});
+    }
+
+    std::lock_guard<std::mutex> lock(_searchMutex);
+
+    if (_searches.size() >= SEARCH_CACHE_SIZE)
+        _searches.pop_back();
+
+    _searches.push_front({key, found});
+
+    return found;
+}
+
+std::shared_ptr<const CHMServer::IndexEntries> CHMServer::Index(Archive& archive)
+{
+    // Not archive.mutex, pages of this book can be served while its index is being read.
+    std::lock_guard<std::mutex> indexLock(archive.indexMutex);
+
+    if (archive.index)
+        return archive.index;
+
+    auto file = Open(archive);
+
+    if (!file)
+        return nullptr;
+
+    auto entries = std::make_shared<IndexEntries>();
+
+    {
+        std::unique_lock<std::mutex> lock(archive.mutex, std::defer_lock);
+
+        if (!CHM_CONCURRENT_READERS)
+            lock.lock();
+
+        // Books without an index end up with an empty one, so they aren't looked at again.
+        file->GetIndex([&entries](const wxString& name, const wxString& url) {
+            auto path = url.StartsWith(wxT("/")) ? url : wxT("/") + url;
+            entries->push_back({std::string(name.Lower().utf8_str()), std::string(name.utf8_str()),
+                                std::string(path.utf8_str())});
+        });
+    }
+
+    std::stable_sort(entries->begin(), entries->end(),
+                     [](const IndexEntry& a, const IndexEntry& b) { return a.key < b.key; });
+
+    archive.index = entries;
+
+    return archive.index;
+}
+
+CHMServer::Archive* CHMServer::FindArchive(const std::string& path, std::string& rest)
+{
+    // Archives in subdirectories have slashes in their names too: the longest name that fits wins.
+    for (auto slash = path.size(); slash > 1; slash = path.rfind('/', slash - 1)) {
+        auto it = _archives.find(path.substr(1, slash - 1));
+
+        if (it != _archives.end()) {
+            rest = path.substr(slash);
+            return it->second.get();
+        }
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<CHMFile> CHMServer::Open(Archive& archive)
+{
+    std::lock_guard<std::mutex> lock(archive.mutex);
+
+    if (!archive.file && !archive.failed) {
+        auto file = std::make_shared<CHMFile>(archive.path);
+
+        if (file->IsOk())
+            archive.file = file;
+        else
+            archive.failed = true;
+    }
+
+    return archive.file;
+}
+
+bool CHMServer::SendResponse(Connection& connection, const Request& request, int status,
+                             const std::string& contentType, const std::string& body, const std::string& extraHeaders)
+{
+    auto response = std::string("HTTP/1.1 ") + std::to_string(status) + " " + StatusText(status) + "\r\n";
+
+    if (!contentType.empty())
+        response += "Content-Type: " + contentType + "\r\n";
+
+    if (status != 304)
+        response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+
+    response += extraHeaders + "Connection: " + (request.keepAlive ? "keep-alive" : "close") + "\r\n\r\n";
+
+    if (request.method != "HEAD")
+        response += body;
+
+    return SendAll(connection.fd, response.data(), response.size()) && request.keepAlive;
+}
+
+CHMServer::Connection::~Connection()
+{
+    close(fd);
+}
@@ -0,0 +1,202 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMSERVER_H_
+#define __CHMSERVER_H_
+
+#include <atomic>
+#include <chmfile.h>
+#include <chmlibrary.h>
+#include <chmthreadpool.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <wx/string.h>
+
+/*!
+  \brief Serves the contents of .chm archives over HTTP (xchm --serve), GET /<archive>/<path> mapping to the file at
+  <path> inside <archive>. POSIX only.
+
+  A single thread polls the listening socket and the idle keep-alive connections. Connections with a request
+  waiting are handed to a thread pool, one request at a time, and go back to the poller when done. Every archive is
+  opened once, on its first request, and (with the builtin CHMLIB) read by all the pool threads at the same time.
+
+  Two JSON endpoints make the books searchable without scraping them:
+
+  - GET /search?q=<words>[&book=<name>][&whole=1][&titles=1][&offset=<n>][&limit=<n>] searches one book (or all of
+    them at once), returning ranked page hits. Recent searches are kept, so paging through results is cheap.
+  - GET /index?book=<name>[&q=<prefix>][&offset=<n>][&limit=<n>] returns the book's index (keyword / URL pairs),
+    optionally only the keywords starting with prefix. Read once per book, then served from memory.
+ */
+class CHMServer {
+public:
+    /*!
+      \brief Sets up the server, without listening yet.
+      \param root A .chm file, or a directory whose .chm files (subdirectories included) will be served.
+      \param threads How many requests can be handled at once. 0 picks a default based on the number of cores.
+     */
+    explicit CHMServer(const wxString& root, unsigned threads = 0);
+
+    //! Stops the server.
+    ~CHMServer();
+
+    /*!
+      \brief Starts listening and serving.
+      \param port The TCP port to listen on, on all interfaces.
+      \return false if there's nothing to serve or the port can't be listened on.
+     */
+    bool Start(unsigned short port);
+
+    //! Stops listening, closes all the connections and waits for the requests being handled.
+    void Stop();
+
+    //! How many archives are being served.
+    size_t ArchiveCount() const { return _archives.size(); }
+
+public:
+    //! No copy construction allowed.
+    CHMServer(const CHMServer&) = delete;
+
+    //! No assignments.
+    CHMServer& operator=(const CHMServer&) = delete;
+
+private:
+    //! An index entry, all strings UTF-8.
+    struct IndexEntry {
+        std::string key; // Lowercase name, what entries are sorted by.
+        std::string name;
+        std::string url;
+    };
+
+    using IndexEntries = std::vector<IndexEntry>;
+
+    //! A search hit, all strings UTF-8.
+    struct SearchHit {
+        std::string book;
+        std::string bookTitle;
+        std::string title;
+        std::string url;
+    };
+
+    using SearchHits = std::vector<SearchHit>;
+
+    //! A served .chm file, opened on its first request.
+    struct Archive {
+        wxString                            path;
+        std::string                         etag;
+        std::mutex                          mutex;
+        std::shared_ptr<CHMFile>            file;
+        bool                                failed {false};
+        std::mutex                          indexMutex;
+        std::shared_ptr<const IndexEntries> index;
+    };
+
+    //! A recent search.
+    struct CachedSearch {
+        std::string                       key;
+        std::shared_ptr<const SearchHits> hits;
+    };
+
+    //! A client connection, along with whatever it has sent that hasn't been handled yet.
+    struct Connection {
+        //! Takes over the socket fd.
+        Connection(int fd, int64_t idleSince) : fd(fd), idleSince(idleSince) {}
+
+        //! Closes the socket, whichever way the connection goes away (an exception included).
+        ~Connection();
+
+        //! No copy construction allowed.
+        Connection(const Connection&) = delete;
+
+        //! No assignments.
+        Connection& operator=(const Connection&) = delete;
+
+        int         fd;
+        std::string buffer;
+        int64_t     idleSince;
+    };
+
+    //! A parsed request.
+    struct Request {
+        std::string method;
+        std::string path;
+        std::string query;
+        std::string head;
+        bool        keepAlive {false};
+    };
+
+private:
+    //! Poller thread entry point.
+    void Poll();
+
+    //! Handles the next request on connection (on a pool thread), then gives it back to the poller.
+    void Serve(std::unique_ptr<Connection> connection);
+
+    //! Helper. Reads a whole request head. Returns false if the connection should be closed.
+    bool ReadRequest(Connection& connection, Request& request);
+
+    //! Helper. Answers a request. Returns false if the connection should be closed.
+    bool Respond(Connection& connection, const Request& request);
+
+    //! Helper. Sends the file at path inside archive, honouring Range and If-None-Match.
+    bool SendObject(Connection& connection, const Request& request, Archive& archive, const std::string& path);
+
+    //! Helper. Answers /search.
+    bool SendSearch(Connection& connection, const Request& request);
+
+    //! Helper. Answers /index.
+    bool SendIndex(Connection& connection, const Request& request);
+
+    //! Helper. Searches book (or all the books, if empty), unless the same search has been done recently.
+    std::shared_ptr<const SearchHits> Search(const std::vector<wxString>& words, const std::string& book,
+                                             bool wholeWords, bool titlesOnly);
+
+    //! Helper. Reads the index of archive, if it hasn't been read yet.
+    std::shared_ptr<const IndexEntries> Index(Archive& archive);
+
+    //! Helper. Finds the archive path starts with, setting rest to the path inside it.
+    Archive* FindArchive(const std::string& path, std::string& rest);
+
+    //! Helper. Opens archive, if it hasn't been opened yet.
+    std::shared_ptr<CHMFile> Open(Archive& archive);
+
+    //! Helper. Sends a complete, small response.
+    bool SendResponse(Connection& connection, const Request& request, int status, const std::string& contentType,
+                      const std::string& body, const std::string& extraHeaders = {});
+
+private:
+    std::map<std::string, std::unique_ptr<Archive>> _archives;
+    unsigned                                        _threads;
+    int                                             _listener {-1};
+    int                                             _wake[2] {-1, -1};
+    std::atomic<bool>                               _stop {false};
+    std::mutex                                      _mutex;
+    std::vector<std::unique_ptr<Connection>>        _resumed;
+    std::thread                                     _poller;
+    std::unique_ptr<CHMThreadPool>                  _pool;
+    std::unique_ptr<CHMThreadPool>                  _searchPool;
+    std::mutex                                      _searchMutex;
+    std::deque<CachedSearch>                        _searches;
+};
+
+#endif // __CHMSERVER_H_
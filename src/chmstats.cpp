@@ -0,0 +1,124 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <atomic>
+#include <chmfile.h>
+#include <chmstats.h>
+#include <wx/intl.h>
+
+namespace {
+
+// How many stripes threads spread over.
+constexpr unsigned STRIPES {16};
+
+// Each on a cache line (or more) of its own, so that threads don't fight over them.
+struct alignas(64) Stripe {
+    std::atomic<uint64_t> counters[CHMStats::COUNTERS];
+};
+
+Stripe                stripes[STRIPES];
+std::atomic<unsigned> nextStripe {0};
+
+// The calling thread's stripe, handed out round robin.
+Stripe& ThreadStripe()
+{
+    thread_local Stripe& stripe = stripes[nextStripe.fetch_add(1, std::memory_order_relaxed) % STRIPES];
+    return stripe;
+}
+
+wxString Count(uint64_t value)
+{
+    return wxString::Format(wxT("%llu"), static_cast<unsigned long long>(value));
+}
+
+wxString Millis(uint64_t micros)
+{
+    return wxString::Format(_("%.1f ms"), micros / 1000.0);
+}
+
+wxString Bytes(uint64_t bytes)
+{
+    return wxString::Format(_("%.1f MiB"), bytes / (1024.0 * 1024.0));
+}
+
+} // end of anonymous namespace
+
+void CHMStats::Add(Counter counter, uint64_t value)
+{
+    ThreadStripe().counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t CHMStats::Get(Counter counter)
+{
+    uint64_t total {0};
+
+    for (auto&& stripe : stripes)
+        total += stripe.counters[counter].load(std::memory_order_relaxed);
+
+    return total;
+}
+
+std::vector<std::pair<wxString, wxString>> CHMStats::Snapshot()
+{
+    std::vector<std::pair<wxString, wxString>> rows {{_("Contents trees loaded"), Count(Get(TOC_LOADS))},
+                                                     {_("Time loading contents trees"), Millis(Get(TOC_LOAD_US))},
+                                                     {_("Indexes loaded"), Count(Get(INDEX_LOADS))},
+                                                     {_("Time loading indexes"), Millis(Get(INDEX_LOAD_US))},
+                                                     {_("Full-text lookups"), Count(Get(SEARCHES))},
+                                                     {_("Time searching"), Millis(Get(SEARCH_US))}};
+
+#ifdef ENABLE_BUILTIN_CHMLIB
+    LONGUINT64 lib[CHM_STAT_COUNT];
+    chm_get_stats(lib);
+
+    auto lookups = lib[CHM_STAT_CACHE_HITS] + lib[CHM_STAT_CACHE_MISSES];
+
+    rows.insert(rows.end(),
+                {{_("Files looked up"), Count(lib[CHM_STAT_RESOLVES])},
+                 {_("Directory pages read"), Count(lib[CHM_STAT_DIR_PAGES])},
+                 {_("Block cache hits"), Count(lib[CHM_STAT_CACHE_HITS])},
+                 {_("Block cache misses"), Count(lib[CHM_STAT_CACHE_MISSES])},
+                 {_("Block cache hit ratio"),
+                  wxString::Format(wxT("%.1f%%"), lookups ? 100.0 * lib[CHM_STAT_CACHE_HITS] / lookups : 0.0)},
+                 {_("Blocks decompressed"), Count(lib[CHM_STAT_BLOCKS_DECOMPRESSED])},
+                 {_("Decompressed"), Bytes(lib[CHM_STAT_BYTES_INFLATED])},
+                 {_("I/O system calls"), Count(lib[CHM_STAT_SYSCALLS])},
+                 {_("Read from disk"), Bytes(lib[CHM_STAT_BYTES_READ])}});
+#endif
+
+    return rows;
+}
+
+wxString CHMStats::Report()
+{
+    wxString report;
+
+    for (auto&& row : Snapshot())
+        report += row.first + wxT(": ") + row.second + wxT("\n");
+
+    return report;
+}
+
+CHMStats::Timer::~Timer()
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - _start).count();
+
+    Add(_calls);
+    Add(_micros, elapsed);
+}
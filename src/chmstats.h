@@ -0,0 +1,78 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMSTATS_H_
+#define __CHMSTATS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <wx/string.h>
+
+/*!
+  \brief Process-wide performance counters: how many contents trees and indexes have been loaded and searches run, and
+  how long they took, along with CHMLIB's own counters when using the builtin CHMLIB.
+
+  Cheap enough to always keep: every thread adds to a stripe of counters of its own, with relaxed atomics, and the
+  stripes are only summed up when the counters are read.
+ */
+class CHMStats {
+public:
+    //! What's being counted.
+    enum Counter { TOC_LOADS, TOC_LOAD_US, INDEX_LOADS, INDEX_LOAD_US, SEARCHES, SEARCH_US, COUNTERS };
+
+    //! Adds value to counter.
+    static void Add(Counter counter, uint64_t value = 1);
+
+    //! The current value of counter, summed up over all the threads.
+    static uint64_t Get(Counter counter);
+
+    //! All the counters, as (description, value) pairs ready to be displayed.
+    static std::vector<std::pair<wxString, wxString>> Snapshot();
+
+    //! Snapshot(), as one counter per line.
+    static wxString Report();
+
+    //! Counts the scope it lives in in one counter, and the time spent in it (in microseconds) in another.
+    class Timer {
+    public:
+        //! Starts timing.
+        Timer(Counter calls, Counter micros) : _calls(calls), _micros(micros), _start(Clock::now()) {}
+
+        //! Stops timing, and adds to the counters.
+        ~Timer();
+
+    public:
+        //! No copy construction allowed.
+        Timer(const Timer&) = delete;
+
+        //! No assignments.
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        Counter           _calls;
+        Counter           _micros;
+        Clock::time_point _start;
+    };
+};
+
+#endif // __CHMSTATS_H_
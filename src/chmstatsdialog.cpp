@@ -0,0 +1,87 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <chmstats.h>
+#include <chmstatsdialog.h>
+#include <wx/button.h>
+#include <wx/listctrl.h>
+#include <wx/sizer.h>
+#include <wx/wx.h>
+
+namespace {
+
+constexpr int REFRESH_MS {1000};
+
+} // end of anonymous namespace
+
+CHMStatsDialog::CHMStatsDialog(wxWindow* parent)
+    : wxDialog(parent, wxID_ANY, _("Statistics"), wxDefaultPosition, wxDefaultSize,
+               wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER),
+      _timer(this)
+{
+    _list = new wxListCtrl(this, wxID_ANY, wxDefaultPosition, wxSize(400, 320), wxLC_REPORT | wxLC_SINGLE_SEL);
+    _list->InsertColumn(0, _("Counter"));
+    _list->InsertColumn(1, _("Value"), wxLIST_FORMAT_RIGHT);
+
+    auto szButtons = new wxBoxSizer(wxHORIZONTAL);
+
+    szButtons->Add(new wxButton(this, wxID_REFRESH, _("Refresh")), 0, wxRIGHT, 5);
+    szButtons->Add(new wxButton(this, wxID_OK, _("Close")), 0);
+
+    auto topsizer = new wxBoxSizer(wxVERTICAL);
+
+    topsizer->Add(_list, 1, wxEXPAND | wxALL, 5);
+    topsizer->Add(szButtons, 0, wxALIGN_RIGHT | wxLEFT | wxRIGHT | wxBOTTOM, 5);
+
+    SetAutoLayout(true);
+    SetSizer(topsizer);
+    topsizer->Fit(this);
+    Centre(wxBOTH);
+
+    UpdateCounters();
+
+    _list->SetColumnWidth(0, 260);
+    _list->SetColumnWidth(1, wxLIST_AUTOSIZE_USEHEADER);
+
+    Bind(wxEVT_BUTTON, &CHMStatsDialog::OnRefresh, this, wxID_REFRESH);
+    Bind(wxEVT_TIMER, &CHMStatsDialog::OnRefresh, this);
+
+    _timer.Start(REFRESH_MS);
+}
+
+void CHMStatsDialog::OnRefresh(wxEvent&)
+{
+    UpdateCounters();
+}
+
+void CHMStatsDialog::UpdateCounters()
+{
+    auto rows = CHMStats::Snapshot();
+
+    // Same rows every time, only the values change.
+    if (static_cast<size_t>(_list->GetItemCount()) != rows.size()) {
+        _list->DeleteAllItems();
+
+        for (size_t i = 0; i < rows.size(); ++i)
+            _list->InsertItem(i, rows[i].first);
+    }
+
+    for (size_t i = 0; i < rows.size(); ++i)
+        _list->SetItem(i, 1, rows[i].second);
+}
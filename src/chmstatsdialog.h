@@ -0,0 +1,48 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMSTATSDIALOG_H
+#define __CHMSTATSDIALOG_H
+
+#include <wx/dialog.h>
+#include <wx/timer.h>
+
+// Forward declarations.
+class wxListCtrl;
+
+//! Dialog showing CHMStats' counters, updated every second for as long as it's open.
+class CHMStatsDialog : public wxDialog {
+public:
+    //! Initializes the dialog.
+    explicit CHMStatsDialog(wxWindow* parent);
+
+protected:
+    //! Called every second, and when the user clicks 'Refresh'.
+    void OnRefresh(wxEvent& event);
+
+private:
+    //! Helper. Fills the list with the current counters.
+    void UpdateCounters();
+
+private:
+    wxListCtrl* _list;
+    wxTimer     _timer;
+};
+
+#endif // __CHMSTATSDIALOG_H
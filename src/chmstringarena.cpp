@@ -0,0 +1,72 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <chmstringarena.h>
+#include <cstring>
+
+namespace {
+
+// Strings are carved out of chunks this big. Longer strings get a chunk of their own.
+constexpr size_t CHUNK_SIZE {64 * 1024};
+
+} // end of anonymous namespace
+
+CHMStringRef CHMStringArena::Add(const wxString& str)
+{
+    auto   utf8   = str.utf8_str();
+    size_t length = utf8.length();
+
+    if (!length)
+        return {};
+
+    char* dest;
+
+    if (length > CHUNK_SIZE / 4) {
+        // Slip it in before the current chunk, so that one keeps filling up.
+        auto chunk = std::make_unique<char[]>(length);
+        dest       = chunk.get();
+        _chunks.insert(_chunks.empty() ? _chunks.end() : _chunks.end() - 1, std::move(chunk));
+
+    } else {
+        if (_capacity - _used < length) {
+            _chunks.push_back(std::make_unique<char[]>(CHUNK_SIZE));
+            _used     = 0;
+            _capacity = CHUNK_SIZE;
+        }
+
+        dest = _chunks.back().get() + _used;
+        _used += length;
+    }
+
+    std::memcpy(dest, utf8.data(), length);
+    _bytes += length;
+
+    return {dest, static_cast<uint32_t>(length)};
+}
+
+wxString CHMStringArena::Get(const CHMStringRef& ref)
+{
+    return ref.length ? wxString::FromUTF8(ref.data, ref.length) : wxString();
+}
+
+void CHMStringArena::Clear()
+{
+    _chunks.clear();
+    _used = _capacity = _bytes = 0;
+}
@@ -0,0 +1,73 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMSTRINGARENA_H_
+#define __CHMSTRINGARENA_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <wx/string.h>
+
+//! Where a string kept by a CHMStringArena lives, and how long (in UTF-8 bytes) it is.
+struct CHMStringRef {
+    const char* data {nullptr};
+    uint32_t    length {0};
+};
+
+/*!
+  \brief Append-only storage for the many small strings of a contents tree or index list (mostly URLs), kept as UTF-8
+  in big chunks and all freed at once. A CHMStringRef costs far less than a wxString with its own allocation.
+ */
+class CHMStringArena {
+public:
+    //! Creates an empty arena.
+    CHMStringArena() = default;
+
+    /*!
+      \brief Copies a string into the arena.
+      \param str The string.
+      \return A reference that stays valid until Clear() is called or the arena goes away.
+     */
+    CHMStringRef Add(const wxString& str);
+
+    //! Returns the string ref points to.
+    static wxString Get(const CHMStringRef& ref);
+
+    //! Forgets all the strings, invalidating the references handed out so far.
+    void Clear();
+
+    //! Bytes taken by the strings.
+    size_t Size() const { return _bytes; }
+
+public:
+    //! No copy construction allowed.
+    CHMStringArena(const CHMStringArena&) = delete;
+
+    //! No assignments.
+    CHMStringArena& operator=(const CHMStringArena&) = delete;
+
+private:
+    std::vector<std::unique_ptr<char[]>> _chunks;
+    size_t                               _used {0};
+    size_t                               _capacity {0};
+    size_t                               _bytes {0};
+};
+
+#endif // __CHMSTRINGARENA_H_
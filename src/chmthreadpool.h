@@ -0,0 +1,89 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMTHREADPOOL_H_
+#define __CHMTHREADPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//! Fixed-size pool of worker threads running queued tasks in FIFO order.
+class CHMThreadPool {
+public:
+    /*!
+      \brief Starts the worker threads.
+      \param threads How many. 0 means one per core.
+     */
+    explicit CHMThreadPool(unsigned threads = 0);
+
+    //! Runs the tasks still queued, then joins the worker threads.
+    ~CHMThreadPool();
+
+    /*!
+      \brief Queues a task.
+      \param task Any callable taking no arguments.
+      \return A future for the task's result.
+     */
+    template <typename F>
+    auto Submit(F&& task) -> std::future<std::invoke_result_t<F>>
+    {
+        using Result = std::invoke_result_t<F>;
+
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        auto future   = packaged->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.emplace_back([packaged] { (*packaged)(); });
+        }
+
+        _cv.notify_one();
+        return future;
+    }
+
+    //! How many worker threads there are.
+    size_t Size() const { return _threads.size(); }
+
+public:
+    //! No copy construction allowed.
+    CHMThreadPool(const CHMThreadPool&) = delete;
+
+    //! No assignments.
+    CHMThreadPool& operator=(const CHMThreadPool&) = delete;
+
+private:
+    //! Worker thread entry point.
+    void Run();
+
+private:
+    std::mutex                        _mutex;
+    std::condition_variable           _cv;
+    std::deque<std::function<void()>> _tasks;
+    bool                              _stop {false};
+    std::vector<std::thread>          _threads;
+};
+
+#endif // __CHMTHREADPOOL_H_
@@ -0,0 +1,171 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#include <atomic>
+#include <chmtrace.h>
+#include <string>
+#include <stringutils.h>
+#include <wx/ffile.h>
+#include <wx/utils.h>
+
+#ifdef ENABLE_BUILTIN_CHMLIB
+#include <xchm_chm_lib.h>
+#endif
+
+namespace {
+
+// Spans kept, about 2.5 MB worth.
+constexpr uint64_t CAPACITY {1 << 16};
+
+// How deep CHMLIB spans nest on one thread.
+constexpr int MAX_LIB_DEPTH {8};
+
+// A slot of the ring buffer. seq is 0 while a writer fills it in, and the span's sequence number + 1 once it's done,
+// so Write() can tell complete spans from ones that are being overwritten.
+struct Event {
+    std::atomic<uint64_t>    seq {0};
+    std::atomic<const char*> name {nullptr};
+    std::atomic<uint64_t>    start {0};
+    std::atomic<uint64_t>    duration {0};
+    std::atomic<uint32_t>    tid {0};
+};
+
+Event                 ring[CAPACITY];
+std::atomic<uint64_t> head {0};
+std::atomic<bool>     enabled {false};
+std::atomic<uint32_t> nextTid {1};
+wxString              traceFile;
+const auto            epoch = std::chrono::steady_clock::now();
+
+uint64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// Small, stable thread IDs make for a more readable timeline than the system's.
+uint32_t ThreadId()
+{
+    thread_local uint32_t tid = nextTid.fetch_add(1, std::memory_order_relaxed);
+    return tid;
+}
+
+void Record(const char* name, uint64_t start, uint64_t end)
+{
+    auto  seq   = head.fetch_add(1, std::memory_order_relaxed);
+    auto& event = ring[seq % CAPACITY];
+
+    event.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.duration.store(end - start, std::memory_order_relaxed);
+    event.tid.store(ThreadId(), std::memory_order_relaxed);
+
+    event.seq.store(seq + 1, std::memory_order_release);
+}
+
+#ifdef ENABLE_BUILTIN_CHMLIB
+void LibHook(const char* name, int begin)
+{
+    thread_local uint64_t starts[MAX_LIB_DEPTH];
+    thread_local int      depth {0};
+
+    if (begin) {
+        if (depth < MAX_LIB_DEPTH)
+            starts[depth] = Now();
+        ++depth;
+
+    } else if (depth > 0 && --depth < MAX_LIB_DEPTH && enabled.load(std::memory_order_relaxed))
+        Record(name, starts[depth], Now());
+}
+#endif
+
+} // end of anonymous namespace
+
+void CHMTrace::Enable(const wxString& file)
+{
+    traceFile = file;
+
+    // The thread turning tracing on (the main thread) is thread 1.
+    ThreadId();
+
+#ifdef ENABLE_BUILTIN_CHMLIB
+    chm_set_trace_hook(LibHook);
+#endif
+
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+bool CHMTrace::Enabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+bool CHMTrace::Write()
+{
+    enabled.store(false, std::memory_order_relaxed);
+
+    auto        end   = head.load(std::memory_order_acquire);
+    auto        begin = end > CAPACITY ? end - CAPACITY : 0;
+    auto        pid   = wxGetProcessId();
+    std::string json  = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + std::to_string(pid)
+        + ",\"tid\":1,\"args\":{\"name\":\"main\"}}";
+
+    for (auto seq = begin; seq < end; ++seq) {
+        auto& event = ring[seq % CAPACITY];
+
+        if (event.seq.load(std::memory_order_acquire) != seq + 1)
+            continue;
+
+        auto name     = event.name.load(std::memory_order_relaxed);
+        auto start    = event.start.load(std::memory_order_relaxed);
+        auto duration = event.duration.load(std::memory_order_relaxed);
+        auto tid      = event.tid.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // Overwritten while we were reading it.
+        if (event.seq.load(std::memory_order_relaxed) != seq + 1)
+            continue;
+
+        json += ",\n{\"name\":" + jsonString(name) + ",\"cat\":\"xchm\",\"ph\":\"X\",\"ts\":" + std::to_string(start)
+            + ",\"dur\":" + std::to_string(duration) + ",\"pid\":" + std::to_string(pid)
+            + ",\"tid\":" + std::to_string(tid) + "}";
+    }
+
+    json += "\n]}\n";
+
+    wxFFile file(traceFile, "w");
+
+    return file.IsOpened() && file.Write(json.data(), json.size()) == json.size() && file.Close();
+}
+
+CHMTrace::Scope::Scope(const char* name)
+    : _name(enabled.load(std::memory_order_relaxed) ? name : nullptr), _start(_name ? Now() : 0)
+{
+}
+
+CHMTrace::Scope::~Scope()
+{
+    if (_name && enabled.load(std::memory_order_relaxed))
+        Record(_name, _start, Now());
+}
@@ -0,0 +1,68 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __CHMTRACE_H_
+#define __CHMTRACE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <wx/string.h>
+
+/*!
+  \brief Opt-in event tracing. Records timed spans (what, when, how long and on which thread) into a fixed size,
+  lock-free ring buffer, and writes them out as Chrome trace event JSON, for chrome://tracing or
+  https://ui.perfetto.dev.
+
+  Until Enable() is called a Scope costs a relaxed atomic load. Once the ring buffer is full, the oldest spans make
+  room for the newest ones.
+ */
+class CHMTrace {
+public:
+    //! Starts recording, to be written to file. Also traces the builtin CHMLIB, when there is one.
+    static void Enable(const wxString& file);
+
+    //! Are we recording?
+    static bool Enabled();
+
+    //! Stops recording and writes the spans recorded so far to the file passed to Enable().
+    static bool Write();
+
+    //! Records the span it's been alive for, if recording.
+    class Scope {
+    public:
+        //! Starts the span. name must outlive the trace, so it's best a string literal.
+        explicit Scope(const char* name);
+
+        //! Ends the span.
+        ~Scope();
+
+    public:
+        //! No copy construction allowed.
+        Scope(const Scope&) = delete;
+
+        //! No assignments.
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* _name;
+        uint64_t    _start;
+    };
+};
+
+#endif // __CHMTRACE_H_
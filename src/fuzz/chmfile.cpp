@@ -0,0 +1,101 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+/*
+  Fuzzes CHMFile with the input as an archive: #SYSTEM and #WINDOWS, the contents and index (binary or sitemap),
+  context IDs and, with words taken from the index, the $FIftiMain full-text index. Archives without one are not
+  searched, that would build (and cache) our own index. Built by "make fuzz".
+ */
+
+#include <chmfile.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fuzz/fuzzfile.h>
+#include <wx/init.h>
+
+namespace {
+
+// Index entries whose words get searched for.
+constexpr size_t MAX_QUERIES {4};
+constexpr size_t MAX_PREFIX_WORDS {16};
+
+} // end of anonymous namespace
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    static wxInitializer initializer(*argc, *argv);
+
+    if (!initializer.IsOk()) {
+        std::fprintf(stderr, "can't initialize wxWidgets\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    auto path = fuzzFile(data, size);
+
+    if (path.empty())
+        return 0;
+
+    CHMFile chmFile(wxString::FromUTF8(path.c_str()));
+
+    if (!chmFile.IsOk())
+        return 0;
+
+    CHMIndexCallback ignore = [](const wxString&, const wxString&) {};
+    chmFile.GetTopics(ignore);
+
+    wxArrayString    queries;
+    CHMIndexCallback addQuery = [&queries](const wxString& name, const wxString&) {
+        if (queries.GetCount() < MAX_QUERIES)
+            queries.Add(name.BeforeFirst(wxT(' ')).Lower());
+    };
+    chmFile.GetIndex(addQuery);
+
+    if (chmFile.LoadContextIDs())
+        for (auto cid : {0, 1, 0x1000})
+            if (chmFile.IsValidCID(cid))
+                chmFile.GetPageByCID(cid);
+
+    if (!chmFile.HasFIftiMain())
+        return 0;
+
+    for (size_t i = 0; i < queries.GetCount(); ++i) {
+        if (queries[i].IsEmpty())
+            continue;
+
+        CHMSearchResults results;
+        chmFile.IndexSearch(queries[i], i % 2 == 0, i % 3 == 0, results);
+
+        auto          prefix    = queries[i].Left(2);
+        auto          leaf      = chmFile.IndexLeafOffset(prefix);
+        auto          truncated = false;
+        CHMIndexWords words;
+
+        if (leaf && chmFile.IndexPrefixWords(prefix, leaf, MAX_PREFIX_WORDS, words, truncated))
+            for (auto&& word : words)
+                chmFile.IndexWordResults(word, results);
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+/*
+  Fuzzes chmlib: opens the input as an archive, then resolves and reads everything in it, both with copies and with
+  spans, in random and sequential access mode. Built by "make fuzz".
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <fuzz/fuzzfile.h>
+#include <vector>
+#include <xchm_chm_lib.h>
+
+namespace {
+
+// Enough to get through a few LZX blocks, not so much that big objects slow everything down.
+constexpr LONGINT64 MAX_READ {0x20000};
+
+int ReadObject(struct chmFile* h, struct chmUnitInfo* ui, void*)
+{
+    struct chmUnitInfo resolved;
+
+    if (chm_resolve_object(h, ui->path, &resolved) != CHM_RESOLVE_SUCCESS)
+        return CHM_ENUMERATOR_CONTINUE;
+
+    auto len = resolved.length < static_cast<LONGUINT64>(MAX_READ) ? static_cast<LONGINT64>(resolved.length) : MAX_READ;
+    std::vector<unsigned char> buffer(static_cast<size_t>(len) + 1);
+
+    chm_retrieve_object(h, &resolved, buffer.data(), 0, len);
+
+    // The last bytes again, from a cache that now holds their block.
+    if (len > 1)
+        chm_retrieve_object(h, &resolved, buffer.data(), len / 2, len - len / 2);
+
+    for (LONGINT64 addr = 0; addr < len;) {
+        struct chmSpan span;
+        auto           got = chm_retrieve_span(h, &resolved, addr, len - addr, &span);
+
+        if (got <= 0)
+            break;
+
+        addr += got;
+        chm_release_span(h, &span);
+    }
+
+    return CHM_ENUMERATOR_CONTINUE;
+}
+
+} // end of anonymous namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    auto path = fuzzFile(data, size);
+
+    if (path.empty())
+        return 0;
+
+    auto h = chm_open(path.c_str());
+
+    if (!h)
+        return 0;
+
+    chm_enumerate(h, CHM_ENUMERATE_ALL, ReadObject, nullptr);
+
+    chm_set_param(h, CHM_PARAM_ACCESS_PATTERN, CHM_ACCESS_SEQUENTIAL);
+    chm_enumerate_dir(h, "/", CHM_ENUMERATE_NORMAL | CHM_ENUMERATE_FILES, ReadObject, nullptr);
+
+    chm_close(h);
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __FUZZ_FILE_H_
+#define __FUZZ_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+/*!
+  \brief Writes a fuzz input to a file, for the code that only opens archives by name. The file is the same one for
+  every input of a process, and gets removed when the process exits.
+  \param data The input.
+  \param size Its size.
+  \return The file's name, or an empty string if it couldn't be written.
+ */
+inline std::string fuzzFile(const uint8_t* data, size_t size)
+{
+    static std::string path;
+
+    if (path.empty()) {
+        const char* dir  = std::getenv("TMPDIR");
+        std::string name = std::string(dir && *dir ? dir : "/tmp") + "/xchm-fuzz-XXXXXX";
+        auto        fd   = mkstemp(&name[0]);
+
+        if (fd < 0)
+            return {};
+
+        close(fd);
+        path = name;
+        std::atexit([] { unlink(path.c_str()); });
+    }
+
+    auto file = std::fopen(path.c_str(), "wb");
+
+    if (!file)
+        return {};
+
+    auto ok = std::fwrite(data, 1, size, file) == size;
+
+    return std::fclose(file) == 0 && ok ? path : std::string();
+}
+
+#endif // __FUZZ_FILE_H_
@@ -0,0 +1,58 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+/*
+  Fuzzes HHCParser with the input as a contents or index file. It is parsed in two chunks, split where the first
+  byte says, as sitemaps read from an archive come in one chunk per LZX block. Built by "make fuzz".
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <hhcparser.h>
+#include <wx/init.h>
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    static wxInitializer initializer(*argc, *argv);
+
+    if (!initializer.IsOk()) {
+        std::fprintf(stderr, "can't initialize wxWidgets\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size < 1)
+        return 0;
+
+    auto             text  = reinterpret_cast<const char*>(data + 1);
+    auto             len   = size - 1;
+    auto             split = len * data[0] / 255;
+    CHMIndexCallback list  = [](const wxString&, const wxString&) {};
+    HHCParser        parser(wxFONTENCODING_CP1252, nullptr, nullptr, &list);
+
+    parser.parse(text, split);
+    parser.parse(text + split, len - split);
+
+    return 0;
+}
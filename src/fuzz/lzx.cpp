@@ -0,0 +1,59 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+/*
+  Fuzzes the LZX decompressor: the first byte of the input picks the window size, the rest is decompressed into a
+  32 KiB block, then again without a reset, so that the second pass starts from whatever state the first one left
+  behind. Built by "make fuzz".
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <lzx.h>
+#include <vector>
+
+namespace {
+
+// What chmlib decompresses at a time.
+constexpr int BLOCK_LEN {0x8000};
+
+} // end of anonymous namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size < 2 || size - 1 > static_cast<size_t>(INT32_MAX))
+        return 0;
+
+    // Window sizes from 32 KiB to 2 MiB, the ones LZXinit() accepts.
+    auto state = LZXinit(15 + data[0] % 7);
+
+    if (!state)
+        return 0;
+
+    // LZXdecompress() wants writable buffers.
+    std::vector<unsigned char> input(data + 1, data + size), output(BLOCK_LEN);
+
+    for (int block = 0; block < 2; ++block)
+        if (LZXdecompress(state, input.data(), output.data(), static_cast<int>(input.size()), BLOCK_LEN) != DECR_OK)
+            break;
+
+    LZXteardown(state);
+
+    return 0;
+}
@@ -18,10 +18,12 @@
 */
 
 #include <cctype>
-#include <chmlistctrl.h>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <hhcparser.h>
 #include <map>
+#include <wx/thread.h>
 #include <wx/wx.h>
 #include <wxstringutils.h>
 
@@ -29,74 +31,223 @@
 #include <config.h>
 #endif
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
+
 namespace {
 
 struct HTMLChar {
-    const wxChar* name;
-    unsigned      code;
+    const char* name;
+    unsigned    code;
 };
 
-extern "C" int HTMLCharCompare(const void* key, const void* item)
+constexpr HTMLChar substitutions[] = {
+    {"AElig", 198},    {"Aacute", 193},  {"Acirc", 194},   {"Agrave", 192},  {"Alpha", 913},
+    {"Aring", 197},    {"Atilde", 195},  {"Auml", 196},    {"Beta", 914},    {"Ccedil", 199},
+    {"Chi", 935},      {"Dagger", 8225}, {"Delta", 916},   {"Dstrok", 208},  {"ETH", 208},
+    {"Eacute", 201},   {"Ecirc", 202},   {"Egrave", 200},  {"Epsilon", 917}, {"Eta", 919},
+    {"Euml", 203},     {"Gamma", 915},   {"Iacute", 205},  {"Icirc", 206},   {"Igrave", 204},
+    {"Iota", 921},     {"Iuml", 207},    {"Kappa", 922},   {"Lambda", 923},  {"Mu", 924},
+    {"Ntilde", 209},   {"Nu", 925},      {"OElig", 338},   {"Oacute", 211},  {"Ocirc", 212},
+    {"Ograve", 210},   {"Omega", 937},   {"Omicron", 927}, {"Oslash", 216},  {"Otilde", 213},
+    {"Ouml", 214},     {"Phi", 934},     {"Pi", 928},      {"Prime", 8243},  {"Psi", 936},
+    {"Rho", 929},      {"Scaron", 352},  {"Sigma", 931},   {"THORN", 222},   {"Tau", 932},
+    {"Theta", 920},    {"Uacute", 218},  {"Ucirc", 219},   {"Ugrave", 217},  {"Upsilon", 933},
+    {"Uuml", 220},     {"Xi", 926},      {"Yacute", 221},  {"Yuml", 376},    {"Zeta", 918},
+    {"aacute", 225},   {"acirc", 226},   {"acute", 180},   {"aelig", 230},   {"agrave", 224},
+    {"alefsym", 8501}, {"alpha", 945},   {"amp", 38},      {"and", 8743},    {"ang", 8736},
+    {"aring", 229},    {"asymp", 8776},  {"atilde", 227},  {"auml", 228},    {"bdquo", 8222},
+    {"beta", 946},     {"brvbar", 166},  {"bull", 8226},   {"cap", 8745},    {"ccedil", 231},
+    {"cedil", 184},    {"cent", 162},    {"chi", 967},     {"circ", 710},    {"clubs", 9827},
+    {"cong", 8773},    {"copy", 169},    {"crarr", 8629},  {"cup", 8746},    {"curren", 164},
+    {"dArr", 8659},    {"dagger", 8224}, {"darr", 8595},   {"deg", 176},     {"delta", 948},
+    {"diams", 9830},   {"divide", 247},  {"eacute", 233},  {"ecirc", 234},   {"egrave", 232},
+    {"empty", 8709},   {"emsp", 8195},   {"ensp", 8194},   {"epsilon", 949}, {"equiv", 8801},
+    {"eta", 951},      {"eth", 240},     {"euml", 235},    {"euro", 8364},   {"exist", 8707},
+    {"fnof", 402},     {"forall", 8704}, {"frac12", 189},  {"frac14", 188},  {"frac34", 190},
+    {"frasl", 8260},   {"gamma", 947},   {"ge", 8805},     {"gt", 62},       {"hArr", 8660},
+    {"harr", 8596},    {"hearts", 9829}, {"hellip", 8230}, {"iacute", 237},  {"icirc", 238},
+    {"iexcl", 161},    {"igrave", 236},  {"image", 8465},  {"infin", 8734},  {"int", 8747},
+    {"iota", 953},     {"iquest", 191},  {"isin", 8712},   {"iuml", 239},    {"kappa", 954},
+    {"lArr", 8656},    {"lambda", 955},  {"lang", 9001},   {"laquo", 171},   {"larr", 8592},
+    {"lceil", 8968},   {"ldquo", 8220},  {"le", 8804},     {"lfloor", 8970}, {"lowast", 8727},
+    {"loz", 9674},     {"lrm", 8206},    {"lsaquo", 8249}, {"lsquo", 8216},  {"lt", 60},
+    {"macr", 175},     {"mdash", 8212},  {"micro", 181},   {"middot", 183},  {"minus", 8722},
+    {"mu", 956},       {"nabla", 8711},  {"nbsp", 160},    {"ndash", 8211},  {"ne", 8800},
+    {"ni", 8715},      {"not", 172},     {"notin", 8713},  {"nsub", 8836},   {"ntilde", 241},
+    {"nu", 957},       {"oacute", 243},  {"ocirc", 244},   {"oelig", 339},   {"ograve", 242},
+    {"oline", 8254},   {"omega", 969},   {"omicron", 959}, {"oplus", 8853},  {"or", 8744},
+    {"ordf", 170},     {"ordm", 186},    {"oslash", 248},  {"otilde", 245},  {"otimes", 8855},
+    {"ouml", 246},     {"para", 182},    {"part", 8706},   {"permil", 8240}, {"perp", 8869},
+    {"phi", 966},      {"pi", 960},      {"piv", 982},     {"plusmn", 177},  {"pound", 163},
+    {"prime", 8242},   {"prod", 8719},   {"prop", 8733},   {"psi", 968},     {"quot", 34},
+    {"rArr", 8658},    {"radic", 8730},  {"rang", 9002},   {"raquo", 187},   {"rarr", 8594},
+    {"rceil", 8969},   {"rdquo", 8221},  {"real", 8476},   {"reg", 174},     {"rfloor", 8971},
+    {"rho", 961},      {"rlm", 8207},    {"rsaquo", 8250}, {"rsquo", 8217},  {"sbquo", 8218},
+    {"scaron", 353},   {"sdot", 8901},   {"sect", 167},    {"shy", 173},     {"sigma", 963},
+    {"sigmaf", 962},   {"sim", 8764},    {"spades", 9824}, {"sub", 8834},    {"sube", 8838},
+    {"sum", 8721},     {"sup", 8835},    {"sup1", 185},    {"sup2", 178},    {"sup3", 179},
+    {"supe", 8839},    {"szlig", 223},   {"tau", 964},     {"there4", 8756}, {"theta", 952},
+    {"thetasym", 977}, {"thinsp", 8201}, {"thorn", 254},   {"tilde", 732},   {"times", 215},
+    {"trade", 8482},   {"uArr", 8657},   {"uacute", 250},  {"uarr", 8593},   {"ucirc", 251},
+    {"ugrave", 249},   {"uml", 168},     {"upsih", 978},   {"upsilon", 965}, {"uuml", 252},
+    {"weierp", 8472},  {"xi", 958},      {"yacute", 253},  {"yen", 165},     {"yuml", 255},
+    {"zeta", 950},     {"zwj", 8205},    {"zwnj", 8204}};
+
+constexpr size_t ENTITY_COUNT {sizeof(substitutions) / sizeof(HTMLChar)};
+constexpr size_t ENTITY_BUCKETS {128};
+constexpr size_t ENTITY_SLOTS {512};
+
+constexpr size_t Length(const char* str)
+{
+    size_t len = 0;
+
+    while (str[len])
+        ++len;
+
+    return len;
+}
+
+constexpr uint32_t EntityHash(const char* name, size_t len, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+
+    for (size_t i = 0; i < len; ++i)
+        hash = (hash ^ static_cast<unsigned char>(name[i])) * 16777619u;
+
+    return hash;
+}
+
+/*
+  Hash and displace: every name first goes into a bucket, then each bucket gets the seed that sends all its names to
+  slots still free. A lookup is two hashes and one comparison.
+ */
+struct EntityTable {
+    uint16_t seeds[ENTITY_BUCKETS];
+    int16_t  slots[ENTITY_SLOTS];
+    bool     complete;
+};
+
+constexpr EntityTable MakeEntityTable()
+{
+    EntityTable table {};
+    size_t      bucketOf[ENTITY_COUNT] {}, bucketSize[ENTITY_BUCKETS] {}, slotOf[ENTITY_COUNT] {};
+
+    for (auto& slot : table.slots)
+        slot = -1;
+
+    for (size_t i = 0; i < ENTITY_COUNT; ++i) {
+        bucketOf[i] = EntityHash(substitutions[i].name, Length(substitutions[i].name), 0) % ENTITY_BUCKETS;
+        ++bucketSize[bucketOf[i]];
+    }
+
+    // The fuller buckets are the hardest to place, so they go first.
+    for (auto size = ENTITY_COUNT; size > 0; --size)
+        for (size_t b = 0; b < ENTITY_BUCKETS; ++b) {
+            if (bucketSize[b] != size)
+                continue;
+
+            uint16_t seed   = 1;
+            auto     placed = false;
+
+            for (; seed < UINT16_MAX && !placed; ++seed) {
+                size_t taken = 0;
+
+                placed = true;
+
+                for (size_t i = 0; i < ENTITY_COUNT && placed; ++i) {
+                    if (bucketOf[i] != b)
+                        continue;
+
+                    slotOf[i] = EntityHash(substitutions[i].name, Length(substitutions[i].name), seed) % ENTITY_SLOTS;
+
+                    if (table.slots[slotOf[i]] != -1)
+                        placed = false;
+                    else {
+                        table.slots[slotOf[i]] = static_cast<int16_t>(i);
+                        ++taken;
+                    }
+                }
+
+                if (!placed) // Undo this try.
+                    for (size_t i = 0; i < ENTITY_COUNT && taken; ++i)
+                        if (bucketOf[i] == b && table.slots[slotOf[i]] == static_cast<int16_t>(i)) {
+                            table.slots[slotOf[i]] = -1;
+                            --taken;
+                        }
+            }
+
+            if (!placed)
+                return table;
+
+            table.seeds[b] = seed - 1;
+        }
+
+    table.complete = true;
+    return table;
+}
+
+constexpr EntityTable entities = MakeEntityTable();
+static_assert(entities.complete, "no perfect hash for the HTML entity table");
+
+unsigned NamedEntity(const char* name, size_t len)
 {
-    return wxStrcmp(static_cast<const wxChar*>(key), static_cast<const HTMLChar*>(item)->name);
+    auto seed  = entities.seeds[EntityHash(name, len, 0) % ENTITY_BUCKETS];
+    auto index = entities.slots[EntityHash(name, len, seed) % ENTITY_SLOTS];
+
+    if (index < 0)
+        return 0;
+
+    auto candidate = substitutions[index].name;
+    return !std::strncmp(candidate, name, len) && !candidate[len] ? substitutions[index].code : 0;
 }
 
-HTMLChar substitutions[] = {
-    {wxT("AElig"), 198},    {wxT("Aacute"), 193},  {wxT("Acirc"), 194},   {wxT("Agrave"), 192},  {wxT("Alpha"), 913},
-    {wxT("Aring"), 197},    {wxT("Atilde"), 195},  {wxT("Auml"), 196},    {wxT("Beta"), 914},    {wxT("Ccedil"), 199},
-    {wxT("Chi"), 935},      {wxT("Dagger"), 8225}, {wxT("Delta"), 916},   {wxT("Dstrok"), 208},  {wxT("ETH"), 208},
-    {wxT("Eacute"), 201},   {wxT("Ecirc"), 202},   {wxT("Egrave"), 200},  {wxT("Epsilon"), 917}, {wxT("Eta"), 919},
-    {wxT("Euml"), 203},     {wxT("Gamma"), 915},   {wxT("Iacute"), 205},  {wxT("Icirc"), 206},   {wxT("Igrave"), 204},
-    {wxT("Iota"), 921},     {wxT("Iuml"), 207},    {wxT("Kappa"), 922},   {wxT("Lambda"), 923},  {wxT("Mu"), 924},
-    {wxT("Ntilde"), 209},   {wxT("Nu"), 925},      {wxT("OElig"), 338},   {wxT("Oacute"), 211},  {wxT("Ocirc"), 212},
-    {wxT("Ograve"), 210},   {wxT("Omega"), 937},   {wxT("Omicron"), 927}, {wxT("Oslash"), 216},  {wxT("Otilde"), 213},
-    {wxT("Ouml"), 214},     {wxT("Phi"), 934},     {wxT("Pi"), 928},      {wxT("Prime"), 8243},  {wxT("Psi"), 936},
-    {wxT("Rho"), 929},      {wxT("Scaron"), 352},  {wxT("Sigma"), 931},   {wxT("THORN"), 222},   {wxT("Tau"), 932},
-    {wxT("Theta"), 920},    {wxT("Uacute"), 218},  {wxT("Ucirc"), 219},   {wxT("Ugrave"), 217},  {wxT("Upsilon"), 933},
-    {wxT("Uuml"), 220},     {wxT("Xi"), 926},      {wxT("Yacute"), 221},  {wxT("Yuml"), 376},    {wxT("Zeta"), 918},
-    {wxT("aacute"), 225},   {wxT("acirc"), 226},   {wxT("acute"), 180},   {wxT("aelig"), 230},   {wxT("agrave"), 224},
-    {wxT("alefsym"), 8501}, {wxT("alpha"), 945},   {wxT("amp"), 38},      {wxT("and"), 8743},    {wxT("ang"), 8736},
-    {wxT("aring"), 229},    {wxT("asymp"), 8776},  {wxT("atilde"), 227},  {wxT("auml"), 228},    {wxT("bdquo"), 8222},
-    {wxT("beta"), 946},     {wxT("brvbar"), 166},  {wxT("bull"), 8226},   {wxT("cap"), 8745},    {wxT("ccedil"), 231},
-    {wxT("cedil"), 184},    {wxT("cent"), 162},    {wxT("chi"), 967},     {wxT("circ"), 710},    {wxT("clubs"), 9827},
-    {wxT("cong"), 8773},    {wxT("copy"), 169},    {wxT("crarr"), 8629},  {wxT("cup"), 8746},    {wxT("curren"), 164},
-    {wxT("dArr"), 8659},    {wxT("dagger"), 8224}, {wxT("darr"), 8595},   {wxT("deg"), 176},     {wxT("delta"), 948},
-    {wxT("diams"), 9830},   {wxT("divide"), 247},  {wxT("eacute"), 233},  {wxT("ecirc"), 234},   {wxT("egrave"), 232},
-    {wxT("empty"), 8709},   {wxT("emsp"), 8195},   {wxT("ensp"), 8194},   {wxT("epsilon"), 949}, {wxT("equiv"), 8801},
-    {wxT("eta"), 951},      {wxT("eth"), 240},     {wxT("euml"), 235},    {wxT("euro"), 8364},   {wxT("exist"), 8707},
-    {wxT("fnof"), 402},     {wxT("forall"), 8704}, {wxT("frac12"), 189},  {wxT("frac14"), 188},  {wxT("frac34"), 190},
-    {wxT("frasl"), 8260},   {wxT("gamma"), 947},   {wxT("ge"), 8805},     {wxT("gt"), 62},       {wxT("hArr"), 8660},
-    {wxT("harr"), 8596},    {wxT("hearts"), 9829}, {wxT("hellip"), 8230}, {wxT("iacute"), 237},  {wxT("icirc"), 238},
-    {wxT("iexcl"), 161},    {wxT("igrave"), 236},  {wxT("image"), 8465},  {wxT("infin"), 8734},  {wxT("int"), 8747},
-    {wxT("iota"), 953},     {wxT("iquest"), 191},  {wxT("isin"), 8712},   {wxT("iuml"), 239},    {wxT("kappa"), 954},
-    {wxT("lArr"), 8656},    {wxT("lambda"), 955},  {wxT("lang"), 9001},   {wxT("laquo"), 171},   {wxT("larr"), 8592},
-    {wxT("lceil"), 8968},   {wxT("ldquo"), 8220},  {wxT("le"), 8804},     {wxT("lfloor"), 8970}, {wxT("lowast"), 8727},
-    {wxT("loz"), 9674},     {wxT("lrm"), 8206},    {wxT("lsaquo"), 8249}, {wxT("lsquo"), 8216},  {wxT("lt"), 60},
-    {wxT("macr"), 175},     {wxT("mdash"), 8212},  {wxT("micro"), 181},   {wxT("middot"), 183},  {wxT("minus"), 8722},
-    {wxT("mu"), 956},       {wxT("nabla"), 8711},  {wxT("nbsp"), 160},    {wxT("ndash"), 8211},  {wxT("ne"), 8800},
-    {wxT("ni"), 8715},      {wxT("not"), 172},     {wxT("notin"), 8713},  {wxT("nsub"), 8836},   {wxT("ntilde"), 241},
-    {wxT("nu"), 957},       {wxT("oacute"), 243},  {wxT("ocirc"), 244},   {wxT("oelig"), 339},   {wxT("ograve"), 242},
-    {wxT("oline"), 8254},   {wxT("omega"), 969},   {wxT("omicron"), 959}, {wxT("oplus"), 8853},  {wxT("or"), 8744},
-    {wxT("ordf"), 170},     {wxT("ordm"), 186},    {wxT("oslash"), 248},  {wxT("otilde"), 245},  {wxT("otimes"), 8855},
-    {wxT("ouml"), 246},     {wxT("para"), 182},    {wxT("part"), 8706},   {wxT("permil"), 8240}, {wxT("perp"), 8869},
-    {wxT("phi"), 966},      {wxT("pi"), 960},      {wxT("piv"), 982},     {wxT("plusmn"), 177},  {wxT("pound"), 163},
-    {wxT("prime"), 8242},   {wxT("prod"), 8719},   {wxT("prop"), 8733},   {wxT("psi"), 968},     {wxT("quot"), 34},
-    {wxT("rArr"), 8658},    {wxT("radic"), 8730},  {wxT("rang"), 9002},   {wxT("raquo"), 187},   {wxT("rarr"), 8594},
-    {wxT("rceil"), 8969},   {wxT("rdquo"), 8221},  {wxT("real"), 8476},   {wxT("reg"), 174},     {wxT("rfloor"), 8971},
-    {wxT("rho"), 961},      {wxT("rlm"), 8207},    {wxT("rsaquo"), 8250}, {wxT("rsquo"), 8217},  {wxT("sbquo"), 8218},
-    {wxT("scaron"), 353},   {wxT("sdot"), 8901},   {wxT("sect"), 167},    {wxT("shy"), 173},     {wxT("sigma"), 963},
-    {wxT("sigmaf"), 962},   {wxT("sim"), 8764},    {wxT("spades"), 9824}, {wxT("sub"), 8834},    {wxT("sube"), 8838},
-    {wxT("sum"), 8721},     {wxT("sup"), 8835},    {wxT("sup1"), 185},    {wxT("sup2"), 178},    {wxT("sup3"), 179},
-    {wxT("supe"), 8839},    {wxT("szlig"), 223},   {wxT("tau"), 964},     {wxT("there4"), 8756}, {wxT("theta"), 952},
-    {wxT("thetasym"), 977}, {wxT("thinsp"), 8201}, {wxT("thorn"), 254},   {wxT("tilde"), 732},   {wxT("times"), 215},
-    {wxT("trade"), 8482},   {wxT("uArr"), 8657},   {wxT("uacute"), 250},  {wxT("uarr"), 8593},   {wxT("ucirc"), 251},
-    {wxT("ugrave"), 249},   {wxT("uml"), 168},     {wxT("upsih"), 978},   {wxT("upsilon"), 965}, {wxT("uuml"), 252},
-    {wxT("weierp"), 8472},  {wxT("xi"), 958},      {wxT("yacute"), 253},  {wxT("yen"), 165},     {wxT("yuml"), 255},
-    {wxT("zeta"), 950},     {wxT("zwj"), 8205},    {wxT("zwnj"), 8204},   {nullptr, 0}};
+// Returns the first '"', '<' or '>' in [p, end), or end.
+const char* FindTagDelimiter(const char* p, const char* end)
+{
+#if defined(__SSE2__) && defined(__GNUC__)
+    const auto quote = _mm_set1_epi8('\"'), lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>');
+
+    for (; end - p >= 16; p += 16) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto hits  = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, lt)),
+                                  _mm_cmpeq_epi8(block, gt));
 
+        if (auto mask = _mm_movemask_epi8(hits))
+            return p + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; p != end; ++p)
+        if (*p == '\"' || *p == '<' || *p == '>')
+            return p;
+
+    return end;
 }
 
-HHCParser::HHCParser(wxFontEncoding enc, wxTreeCtrl* tree, CHMListCtrl* list) : _tree(tree), _list(list), _enc(enc)
+const char* Find(const char* p, const char* end, char c)
+{
+    auto found = static_cast<const char*>(std::memchr(p, c, end - p));
+    return found ? found : end;
+}
+
+// <cctype> wants its argument to be an unsigned char (or EOF), which a high-bit char in a book isn't.
+inline bool IsSpace(char c)
+{
+    return std::isspace(static_cast<unsigned char>(c));
+}
+
+inline char ToLower(char c)
+{
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+} // end of anonymous namespace
+
+HHCParser::HHCParser(wxFontEncoding enc, wxTreeCtrl* tree, CHMStringArena* treeStrings,
+                     const CHMIndexCallback* list)
+    : _tree(tree), _treeStrings(treeStrings), _list(list), _enc(enc)
 {
     _cvPtr = createCSConvPtr(_enc);
 
@@ -106,38 +257,61 @@ HHCParser::HHCParser(wxFontEncoding enc, wxTreeCtrl* tree, CHMListCtrl* list) :
 
 void HHCParser::parse(const char* chunk)
 {
-    while (*chunk) {
-        switch (*chunk) {
-        case '\"':
-            _inquote = !_inquote;
-            break;
+    parse(chunk, std::strlen(chunk));
+}
 
-        case '<':
-            if (!_inquote) {
-                _intag = true;
-                _tag   = "";
-                ++chunk;
-                continue;
-            }
-            // fallthrough
+void HHCParser::parse(const char* chunk, size_t length)
+{
+    auto p = chunk, end = chunk + length;
 
-        case '>':
-            if (!_inquote) {
-                handleTag(_tag);
-                _intag = false;
-                ++chunk;
-                continue;
-            }
-            // fallthrough
+    while (p != end) {
+        if (!_intag) {
+            p = Find(p, end, '<');
+
+            if (p == end)
+                return;
+
+            _intag = true;
+            ++p;
         }
 
-        if (_intag)
-            _tag += *chunk;
-        ++chunk;
+        // Tag text is only copied into _tag when the tag straddles two chunks.
+        auto start = p;
+
+        while (p != end) {
+            p = _inquote ? Find(p, end, '\"') : FindTagDelimiter(p, end);
+
+            if (p == end || *p == '>')
+                break;
+
+            if (*p == '<') { // A stray '<' before this one, start over.
+                _tag.clear();
+                start = p + 1;
+            } else
+                _inquote = !_inquote;
+
+            ++p;
+        }
+
+        if (p == end) {
+            _tag.append(start, end);
+            return;
+        }
+
+        if (_tag.empty())
+            handleTag(std::string_view(start, p - start));
+        else {
+            _tag.append(start, p);
+            handleTag(_tag);
+            _tag.clear();
+        }
+
+        _intag = false;
+        ++p;
     }
 }
 
-void HHCParser::handleTag(const std::string& tag)
+void HHCParser::handleTag(std::string_view tag)
 {
     constexpr auto TIME_TO_YIELD = 1024;
 
@@ -147,13 +321,15 @@ void HHCParser::handleTag(const std::string& tag)
     ++_counter;
 
     if ((_counter % TIME_TO_YIELD) == 0) {
-        wxYield();
+        // Only the GUI thread has anything to yield to.
+        if (wxThread::IsMain())
+            wxYield();
         _counter = 0;
     }
 
     size_t i;
     for (i = 0; i < tag.length(); ++i) {
-        if (isspace(tag[i]))
+        if (IsSpace(tag[i]))
             continue;
         else
             break;
@@ -165,8 +341,8 @@ void HHCParser::handleTag(const std::string& tag)
     std::string tagName;
 
     for (; i != tag.length(); ++i) {
-        if (!isspace(tag[i]))
-            tagName += tolower(tag[i]);
+        if (!IsSpace(tag[i]))
+            tagName += ToLower(tag[i]);
         else
             break;
     }
@@ -178,23 +354,25 @@ void HHCParser::handleTag(const std::string& tag)
             if (!_value.empty() && _value[0] != '/')
                 _value = "/" + _value;
 
-            auto name  = CURRENT_CHAR_STRING(_name.c_str());
-            auto value = CURRENT_CHAR_STRING(_value.c_str());
+            // Names are in the archive's encoding, the URLs are taken byte for byte.
+            const wxMBConv& nameConv = _enc == wxFONTENCODING_SYSTEM ? wxConvISO8859_1 : *_cvPtr;
+            wxString        name, value;
 
             if (_htmlChars) {
-                name       = replaceHTMLChars(name);
-                value      = replaceHTMLChars(value);
+                name       = replaceHTMLChars(_name, nameConv);
+                value      = replaceHTMLChars(_value, wxConvISO8859_1);
                 _htmlChars = false;
+            } else {
+                name  = CURRENT_CHAR_STRING_CV(_name.c_str(), nameConv);
+                value = CURRENT_CHAR_STRING(_value.c_str());
             }
 
-            name = translateEncoding(name, _enc);
-
             addToTree(name, value);
             addToList(name, value);
 
         } else if (tagName == "param") {
             std::string name, value;
-            auto        special = getParameters(tag.c_str() + i, name, value);
+            auto        special = getParameters(tag.substr(i), name, value);
 
             if (name == "name" && _name.empty()) {
                 _name      = value;
@@ -219,27 +397,28 @@ void HHCParser::handleTag(const std::string& tag)
     }
 }
 
-bool HHCParser::getParameters(const char* input, std::string& name, std::string& value)
+bool HHCParser::getParameters(std::string_view tag, std::string& name, std::string& value)
 {
     auto lower = false, modify = false;
+    auto input = tag.data(), end = input + tag.size();
 
     name = value = "";
 
-    while (*input) {
+    while (input != end) {
         std::string tmpstr;
 
-        while (*input && isspace(*input))
+        while (input != end && IsSpace(*input))
             ++input;
 
-        while (*input && !isspace(*input) && *input != '=') {
-            tmpstr += tolower(*input);
+        while (input != end && !IsSpace(*input) && *input != '=') {
+            tmpstr += ToLower(*input);
             ++input;
         }
 
-        while (*input && isspace(*input))
+        while (input != end && IsSpace(*input))
             ++input;
 
-        if (*input) {
+        if (input != end) {
             if (*input != '=')
                 return modify;
             else
@@ -252,30 +431,30 @@ bool HHCParser::getParameters(const char* input, std::string& name, std::string&
             lower = false;
         else {
             // now skip value.
-            while (*input && isspace(*input))
+            while (input != end && IsSpace(*input))
                 ++input;
 
-            if (*input == '\"') {
+            if (input != end && *input == '\"') {
                 ++input;
-                while (*input && *input != '\"')
+                while (input != end && *input != '\"')
                     ++input;
-                if (*input == '\"')
+                if (input != end && *input == '\"')
                     ++input;
             } else {
-                while (*input && !isspace(*input))
+                while (input != end && !IsSpace(*input))
                     ++input;
             }
             continue;
         }
 
-        while (*input && isspace(*input))
+        while (input != end && IsSpace(*input))
             ++input;
 
-        if (*input == '\"') {
+        if (input != end && *input == '\"') {
             ++input;
-            while (*input && *input != '\"') {
+            while (input != end && *input != '\"') {
                 if (lower)
-                    name += tolower(*input++);
+                    name += ToLower(*input++);
                 else {
                     if (*input == '&')
                         modify = true;
@@ -283,12 +462,12 @@ bool HHCParser::getParameters(const char* input, std::string& name, std::string&
                 }
             }
 
-            if (*input == '\"')
+            if (input != end && *input == '\"')
                 ++input;
         } else {
-            while (*input && !isspace(*input))
+            while (input != end && !IsSpace(*input))
                 if (lower)
-                    name += tolower(*input++);
+                    name += ToLower(*input++);
                 else {
                     if (*input == '&')
                         modify = true;
@@ -308,7 +487,7 @@ void HHCParser::addToTree(const wxString& name, const wxString& value)
     if (!name.IsEmpty()) {
         auto parentIndex = _level ? _level - 1 : 0;
 
-        _parents[_level] = _tree->AppendItem(_parents[parentIndex], name, 2, 2, new URLTreeItem(value));
+        _parents[_level] = _tree->AppendItem(_parents[parentIndex], name, 2, 2, new URLTreeItem(*_treeStrings, value));
 
         if (!_level)
             _parents[0] = _tree->GetRootItem();
@@ -328,52 +507,57 @@ void HHCParser::addToList(const wxString& name, const wxString& value)
         return;
 
     if (!name.IsEmpty() && !value.IsEmpty())
-        _list->AddPairItem(name, value);
+        (*_list)(name, value);
 }
 
-wxString HHCParser::replaceHTMLChars(const wxString& input)
+wxString HHCParser::replaceHTMLChars(const std::string& input, const wxMBConv& cv)
 {
     wxString result;
+    size_t   run = 0, pos = 0, amp;
 
-    if (input.IsEmpty())
-        return wxEmptyString;
-
-    auto     inSpecial = false;
-    wxString special;
-
-    for (size_t i = 0; i < input.Length(); ++i) {
-        switch (static_cast<wxChar>(input[i])) {
-        case wxT('&'):
-            inSpecial = true;
-            special   = wxEmptyString;
-            continue;
-        case wxT(';'):
-            if (inSpecial) {
-                inSpecial = false;
+    // Plain text runs go through cv, entities are appended as the characters they stand for. Unknown entities and
+    // '&'s that don't start one stay in the run, as they are.
+    while ((amp = input.find('&', pos)) != std::string::npos) {
+        auto semicolon = input.find(';', amp + 1);
 
-                auto code = getHTMLCode(special);
+        if (semicolon == std::string::npos)
+            break;
 
-                if (code)
-                    result.Append(charForCode(code, *_cvPtr, false));
+        auto code = getHTMLCode(std::string_view(input).substr(amp + 1, semicolon - amp - 1));
 
-                continue;
-            }
+        if (!code) {
+            pos = amp + 1;
+            continue;
         }
 
-        if (inSpecial)
-            special.Append(input[i]);
-        else if (input[i])
-            result.Append(input[i]);
+        result += CURRENT_CHAR_STRING_CV(input.substr(run, amp - run).c_str(), cv);
+        result += charForCode(code, *_cvPtr, false);
+        run = pos = semicolon + 1;
     }
 
-    return result;
+    return result + CURRENT_CHAR_STRING_CV(input.c_str() + run, cv);
 }
 
-unsigned HHCParser::getHTMLCode(const wxString& name)
+unsigned HHCParser::getHTMLCode(std::string_view name)
 {
-    auto substitutions_cnt = sizeof(substitutions) / sizeof(HTMLChar) - 1;
-    auto hc                = static_cast<HTMLChar*>(
-        bsearch(name.c_str(), substitutions, substitutions_cnt, sizeof(HTMLChar), HTMLCharCompare));
+    if (name.size() > 1 && name[0] == '#') {
+        auto hex  = name[1] == 'x' || name[1] == 'X';
+        auto code = 0UL;
+
+        name.remove_prefix(hex ? 2 : 1);
+
+        if (name.empty() || name.size() > 7)
+            return 0;
+
+        for (auto c : name) {
+            if (!isxdigit(static_cast<unsigned char>(c)) || (!hex && !isdigit(static_cast<unsigned char>(c))))
+                return 0;
+
+            code = code * (hex ? 16 : 10) + (isdigit(static_cast<unsigned char>(c)) ? c - '0' : (c | 0x20) - 'a' + 10);
+        }
+
+        return code <= 0x10FFFF ? code : 0;
+    }
 
-    return hc ? hc->code : 0;
+    return NamedEntity(name.data(), name.size());
 }
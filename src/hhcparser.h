@@ -20,14 +20,14 @@
 #ifndef __HHCPARSER_H_
 #define __HHCPARSER_H_
 
+#include <chmfile.h>
+#include <chmstringarena.h>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <wx/font.h>
 #include <wx/treectrl.h>
 
-// Forward declarations.
-class CHMListCtrl;
-
 //! Maximum number of tree levels.
 constexpr size_t TREE_BUF_SIZE {128};
 
@@ -37,30 +37,36 @@ constexpr size_t TREE_BUF_SIZE {128};
 */
 struct URLTreeItem : public wxTreeItemData {
 
-    //! Sets the data to str.
-    explicit URLTreeItem(const wxString& str) : _url(str) {}
+    //! Sets the data to str, keeping it in strings.
+    URLTreeItem(CHMStringArena& strings, const wxString& str) : _url(strings.Add(str)) {}
+
+    //! Returns the URL.
+    wxString URL() const { return CHMStringArena::Get(_url); }
 
-    //! Useful data.
-    wxString _url;
+    //! Useful data, kept in the tree's arena.
+    CHMStringRef _url;
 };
 
 //! Fast index/contents file parser
 class HHCParser {
 
 public:
-    //! Constructor
-    HHCParser(wxFontEncoding enc, wxTreeCtrl* tree, CHMListCtrl* list);
+    //! Constructor. The URLs of the tree items are kept in treeStrings, index entries are passed to list.
+    HHCParser(wxFontEncoding enc, wxTreeCtrl* tree, CHMStringArena* treeStrings, const CHMIndexCallback* list);
 
 public:
-    //! Parse a chunk of data.
+    //! Parse a NUL-terminated chunk of data.
     void parse(const char* chunk);
 
+    //! Parse length bytes of data. Tags may be split between consecutive chunks.
+    void parse(const char* chunk, size_t length);
+
 private:
     //! Handle a retrieved tag. I'm only interested in very few tags.
-    void handleTag(const std::string& tag);
+    void handleTag(std::string_view tag);
 
     //! Retrieve a parameter name.
-    bool getParameters(const char* input, std::string& name, std::string& value);
+    bool getParameters(std::string_view input, std::string& name, std::string& value);
 
     //! Add the information to the contents tree
     void addToTree(const wxString& name, const wxString& value);
@@ -68,11 +74,11 @@ private:
     //! Add the information to the index list.
     void addToList(const wxString& name, const wxString& value);
 
-    //! Replace special HTML strings with correct code.
-    wxString replaceHTMLChars(const wxString& input);
+    //! Converts input to a wxString with cv, replacing the HTML entities with the characters they stand for.
+    wxString replaceHTMLChars(const std::string& input, const wxMBConv& cv);
 
-    //! HTML code for given name (if available)
-    unsigned getHTMLCode(const wxString& name);
+    //! Code point of the named or numeric entity name (without '&' and ';'), 0 if there is none.
+    unsigned getHTMLCode(std::string_view name);
 
 public:
     //! Prevent copying, we have an unique_ptr<> member
@@ -90,7 +96,8 @@ private:
     std::string               _name;
     std::string               _value;
     wxTreeCtrl*               _tree;
-    CHMListCtrl*              _list;
+    CHMStringArena*           _treeStrings;
+    const CHMIndexCallback*   _list;
     wxTreeItemId              _parents[TREE_BUF_SIZE] {};
     wxFontEncoding            _enc;
     int                       _counter {0};
@@ -0,0 +1,149 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+/*
+  hhcparsertest: feeds index entries with HTML entities in their names through HHCParser, and checks the names that
+  come out. Then feeds a sitemap in two chunks, split at every offset, and checks it parses the same as in one.
+  Run by "make check".
+ */
+
+#include <cstdio>
+#include <hhcparser.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <wx/init.h>
+
+namespace {
+
+// The name HHCParser gives an index entry called name, or "<none>" if it doesn't add one.
+wxString ParseName(const std::string& name)
+{
+    wxString         result = wxT("<none>");
+    CHMIndexCallback list   = [&result](const wxString& n, const wxString&) { result = n; };
+    HHCParser        parser(wxFONTENCODING_SYSTEM, nullptr, nullptr, &list);
+
+    parser.parse(("<OBJECT type=\"text/sitemap\"><param name=\"Name\" value=\"" + name
+                  + "\"><param name=\"Local\" value=\"page.htm\"></OBJECT>")
+                     .c_str());
+
+    return result;
+}
+
+using Entries = std::vector<std::pair<wxString, wxString>>;
+
+// Tags, quoted attribute values (one with a '>' in it) and entities for the split points to land in.
+const char SITEMAP[] = "<HTML><BODY><UL>\n"
+                       "<LI> <OBJECT type=\"text/sitemap\">\n"
+                       "\t<param name=\"Name\" value=\"Fish &amp; chips\">\n"
+                       "\t<param name=\"Local\" value=\"fish.htm\">\n"
+                       "\t</OBJECT>\n"
+                       "<LI> <OBJECT type=\"text/sitemap\">\n"
+                       "\t<param name=\"Name\" value=\"a > b &gt; &#65;&#x42;\">\n"
+                       "\t<param name=\"Local\" value=\"dir/compare.html#top\">\n"
+                       "\t</OBJECT>\n"
+                       "<LI> <OBJECT type=\"text/sitemap\">\n"
+                       "\t<param name=\"Name\" value=\"R&D\">\n"
+                       "\t<param name=\"Local\" value=\"rd.htm\">\n"
+                       "\t</OBJECT>\n"
+                       "</UL></BODY></HTML>\n";
+
+// The entries HHCParser finds in SITEMAP, fed to it in chunks of the given lengths.
+Entries ParseChunks(const std::vector<size_t>& lengths)
+{
+    Entries          entries;
+    CHMIndexCallback list = [&entries](const wxString& name, const wxString& url) { entries.emplace_back(name, url); };
+    HHCParser        parser(wxFONTENCODING_SYSTEM, nullptr, nullptr, &list);
+    size_t           offset = 0;
+
+    for (auto length : lengths) {
+        parser.parse(SITEMAP + offset, length);
+        offset += length;
+    }
+
+    return entries;
+}
+
+// Fails if splitting SITEMAP anywhere, or into single bytes, changes what comes out of it.
+int CheckSplits()
+{
+    auto size     = sizeof(SITEMAP) - 1;
+    auto whole    = ParseChunks({size});
+    auto failures = 0;
+
+    if (whole.size() != 3) {
+        std::fprintf(stderr, "hhcparsertest: %zu entries in the sitemap, expected 3\n", whole.size());
+        return 1;
+    }
+
+    for (size_t split = 0; split <= size; ++split)
+        if (ParseChunks({split, size - split}) != whole) {
+            std::fprintf(stderr, "hhcparsertest: the sitemap parses differently when split at %zu\n", split);
+            ++failures;
+        }
+
+    if (ParseChunks(std::vector<size_t>(size, 1)) != whole) {
+        std::fprintf(stderr, "hhcparsertest: the sitemap parses differently a byte at a time\n");
+        ++failures;
+    }
+
+    return failures;
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char** argv)
+{
+    wxInitializer initializer(argc, argv);
+
+    if (!initializer.IsOk()) {
+        std::fprintf(stderr, "hhcparsertest: can't initialize wxWidgets\n");
+        return 1;
+    }
+
+    static const struct {
+        const char* name;
+        const char* expected;
+    } cases[] = {
+        {"plain", "plain"},
+        {"Foo &amp; bar", "Foo & bar"},
+        {"&lt;tag&gt;", "<tag>"},
+        {"&#65;&#x42;C", "ABC"},
+        {"AT&T; x", "AT&T; x"},                             // unknown entity
+        {"Foo &nbsp Bar &amp; baz", "Foo &nbsp Bar & baz"}, // '&' without an entity, before one
+        {"Fish & chips", "Fish & chips"},                   // bare '&'
+        {"R&D", "R&D"},
+    };
+
+    auto failures = 0;
+
+    for (const auto& c : cases) {
+        auto name = ParseName(c.name);
+
+        if (name != wxString::FromUTF8(c.expected)) {
+            std::fprintf(stderr, "hhcparsertest: \"%s\" parsed as \"%s\", expected \"%s\"\n", c.name,
+                         static_cast<const char*>(name.utf8_str()), c.expected);
+            ++failures;
+        }
+    }
+
+    failures += CheckSplits();
+
+    return failures ? 1 : 0;
+}
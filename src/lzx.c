@@ -266,9 +266,15 @@ int LZXreset(struct LZXstate *pState)
 
 #define INIT_BITSTREAM do { bitsleft = 0; bitbuf = 0; } while (0)
 
+/* Past the end of the input, we read zeroes: the bitstream may ask for a few
+ * bits more than it uses, and corrupt input mustn't make us read beyond
+ * endinp. The buffer exhaustion checks catch the input that really ran out.
+ */
+#define INPUT_BYTE(p) ((p) < endinp ? *(p) : 0)
+
 #define ENSURE_BITS(n)							\
   while (bitsleft < (n)) {						\
-    bitbuf |= ((inpos[1]<<8)|inpos[0]) << (ULONG_BITS-16 - bitsleft);	\
+    bitbuf |= (ULONG) ((INPUT_BYTE(inpos+1)<<8)|INPUT_BYTE(inpos)) << (ULONG_BITS-16 - bitsleft);	\
     bitsleft += 16; inpos+=2;						\
   }
 
@@ -323,7 +329,7 @@ int LZXreset(struct LZXstate *pState)
  * own special LZX way.
  */
 #define READ_LENGTHS(tbl,first,last) do { \
-  lb.bb = bitbuf; lb.bl = bitsleft; lb.ip = inpos; \
+  lb.bb = bitbuf; lb.bl = bitsleft; lb.ip = inpos; lb.end = endinp; \
   if (lzx_read_lens(pState, LENTABLE(tbl),(first),(last),&lb)) { \
     return DECR_ILLEGALDATA; \
   } \
@@ -419,6 +425,7 @@ struct lzx_bits {
   ULONG bb;
   int bl;
   UBYTE *ip;
+  UBYTE *end;
 };
 
 static int lzx_read_lens(struct LZXstate *pState, UBYTE *lens, ULONG first, ULONG last, struct lzx_bits *lb) {
@@ -428,6 +435,7 @@ static int lzx_read_lens(struct LZXstate *pState, UBYTE *lens, ULONG first, ULON
     register ULONG bitbuf = lb->bb;
     register int bitsleft = lb->bl;
     UBYTE *inpos = lb->ip;
+    UBYTE *endinp = lb->end;
     UWORD *hufftbl;
 
     for (x = 0; x < 20; x++) {
@@ -484,6 +492,9 @@ int LZXdecompress(struct LZXstate *pState, unsigned char *inpos, unsigned char *
     int togo = outlen, this_run, main_element, aligned_bits;
     int match_length, length_footer, extra, verbatim_bits;
 
+    /* the output is copied out of the window */
+    if (outlen <= 0 || (ULONG) outlen > window_size) return DECR_DATAFORMAT;
+
     INIT_BITSTREAM;
 
     /* read header if necessary */
@@ -528,9 +539,10 @@ int LZXdecompress(struct LZXstate *pState, unsigned char *inpos, unsigned char *
                     pState->intel_started = 1; /* because we can't assume otherwise */
                     ENSURE_BITS(16); /* get up to 16 pad bits into the buffer */
                     if (bitsleft > 16) inpos -= 2; /* and align the bitstream! */
-                    R0 = inpos[0]|(inpos[1]<<8)|(inpos[2]<<16)|(inpos[3]<<24);inpos+=4;
-                    R1 = inpos[0]|(inpos[1]<<8)|(inpos[2]<<16)|(inpos[3]<<24);inpos+=4;
-                    R2 = inpos[0]|(inpos[1]<<8)|(inpos[2]<<16)|(inpos[3]<<24);inpos+=4;
+                    if (inpos + 12 > endinp) return DECR_ILLEGALDATA;
+                    R0 = inpos[0]|(inpos[1]<<8)|(inpos[2]<<16)|((ULONG) inpos[3]<<24);inpos+=4;
+                    R1 = inpos[0]|(inpos[1]<<8)|(inpos[2]<<16)|((ULONG) inpos[3]<<24);inpos+=4;
+                    R2 = inpos[0]|(inpos[1]<<8)|(inpos[2]<<16)|((ULONG) inpos[3]<<24);inpos+=4;
                     break;
 
                 default:
@@ -612,6 +624,9 @@ int LZXdecompress(struct LZXstate *pState, unsigned char *inpos, unsigned char *
                                 R2 = R0; R0 = match_offset;
                             }
 
+                            /* can't reach back further than the window */
+                            if (match_offset > window_size) return DECR_ILLEGALDATA;
+
                             rundest = window + window_posn;
                             runsrc  = rundest - match_offset;
                             window_posn += match_length;
@@ -693,6 +708,9 @@ int LZXdecompress(struct LZXstate *pState, unsigned char *inpos, unsigned char *
                                 R2 = R0; R0 = match_offset;
                             }
 
+                            /* can't reach back further than the window */
+                            if (match_offset > window_size) return DECR_ILLEGALDATA;
+
                             rundest = window + window_posn;
                             runsrc  = rundest - match_offset;
                             window_posn += match_length;
@@ -747,7 +765,7 @@ int LZXdecompress(struct LZXstate *pState, unsigned char *inpos, unsigned char *
 
             while (data < dataend) {
                 if (*data++ != 0xE8) { curpos++; continue; }
-                abs_off = data[0] | (data[1]<<8) | (data[2]<<16) | (data[3]<<24);
+                abs_off = (LONG) (data[0] | (data[1]<<8) | (data[2]<<16) | ((ULONG) data[3]<<24));
                 if ((abs_off >= -curpos) && (abs_off < filesize)) {
                     rel_off = (abs_off >= 0) ? abs_off - curpos : abs_off + filesize;
                     data[0] = (UBYTE) rel_off;
@@ -0,0 +1,157 @@
+/*
+  Copyright (C) 2003 - 2026  Razvan Cojocaru <razvanc@mailbox.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+  MA 02110-1301, USA.
+*/
+
+#ifndef __STRING_UTILS_H_
+#define __STRING_UTILS_H_
+
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Plain std::string helpers for URLs, archive paths and JSON, shared by the HTTP server, the prefetcher and the
+// file system handler. The wxString ones are in wxstringutils.h.
+
+//! The value of the hex digit c, or -1 if it isn't one.
+inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+//! Appends str to dest, with the %XX escapes decoded. Malformed escapes are copied as they are.
+inline void percentDecode(std::string_view str, std::string& dest)
+{
+    for (size_t i = 0; i < str.size(); ++i) {
+        int hi, lo;
+
+        if (str[i] == '%' && i + 2 < str.size() && (hi = hexValue(str[i + 1])) >= 0
+            && (lo = hexValue(str[i + 2])) >= 0) {
+            dest += static_cast<char>(hi << 4 | lo);
+            i += 2;
+        } else
+            dest += str[i];
+    }
+}
+
+//! str, with the %XX escapes decoded.
+inline std::string percentDecode(std::string_view str)
+{
+    std::string decoded;
+
+    decoded.reserve(str.size());
+    percentDecode(str, decoded);
+
+    return decoded;
+}
+
+//! str with its ASCII letters lowercased, the rest of the bytes left alone.
+inline std::string lowerCase(std::string str)
+{
+    for (auto& c : str)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+    return str;
+}
+
+/*!
+  \brief Collapses the empty, "." and ".." components of an absolute UNIX path, the way wxFileName::Normalize()
+  does. ".." at the root stays at the root.
+  \return The normalized path, starting with a '/'. Directory paths keep their trailing slash.
+ */
+inline std::string normalizePath(std::string_view path)
+{
+    std::string         normalized;
+    std::vector<size_t> starts;
+    size_t              i = 0, n = path.size();
+
+    normalized.reserve(n + 1);
+
+    while (i < n) {
+        while (i < n && path[i] == '/')
+            ++i;
+
+        auto j = path.find('/', i);
+        if (j == std::string_view::npos)
+            j = n;
+
+        auto len = j - i;
+
+        if (len == 2 && path[i] == '.' && path[i + 1] == '.') {
+            if (!starts.empty()) {
+                normalized.resize(starts.back());
+                starts.pop_back();
+            }
+        } else if (len > 1 || (len == 1 && path[i] != '.')) {
+            starts.push_back(normalized.size());
+            normalized += '/';
+            normalized.append(path, i, len);
+        }
+
+        i = j;
+    }
+
+    if (normalized.empty() || path.back() == '/')
+        normalized += '/';
+
+    return normalized;
+}
+
+//! str (UTF-8) as a quoted JSON string.
+inline std::string jsonString(std::string_view str)
+{
+    std::string json = "\"";
+
+    for (unsigned char c : str) {
+        switch (c) {
+        case '"':
+            json += "\\\"";
+            break;
+        case '\\':
+            json += "\\\\";
+            break;
+        case '\n':
+            json += "\\n";
+            break;
+        case '\r':
+            json += "\\r";
+            break;
+        case '\t':
+            json += "\\t";
+            break;
+        default:
+            if (c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                json += escaped;
+            } else
+                json += static_cast<char>(c);
+        }
+    }
+
+    return json + "\"";
+}
+
+#endif // __STRING_UTILS_H_
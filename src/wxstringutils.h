@@ -53,10 +53,8 @@ inline std::unique_ptr<wxCSConv> createCSConvPtr(wxFontEncoding enc)
 inline wxString translateEncoding(const wxString& input, wxFontEncoding enc)
 {
     if (!input.IsEmpty() && enc != wxFONTENCODING_SYSTEM) {
-        wxCSConv convFrom(wxFONTENCODING_ISO8859_1);
-        auto     convToPtr = createCSConvPtr(enc);
-
-        return wxString(input.mb_str(convFrom), *convToPtr);
+        auto convToPtr = createCSConvPtr(enc);
+        return wxString(input.mb_str(wxConvISO8859_1), *convToPtr);
     }
 
     return input;
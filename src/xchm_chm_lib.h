@@ -95,6 +95,11 @@ void chm_close(struct chmFile *h);
 
 /* methods for ssetting tuning parameters for particular file */
 #define CHM_PARAM_MAX_BLOCKS_CACHED 0
+#define CHM_PARAM_ACCESS_PATTERN    1
+
+/* values for CHM_PARAM_ACCESS_PATTERN */
+#define CHM_ACCESS_RANDOM           0
+#define CHM_ACCESS_SEQUENTIAL       1
 void chm_set_param(struct chmFile *h,
                    int paramType,
                    int paramVal);
@@ -113,6 +118,30 @@ LONGINT64 chm_retrieve_object(struct chmFile *h,
                               LONGUINT64 addr,
                               LONGINT64 len);
 
+/* a read-only view of (part of) an object, valid until released.  compressed
+ * data is seen right in the decompressed blocks cache, which keeps the block
+ * around for as long as it's pinned */
+struct chmSpan
+{
+    const unsigned char *data;
+    LONGINT64            len;
+    void                *pin;
+    LONGUINT64           block;
+};
+
+/* pin up to len bytes of an object, starting at addr.  the span may be shorter
+ * than requested (it never crosses a compressed block boundary).  returns its
+ * length, 0 on failure.  every span has to be released before chm_close() */
+LONGINT64 chm_retrieve_span(struct chmFile *h,
+                            struct chmUnitInfo *ui,
+                            LONGUINT64 addr,
+                            LONGINT64 len,
+                            struct chmSpan *span);
+
+/* unpin a span */
+void chm_release_span(struct chmFile *h,
+                      struct chmSpan *span);
+
 /* enumerate the objects in the .chm archive */
 typedef int (*CHM_ENUMERATOR)(struct chmFile *h,
                               struct chmUnitInfo *ui,
@@ -137,6 +166,27 @@ int chm_enumerate_dir(struct chmFile *h,
                       CHM_ENUMERATOR e,
                       void *context);
 
+/* process-wide performance counters, for all the handles ever opened */
+#define CHM_STAT_RESOLVES            (0)    /* chm_resolve_object() calls       */
+#define CHM_STAT_DIR_PAGES           (1)    /* directory pages read             */
+#define CHM_STAT_CACHE_HITS          (2)    /* compressed reads found cached    */
+#define CHM_STAT_CACHE_MISSES        (3)    /* compressed reads not found       */
+#define CHM_STAT_BLOCKS_DECOMPRESSED (4)    /* LZX blocks decompressed          */
+#define CHM_STAT_BYTES_INFLATED      (5)    /* bytes those blocks came out as   */
+#define CHM_STAT_SYSCALLS            (6)    /* I/O system calls                 */
+#define CHM_STAT_BYTES_READ          (7)    /* bytes read from the .chm files   */
+#define CHM_STAT_COUNT               (8)
+
+/* add up the counters of all the threads into stats[CHM_STAT_COUNT] */
+void chm_get_stats(LONGUINT64 *stats);
+
+/* tracing: when set, hook(name, 1) is called when chm_resolve_object() or a
+ * block decompression starts, and hook(name, 0) when it's done, on the same
+ * thread.  it may be set (or cleared) at any time, from any thread: calls
+ * already under way may still end up in the previous hook. */
+typedef void (*CHM_TRACE_HOOK)(const char *name, int begin);
+void chm_set_trace_hook(CHM_TRACE_HOOK hook);
+
 #ifdef __cplusplus
 }
 #endif